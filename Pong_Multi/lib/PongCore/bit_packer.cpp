@@ -0,0 +1,119 @@
+#include "bit_packer.h"
+
+namespace {
+
+constexpr uint8_t VAR_GROUP_BITS = 4;
+constexpr uint8_t VAR_MAX_GROUPS = 8;  // 32 bits
+
+uint32_t lowMask(uint8_t bits) {
+  return bits >= 32 ? 0xFFFFFFFFu : (1u << bits) - 1u;
+}
+
+uint32_t zigzag(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+int32_t unzigzag(uint32_t value) {
+  return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1u);
+}
+
+}  // namespace
+
+BitWriter bitWriter(uint8_t *data, size_t capacity) {
+  BitWriter writer;
+  writer.data = data;
+  writer.capacity = capacity;
+  return writer;
+}
+
+BitReader bitReader(const uint8_t *data, size_t length) {
+  BitReader reader;
+  reader.data = data;
+  reader.length = length;
+  return reader;
+}
+
+void bitWrite(BitWriter &writer, uint32_t value, uint8_t bits) {
+  if (writer.overflow || writer.bitCount + bits > writer.capacity * 8) {
+    writer.overflow = true;
+    return;
+  }
+  value &= lowMask(bits);
+  while (bits > 0) {
+    size_t byteIndex = writer.bitCount / 8;
+    uint8_t offset = static_cast<uint8_t>(writer.bitCount % 8);
+    uint8_t take = static_cast<uint8_t>(8 - offset) < bits ? static_cast<uint8_t>(8 - offset) : bits;
+    if (offset == 0) {
+      writer.data[byteIndex] = 0;
+    }
+    writer.data[byteIndex] |= static_cast<uint8_t>((value & lowMask(take)) << offset);
+    value >>= take;
+    bits = static_cast<uint8_t>(bits - take);
+    writer.bitCount += take;
+  }
+}
+
+uint32_t bitRead(BitReader &reader, uint8_t bits) {
+  if (reader.overflow || reader.bitCount + bits > reader.length * 8) {
+    reader.overflow = true;
+    return 0;
+  }
+  uint32_t value = 0;
+  uint8_t shift = 0;
+  while (shift < bits) {
+    size_t byteIndex = reader.bitCount / 8;
+    uint8_t offset = static_cast<uint8_t>(reader.bitCount % 8);
+    uint8_t remaining = static_cast<uint8_t>(bits - shift);
+    uint8_t take = static_cast<uint8_t>(8 - offset) < remaining ? static_cast<uint8_t>(8 - offset) : remaining;
+    value |= ((static_cast<uint32_t>(reader.data[byteIndex]) >> offset) & lowMask(take)) << shift;
+    shift = static_cast<uint8_t>(shift + take);
+    reader.bitCount += take;
+  }
+  return value;
+}
+
+void bitWriteSigned(BitWriter &writer, int32_t value, uint8_t bits) {
+  int32_t maxValue = static_cast<int32_t>(lowMask(static_cast<uint8_t>(bits - 1)));
+  if (value > maxValue) {
+    value = maxValue;
+  } else if (value < -maxValue - 1) {
+    value = -maxValue - 1;
+  }
+  bitWrite(writer, static_cast<uint32_t>(value), bits);
+}
+
+int32_t bitReadSigned(BitReader &reader, uint8_t bits) {
+  uint32_t value = bitRead(reader, bits);
+  if (bits < 32 && (value & (1u << (bits - 1)))) {
+    value |= ~lowMask(bits);  // sign-extend
+  }
+  return static_cast<int32_t>(value);
+}
+
+void bitWriteVar(BitWriter &writer, uint32_t value) {
+  for (uint8_t group = 1; group < VAR_MAX_GROUPS && value >= (1u << VAR_GROUP_BITS); ++group) {
+    bitWrite(writer, (value & lowMask(VAR_GROUP_BITS)) | (1u << VAR_GROUP_BITS), VAR_GROUP_BITS + 1);
+    value >>= VAR_GROUP_BITS;
+  }
+  bitWrite(writer, value, VAR_GROUP_BITS + 1);  // the last group may hold up to 5 bits
+}
+
+uint32_t bitReadVar(BitReader &reader) {
+  uint32_t value = 0;
+  for (uint8_t group = 0; group < VAR_MAX_GROUPS - 1; ++group) {
+    uint32_t chunk = bitRead(reader, VAR_GROUP_BITS + 1);
+    if (!(chunk & (1u << VAR_GROUP_BITS)) || reader.overflow) {
+      return value | (chunk << (group * VAR_GROUP_BITS));
+    }
+    value |= (chunk & lowMask(VAR_GROUP_BITS)) << (group * VAR_GROUP_BITS);
+  }
+  return value | (bitRead(reader, VAR_GROUP_BITS + 1) << ((VAR_MAX_GROUPS - 1) * VAR_GROUP_BITS));
+}
+
+void bitWriteSignedVar(BitWriter &writer, int32_t value) {
+  bitWriteVar(writer, zigzag(value));
+}
+
+int32_t bitReadSignedVar(BitReader &reader) {
+  return unzigzag(bitReadVar(reader));
+}
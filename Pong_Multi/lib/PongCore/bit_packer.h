@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Little bit-level serializer for packets that do not fit a packed struct.
+// Bits fill each byte from the least significant end. Writers and readers
+// never touch memory past their buffer: running out sets overflow, further
+// writes are ignored and further reads return 0.
+
+struct BitWriter {
+  uint8_t *data = nullptr;
+  size_t capacity = 0;  // bytes
+  size_t bitCount = 0;
+  bool overflow = false;
+};
+
+struct BitReader {
+  const uint8_t *data = nullptr;
+  size_t length = 0;  // bytes
+  size_t bitCount = 0;
+  bool overflow = false;
+};
+
+BitWriter bitWriter(uint8_t *data, size_t capacity);
+BitReader bitReader(const uint8_t *data, size_t length);
+
+// Bytes used so far, counting a partly filled last byte.
+inline size_t bitWriterBytes(const BitWriter &writer) {
+  return (writer.bitCount + 7) / 8;
+}
+
+// bits is 1..32; only the low bits of value are written.
+void bitWrite(BitWriter &writer, uint32_t value, uint8_t bits);
+uint32_t bitRead(BitReader &reader, uint8_t bits);
+
+// Two's complement in a fixed width; values outside it are clamped.
+void bitWriteSigned(BitWriter &writer, int32_t value, uint8_t bits);
+int32_t bitReadSigned(BitReader &reader, uint8_t bits);
+
+// Variable length: 4-bit groups, each followed by a "more" bit, so values
+// under 16 take 5 bits and under 256 take 10. Signed values are zigzagged
+// first so small negatives stay small.
+void bitWriteVar(BitWriter &writer, uint32_t value);
+uint32_t bitReadVar(BitReader &reader);
+void bitWriteSignedVar(BitWriter &writer, int32_t value);
+int32_t bitReadSignedVar(BitReader &reader);
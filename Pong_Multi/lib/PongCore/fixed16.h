@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+
+// Signed Q16.16 fixed-point number. Every operation is plain integer math with
+// 64-bit intermediates, so results are bit-identical on Xtensa, x86-64 and any
+// other target regardless of compiler or FPU flags. Results that do not fit
+// saturate instead of wrapping.
+class Fixed16 {
+ public:
+  static constexpr int FRACTION_BITS = 16;
+  static constexpr int32_t ONE = 1 << FRACTION_BITS;
+
+  constexpr Fixed16() : raw_(0) {}
+
+  // Implicit so gameplay constants written as float literals work unchanged.
+  // The conversion goes through double and is exact for every value that fits.
+  constexpr Fixed16(float value) : raw_(roundToRaw(static_cast<double>(value) * ONE)) {}  // NOLINT
+
+  constexpr Fixed16(int value) : raw_(saturate(static_cast<int64_t>(value) * ONE)) {}  // NOLINT
+
+  static constexpr Fixed16 fromRaw(int32_t raw) {
+    return Fixed16(raw, RawTag());
+  }
+
+  constexpr int32_t raw() const {
+    return raw_;
+  }
+
+  constexpr float toFloat() const {
+    return static_cast<float>(raw_) / static_cast<float>(ONE);
+  }
+
+  friend constexpr Fixed16 operator+(Fixed16 a, Fixed16 b) {
+    return fromRaw(saturate(static_cast<int64_t>(a.raw_) + b.raw_));
+  }
+
+  friend constexpr Fixed16 operator-(Fixed16 a, Fixed16 b) {
+    return fromRaw(saturate(static_cast<int64_t>(a.raw_) - b.raw_));
+  }
+
+  friend constexpr Fixed16 operator*(Fixed16 a, Fixed16 b) {
+    // Arithmetic right shift (floor); GCC guarantees it for signed values.
+    return fromRaw(saturate((static_cast<int64_t>(a.raw_) * b.raw_) >> FRACTION_BITS));
+  }
+
+  friend constexpr Fixed16 operator/(Fixed16 a, Fixed16 b) {
+    if (b.raw_ == 0) {
+      return fromRaw(a.raw_ >= 0 ? INT32_MAX : INT32_MIN);
+    }
+    return fromRaw(saturate((static_cast<int64_t>(a.raw_) * ONE) / b.raw_));
+  }
+
+  constexpr Fixed16 operator-() const {
+    return fromRaw(saturate(-static_cast<int64_t>(raw_)));
+  }
+
+  Fixed16 &operator+=(Fixed16 other) {
+    return *this = *this + other;
+  }
+
+  Fixed16 &operator-=(Fixed16 other) {
+    return *this = *this - other;
+  }
+
+  Fixed16 &operator*=(Fixed16 other) {
+    return *this = *this * other;
+  }
+
+  friend constexpr bool operator<(Fixed16 a, Fixed16 b) {
+    return a.raw_ < b.raw_;
+  }
+  friend constexpr bool operator>(Fixed16 a, Fixed16 b) {
+    return a.raw_ > b.raw_;
+  }
+  friend constexpr bool operator<=(Fixed16 a, Fixed16 b) {
+    return a.raw_ <= b.raw_;
+  }
+  friend constexpr bool operator>=(Fixed16 a, Fixed16 b) {
+    return a.raw_ >= b.raw_;
+  }
+  friend constexpr bool operator==(Fixed16 a, Fixed16 b) {
+    return a.raw_ == b.raw_;
+  }
+  friend constexpr bool operator!=(Fixed16 a, Fixed16 b) {
+    return a.raw_ != b.raw_;
+  }
+
+ private:
+  struct RawTag {};
+
+  constexpr Fixed16(int32_t raw, RawTag) : raw_(raw) {}
+
+  static constexpr int32_t saturate(int64_t value) {
+    return value > INT32_MAX ? INT32_MAX : (value < INT32_MIN ? INT32_MIN : static_cast<int32_t>(value));
+  }
+
+  static constexpr int32_t roundToRaw(double scaled) {
+    return scaled >= 2147483647.0    ? INT32_MAX
+           : scaled <= -2147483648.0 ? INT32_MIN
+           : scaled >= 0.0           ? static_cast<int32_t>(scaled + 0.5)
+                                     : static_cast<int32_t>(scaled - 0.5);
+  }
+
+  int32_t raw_;
+};
+
+inline Fixed16 fixedAbs(Fixed16 value) {
+  return value < Fixed16() ? -value : value;
+}
+
+// Integer square root of the raw value shifted up by 16 bits: exact floor.
+inline Fixed16 fixedSqrt(Fixed16 value) {
+  if (value.raw() <= 0) {
+    return Fixed16();
+  }
+  uint64_t n = static_cast<uint64_t>(value.raw()) << Fixed16::FRACTION_BITS;
+  uint64_t result = 0;
+  uint64_t bit = 1ull << 62;
+  while (bit > n) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (n >= result + bit) {
+      n -= result + bit;
+      result = (result >> 1) + bit;
+    } else {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+  return Fixed16::fromRaw(static_cast<int32_t>(result));
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+// Stack-resident string with a fixed capacity (not counting the terminator).
+// Mirrors the parts of Arduino's String API the game uses, but never touches
+// the heap: anything past the capacity is silently truncated.
+template <size_t Capacity>
+class FixedString {
+ public:
+  FixedString() {
+    clear();
+  }
+
+  FixedString(const char *text) {  // NOLINT: implicit like Arduino String
+    assign(text);
+  }
+
+  template <size_t Other>
+  explicit FixedString(const FixedString<Other> &other) {
+    assign(other.c_str(), other.length());
+  }
+
+  FixedString &operator=(const char *text) {
+    assign(text);
+    return *this;
+  }
+
+  static constexpr size_t capacity() {
+    return Capacity;
+  }
+
+  void clear() {
+    length_ = 0;
+    data_[0] = '\0';
+  }
+
+  void assign(const char *text) {
+    assign(text, text == nullptr ? 0 : strlen(text));
+  }
+
+  void assign(const char *text, size_t len) {
+    length_ = (text == nullptr) ? 0 : (len < Capacity ? len : Capacity);
+    if (length_ > 0) {
+      memmove(data_, text, length_);
+    }
+    data_[length_] = '\0';
+  }
+
+  // Copies at most maxChars characters, ending in "..." when text was longer.
+  void assignTruncated(const char *text, size_t maxChars) {
+    size_t len = text == nullptr ? 0 : strlen(text);
+    if (maxChars > Capacity) {
+      maxChars = Capacity;
+    }
+    if (len <= maxChars) {
+      assign(text, len);
+      return;
+    }
+    if (maxChars <= 3) {
+      assign(text, maxChars);
+      return;
+    }
+    assign(text, maxChars - 3);
+    append("...");
+  }
+
+  bool append(char c) {
+    if (length_ >= Capacity) {
+      return false;
+    }
+    data_[length_++] = c;
+    data_[length_] = '\0';
+    return true;
+  }
+
+  void append(const char *text) {
+    if (text == nullptr) {
+      return;
+    }
+    while (*text != '\0' && append(*text)) {
+      ++text;
+    }
+  }
+
+  void format(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+    va_list args;
+    va_start(args, fmt);
+    clear();
+    appendFormatV(fmt, args);
+    va_end(args);
+  }
+
+  void appendFormat(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+    va_list args;
+    va_start(args, fmt);
+    appendFormatV(fmt, args);
+    va_end(args);
+  }
+
+  void removeLast() {
+    if (length_ > 0) {
+      data_[--length_] = '\0';
+    }
+  }
+
+  void trim() {
+    size_t start = 0;
+    while (start < length_ && isSpace(data_[start])) {
+      ++start;
+    }
+    size_t end = length_;
+    while (end > start && isSpace(data_[end - 1])) {
+      --end;
+    }
+    assign(data_ + start, end - start);
+  }
+
+  // Writes a NUL-terminated copy into a fixed packet field.
+  void copyTo(char *out, size_t outSize) const {
+    if (outSize == 0) {
+      return;
+    }
+    size_t len = length_ < outSize - 1 ? length_ : outSize - 1;
+    memcpy(out, data_, len);
+    memset(out + len, 0, outSize - len);
+  }
+
+  size_t length() const {
+    return length_;
+  }
+
+  bool isEmpty() const {
+    return length_ == 0;
+  }
+
+  const char *c_str() const {
+    return data_;
+  }
+
+  bool operator==(const FixedString &other) const {
+    return length_ == other.length_ && memcmp(data_, other.data_, length_) == 0;
+  }
+
+  bool operator!=(const FixedString &other) const {
+    return !(*this == other);
+  }
+
+ private:
+  static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  }
+
+  void appendFormatV(const char *fmt, va_list args) {
+    int written = vsnprintf(data_ + length_, Capacity + 1 - length_, fmt, args);
+    if (written > 0) {
+      length_ += static_cast<size_t>(written);
+      if (length_ > Capacity) {
+        length_ = Capacity;
+      }
+    }
+    data_[length_] = '\0';
+  }
+
+  char data_[Capacity + 1];
+  size_t length_ = 0;
+};
@@ -0,0 +1,75 @@
+#include "hdr_histogram.h"
+
+namespace {
+
+uint32_t highestBit(uint32_t value) {
+  uint32_t bit = 0;
+  while (value >>= 1) {
+    ++bit;
+  }
+  return bit;
+}
+
+size_t bucketIndex(uint32_t value) {
+  if (value < HDR_LINEAR_LIMIT) {
+    return value;
+  }
+  // value >> shift lands in [HDR_SUB_BUCKETS, 2 * HDR_SUB_BUCKETS).
+  uint32_t shift = highestBit(value) - HDR_SUB_BUCKET_BITS;
+  return HDR_LINEAR_LIMIT + (shift - 1) * HDR_SUB_BUCKETS + ((value >> shift) - HDR_SUB_BUCKETS);
+}
+
+// Largest value that lands in bucket index.
+uint32_t bucketTop(size_t index) {
+  if (index < HDR_LINEAR_LIMIT) {
+    return static_cast<uint32_t>(index);
+  }
+  size_t above = index - HDR_LINEAR_LIMIT;
+  uint32_t shift = static_cast<uint32_t>(above / HDR_SUB_BUCKETS) + 1;
+  uint64_t low = static_cast<uint64_t>(HDR_SUB_BUCKETS + above % HDR_SUB_BUCKETS) << shift;
+  return static_cast<uint32_t>(low + (uint64_t{1} << shift) - 1);
+}
+
+}  // namespace
+
+void hdrReset(HdrHistogram &histogram) {
+  histogram = HdrHistogram();
+}
+
+void hdrRecord(HdrHistogram &histogram, uint32_t value) {
+  ++histogram.counts[bucketIndex(value)];
+  ++histogram.total;
+  histogram.sum += value;
+  histogram.min = value < histogram.min ? value : histogram.min;
+  histogram.max = value > histogram.max ? value : histogram.max;
+}
+
+void hdrMerge(HdrHistogram &into, const HdrHistogram &from) {
+  for (size_t i = 0; i < HDR_BUCKET_COUNT; ++i) {
+    into.counts[i] += from.counts[i];
+  }
+  into.total += from.total;
+  into.sum += from.sum;
+  into.min = from.min < into.min ? from.min : into.min;
+  into.max = from.max > into.max ? from.max : into.max;
+}
+
+uint32_t hdrPercentile(const HdrHistogram &histogram, double percent) {
+  if (histogram.total == 0) {
+    return 0;
+  }
+  if (percent >= 100.0) {
+    return histogram.max;
+  }
+  uint64_t wanted = static_cast<uint64_t>(percent / 100.0 * static_cast<double>(histogram.total) + 0.5);
+  wanted = wanted == 0 ? 1 : wanted;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < HDR_BUCKET_COUNT; ++i) {
+    seen += histogram.counts[i];
+    if (seen >= wanted) {
+      uint32_t top = bucketTop(i);
+      return top < histogram.max ? top : histogram.max;
+    }
+  }
+  return histogram.max;
+}
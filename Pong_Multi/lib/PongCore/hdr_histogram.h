@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// High dynamic range histogram of 32-bit values (microseconds, permille...).
+// Values below HDR_LINEAR_LIMIT are counted exactly; above that every power
+// of two is split into HDR_SUB_BUCKETS buckets, so any recorded value is
+// reported within 1/HDR_SUB_BUCKETS (under 2%) of itself, from 1 us to over
+// an hour. Fixed size, nothing allocated: recording is a shift and an add.
+
+constexpr uint32_t HDR_SUB_BUCKET_BITS = 6;
+constexpr uint32_t HDR_SUB_BUCKETS = 1u << HDR_SUB_BUCKET_BITS;  // 64
+constexpr uint32_t HDR_LINEAR_LIMIT = 2 * HDR_SUB_BUCKETS;       // 128
+constexpr size_t HDR_BUCKET_COUNT = HDR_LINEAR_LIMIT + (32 - HDR_SUB_BUCKET_BITS - 1) * HDR_SUB_BUCKETS;
+
+struct HdrHistogram {
+  uint32_t counts[HDR_BUCKET_COUNT] = {};
+  uint64_t total = 0;
+  uint64_t sum = 0;
+  uint32_t min = UINT32_MAX;
+  uint32_t max = 0;
+};
+
+void hdrReset(HdrHistogram &histogram);
+
+void hdrRecord(HdrHistogram &histogram, uint32_t value);
+
+void hdrMerge(HdrHistogram &into, const HdrHistogram &from);
+
+// Smallest recorded value (to bucket precision) that percentile percent of
+// the records do not exceed; 0 when empty. 100 gives the exact maximum.
+uint32_t hdrPercentile(const HdrHistogram &histogram, double percent);
+
+inline uint32_t hdrMean(const HdrHistogram &histogram) {
+  return histogram.total != 0 ? static_cast<uint32_t>(histogram.sum / histogram.total) : 0;
+}
@@ -0,0 +1,233 @@
+#include "impaired_transport.h"
+
+#include <cmath>
+#include <cstring>
+
+ImpairedTransport::ImpairedTransport(Transport &inner, Clock nowMs, uint32_t seed) : inner_(inner), nowMs_(nowMs) {
+  reseed(seed);
+}
+
+void ImpairedTransport::reseed(uint32_t seed) {
+  // Small seeds would make xorshift's first outputs tiny, and every early
+  // packet would look like a loss; scramble the seed first.
+  uint32_t x = seed * 0x9E3779B9u;
+  x ^= x >> 16;
+  x *= 0x85EBCA6Bu;
+  x ^= x >> 13;
+  rng_ = x != 0 ? x : 0x9E3779B9u;
+  outgoing_.burst = false;
+  incoming_.burst = false;
+}
+
+bool ImpairedTransport::bind(uint16_t port) {
+  for (Pending &pending : queue_) {
+    pending.used = false;
+  }
+  return inner_.bind(port);
+}
+
+void ImpairedTransport::close() {
+  for (Pending &pending : queue_) {
+    pending.used = false;
+  }
+  inner_.close();
+}
+
+bool ImpairedTransport::sendTo(const NetAddress &to, const uint8_t *data, size_t length) {
+  poll();
+  if (!enabled_) {
+    return inner_.sendTo(to, data, length);
+  }
+  if (length > IMPAIRED_DATAGRAM_MAX) {
+    return false;
+  }
+  return admit(outgoing_, false, false, to, data, length);
+}
+
+bool ImpairedTransport::broadcast(uint16_t port, const uint8_t *data, size_t length) {
+  poll();
+  if (!enabled_) {
+    return inner_.broadcast(port, data, length);
+  }
+  if (length > IMPAIRED_DATAGRAM_MAX) {
+    return false;
+  }
+  NetAddress address;
+  address.port = port;
+  return admit(outgoing_, false, true, address, data, length);
+}
+
+// Group datagrams come out of inner_.receive() like any other, so they are
+// impaired on the way in as well.
+bool ImpairedTransport::joinGroup(const NetAddress &group) {
+  return inner_.joinGroup(group);
+}
+
+void ImpairedTransport::leaveGroup() {
+  inner_.leaveGroup();
+}
+
+int ImpairedTransport::receive(uint8_t *buffer, size_t capacity, NetAddress &from) {
+  poll();
+  drainInner();
+  int index;
+  while ((index = takeDue(true)) >= 0) {
+    Pending &pending = queue_[index];
+    pending.used = false;
+    if (pending.length >= capacity) {
+      continue;
+    }
+    memcpy(buffer, pending.data, pending.length);
+    from = pending.address;
+    ++incoming_.stats.passed;
+    return pending.length;
+  }
+  return 0;
+}
+
+void ImpairedTransport::poll() {
+  int index;
+  while ((index = takeDue(false)) >= 0) {
+    Pending &pending = queue_[index];
+    pending.used = false;
+    bool sent = pending.broadcast ? inner_.broadcast(pending.address.port, pending.data, pending.length)
+                                  : inner_.sendTo(pending.address, pending.data, pending.length);
+    if (sent) {
+      ++outgoing_.stats.passed;
+    }
+  }
+}
+
+void ImpairedTransport::drainInner() {
+  uint8_t buffer[IMPAIRED_DATAGRAM_MAX + 1];
+  NetAddress from;
+  int length;
+  while ((length = inner_.receive(buffer, sizeof(buffer), from)) > 0) {
+    if (enabled_) {
+      admit(incoming_, true, false, from, buffer, static_cast<size_t>(length));
+    } else {
+      enqueue(incoming_, true, false, from, buffer, static_cast<size_t>(length), 0);
+    }
+  }
+}
+
+bool ImpairedTransport::admit(Direction &direction, bool incoming, bool broadcast, const NetAddress &address,
+                              const uint8_t *data, size_t length) {
+  const ImpairmentProfile &profile = direction.profile;
+
+  // Every packet consumes the same draws, so changing one probability does not
+  // reshuffle the decisions made for the others.
+  float transition = nextUnit();
+  float loss = nextUnit();
+  float reorder = nextUnit();
+  float duplicate = nextUnit();
+
+  if (direction.burst) {
+    direction.burst = transition >= profile.burstExit;
+  } else {
+    direction.burst = transition < profile.burstEnter;
+  }
+  if (loss < (direction.burst ? profile.lossBad : profile.lossGood)) {
+    ++direction.stats.dropped;
+    if (direction.burst) {
+      ++direction.stats.burstDropped;
+    }
+    return true;
+  }
+
+  uint32_t delayMs = sampleDelay(profile);
+  if (reorder < profile.reorder) {
+    delayMs += profile.reorderMs;
+    ++direction.stats.reordered;
+  }
+  bool queued = enqueue(direction, incoming, broadcast, address, data, length, delayMs);
+  if (queued && duplicate < profile.duplicate) {
+    if (enqueue(direction, incoming, broadcast, address, data, length, sampleDelay(profile))) {
+      ++direction.stats.duplicated;
+    }
+  }
+  return queued;
+}
+
+bool ImpairedTransport::enqueue(Direction &direction, bool incoming, bool broadcast, const NetAddress &address,
+                                const uint8_t *data, size_t length, uint32_t delayMs) {
+  for (Pending &pending : queue_) {
+    if (pending.used) {
+      continue;
+    }
+    pending.used = true;
+    pending.incoming = incoming;
+    pending.broadcast = broadcast;
+    pending.address = address;
+    pending.deliverAtMs = nowMs_() + delayMs;
+    pending.order = order_++;
+    pending.length = static_cast<uint8_t>(length);
+    memcpy(pending.data, data, length);
+    return true;
+  }
+  ++direction.stats.queueFull;
+  return false;
+}
+
+uint32_t ImpairedTransport::sampleDelay(const ImpairmentProfile &profile) {
+  if (profile.jitterMs == 0) {
+    return profile.delayMs;
+  }
+  float jitter = static_cast<float>(profile.jitterMs);
+  float delay = static_cast<float>(profile.delayMs);
+  switch (profile.shape) {
+    case DelayShape::Uniform:
+      return profile.delayMs + nextRandom() % profile.jitterMs;
+    case DelayShape::Normal: {
+      // Irwin-Hall: twelve uniforms minus six is close enough to N(0, 1).
+      float sum = -6.0f;
+      for (int i = 0; i < 12; ++i) {
+        sum += nextUnit();
+      }
+      delay += sum * jitter;
+      break;
+    }
+    case DelayShape::Pareto: {
+      // Pareto with alpha 2: x_m / sqrt(u) has mean 2 x_m, so the excess over
+      // x_m averages jitterMs.
+      float u = 1.0f - nextUnit();
+      delay += fminf(jitter * (1.0f / sqrtf(u) - 1.0f), jitter * 8.0f);
+      break;
+    }
+  }
+  return delay > 0.0f ? static_cast<uint32_t>(delay + 0.5f) : 0;
+}
+
+int ImpairedTransport::takeDue(bool incoming) {
+  uint32_t now = nowMs_();
+  int best = -1;
+  for (size_t i = 0; i < IMPAIRED_QUEUE_SIZE; ++i) {
+    const Pending &pending = queue_[i];
+    if (!pending.used || pending.incoming != incoming || static_cast<int32_t>(now - pending.deliverAtMs) < 0) {
+      continue;
+    }
+    if (best < 0) {
+      best = static_cast<int>(i);
+      continue;
+    }
+    const Pending &current = queue_[best];
+    int32_t sooner = static_cast<int32_t>(pending.deliverAtMs - current.deliverAtMs);
+    if (sooner < 0 || (sooner == 0 && static_cast<int32_t>(pending.order - current.order) < 0)) {
+      best = static_cast<int>(i);
+    }
+  }
+  return best;
+}
+
+uint32_t ImpairedTransport::nextRandom() {
+  uint32_t x = rng_;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  rng_ = x;
+  return x;
+}
+
+float ImpairedTransport::nextUnit() {
+  return static_cast<float>(nextRandom() >> 8) * (1.0f / 16777216.0f);
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "transport.h"
+
+// Transport decorator that makes a quiet link behave like bad Wi-Fi: one-way
+// delay with jitter, Gilbert-Elliott burst loss, reordering and duplication,
+// applied separately to outgoing and incoming datagrams. Everything is drawn
+// from a seeded xorshift RNG, so the same seed and traffic replay the same
+// impairments. Held datagrams live in a fixed queue; nothing is allocated.
+
+constexpr size_t IMPAIRED_QUEUE_SIZE = 32;      // datagrams in flight, both directions
+constexpr size_t IMPAIRED_DATAGRAM_MAX = 128;  // larger sends are refused
+
+enum class DelayShape : uint8_t {
+  Uniform,  // delayMs + [0, jitterMs)
+  Normal,   // centred on delayMs, jitterMs standard deviation, never below 0
+  Pareto,   // delayMs + long tail with mean jitterMs, capped at 8x jitterMs
+};
+
+// Probabilities are 0..1 and apply per datagram.
+struct ImpairmentProfile {
+  uint32_t delayMs = 0;
+  uint32_t jitterMs = 0;
+  DelayShape shape = DelayShape::Uniform;
+  // Gilbert-Elliott: a two-state loss chain. Good drops lossGood of packets,
+  // Bad drops lossBad; each packet first moves Good->Bad with burstEnter and
+  // Bad->Good with burstExit. burstEnter 0 gives plain random loss.
+  float lossGood = 0.0f;
+  float lossBad = 1.0f;
+  float burstEnter = 0.0f;
+  float burstExit = 1.0f;
+  float reorder = 0.0f;       // chance a packet is held back an extra reorderMs
+  uint32_t reorderMs = 40;
+  float duplicate = 0.0f;     // chance a packet is delivered twice
+};
+
+struct ImpairmentStats {
+  uint32_t passed = 0;       // datagrams handed to the far side
+  uint32_t dropped = 0;      // lost by the loss model
+  uint32_t burstDropped = 0;  // of those, lost while in the Bad state
+  uint32_t reordered = 0;
+  uint32_t duplicated = 0;
+  uint32_t queueFull = 0;    // lost because the hold queue was full
+};
+
+class ImpairedTransport : public Transport {
+ public:
+  using Clock = uint32_t (*)();
+
+  // inner must outlive the decorator. nowMs is the millisecond clock used to
+  // schedule deliveries (millis() on the device).
+  ImpairedTransport(Transport &inner, Clock nowMs, uint32_t seed);
+
+  ImpairedTransport(const ImpairedTransport &) = delete;
+  ImpairedTransport &operator=(const ImpairedTransport &) = delete;
+
+  void setOutgoingProfile(const ImpairmentProfile &profile) {
+    outgoing_.profile = profile;
+  }
+  void setIncomingProfile(const ImpairmentProfile &profile) {
+    incoming_.profile = profile;
+  }
+  void setProfile(const ImpairmentProfile &profile) {
+    setOutgoingProfile(profile);
+    setIncomingProfile(profile);
+  }
+  void setEnabled(bool enabled) {
+    enabled_ = enabled;
+  }
+  bool enabled() const {
+    return enabled_;
+  }
+  void reseed(uint32_t seed);
+
+  const ImpairmentStats &outgoingStats() const {
+    return outgoing_.stats;
+  }
+  const ImpairmentStats &incomingStats() const {
+    return incoming_.stats;
+  }
+
+  bool bind(uint16_t port) override;
+  void close() override;
+  bool sendTo(const NetAddress &to, const uint8_t *data, size_t length) override;
+  bool broadcast(uint16_t port, const uint8_t *data, size_t length) override;
+  bool joinGroup(const NetAddress &group) override;
+  void leaveGroup() override;
+  int receive(uint8_t *buffer, size_t capacity, NetAddress &from) override;
+
+  // Sends whatever outgoing datagrams are due. receive() and sendTo() already
+  // call it; loops that do neither for a while can call it directly.
+  void poll();
+
+ private:
+  struct Direction {
+    ImpairmentProfile profile;
+    ImpairmentStats stats;
+    bool burst = false;  // Gilbert-Elliott state
+  };
+
+  struct Pending {
+    NetAddress address;  // destination when outgoing, source when incoming
+    uint32_t deliverAtMs = 0;
+    uint32_t order = 0;  // breaks ties so equal deadlines stay FIFO
+    uint8_t length = 0;
+    bool used = false;
+    bool incoming = false;
+    bool broadcast = false;
+    uint8_t data[IMPAIRED_DATAGRAM_MAX];
+  };
+
+  bool admit(Direction &direction, bool incoming, bool broadcast, const NetAddress &address, const uint8_t *data,
+             size_t length);
+  bool enqueue(Direction &direction, bool incoming, bool broadcast, const NetAddress &address, const uint8_t *data,
+               size_t length, uint32_t delayMs);
+  uint32_t sampleDelay(const ImpairmentProfile &profile);
+  int takeDue(bool incoming);  // index of the earliest due entry, or -1
+  uint32_t nextRandom();
+  float nextUnit();  // [0, 1)
+  void drainInner();
+
+  Transport &inner_;
+  Clock nowMs_;
+  uint32_t rng_ = 1;
+  uint32_t order_ = 0;
+  bool enabled_ = true;
+  Direction outgoing_;
+  Direction incoming_;
+  Pending queue_[IMPAIRED_QUEUE_SIZE];
+};
@@ -0,0 +1,144 @@
+#include "interp_buffer.h"
+
+#include "pong_sim.h"
+
+namespace {
+
+constexpr uint32_t OFFSET_CREEP_INTERVAL_MS = 1000;
+constexpr int32_t OFFSET_RESYNC_MS = 1000;
+constexpr int32_t FRAME_RESTART_GAP = 256;
+
+// Signed distance a - b on a wrapping millisecond clock.
+int32_t timeDiff(uint32_t a, uint32_t b) {
+  return static_cast<int32_t>(a - b);
+}
+
+const Snapshot &snapshotAt(const InterpBuffer &buffer, size_t index) {
+  return buffer.snapshots[(buffer.head + index) % INTERP_BUFFER_SIZE];
+}
+
+// The offset follows the fastest packet seen, since that one is closest to the
+// true one-way delay. It creeps up by 1 ms a second so clock drift or a slower
+// route is eventually picked up, and resyncs outright on a large jump.
+void updateClockOffset(InterpBuffer &buffer, const Snapshot &snapshot) {
+  int32_t sample = timeDiff(snapshot.arrivalMs, snapshot.hostTimeMs);
+  if (!buffer.hasClockOffset || sample - buffer.clockOffsetMs > OFFSET_RESYNC_MS) {
+    buffer.clockOffsetMs = sample;
+    buffer.offsetCreepMs = snapshot.arrivalMs;
+    buffer.hasClockOffset = true;
+    return;
+  }
+  if (sample < buffer.clockOffsetMs) {
+    buffer.clockOffsetMs = sample;
+  } else if (timeDiff(snapshot.arrivalMs, buffer.offsetCreepMs) >= static_cast<int32_t>(OFFSET_CREEP_INTERVAL_MS)) {
+    ++buffer.clockOffsetMs;
+    buffer.offsetCreepMs = snapshot.arrivalMs;
+  }
+}
+
+float lerp(float a, float b, float t) {
+  return a + (b - a) * t;
+}
+
+}  // namespace
+
+void interpReset(InterpBuffer &buffer) {
+  buffer = InterpBuffer();
+}
+
+bool interpPush(InterpBuffer &buffer, const Snapshot &snapshot) {
+  if (buffer.count > 0) {
+    int32_t ahead = timeDiff(snapshot.frameId, snapshotAt(buffer, buffer.count - 1).frameId);
+    if (ahead < -FRAME_RESTART_GAP) {
+      // Far behind rather than slightly late: the host restarted its frame
+      // counter, e.g. for a new session.
+      InterpStats stats = buffer.stats;
+      interpReset(buffer);
+      buffer.stats = stats;
+    } else if (ahead <= 0) {
+      ++buffer.stats.staleDropped;
+      return false;
+    }
+  }
+  updateClockOffset(buffer, snapshot);
+  if (buffer.count == INTERP_BUFFER_SIZE) {
+    buffer.head = (buffer.head + 1) % INTERP_BUFFER_SIZE;
+    --buffer.count;
+  }
+  buffer.snapshots[(buffer.head + buffer.count) % INTERP_BUFFER_SIZE] = snapshot;
+  ++buffer.count;
+  return true;
+}
+
+bool interpSample(InterpBuffer &buffer, uint32_t localNowMs, uint32_t delayMs, InterpSample &out) {
+  if (buffer.count == 0) {
+    return false;
+  }
+  uint32_t renderMs = localNowMs - static_cast<uint32_t>(buffer.clockOffsetMs) - delayMs;
+  const Snapshot &newest = snapshotAt(buffer, buffer.count - 1);
+  buffer.stats.leadMs = timeDiff(newest.hostTimeMs, renderMs);
+
+  // Newest snapshot at or before the render time; everything after it is still buffered.
+  size_t older = buffer.count;
+  while (older > 0 && timeDiff(snapshotAt(buffer, older - 1).hostTimeMs, renderMs) > 0) {
+    --older;
+  }
+  buffer.stats.buffered = static_cast<uint32_t>(buffer.count - older);
+
+  if (older == 0) {
+    // Render clock is behind everything queued: show the oldest snapshot.
+    const Snapshot &oldest = snapshotAt(buffer, 0);
+    out.ballX = oldest.ballX;
+    out.ballY = oldest.ballY;
+    out.hostPaddleY = oldest.hostPaddleY;
+    out.clientPaddleY = oldest.clientPaddleY;
+    buffer.holding = false;
+    return true;
+  }
+
+  const Snapshot &a = snapshotAt(buffer, older - 1);
+  if (older == buffer.count) {
+    // Nothing newer yet: carry the ball along its last known velocity,
+    // bouncing off the walls. Between keyframes that is exact; if packets are
+    // late for too long, hold it.
+    ++buffer.stats.extrapolatedFrames;
+    int32_t aheadMs = timeDiff(renderMs, a.hostTimeMs);
+    if (aheadMs > static_cast<int32_t>(INTERP_MAX_EXTRAPOLATION_MS)) {
+      aheadMs = static_cast<int32_t>(INTERP_MAX_EXTRAPOLATION_MS);
+      if (!buffer.holding) {
+        ++buffer.stats.underruns;
+        buffer.holding = true;
+      }
+    } else {
+      buffer.holding = false;
+    }
+    float seconds = static_cast<float>(aheadMs) / 1000.0f;
+    float top = BALL_RADIUS;
+    float bottom = SCREEN_HEIGHT - BALL_RADIUS;
+    out.ballX = a.ballX + a.ballVX * seconds;
+    out.ballY = a.ballY + a.ballVY * seconds;
+    if (out.ballY < top) {
+      out.ballY = 2.0f * top - out.ballY;
+    } else if (out.ballY > bottom) {
+      out.ballY = 2.0f * bottom - out.ballY;
+    }
+    out.hostPaddleY = a.hostPaddleY;
+    out.clientPaddleY = a.clientPaddleY;
+    return true;
+  }
+
+  buffer.holding = false;
+  const Snapshot &b = snapshotAt(buffer, older);
+  int32_t spanMs = timeDiff(b.hostTimeMs, a.hostTimeMs);
+  float t = spanMs > 0 ? static_cast<float>(timeDiff(renderMs, a.hostTimeMs)) / static_cast<float>(spanMs) : 1.0f;
+  if (a.points != b.points) {
+    // A point was scored in between: the ball jumped back to the centre, so
+    // sliding it across the field would be wrong. Hold, then snap.
+    t = 0.0f;
+  }
+  out.ballX = lerp(a.ballX, b.ballX, t);
+  out.ballY = lerp(a.ballY, b.ballY, t);
+  out.hostPaddleY = lerp(a.hostPaddleY, b.hostPaddleY, t);
+  out.clientPaddleY = lerp(a.clientPaddleY, b.clientPaddleY, t);
+  return true;
+}
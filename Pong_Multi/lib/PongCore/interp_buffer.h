@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Client-side snapshot buffer. State packets are queued with the host's send
+// time and the client renders a moment a little in the past, interpolating
+// between the two snapshots around it. Jitter then only shifts where inside
+// the buffer the client samples, instead of making the ball stutter. Past the
+// newest snapshot the ball is extrapolated: while it flies straight the host
+// only sends occasional keyframes (see state_send_policy.h).
+
+constexpr size_t INTERP_BUFFER_SIZE = 16;           // ~0.5 s at the 32 ms send interval
+constexpr uint32_t INTERP_MAX_EXTRAPOLATION_MS = 300;  // hold the ball after this long without data;
+                                                       // must exceed the host's keyframe interval
+
+struct Snapshot {
+  uint32_t frameId = 0;
+  uint32_t hostTimeMs = 0;
+  uint32_t arrivalMs = 0;
+  float ballX = 0.0f;
+  float ballY = 0.0f;
+  float ballVX = 0.0f;
+  float ballVY = 0.0f;
+  float hostPaddleY = 0.0f;
+  float clientPaddleY = 0.0f;
+  uint8_t points = 0;  // hostScore + clientScore: a change means the ball was re-centred
+};
+
+// What the client should draw this frame.
+struct InterpSample {
+  float ballX = 0.0f;
+  float ballY = 0.0f;
+  float hostPaddleY = 0.0f;
+  float clientPaddleY = 0.0f;
+};
+
+struct InterpStats {
+  uint32_t underruns = 0;           // times extrapolation ran out and the ball was held
+  uint32_t extrapolatedFrames = 0;  // frames drawn from velocity instead of two snapshots
+  uint32_t staleDropped = 0;        // packets older than the newest one already queued
+  uint32_t buffered = 0;            // snapshots at or ahead of the render clock last frame
+  int32_t leadMs = 0;               // newest snapshot minus render time; negative while extrapolating
+};
+
+struct InterpBuffer {
+  Snapshot snapshots[INTERP_BUFFER_SIZE];
+  size_t head = 0;  // slot of the oldest snapshot
+  size_t count = 0;
+  int32_t clockOffsetMs = 0;  // local millis() minus host millis(), on the fastest packets
+  uint32_t offsetCreepMs = 0;  // last time the offset was let drift upwards
+  bool hasClockOffset = false;
+  bool holding = false;  // extrapolated as far as allowed, waiting for data
+  InterpStats stats;
+};
+
+void interpReset(InterpBuffer &buffer);
+
+// Queues a snapshot stamped with its local arrival time. Returns false when its
+// frameId is not newer than the newest one queued (duplicate or reordered).
+bool interpPush(InterpBuffer &buffer, const Snapshot &snapshot);
+
+// Fills out with the state at localNowMs - delayMs on the host's clock. Returns
+// false while the buffer is empty.
+bool interpSample(InterpBuffer &buffer, uint32_t localNowMs, uint32_t delayMs, InterpSample &out);
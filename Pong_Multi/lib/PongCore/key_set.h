@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Fixed 512-bit set of keyboard keys: ASCII codes at 0..255 and HID usages at
+// 256..511. Sets of keys a screen asks about are built at compile time; the
+// keyboard is read into one once per loop and every query is a few bit tests,
+// with nothing allocated. A set also records which of its 32-bit words hold
+// any keys, so a query only visits those (one or two for almost every set).
+
+constexpr size_t KEY_SET_BITS = 512;
+
+struct KeySet {
+  static constexpr size_t WORD_COUNT = KEY_SET_BITS / 32;
+  uint32_t words[WORD_COUNT];
+  uint16_t usedWords;  // bit i set when words[i] may be non-zero
+
+  constexpr KeySet() : words{}, usedWords(0) {}
+
+  constexpr KeySet withIndex(size_t index) const {
+    KeySet result = *this;
+    result.words[(index % KEY_SET_BITS) / 32] |= 1u << (index % 32);
+    result.usedWords |= static_cast<uint16_t>(1u << ((index % KEY_SET_BITS) / 32));
+    return result;
+  }
+
+  constexpr KeySet ascii(char key) const {
+    return withIndex(static_cast<uint8_t>(key));
+  }
+
+  constexpr KeySet hid(uint8_t code) const {
+    return withIndex(256u + code);
+  }
+
+  // Letters match regardless of shift/caps.
+  constexpr KeySet letter(char key) const {
+    return (key >= 'a' && key <= 'z') ? ascii(key).ascii(static_cast<char>(key - 'a' + 'A'))
+           : (key >= 'A' && key <= 'Z') ? ascii(key).ascii(static_cast<char>(key - 'A' + 'a'))
+                                        : ascii(key);
+  }
+
+  void set(size_t index) {
+    words[(index % KEY_SET_BITS) / 32] |= 1u << (index % 32);
+    usedWords |= static_cast<uint16_t>(1u << ((index % KEY_SET_BITS) / 32));
+  }
+
+  void setAscii(char key) {
+    set(static_cast<uint8_t>(key));
+  }
+
+  void setHid(uint8_t code) {
+    set(256u + code);
+  }
+
+  void clear() {
+    for (uint32_t used = usedWords; used != 0; used &= used - 1) {
+      words[__builtin_ctz(used)] = 0;
+    }
+    usedWords = 0;
+  }
+};
+
+// Whether any of keys is held in down.
+inline bool keySetAny(const KeySet &down, const KeySet &keys) {
+  for (uint32_t used = keys.usedWords; used != 0; used &= used - 1) {
+    size_t i = static_cast<size_t>(__builtin_ctz(used));
+    if ((down.words[i] & keys.words[i]) != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Whether any of keys is held in down but was not when a query last covered
+// it. Only the latch bits for keys are updated, so separate queries for
+// different keys do not disturb each other.
+inline bool keySetJustPressed(const KeySet &down, KeySet &latch, const KeySet &keys) {
+  bool anyJustPressed = false;
+  for (uint32_t used = keys.usedWords; used != 0; used &= used - 1) {
+    size_t i = static_cast<size_t>(__builtin_ctz(used));
+    uint32_t held = down.words[i] & keys.words[i];
+    if ((held & ~latch.words[i]) != 0) {
+      anyJustPressed = true;
+    }
+    latch.words[i] = (latch.words[i] & ~keys.words[i]) | held;
+  }
+  latch.usedWords |= keys.usedWords;
+  return anyJustPressed;
+}
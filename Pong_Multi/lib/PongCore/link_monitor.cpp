@@ -0,0 +1,60 @@
+#include "link_monitor.h"
+
+void linkMonitorReset(LinkMonitor &monitor, uint32_t nowMs) {
+  monitor.state = LinkState::Connected;
+  monitor.lastHeardMs = nowMs;
+  monitor.stats = LinkStats();
+}
+
+void linkMonitorHeard(LinkMonitor &monitor, uint32_t nowMs) {
+  uint32_t silenceMs = nowMs - monitor.lastHeardMs;
+  if (silenceMs > monitor.stats.longestSilenceMs && silenceMs < 0x80000000u) {
+    monitor.stats.longestSilenceMs = silenceMs;
+  }
+  monitor.lastHeardMs = nowMs;
+}
+
+LinkState linkMonitorUpdate(LinkMonitor &monitor, uint32_t nowMs, uint32_t slackMs) {
+  if (monitor.state == LinkState::Dropped) {
+    return monitor.state;
+  }
+  uint32_t silenceMs = nowMs - monitor.lastHeardMs;
+  if (silenceMs >= 0x80000000u) {
+    silenceMs = 0;  // heard after nowMs was read
+  }
+  const LinkThresholds &limits = monitor.thresholds;
+  LinkState next = LinkState::Connected;
+  if (silenceMs > limits.droppedMs + slackMs) {
+    next = LinkState::Dropped;
+  } else if (silenceMs > limits.reconnectingMs + slackMs) {
+    next = LinkState::Reconnecting;
+  } else if (silenceMs > limits.degradedMs + slackMs) {
+    next = LinkState::Degraded;
+  }
+
+  if (next != monitor.state) {
+    if (next == LinkState::Degraded && monitor.state == LinkState::Connected) {
+      ++monitor.stats.degraded;
+    } else if (next == LinkState::Reconnecting) {
+      ++monitor.stats.reconnecting;
+    } else if (monitor.state == LinkState::Reconnecting && next != LinkState::Dropped) {
+      ++monitor.stats.recovered;
+    }
+    monitor.state = next;
+  }
+  return monitor.state;
+}
+
+const char *linkStateName(LinkState state) {
+  switch (state) {
+    case LinkState::Connected:
+      return "ok";
+    case LinkState::Degraded:
+      return "degraded";
+    case LinkState::Reconnecting:
+      return "reconnecting";
+    case LinkState::Dropped:
+      return "dropped";
+  }
+  return "?";
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+// Peer liveness from how long the peer has been silent. Both sides ping every
+// 250 ms, so a healthy link is never quiet for long. Degraded is only a
+// warning. Reconnecting stops the game streams and freezes the match, leaving
+// the pings as probes. Dropped gives up on the peer. Every threshold is
+// stretched by the caller's slack (the RTT-based part of netClockTimeoutMs)
+// so a slow but live link is not taken for a dead one.
+
+constexpr uint32_t LINK_DEGRADED_MS = 600;
+constexpr uint32_t LINK_RECONNECTING_MS = 1500;
+constexpr uint32_t LINK_DROPPED_MS = 6000;
+
+enum class LinkState : uint8_t {
+  Connected,
+  Degraded,
+  Reconnecting,
+  Dropped,
+};
+
+struct LinkThresholds {
+  uint32_t degradedMs = LINK_DEGRADED_MS;
+  uint32_t reconnectingMs = LINK_RECONNECTING_MS;
+  uint32_t droppedMs = LINK_DROPPED_MS;
+};
+
+struct LinkStats {
+  uint32_t degraded = 0;      // times the link went quiet past degradedMs
+  uint32_t reconnecting = 0;  // times it went quiet past reconnectingMs
+  uint32_t recovered = 0;     // came back from Reconnecting
+  uint32_t longestSilenceMs = 0;
+};
+
+struct LinkMonitor {
+  LinkThresholds thresholds;
+  LinkState state = LinkState::Connected;
+  uint32_t lastHeardMs = 0;
+  LinkStats stats;
+};
+
+// Starts watching a new peer as Connected. Thresholds are kept.
+void linkMonitorReset(LinkMonitor &monitor, uint32_t nowMs);
+
+// Call for every packet from the peer.
+void linkMonitorHeard(LinkMonitor &monitor, uint32_t nowMs);
+
+// Moves to the state the current silence calls for. Dropped stays until reset.
+LinkState linkMonitorUpdate(LinkMonitor &monitor, uint32_t nowMs, uint32_t slackMs);
+
+const char *linkStateName(LinkState state);
@@ -0,0 +1,215 @@
+#include "lobby_table.h"
+
+#include <cstring>
+
+namespace {
+
+constexpr uint8_t BEACON_STATE_PLAYING = 0x01;
+constexpr uint8_t BEACON_LOCKSTEP = 0x02;
+
+int findSlot(const LobbyTable &table, const NetAddress &address, uint32_t lobbyId) {
+  int byId = -1;
+  for (size_t i = 0; i < table.count; ++i) {
+    const LobbyEntry &entry = table.entries[table.order[i]];
+    if (entry.address == address) {
+      return table.order[i];
+    }
+    if (byId < 0 && entry.beacon.lobbyId == lobbyId) {
+      byId = table.order[i];  // the same host, now at another address
+    }
+  }
+  return byId;
+}
+
+void removeAt(LobbyTable &table, size_t index) {
+  memmove(&table.order[index], &table.order[index + 1], table.count - index - 1);
+  --table.count;
+}
+
+// Silence in beacon intervals, compared without dividing: whether a has
+// been quiet for more of its interval than b.
+bool quieter(const LobbyEntry &a, const LobbyEntry &b, uint32_t nowMs) {
+  return static_cast<uint64_t>(nowMs - a.lastHeardMs) * lobbyBeaconIntervalMs(b.beacon.state) >
+         static_cast<uint64_t>(nowMs - b.lastHeardMs) * lobbyBeaconIntervalMs(a.beacon.state);
+}
+
+// A free slot or, when the table is full, the slot of the lobby that is
+// quietest for its beacon interval if it is one beacon from expiring, or of the
+// quietest one already in a match if the newcomer is open. -1 when every
+// listed lobby is worth more than the newcomer: the list on screen stays put
+// instead of churning through more hosts than it can hold.
+int claimSlot(LobbyTable &table, LobbyState state, uint32_t nowMs) {
+  if (table.count < LOBBY_TABLE_CAPACITY) {
+    bool used[LOBBY_TABLE_CAPACITY] = {};
+    for (size_t i = 0; i < table.count; ++i) {
+      used[table.order[i]] = true;
+    }
+    for (size_t slot = 0; slot < LOBBY_TABLE_CAPACITY; ++slot) {
+      if (!used[slot]) {
+        table.order[table.count++] = static_cast<uint8_t>(slot);
+        return static_cast<int>(slot);
+      }
+    }
+  }
+  int quietest = -1;
+  int quietestBusy = -1;
+  for (size_t i = 0; i < table.count; ++i) {
+    const LobbyEntry &entry = table.entries[table.order[i]];
+    if (quietest < 0 || quieter(entry, table.entries[table.order[quietest]], nowMs)) {
+      quietest = static_cast<int>(i);
+    }
+    if (entry.beacon.state == LobbyState::Playing &&
+        (quietestBusy < 0 || quieter(entry, table.entries[table.order[quietestBusy]], nowMs))) {
+      quietestBusy = static_cast<int>(i);
+    }
+  }
+  const LobbyEntry &candidate = table.entries[table.order[quietest]];
+  int victim = -1;
+  if (nowMs - candidate.lastHeardMs > (LOBBY_EXPIRE_BEACONS - 1) * lobbyBeaconIntervalMs(candidate.beacon.state)) {
+    victim = quietest;
+  } else if (state == LobbyState::Open) {
+    victim = quietestBusy;
+  }
+  if (victim < 0) {
+    ++table.stats.turnedAway;
+    return -1;
+  }
+  uint8_t slot = table.order[victim];
+  removeAt(table, static_cast<size_t>(victim));
+  table.order[table.count++] = slot;
+  ++table.stats.evicted;
+  return slot;
+}
+
+}  // namespace
+
+size_t lobbyBeaconEncode(const LobbyBeacon &beacon, uint8_t *out, size_t capacity) {
+  size_t nameLength = strnlen(beacon.name, LOBBY_NAME_MAX);
+  size_t length = 8 + nameLength;
+  if (length > capacity) {
+    return 0;
+  }
+  out[0] = static_cast<uint8_t>(PacketType::LobbyBeacon);
+  memcpy(&out[1], &beacon.lobbyId, sizeof(beacon.lobbyId));
+  out[5] = beacon.seq;
+  out[6] = static_cast<uint8_t>((beacon.state == LobbyState::Playing ? BEACON_STATE_PLAYING : 0) |
+                                (beacon.netMode == NetMode::Lockstep ? BEACON_LOCKSTEP : 0));
+  out[7] = static_cast<uint8_t>(nameLength);
+  memcpy(&out[8], beacon.name, nameLength);
+  return length;
+}
+
+bool lobbyBeaconDecode(const uint8_t *data, size_t length, LobbyBeacon &out) {
+  if (length < 8 || data[0] != static_cast<uint8_t>(PacketType::LobbyBeacon)) {
+    return false;
+  }
+  size_t nameLength = data[7];
+  if (nameLength > LOBBY_NAME_MAX || length < 8 + nameLength) {
+    return false;
+  }
+  memcpy(&out.lobbyId, &data[1], sizeof(out.lobbyId));
+  out.seq = data[5];
+  out.state = (data[6] & BEACON_STATE_PLAYING) != 0 ? LobbyState::Playing : LobbyState::Open;
+  out.netMode = (data[6] & BEACON_LOCKSTEP) != 0 ? NetMode::Lockstep : NetMode::Snapshot;
+  memcpy(out.name, &data[8], nameLength);
+  out.name[nameLength] = '\0';
+  return true;
+}
+
+void lobbyTableReset(LobbyTable &table) {
+  table.count = 0;
+  table.stats = LobbyTableStats();
+}
+
+bool lobbyTableHeard(LobbyTable &table, const NetAddress &from, const LobbyBeacon &beacon, uint32_t nowMs) {
+  ++table.stats.beacons;
+  int slot = findSlot(table, from, beacon.lobbyId);
+  bool fresh = slot < 0;
+  if (fresh) {
+    slot = claimSlot(table, beacon.state, nowMs);
+    if (slot < 0) {
+      return false;
+    }
+    ++table.stats.added;
+  } else if (table.entries[slot].beacon.lobbyId != beacon.lobbyId) {
+    fresh = true;  // the host at this address started over: keep the place, not the history
+    ++table.stats.restarted;
+  }
+  LobbyEntry &entry = table.entries[slot];
+  if (fresh) {
+    entry = LobbyEntry();
+    entry.firstHeardMs = nowMs;
+    entry.lastProbeMs = nowMs - LOBBY_PROBE_INTERVAL_MS;  // due straight away
+  } else {
+    uint8_t gap = static_cast<uint8_t>(beacon.seq - entry.beacon.seq);
+    if (gap == 0 || gap > 128) {
+      return false;  // a duplicate or a straggler
+    }
+    entry.beaconsMissed = static_cast<uint16_t>(entry.beaconsMissed + gap - 1);
+  }
+  bool changed = fresh || entry.beacon.state != beacon.state || entry.beacon.netMode != beacon.netMode ||
+                 strcmp(entry.beacon.name, beacon.name) != 0;
+  entry.address = from;
+  entry.beacon = beacon;
+  entry.lastHeardMs = nowMs;
+  ++entry.beaconsHeard;
+  return changed;
+}
+
+size_t lobbyTableExpire(LobbyTable &table, uint32_t nowMs) {
+  size_t removed = 0;
+  size_t i = 0;
+  while (i < table.count) {
+    const LobbyEntry &entry = table.entries[table.order[i]];
+    if (nowMs - entry.lastHeardMs > LOBBY_EXPIRE_BEACONS * lobbyBeaconIntervalMs(entry.beacon.state)) {
+      removeAt(table, i);
+      ++removed;
+    } else {
+      ++i;
+    }
+  }
+  table.stats.expired += static_cast<uint32_t>(removed);
+  return removed;
+}
+
+const LobbyEntry *lobbyTableNextProbe(LobbyTable &table, uint32_t nowMs) {
+  LobbyEntry *due = nullptr;
+  uint32_t dueFor = 0;
+  for (size_t i = 0; i < table.count; ++i) {
+    LobbyEntry &entry = table.entries[table.order[i]];
+    uint32_t since = nowMs - entry.lastProbeMs;
+    if (since >= LOBBY_PROBE_INTERVAL_MS && (due == nullptr || since > dueFor)) {
+      due = &entry;
+      dueFor = since;
+    }
+  }
+  if (due != nullptr) {
+    due->lastProbeMs = nowMs;
+    ++table.stats.probes;
+  }
+  return due;
+}
+
+void lobbyTableAnswer(LobbyTable &table, const NetAddress &from, uint32_t lobbyId, uint32_t sentUs, uint32_t nowUs) {
+  int slot = findSlot(table, from, lobbyId);
+  if (slot < 0 || table.entries[slot].beacon.lobbyId != lobbyId) {
+    return;
+  }
+  LobbyEntry &entry = table.entries[slot];
+  uint32_t rttUs = nowUs - sentUs;
+  if (rttUs > 10000000u) {
+    return;  // a stale answer from before a wrap, or garbage
+  }
+  // Same smoothing as TCP's SRTT (RFC 6298).
+  entry.srttUs = entry.srttUs == 0 ? (rttUs != 0 ? rttUs : 1) : entry.srttUs - entry.srttUs / 8 + rttUs / 8;
+  ++table.stats.answers;
+}
+
+int lobbyTableFind(const LobbyTable &table, uint32_t lobbyId) {
+  for (size_t i = 0; i < table.count; ++i) {
+    if (table.entries[table.order[i]].beacon.lobbyId == lobbyId) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
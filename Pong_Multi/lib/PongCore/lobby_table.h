@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "protocol.h"
+#include "transport.h"
+
+// Lobby discovery. Hosts broadcast a small beacon, once a second while they
+// wait for a player and every few seconds once in a match; a browsing client
+// keeps every host it hears in a LobbyTable, probes each for its round-trip
+// time and lets the player pick one, instead of joining whichever host
+// answers a broadcast first. The table is a fixed array: hearing, probing
+// and aging hundreds of hosts allocates nothing.
+
+constexpr size_t LOBBY_TABLE_CAPACITY = 128;
+constexpr size_t LOBBY_NAME_MAX = PLAYER_NAME_MAX_LEN - 1;
+constexpr size_t LOBBY_BEACON_MAX = 8 + LOBBY_NAME_MAX;
+constexpr uint32_t LOBBY_BEACON_INTERVAL_MS = 1000;       // while the host waits for a player
+constexpr uint32_t LOBBY_BEACON_BUSY_INTERVAL_MS = 5000;  // while it plays: listed, not joinable
+constexpr uint32_t LOBBY_EXPIRE_BEACONS = 3;              // missed beacons before a lobby is dropped
+constexpr uint32_t LOBBY_PROBE_INTERVAL_MS = 2000;        // per lobby
+constexpr uint32_t LOBBY_PROBE_SPACING_MS = 20;           // between any two probes: at most 50/s
+
+enum class LobbyState : uint8_t {
+  Open = 0,     // waiting for a player
+  Playing = 1,  // has one
+};
+
+// PacketType::LobbyBeacon on the wire: type, lobbyId, seq, state and net
+// mode, then the host's name, length-prefixed.
+struct LobbyBeacon {
+  uint32_t lobbyId = 0;  // random per hosting session: a restarted host is a new lobby
+  uint8_t seq = 0;       // counts beacons, so the browser sees the ones it missed
+  LobbyState state = LobbyState::Open;
+  NetMode netMode = NetMode::Snapshot;
+  char name[LOBBY_NAME_MAX + 1] = {};
+};
+
+// Returns the datagram length, or 0 if it did not fit.
+size_t lobbyBeaconEncode(const LobbyBeacon &beacon, uint8_t *out, size_t capacity);
+bool lobbyBeaconDecode(const uint8_t *data, size_t length, LobbyBeacon &out);
+
+inline uint32_t lobbyBeaconIntervalMs(LobbyState state) {
+  return state == LobbyState::Open ? LOBBY_BEACON_INTERVAL_MS : LOBBY_BEACON_BUSY_INTERVAL_MS;
+}
+
+struct LobbyEntry {
+  NetAddress address;
+  LobbyBeacon beacon;  // the newest one heard
+  uint32_t firstHeardMs = 0;
+  uint32_t lastHeardMs = 0;
+  uint32_t lastProbeMs = 0;
+  uint32_t srttUs = 0;  // smoothed probe round trip; 0 until the first answer
+  uint16_t beaconsHeard = 0;
+  uint16_t beaconsMissed = 0;  // gaps in seq
+};
+
+struct LobbyTableStats {
+  uint32_t beacons = 0;
+  uint32_t added = 0;
+  uint32_t restarted = 0;  // same address or id, new session: the entry starts over
+  uint32_t expired = 0;
+  uint32_t evicted = 0;     // the table was full: a lobby about to expire or in a match made room
+  uint32_t turnedAway = 0;  // the table was full of lobbies worth keeping: a new one was not listed
+  uint32_t probes = 0;
+  uint32_t answers = 0;
+};
+
+// Entries live in fixed slots; order lists the used ones by when they were
+// first heard, so a lobby keeps its place on screen while others come and go.
+struct LobbyTable {
+  LobbyEntry entries[LOBBY_TABLE_CAPACITY];
+  uint8_t order[LOBBY_TABLE_CAPACITY];
+  size_t count = 0;
+  LobbyTableStats stats;
+};
+
+void lobbyTableReset(LobbyTable &table);
+
+// Adds or refreshes the lobby behind a beacon, deduplicated by address and by
+// lobby id. A full table only takes a new lobby in place of one about to
+// expire or, for an open lobby, one already in a match. Returns true
+// when the list as displayed changed: a new or restarted lobby, or a new name
+// or state.
+bool lobbyTableHeard(LobbyTable &table, const NetAddress &from, const LobbyBeacon &beacon, uint32_t nowMs);
+
+// Drops lobbies that missed LOBBY_EXPIRE_BEACONS of their beacons. Returns
+// how many went.
+size_t lobbyTableExpire(LobbyTable &table, uint32_t nowMs);
+
+// The lobby most overdue for a round-trip probe, marked as probed now, or
+// nullptr when none is due.
+const LobbyEntry *lobbyTableNextProbe(LobbyTable &table, uint32_t nowMs);
+
+// Folds in a probe answer: sentUs is the stamp the probe carried.
+void lobbyTableAnswer(LobbyTable &table, const NetAddress &from, uint32_t lobbyId, uint32_t sentUs, uint32_t nowUs);
+
+// Display position i, 0 <= i < count.
+inline const LobbyEntry &lobbyTableAt(const LobbyTable &table, size_t index) {
+  return table.entries[table.order[index]];
+}
+
+// Display position of a lobby, or -1 when it is not listed.
+int lobbyTableFind(const LobbyTable &table, uint32_t lobbyId);
@@ -0,0 +1,367 @@
+#include "lockstep.h"
+
+#include <cstring>
+
+#include "bit_packer.h"
+#include "protocol.h"
+
+namespace {
+
+constexpr uint8_t INPUT_BITS = 3;
+constexpr uint8_t HEADER_BITS = 8 + 16 + 8 + 32 + 32;
+constexpr uint8_t HASH_BITS = 1 + 32 + 32;
+
+static_assert(LOCKSTEP_PACKET_MAX <= MAX_DATAGRAM_SIZE, "Lockstep packets fit the receive buffer");
+static_assert(LOCKSTEP_SYNC_PACKET_MAX <= MAX_DATAGRAM_SIZE, "Sync packets fit the receive buffer");
+static_assert(LOCKSTEP_INPUT_DELAY_TICKS < LOCKSTEP_INPUT_WINDOW, "The input delay fits the window");
+
+size_t slot(uint32_t tick) {
+  return tick % LOCKSTEP_INPUT_WINDOW;
+}
+
+size_t hashSlot(uint32_t tick) {
+  return (tick / LOCKSTEP_HASH_INTERVAL_TICKS) % LOCKSTEP_HASH_HISTORY;
+}
+
+// Bits bitWriteVar() spends on value.
+size_t varBits(uint32_t value) {
+  size_t groups = 1;
+  while (value >= 16 && groups < 8) {
+    value >>= 4;
+    ++groups;
+  }
+  return groups * 5;
+}
+
+int8_t inputDirection(uint8_t input) {
+  if (input & LOCKSTEP_INPUT_UP) {
+    return -1;
+  }
+  return (input & LOCKSTEP_INPUT_DOWN) ? 1 : 0;
+}
+
+// Both sides forget their inputs and start over at tick: the first
+// LOCKSTEP_INPUT_DELAY_TICKS are not sent but filled in the same on both ends.
+void rebase(Lockstep &lockstep, uint32_t tick, bool paused) {
+  uint8_t fill = lockstepInput(0, paused);
+  memset(lockstep.local, fill, sizeof(lockstep.local));
+  memset(lockstep.remote, fill, sizeof(lockstep.remote));
+  lockstep.epochStartTick = tick;
+  lockstep.epochStartPaused = paused;
+  lockstep.tick = tick;
+  lockstep.localEnd = tick + LOCKSTEP_INPUT_DELAY_TICKS;
+  lockstep.remoteEnd = tick + LOCKSTEP_INPUT_DELAY_TICKS;
+  lockstep.peerHasEnd = tick + LOCKSTEP_INPUT_DELAY_TICKS;
+  lockstep.ackPending = true;
+  lockstep.paused = paused;
+  memset(lockstep.hashTicks, 0, sizeof(lockstep.hashTicks));
+  lockstep.newestHashTick = 0;
+  lockstep.sentHashTick = 0;
+  lockstep.peerHashTick = 0;
+  lockstep.desynced = false;
+}
+
+void compareHash(Lockstep &lockstep, uint32_t tick, uint32_t ours, uint32_t theirs) {
+  ++lockstep.stats.hashesChecked;
+  if (ours == theirs) {
+    lockstep.desynced = false;
+    return;
+  }
+  ++lockstep.stats.desyncs;
+  lockstep.desynced = true;
+  lockstep.desyncTick = tick;
+  if (lockstep.host && !lockstepSyncPending(lockstep)) {
+    lockstepBeginResync(lockstep);
+  }
+}
+
+void recordHash(Lockstep &lockstep, const SimState &sim) {
+  uint32_t hash = simStateHash(sim);
+  size_t index = hashSlot(lockstep.tick);
+  lockstep.hashTicks[index] = lockstep.tick;
+  lockstep.hashes[index] = hash;
+  lockstep.newestHashTick = lockstep.tick;
+  if (lockstep.peerHashTick == lockstep.tick) {
+    lockstep.peerHashTick = 0;
+    compareHash(lockstep, lockstep.tick, hash, lockstep.peerHash);
+  } else if (lockstep.peerHashTick != 0 && lockstep.peerHashTick < lockstep.tick) {
+    lockstep.peerHashTick = 0;
+  }
+}
+
+void receiveHash(Lockstep &lockstep, uint32_t tick, uint32_t hash) {
+  if (tick > lockstep.tick) {
+    lockstep.peerHashTick = tick;  // compared once we get there
+    lockstep.peerHash = hash;
+    return;
+  }
+  size_t index = hashSlot(tick);
+  if (tick != 0 && lockstep.hashTicks[index] == tick) {
+    compareHash(lockstep, tick, lockstep.hashes[index], hash);
+  }
+}
+
+bool ready(const Lockstep &lockstep) {
+  uint32_t scheduled = lockstep.tick + LOCKSTEP_INPUT_DELAY_TICKS;
+  return lockstep.tick < lockstep.remoteEnd && scheduled - lockstep.peerHasEnd < LOCKSTEP_INPUT_WINDOW;
+}
+
+uint8_t step(Lockstep &lockstep, SimState &sim, uint8_t localInput) {
+  uint32_t scheduled = lockstep.tick + LOCKSTEP_INPUT_DELAY_TICKS;
+  while (lockstep.localEnd <= scheduled) {
+    lockstep.local[slot(lockstep.localEnd++)] = localInput;
+  }
+  uint8_t own = lockstep.local[slot(lockstep.tick)];
+  uint8_t peer = lockstep.remote[slot(lockstep.tick)];
+  uint8_t hostInput = lockstep.host ? own : peer;
+  uint8_t clientInput = lockstep.host ? peer : own;
+
+  uint8_t events = 0;
+  lockstep.paused = (hostInput & LOCKSTEP_INPUT_PAUSED) != 0;
+  if (!lockstep.paused) {
+    SimInput input;
+    input.hostPaddleDir = inputDirection(hostInput);
+    input.clientPaddleDir = inputDirection(clientInput);
+    events = simStep(sim, input);
+  }
+  ++lockstep.tick;
+  ++lockstep.stats.ticks;
+  if (lockstep.tick % LOCKSTEP_HASH_INTERVAL_TICKS == 0) {
+    recordHash(lockstep, sim);
+  }
+  return events;
+}
+
+uint32_t readScalarBits(BitReader &reader) {
+  return bitRead(reader, 32);
+}
+
+SimScalar scalarFromBits(uint32_t bits) {
+  SimWire wire;
+  memcpy(&wire, &bits, sizeof(wire));
+  return simFromWire(wire);
+}
+
+}  // namespace
+
+void lockstepReset(Lockstep &lockstep, uint32_t seed, bool host) {
+  LockstepStats stats = lockstep.stats;
+  lockstep = Lockstep();
+  lockstep.stats = stats;
+  lockstep.host = host;
+  lockstep.matchTag = static_cast<uint16_t>(seed);
+  rebase(lockstep, 0, false);
+  lockstep.ackPending = false;
+}
+
+uint32_t lockstepAdvance(Lockstep &lockstep, SimState &sim, uint32_t ticksDue, uint8_t localInput, uint8_t &events) {
+  lockstep.owedTicks += ticksDue;
+  if (lockstep.owedTicks > LOCKSTEP_MAX_OWED_TICKS) {
+    lockstep.stats.droppedTicks += lockstep.owedTicks - LOCKSTEP_MAX_OWED_TICKS;
+    lockstep.owedTicks = LOCKSTEP_MAX_OWED_TICKS;
+  }
+  uint32_t ran = 0;
+  while (lockstep.owedTicks > 0) {
+    if (!ready(lockstep)) {
+      ++lockstep.stats.stalls;
+      break;
+    }
+    --lockstep.owedTicks;
+    ++ran;
+    uint8_t tickEvents = step(lockstep, sim, localInput);
+    events |= tickEvents;
+    if (tickEvents & SIM_EVENT_GAME_OVER) {
+      lockstep.owedTicks = 0;
+      break;
+    }
+  }
+  return ran;
+}
+
+bool lockstepSendDue(const Lockstep &lockstep, uint32_t sinceSentMs) {
+  if (sinceSentMs < LOCKSTEP_SEND_INTERVAL_MS) {
+    return false;
+  }
+  return lockstep.localEnd != lockstep.peerHasEnd || lockstep.ackPending ||
+         lockstep.newestHashTick != lockstep.sentHashTick;
+}
+
+void lockstepBeginResync(Lockstep &lockstep) {
+  ++lockstep.epoch;
+  ++lockstep.stats.resyncs;
+  rebase(lockstep, lockstep.tick, lockstep.paused);
+}
+
+size_t lockstepWritePacket(Lockstep &lockstep, uint8_t *out, size_t capacity) {
+  bool withHash = lockstep.newestHashTick != lockstep.sentHashTick;
+  size_t budget = capacity * 8 - HEADER_BITS - varBits(LOCKSTEP_INPUT_WINDOW) - HASH_BITS;
+
+  // Runs from the oldest input the peer lacks, as many as fit.
+  uint32_t count = 0;
+  size_t used = 0;
+  uint32_t pending = lockstep.localEnd - lockstep.peerHasEnd;
+  while (count < pending) {
+    uint8_t value = lockstep.local[slot(lockstep.peerHasEnd + count)];
+    uint32_t run = 1;
+    while (count + run < pending && lockstep.local[slot(lockstep.peerHasEnd + count + run)] == value) {
+      ++run;
+    }
+    size_t bits = INPUT_BITS + varBits(run - 1);
+    if (used + bits > budget) {
+      break;
+    }
+    used += bits;
+    count += run;
+  }
+
+  BitWriter writer = bitWriter(out, capacity);
+  bitWrite(writer, static_cast<uint8_t>(PacketType::LockstepInput), 8);
+  bitWrite(writer, lockstep.matchTag, 16);
+  bitWrite(writer, lockstep.epoch, 8);
+  bitWrite(writer, lockstep.remoteEnd, 32);
+  bitWrite(writer, lockstep.peerHasEnd, 32);
+  bitWriteVar(writer, count);
+  uint32_t written = 0;
+  while (written < count) {
+    uint8_t value = lockstep.local[slot(lockstep.peerHasEnd + written)];
+    uint32_t run = 1;
+    while (written + run < count && lockstep.local[slot(lockstep.peerHasEnd + written + run)] == value) {
+      ++run;
+    }
+    bitWrite(writer, value, INPUT_BITS);
+    bitWriteVar(writer, run - 1);
+    written += run;
+  }
+  bitWrite(writer, withHash ? 1 : 0, 1);
+  if (withHash) {
+    bitWrite(writer, lockstep.newestHashTick, 32);
+    bitWrite(writer, lockstep.hashes[hashSlot(lockstep.newestHashTick)], 32);
+  }
+  if (writer.overflow) {
+    return 0;
+  }
+  lockstep.ackPending = false;
+  lockstep.sentHashTick = lockstep.newestHashTick;
+  return bitWriterBytes(writer);
+}
+
+bool lockstepReadPacket(Lockstep &lockstep, const uint8_t *data, size_t length) {
+  BitReader reader = bitReader(data, length);
+  if (bitRead(reader, 8) != static_cast<uint8_t>(PacketType::LockstepInput)) {
+    return false;
+  }
+  uint16_t matchTag = static_cast<uint16_t>(bitRead(reader, 16));
+  uint8_t epoch = static_cast<uint8_t>(bitRead(reader, 8));
+  uint32_t ackEnd = bitRead(reader, 32);
+  uint32_t firstTick = bitRead(reader, 32);
+  uint32_t count = bitReadVar(reader);
+  if (reader.overflow || matchTag != lockstep.matchTag || count > LOCKSTEP_INPUT_WINDOW) {
+    return false;
+  }
+  lockstep.peerSeen = true;
+  lockstep.peerEpoch = epoch;
+  if (epoch != lockstep.epoch) {
+    return false;  // from before a resync, or ahead of a sync not adopted yet
+  }
+
+  // Decode everything before touching state, so a truncated packet changes nothing.
+  uint8_t inputs[LOCKSTEP_INPUT_WINDOW];
+  uint32_t decoded = 0;
+  while (decoded < count && !reader.overflow) {
+    uint8_t value = static_cast<uint8_t>(bitRead(reader, INPUT_BITS));
+    uint32_t run = bitReadVar(reader) + 1;
+    if (run > count - decoded) {
+      return false;
+    }
+    memset(inputs + decoded, value, run);
+    decoded += run;
+  }
+  bool withHash = bitRead(reader, 1) != 0;
+  uint32_t hashTick = withHash ? bitRead(reader, 32) : 0;
+  uint32_t hash = withHash ? bitRead(reader, 32) : 0;
+  if (reader.overflow) {
+    return false;
+  }
+
+  if (ackEnd > lockstep.peerHasEnd && ackEnd <= lockstep.localEnd) {
+    lockstep.peerHasEnd = ackEnd;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t tick = firstTick + i;
+    if (tick != lockstep.remoteEnd || tick - lockstep.tick >= LOCKSTEP_INPUT_WINDOW) {
+      continue;  // already held, or no room until we catch up
+    }
+    lockstep.remote[slot(tick)] = inputs[i];
+    ++lockstep.remoteEnd;
+    lockstep.ackPending = true;
+  }
+  if (withHash) {
+    receiveHash(lockstep, hashTick, hash);
+  }
+  return true;
+}
+
+size_t lockstepWriteSync(const Lockstep &lockstep, const SimState &sim, uint8_t *out, size_t capacity) {
+  BitWriter writer = bitWriter(out, capacity);
+  bitWrite(writer, static_cast<uint8_t>(PacketType::LockstepSync), 8);
+  bitWrite(writer, lockstep.matchTag, 16);
+  bitWrite(writer, lockstep.epoch, 8);
+  bitWrite(writer, lockstep.epochStartTick, 32);
+  bitWrite(writer, lockstep.epochStartPaused ? 1 : 0, 1);
+  bitWrite(writer, lockstep.tick, 32);
+  bitWrite(writer, lockstep.paused ? 1 : 0, 1);
+  const SimScalar scalars[] = {sim.ballX, sim.ballY, sim.ballVX, sim.ballVY, sim.hostPaddleY, sim.clientPaddleY};
+  for (SimScalar value : scalars) {
+    bitWrite(writer, simScalarBits(value), 32);
+  }
+  bitWrite(writer, sim.tick, 32);
+  bitWrite(writer, sim.rng, 32);
+  bitWrite(writer, sim.serveTicksLeft, 16);
+  bitWrite(writer, sim.hostScore, 8);
+  bitWrite(writer, sim.clientScore, 8);
+  bitWriteSigned(writer, sim.serveDirection, 2);
+  bitWrite(writer, sim.matchActive ? 1 : 0, 1);
+  bitWrite(writer, sim.waitingForServe ? 1 : 0, 1);
+  bitWrite(writer, sim.gameOver ? 1 : 0, 1);
+  return writer.overflow ? 0 : bitWriterBytes(writer);
+}
+
+bool lockstepReadSync(Lockstep &lockstep, SimState &sim, const uint8_t *data, size_t length) {
+  BitReader reader = bitReader(data, length);
+  if (bitRead(reader, 8) != static_cast<uint8_t>(PacketType::LockstepSync)) {
+    return false;
+  }
+  uint16_t matchTag = static_cast<uint16_t>(bitRead(reader, 16));
+  uint8_t epoch = static_cast<uint8_t>(bitRead(reader, 8));
+  uint32_t startTick = bitRead(reader, 32);
+  bool startPaused = bitRead(reader, 1) != 0;
+  uint32_t tick = bitRead(reader, 32);
+  bool paused = bitRead(reader, 1) != 0;
+  SimState state;
+  state.ballX = scalarFromBits(readScalarBits(reader));
+  state.ballY = scalarFromBits(readScalarBits(reader));
+  state.ballVX = scalarFromBits(readScalarBits(reader));
+  state.ballVY = scalarFromBits(readScalarBits(reader));
+  state.hostPaddleY = scalarFromBits(readScalarBits(reader));
+  state.clientPaddleY = scalarFromBits(readScalarBits(reader));
+  state.tick = bitRead(reader, 32);
+  state.rng = bitRead(reader, 32);
+  state.serveTicksLeft = static_cast<uint16_t>(bitRead(reader, 16));
+  state.hostScore = static_cast<uint8_t>(bitRead(reader, 8));
+  state.clientScore = static_cast<uint8_t>(bitRead(reader, 8));
+  state.serveDirection = static_cast<int8_t>(bitReadSigned(reader, 2));
+  state.matchActive = bitRead(reader, 1) != 0;
+  state.waitingForServe = bitRead(reader, 1) != 0;
+  state.gameOver = bitRead(reader, 1) != 0;
+  if (reader.overflow || matchTag != lockstep.matchTag || epoch == lockstep.epoch || tick < startTick ||
+      tick - startTick > LOCKSTEP_INPUT_DELAY_TICKS) {
+    return false;
+  }
+  sim = state;
+  lockstep.epoch = epoch;
+  rebase(lockstep, startTick, startPaused);
+  lockstep.tick = tick;
+  lockstep.paused = paused;
+  ++lockstep.stats.resyncs;
+  return true;
+}
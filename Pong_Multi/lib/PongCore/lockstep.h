@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "pong_sim.h"
+
+// Input-only netcode. Both sides run simStep() from the Start seed and trade
+// nothing but what each player pressed on every tick. An input read now is
+// scheduled LOCKSTEP_INPUT_DELAY_TICKS ahead, which gives it that long to reach
+// the peer; a tick runs only once both sides' inputs for it are known, so a
+// late packet stalls both screens rather than letting them drift apart. Every
+// packet repeats, run-length coded, the inputs the peer has not acknowledged,
+// so loss costs a stall only when it outlasts the input delay.
+//
+// Every LOCKSTEP_HASH_INTERVAL_TICKS both sides hash their state and send the
+// hash along. A mismatch is a desync: the host then starts a new epoch, sends
+// its full state (a sync packet, repeated until the client answers from the
+// new epoch) and both continue from there with the input streams restarted.
+// The same sync puts a resumed client back into a running match.
+
+constexpr uint32_t LOCKSTEP_INPUT_DELAY_TICKS = 12;   // 50 ms at 240 Hz
+constexpr uint32_t LOCKSTEP_INPUT_WINDOW = 128;       // ticks of input kept per side
+constexpr uint32_t LOCKSTEP_MAX_OWED_TICKS = 2 * LOCKSTEP_INPUT_DELAY_TICKS;  // caught up after a stall
+constexpr uint32_t LOCKSTEP_HASH_INTERVAL_TICKS = 60;  // four checks a second
+constexpr size_t LOCKSTEP_HASH_HISTORY = 8;
+constexpr uint32_t LOCKSTEP_SEND_INTERVAL_MS = 16;
+constexpr uint32_t LOCKSTEP_SYNC_RESEND_MS = 100;     // Start and sync, until the client has them
+constexpr size_t LOCKSTEP_PACKET_MAX = 64;
+constexpr size_t LOCKSTEP_SYNC_PACKET_MAX = 64;
+
+// One tick of one player's input.
+constexpr uint8_t LOCKSTEP_INPUT_UP = 0x01;
+constexpr uint8_t LOCKSTEP_INPUT_DOWN = 0x02;
+constexpr uint8_t LOCKSTEP_INPUT_PAUSED = 0x04;  // host only: the simulation holds on this tick
+
+inline uint8_t lockstepInput(int direction, bool paused) {
+  uint8_t input = direction < 0 ? LOCKSTEP_INPUT_UP : direction > 0 ? LOCKSTEP_INPUT_DOWN : 0;
+  return paused ? static_cast<uint8_t>(input | LOCKSTEP_INPUT_PAUSED) : input;
+}
+
+struct LockstepStats {
+  uint32_t ticks = 0;
+  uint32_t stalls = 0;        // updates that had ticks due but lacked the peer's input
+  uint32_t droppedTicks = 0;  // owed past LOCKSTEP_MAX_OWED_TICKS and given up
+  uint32_t hashesChecked = 0;
+  uint32_t desyncs = 0;
+  uint32_t resyncs = 0;  // epochs started (host) or adopted (client)
+};
+
+struct Lockstep {
+  bool host = false;
+  uint16_t matchTag = 0;  // low bits of the seed; packets of another match are ignored
+  uint8_t epoch = 0;
+  uint8_t peerEpoch = 0;  // epoch of the newest packet from the peer
+  uint32_t epochStartTick = 0;  // the first LOCKSTEP_INPUT_DELAY_TICKS from here are filled in, not sent
+  bool epochStartPaused = false;  // ... as still paddles, held or not by the host's pause
+  bool peerSeen = false;  // the peer has sent anything for this match
+  uint32_t tick = 0;      // ticks run so far; the next one to run
+  uint32_t localEnd = LOCKSTEP_INPUT_DELAY_TICKS;    // own inputs known below this tick
+  uint32_t remoteEnd = LOCKSTEP_INPUT_DELAY_TICKS;   // peer inputs known below this tick
+  uint32_t peerHasEnd = LOCKSTEP_INPUT_DELAY_TICKS;  // the peer holds our inputs below this tick
+  bool ackPending = false;  // remoteEnd moved since the last packet
+  uint32_t owedTicks = 0;
+  bool paused = false;  // the last tick ran under the host's pause
+  uint8_t local[LOCKSTEP_INPUT_WINDOW] = {};
+  uint8_t remote[LOCKSTEP_INPUT_WINDOW] = {};
+  uint32_t hashTicks[LOCKSTEP_HASH_HISTORY] = {};  // 0: empty slot
+  uint32_t hashes[LOCKSTEP_HASH_HISTORY] = {};
+  uint32_t newestHashTick = 0;
+  uint32_t sentHashTick = 0;
+  uint32_t peerHashTick = 0;  // a peer hash for a tick not reached yet (0: none)
+  uint32_t peerHash = 0;
+  bool desynced = false;
+  uint32_t desyncTick = 0;
+  LockstepStats stats;
+};
+
+// A new match from seed. Stats stay.
+void lockstepReset(Lockstep &lockstep, uint32_t seed, bool host);
+
+// Runs up to ticksDue more ticks (plus any still owed from a stall) with
+// localInput as this side's input, and ORs the SIM_EVENT_* bits into events.
+// Stops at game over. Returns the ticks run.
+uint32_t lockstepAdvance(Lockstep &lockstep, SimState &sim, uint32_t ticksDue, uint8_t localInput, uint8_t &events);
+
+// Whether an input packet should go out now: new inputs, acknowledgements or
+// a hash the peer has not had, and at least LOCKSTEP_SEND_INTERVAL_MS since
+// the last one.
+bool lockstepSendDue(const Lockstep &lockstep, uint32_t sinceSentMs);
+
+// Host: a sync is out that the client has not answered from yet.
+inline bool lockstepSyncPending(const Lockstep &lockstep) {
+  return lockstep.host && lockstep.peerEpoch != lockstep.epoch;
+}
+
+// Host: restarts the input streams at the current tick under a new epoch. Send
+// lockstepWriteSync() until lockstepSyncPending() clears.
+void lockstepBeginResync(Lockstep &lockstep);
+
+// Writes a PacketType::LockstepInput datagram and returns its length.
+size_t lockstepWritePacket(Lockstep &lockstep, uint8_t *out, size_t capacity);
+
+// Applies a PacketType::LockstepInput datagram. False when it is malformed or
+// belongs to another match or epoch.
+bool lockstepReadPacket(Lockstep &lockstep, const uint8_t *data, size_t length);
+
+// Host: PacketType::LockstepSync with the epoch and sim, the state at the current tick.
+size_t lockstepWriteSync(const Lockstep &lockstep, const SimState &sim, uint8_t *out, size_t capacity);
+
+// Client: adopts a sync from another epoch into lockstep and sim. False when
+// it is malformed, of another match or of the current epoch.
+bool lockstepReadSync(Lockstep &lockstep, SimState &sim, const uint8_t *data, size_t length);
@@ -0,0 +1,62 @@
+#include "net_clock.h"
+
+namespace {
+
+uint32_t absDiff(uint32_t a, uint32_t b) {
+  return a > b ? a - b : b - a;
+}
+
+}  // namespace
+
+void netClockReset(NetClock &clock) {
+  clock = NetClock();
+}
+
+void netClockAddSample(NetClock &clock, uint32_t originUs, uint32_t originMs, uint32_t peerReceiveMs,
+                       uint32_t peerHoldUs, uint32_t nowUs) {
+  uint32_t elapsedUs = nowUs - originUs;
+  uint32_t rttUs = elapsedUs > peerHoldUs ? elapsedUs - peerHoldUs : 0;
+
+  // Offset = t1 - (t0 + rtt / 2): assumes both legs took the same time.
+  ClockSample sample;
+  sample.rttUs = rttUs;
+  sample.offsetMs = static_cast<int32_t>(peerReceiveMs - originMs - (rttUs / 2 + 500) / 1000);
+  clock.samples[clock.nextSample] = sample;
+  clock.nextSample = (clock.nextSample + 1) % NET_CLOCK_FILTER_SIZE;
+  if (clock.sampleCount < NET_CLOCK_FILTER_SIZE) {
+    ++clock.sampleCount;
+  }
+
+  clock.lastRttUs = rttUs;
+  ++clock.pongsReceived;
+  if (!clock.hasSample) {
+    clock.srttUs = rttUs;
+    clock.rttVarUs = rttUs / 2;
+    clock.hasSample = true;
+  } else {
+    clock.rttVarUs = (clock.rttVarUs * 3 + absDiff(clock.srttUs, rttUs)) / 4;
+    clock.srttUs = (clock.srttUs * 7 + rttUs) / 8;
+  }
+
+  // Queueing delay is rarely the same both ways, so the quickest recent
+  // exchange gives the least skewed offset.
+  const ClockSample *best = &clock.samples[0];
+  for (size_t i = 1; i < clock.sampleCount; ++i) {
+    if (clock.samples[i].rttUs < best->rttUs) {
+      best = &clock.samples[i];
+    }
+  }
+  clock.offsetMs = best->offsetMs;
+}
+
+uint32_t netClockRenderDelayMs(const NetClock &clock, uint32_t sendIntervalMs, uint32_t maxMs) {
+  uint32_t delayMs = sendIntervalMs + (2 * clock.rttVarUs + 999) / 1000;
+  return delayMs < maxMs ? delayMs : maxMs;
+}
+
+uint32_t netClockTimeoutMs(const NetClock &clock, uint32_t baseMs) {
+  if (!clock.hasSample) {
+    return baseMs;
+  }
+  return baseMs + 4 * (clock.srttUs + 4 * clock.rttVarUs) / 1000;
+}
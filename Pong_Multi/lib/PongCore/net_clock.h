@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Round-trip time and clock offset between the two devices, measured with
+// NTP-style ping/pong exchanges. Each side stamps a ping with its own clock,
+// the peer stamps when it received it and how long it held it, and the sender
+// works out the round trip and where the peer's millis() stands relative to
+// its own.
+
+constexpr size_t NET_CLOCK_FILTER_SIZE = 8;
+
+struct ClockSample {
+  uint32_t rttUs = 0;
+  int32_t offsetMs = 0;
+};
+
+struct NetClock {
+  uint32_t srttUs = 0;    // smoothed round trip (RFC 6298 weights)
+  uint32_t rttVarUs = 0;  // smoothed deviation, reported as jitter
+  uint32_t lastRttUs = 0;
+  int32_t offsetMs = 0;   // peer millis() minus local millis()
+  bool hasSample = false;
+  ClockSample samples[NET_CLOCK_FILTER_SIZE];
+  size_t nextSample = 0;
+  size_t sampleCount = 0;
+  uint32_t pingsSent = 0;
+  uint32_t pongsReceived = 0;
+};
+
+void netClockReset(NetClock &clock);
+
+// Folds in one exchange. origin* are the local stamps the ping carried,
+// peerReceiveMs and peerHoldUs come back in the pong, nowUs is the local
+// micros() when the pong arrived.
+void netClockAddSample(NetClock &clock, uint32_t originUs, uint32_t originMs, uint32_t peerReceiveMs,
+                       uint32_t peerHoldUs, uint32_t nowUs);
+
+// Peer's millis() at local time localMs.
+inline uint32_t netClockPeerTimeMs(const NetClock &clock, uint32_t localMs) {
+  return localMs + static_cast<uint32_t>(clock.offsetMs);
+}
+
+// How far behind the newest state a client should draw so a packet sent every
+// sendIntervalMs is normally there in time: one interval plus twice the jitter.
+uint32_t netClockRenderDelayMs(const NetClock &clock, uint32_t sendIntervalMs, uint32_t maxMs);
+
+// Silence after which the peer counts as gone: baseMs plus a margin that grows
+// with a slow or noisy link.
+uint32_t netClockTimeoutMs(const NetClock &clock, uint32_t baseMs);
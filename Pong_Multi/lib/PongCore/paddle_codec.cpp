@@ -0,0 +1,141 @@
+#include "paddle_codec.h"
+
+#include "bit_packer.h"
+#include "protocol.h"
+#include "state_codec.h"
+
+namespace {
+
+constexpr uint8_t PADDLE_BITS = 13;  // signed, +-256 px
+constexpr uint8_t COUNT_BITS = 5;
+constexpr uint32_t MOVE_SLACK_MS = 4;  // client frame times and millis() stamps differ a little
+
+static_assert(PADDLE_PACKET_MAX <= MAX_DATAGRAM_SIZE, "Paddle packets fit the receive buffer");
+static_assert(PADDLE_PACKET_INPUTS < (1u << COUNT_BITS), "Input count fits its field");
+
+// The most a paddle can move in elapsedMs, in 1/16 px.
+int32_t maxMove(uint32_t elapsedMs) {
+  return quantizePosition(PADDLE_SPEED * static_cast<float>(elapsedMs + MOVE_SLACK_MS) / 1000.0f) + 1;
+}
+
+}  // namespace
+
+void paddleMessageFill(PaddleMessage &message, const PaddlePredictor &predictor, uint32_t ackFrameId,
+                       uint16_t previousNewestSeq, size_t maxInputs) {
+  if (maxInputs > PADDLE_PACKET_INPUTS) {
+    maxInputs = PADDLE_PACKET_INPUTS;
+  }
+  size_t count = predictor.count < maxInputs ? predictor.count : maxInputs;
+  size_t skip = predictor.count - count;
+  message.ackFrameId = ackFrameId;
+  message.newestSeq = predictor.lastSeq;
+  message.paddleY = quantizePosition(simToFloat(predictor.predictedY));
+  message.inputCount = static_cast<uint8_t>(count);
+  message.freshCount = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const PaddleInput &input = predictor.inputs[(predictor.head + skip + i) % PADDLE_INPUT_HISTORY];
+    message.inputs[i].dy = quantizePosition(simToFloat(input.dy));
+    message.inputs[i].timeMs = static_cast<uint16_t>(input.timeMs);
+    if (inputSeqNewer(input.seq, previousNewestSeq)) {
+      ++message.freshCount;
+    }
+  }
+}
+
+size_t paddleEncode(const PaddleMessage &message, uint8_t *out, size_t capacity) {
+  BitWriter writer = bitWriter(out, capacity);
+  bitWrite(writer, static_cast<uint8_t>(PacketType::Paddle), 8);
+  bitWrite(writer, message.ackFrameId, 32);
+  bitWrite(writer, message.newestSeq, 16);
+  bitWriteSigned(writer, message.paddleY, PADDLE_BITS);
+  bitWrite(writer, message.inputCount, COUNT_BITS);
+  bitWrite(writer, message.freshCount, COUNT_BITS);
+  for (uint8_t i = 0; i < message.inputCount; ++i) {
+    const PaddleInputSample &input = message.inputs[i];
+    if (i == 0) {
+      bitWrite(writer, input.timeMs, 16);
+    } else {
+      bitWriteVar(writer, static_cast<uint16_t>(input.timeMs - message.inputs[i - 1].timeMs));
+    }
+    bitWriteSignedVar(writer, input.dy);
+  }
+  return writer.overflow ? 0 : bitWriterBytes(writer);
+}
+
+bool paddleDecode(const uint8_t *data, size_t length, PaddleMessage &out) {
+  BitReader reader = bitReader(data, length);
+  if (bitRead(reader, 8) != static_cast<uint8_t>(PacketType::Paddle)) {
+    return false;
+  }
+  out.ackFrameId = bitRead(reader, 32);
+  out.newestSeq = static_cast<uint16_t>(bitRead(reader, 16));
+  out.paddleY = bitReadSigned(reader, PADDLE_BITS);
+  out.inputCount = static_cast<uint8_t>(bitRead(reader, COUNT_BITS));
+  out.freshCount = static_cast<uint8_t>(bitRead(reader, COUNT_BITS));
+  if (out.inputCount > PADDLE_PACKET_INPUTS || out.freshCount > out.inputCount) {
+    return false;
+  }
+  for (uint8_t i = 0; i < out.inputCount; ++i) {
+    PaddleInputSample &input = out.inputs[i];
+    if (i == 0) {
+      input.timeMs = static_cast<uint16_t>(bitRead(reader, 16));
+    } else {
+      input.timeMs = static_cast<uint16_t>(out.inputs[i - 1].timeMs + bitReadVar(reader));
+    }
+    input.dy = bitReadSignedVar(reader);
+  }
+  return !reader.overflow;
+}
+
+void paddleReceiverReset(PaddleReceiver &receiver) {
+  receiver.valid = false;
+  receiver.timed = false;
+  receiver.appliedSeq = 0;
+}
+
+bool paddleReceiverApply(PaddleReceiver &receiver, const PaddleMessage &message, SimScalar &paddleY) {
+  if (receiver.valid && !inputSeqNewer(message.newestSeq, receiver.appliedSeq)) {
+    return false;
+  }
+  uint16_t firstSeq = static_cast<uint16_t>(message.newestSeq - message.inputCount + 1);
+  uint16_t wantedSeq = static_cast<uint16_t>(receiver.appliedSeq + 1);
+  if (!receiver.valid || inputSeqNewer(firstSeq, wantedSeq)) {
+    if (receiver.valid) {
+      receiver.stats.inputsLost += static_cast<uint16_t>(firstSeq - wantedSeq);
+      ++receiver.stats.resyncs;
+    }
+    paddleY = simClampPaddleY(SimScalar(dequantizePosition(message.paddleY)));
+    receiver.valid = true;
+    receiver.appliedSeq = message.newestSeq;
+    if (message.inputCount > 0) {
+      receiver.appliedTimeMs = message.inputs[message.inputCount - 1].timeMs;
+      receiver.timed = true;
+    }
+    return true;
+  }
+
+  for (uint8_t i = 0; i < message.inputCount; ++i) {
+    uint16_t seq = static_cast<uint16_t>(firstSeq + i);
+    if (!inputSeqNewer(seq, receiver.appliedSeq)) {
+      continue;
+    }
+    const PaddleInputSample &input = message.inputs[i];
+    int32_t dy = input.dy;
+    if (receiver.timed) {
+      int32_t limit = maxMove(static_cast<uint16_t>(input.timeMs - receiver.appliedTimeMs));
+      if (dy > limit || dy < -limit) {
+        dy = dy > 0 ? limit : -limit;
+        ++receiver.stats.clamped;
+      }
+    }
+    paddleY = simClampPaddleY(paddleY + SimScalar(dequantizePosition(dy)));
+    receiver.appliedSeq = seq;
+    receiver.appliedTimeMs = input.timeMs;
+    receiver.timed = true;
+    ++receiver.stats.inputsApplied;
+    if (i + message.freshCount < message.inputCount) {
+      ++receiver.stats.inputsRecovered;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "paddle_predictor.h"
+#include "pong_sim.h"
+
+// Client paddle on the wire. Besides the paddle position every packet repeats
+// the newest inputs the host has not acknowledged yet, each with its move in
+// 1/16 px and the client's millisecond stamp, as small deltas. The host
+// replays the ones it has not seen, so a run of lost packets shorter than the
+// repeated history costs no movement, and it checks every move against the
+// time it took. Only a gap longer than that snaps to the reported position.
+
+constexpr size_t PADDLE_PACKET_INPUTS = 16;  // ~250 ms of held key at 60 fps
+constexpr size_t PADDLE_PACKET_MAX = 96;     // 16 worst-case inputs still fit
+
+struct PaddleInputSample {
+  int32_t dy = 0;         // 1/16 px
+  uint16_t timeMs = 0;    // low 16 bits of the client's millis()
+};
+
+struct PaddleMessage {
+  uint32_t ackFrameId = 0;  // newest state frame the client holds (0: none yet)
+  uint16_t newestSeq = 0;   // last input folded into paddleY
+  int32_t paddleY = 0;      // 1/16 px
+  uint8_t freshCount = 0;   // trailing inputs that the previous packet did not carry
+  uint8_t inputCount = 0;
+  PaddleInputSample inputs[PADDLE_PACKET_INPUTS];  // oldest first, ending at newestSeq
+};
+
+// Fills message from the predictor's unacknowledged inputs, at most
+// maxInputs of the newest. previousNewestSeq is what the last packet sent.
+void paddleMessageFill(PaddleMessage &message, const PaddlePredictor &predictor, uint32_t ackFrameId,
+                       uint16_t previousNewestSeq, size_t maxInputs = PADDLE_PACKET_INPUTS);
+
+// Writes a PacketType::Paddle datagram and returns its length, or 0 if it did not fit.
+size_t paddleEncode(const PaddleMessage &message, uint8_t *out, size_t capacity);
+bool paddleDecode(const uint8_t *data, size_t length, PaddleMessage &out);
+
+struct PaddleReceiveStats {
+  uint32_t inputsApplied = 0;
+  uint32_t inputsRecovered = 0;  // applied from a repeat after the packet that first carried them was lost
+  uint32_t inputsLost = 0;       // fell out of the repeated history before arriving
+  uint32_t resyncs = 0;          // snaps to the reported position after such a gap
+  uint32_t clamped = 0;          // moves faster than PADDLE_SPEED allows for their time
+};
+
+// Host side: the last input applied to the client paddle.
+struct PaddleReceiver {
+  bool valid = false;
+  bool timed = false;  // appliedTimeMs is known
+  uint16_t appliedSeq = 0;
+  uint16_t appliedTimeMs = 0;
+  PaddleReceiveStats stats;
+};
+
+// Forgets the applied input so the next packet places the paddle. Stats stay.
+// State acknowledges input 0 until then: a client that restarted counts from
+// zero again and must not see the previous process's inputs as acknowledged.
+void paddleReceiverReset(PaddleReceiver &receiver);
+
+// Applies the inputs of message the host has not seen to paddleY. Returns
+// false for a packet no newer than what was already applied.
+bool paddleReceiverApply(PaddleReceiver &receiver, const PaddleMessage &message, SimScalar &paddleY);
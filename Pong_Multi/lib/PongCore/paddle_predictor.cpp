@@ -0,0 +1,47 @@
+#include "paddle_predictor.h"
+
+#include "state_codec.h"
+
+void predictorReset(PaddlePredictor &predictor, SimScalar y) {
+  predictor.head = 0;
+  predictor.count = 0;
+  predictor.ackedSeq = predictor.lastSeq;
+  predictor.predictedY = simClampPaddleY(y);
+}
+
+uint16_t predictorApply(PaddlePredictor &predictor, SimScalar dy, uint32_t nowMs) {
+  dy = SimScalar(dequantizePosition(quantizePosition(simToFloat(dy))));
+  if (predictor.count == PADDLE_INPUT_HISTORY) {
+    predictor.head = (predictor.head + 1) % PADDLE_INPUT_HISTORY;
+    --predictor.count;
+    ++predictor.overflows;
+  }
+  PaddleInput &input = predictor.inputs[(predictor.head + predictor.count) % PADDLE_INPUT_HISTORY];
+  input.seq = ++predictor.lastSeq;
+  input.dy = dy;
+  input.timeMs = nowMs;
+  ++predictor.count;
+  predictor.predictedY = simClampPaddleY(predictor.predictedY + dy);
+  return input.seq;
+}
+
+void predictorReconcile(PaddlePredictor &predictor, uint16_t ackSeq, SimScalar authoritativeY) {
+  if (inputSeqNewer(predictor.ackedSeq, ackSeq)) {
+    return;  // an older acknowledgement than one already applied
+  }
+  predictor.ackedSeq = ackSeq;
+  while (predictor.count > 0 && !inputSeqNewer(predictor.inputs[predictor.head].seq, ackSeq)) {
+    predictor.head = (predictor.head + 1) % PADDLE_INPUT_HISTORY;
+    --predictor.count;
+  }
+
+  SimScalar y = simClampPaddleY(authoritativeY);
+  for (size_t i = 0; i < predictor.count; ++i) {
+    y = simClampPaddleY(y + predictor.inputs[(predictor.head + i) % PADDLE_INPUT_HISTORY].dy);
+  }
+  if (simAbs(y - predictor.predictedY) <= SimScalar(PADDLE_RECONCILE_TOLERANCE)) {
+    return;
+  }
+  ++predictor.corrections;
+  predictor.predictedY = y;
+}
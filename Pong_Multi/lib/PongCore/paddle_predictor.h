@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "pong_sim.h"
+
+// Client-side prediction for the local paddle. Every local move is applied at
+// once and remembered under a sequence number; when the host acknowledges a
+// sequence number together with its paddle position, the moves it has not
+// seen yet are replayed on top of that position. Local movement then feels
+// instant at any RTT, and only a real disagreement moves the paddle.
+
+constexpr size_t PADDLE_INPUT_HISTORY = 64;
+// State packets carry positions in 1/16 px steps; a replayed position within
+// that of the prediction is rounding, not a disagreement.
+constexpr float PADDLE_RECONCILE_TOLERANCE = 1.0f / 16.0f;
+
+struct PaddleInput {
+  uint16_t seq = 0;
+  SimScalar dy = 0.0f;
+  uint32_t timeMs = 0;  // when it was applied, for the host's speed check
+};
+
+struct PaddlePredictor {
+  PaddleInput inputs[PADDLE_INPUT_HISTORY];
+  size_t head = 0;  // slot of the oldest unacknowledged input
+  size_t count = 0;
+  uint16_t lastSeq = 0;  // keeps counting across matches so late packets stay "old"
+  uint16_t ackedSeq = 0;
+  SimScalar predictedY = SCREEN_HEIGHT * 0.5f;
+  uint32_t corrections = 0;  // reconciliations that moved the paddle
+  uint32_t overflows = 0;    // inputs dropped unacknowledged because the history was full
+};
+
+// Clears pending inputs and puts the paddle at y. The sequence counter keeps going.
+void predictorReset(PaddlePredictor &predictor, SimScalar y);
+
+// Applies a local move and returns the sequence number it was recorded under.
+// dy is rounded to the 1/16 px paddle packets carry, so the host adds up
+// exactly the same moves.
+uint16_t predictorApply(PaddlePredictor &predictor, SimScalar dy, uint32_t nowMs);
+
+// Takes the host's position after it processed ackSeq and replays newer inputs.
+void predictorReconcile(PaddlePredictor &predictor, uint16_t ackSeq, SimScalar authoritativeY);
+
+// Wraparound-safe "a is later than b" for 16-bit sequence numbers.
+inline bool inputSeqNewer(uint16_t a, uint16_t b) {
+  return static_cast<int16_t>(static_cast<uint16_t>(a - b)) > 0;
+}
@@ -0,0 +1,430 @@
+#include "pong_sim.h"
+
+namespace {
+
+uint32_t nextRandom(SimState &state) {
+  // xorshift32: tiny, portable and identical on every target.
+  uint32_t x = state.rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  state.rng = x;
+  return x;
+}
+
+int32_t randomRange(SimState &state, int32_t minValue, int32_t maxValue) {
+  uint32_t span = static_cast<uint32_t>(maxValue - minValue + 1);
+  return minValue + static_cast<int32_t>(nextRandom(state) % span);
+}
+
+// Simulation-typed copies of the gameplay constants; in fixed-point builds
+// the float values are converted once, at compile time.
+constexpr SimScalar ZERO = 0.0f;
+constexpr SimScalar ONE = 1.0f;
+constexpr SimScalar TWO = 2.0f;
+constexpr SimScalar RADIUS = BALL_RADIUS;
+constexpr SimScalar FIELD_WIDTH = static_cast<float>(SCREEN_WIDTH);
+constexpr SimScalar FIELD_HEIGHT = static_cast<float>(SCREEN_HEIGHT);
+constexpr SimScalar HALF_HEIGHT = PADDLE_HALF_HEIGHT;
+constexpr SimScalar HOST_LEFT = HOST_PADDLE_X;
+constexpr SimScalar HOST_RIGHT = HOST_PADDLE_X + PADDLE_WIDTH;
+constexpr SimScalar CLIENT_LEFT = CLIENT_PADDLE_X;
+constexpr SimScalar CLIENT_RIGHT = CLIENT_PADDLE_X + PADDLE_WIDTH;
+constexpr SimScalar PADDLE_STEP = PADDLE_SPEED * SIM_DT;
+constexpr SimScalar TICK_DT = SIM_DT;
+constexpr SimScalar SERVE_SPEED = BALL_SPEED_INITIAL;
+constexpr SimScalar SERVE_ARC = 0.6f;
+constexpr SimScalar SPEED_GROWTH = BALL_SPEED_GROWTH;
+constexpr SimScalar SPEED_MAX = BALL_SPEED_MAX;
+constexpr SimScalar SPIN = PADDLE_SPIN;
+
+SimScalar clampScalar(SimScalar value, SimScalar minValue, SimScalar maxValue) {
+  if (value < minValue) {
+    return minValue;
+  }
+  if (value > maxValue) {
+    return maxValue;
+  }
+  return value;
+}
+
+// Earliest ball contact found while sweeping the rest of a tick. time is the
+// fraction (0..1) of the swept displacement covered before touching.
+struct Contact {
+  SimScalar time = 0.0f;
+  SimScalar normalX = 0.0f;
+  SimScalar normalY = 0.0f;
+  int8_t paddle = 0;  // -1 host paddle, +1 client paddle, 0 wall
+};
+
+// Swept circle against an axis-aligned box: sweeps the ball's centre along the
+// displacement (dx, dy) against the box grown by BALL_RADIUS (rounded at the
+// corners). Finds the exact point of impact for any speed; a contact only
+// counts while the ball is moving into the surface. Everything is expressed in
+// pixels and fractions of the step, which keeps Q16.16 intermediates in range.
+bool sweepBallAgainstBox(SimScalar x, SimScalar y, SimScalar dx, SimScalar dy, SimScalar minX, SimScalar minY,
+                         SimScalar maxX, SimScalar maxY, Contact &contact) {
+  // Already touching or overlapping (a paddle moved into the ball, or rounding
+  // left it a hair inside): resolve at once along the shortest way out.
+  SimScalar offX = x - clampScalar(x, minX, maxX);
+  SimScalar offY = y - clampScalar(y, minY, maxY);
+  SimScalar dist2 = offX * offX + offY * offY;
+  if (dist2 <= RADIUS * RADIUS) {
+    SimScalar nx = ZERO;
+    SimScalar ny = ZERO;
+    SimScalar dist = simSqrt(dist2);
+    if (dist > ZERO) {
+      nx = offX / dist;
+      ny = offY / dist;
+    } else {
+      // Centre inside the box: leave through the nearest face.
+      SimScalar left = x - minX;
+      SimScalar right = maxX - x;
+      SimScalar top = y - minY;
+      SimScalar bottom = maxY - y;
+      SimScalar best = left;
+      nx = -ONE;
+      if (right < best) {
+        best = right;
+        nx = ONE;
+      }
+      if (top < best) {
+        best = top;
+        nx = ZERO;
+        ny = -ONE;
+      }
+      if (bottom < best) {
+        nx = ZERO;
+        ny = ONE;
+      }
+    }
+    if (dx * nx + dy * ny >= ZERO) {
+      return false;
+    }
+    contact.time = ZERO;
+    contact.normalX = nx;
+    contact.normalY = ny;
+    return true;
+  }
+
+  // Slab test against the box grown by the radius. An axis without movement
+  // constrains nothing as long as the ball already sits inside that slab.
+  bool movesX = dx != ZERO;
+  bool movesY = dy != ZERO;
+  SimScalar enterX = ZERO;
+  SimScalar exitX = ONE;
+  if (!movesX) {
+    if (x < minX - RADIUS || x > maxX + RADIUS) {
+      return false;
+    }
+  } else {
+    SimScalar t0 = (minX - RADIUS - x) / dx;
+    SimScalar t1 = (maxX + RADIUS - x) / dx;
+    enterX = t0 < t1 ? t0 : t1;
+    exitX = t0 < t1 ? t1 : t0;
+  }
+  SimScalar enterY = ZERO;
+  SimScalar exitY = ONE;
+  if (!movesY) {
+    if (y < minY - RADIUS || y > maxY + RADIUS) {
+      return false;
+    }
+  } else {
+    SimScalar t0 = (minY - RADIUS - y) / dy;
+    SimScalar t1 = (maxY + RADIUS - y) / dy;
+    enterY = t0 < t1 ? t0 : t1;
+    exitY = t0 < t1 ? t1 : t0;
+  }
+  if (!movesX && !movesY) {
+    return false;
+  }
+  bool enterAlongX = movesX && (!movesY || enterX > enterY);
+  SimScalar enter = enterAlongX ? enterX : enterY;
+  SimScalar exit = !movesX ? exitY : (!movesY || exitX < exitY ? exitX : exitY);
+  // exit == 0 is a ball leaving the face it rests on: Q16.16 division rounds
+  // the hair-negative exit time of a ball just bounced off it up to zero.
+  if (enter > exit || exit <= ZERO || enter > ONE) {
+    return false;
+  }
+
+  SimScalar entryTime = enter > ZERO ? enter : ZERO;
+  SimScalar px = x + dx * entryTime;
+  SimScalar py = y + dy * entryTime;
+  bool beyondX = px < minX || px > maxX;
+  bool beyondY = py < minY || py > maxY;
+
+  if (beyondX && beyondY) {
+    // Entered the grown box through a corner square: the real surface there is
+    // a quarter circle around the box corner. Solve from the entry point along
+    // the unit direction so the quadratic only sees a few pixels.
+    SimScalar cornerX = px < minX ? minX : maxX;
+    SimScalar cornerY = py < minY ? minY : maxY;
+    SimScalar length = simSqrt(dx * dx + dy * dy);
+    if (length <= ZERO) {
+      return false;
+    }
+    SimScalar ux = dx / length;
+    SimScalar uy = dy / length;
+    SimScalar ox = px - cornerX;
+    SimScalar oy = py - cornerY;
+    SimScalar halfB = ox * ux + oy * uy;
+    SimScalar c = ox * ox + oy * oy - RADIUS * RADIUS;
+    SimScalar disc = halfB * halfB - c;
+    if (disc < ZERO) {
+      return false;
+    }
+    SimScalar distance = -halfB - simSqrt(disc);
+    if (distance < ZERO) {
+      distance = ZERO;
+    }
+    SimScalar t = entryTime + distance / length;
+    if (t > ONE) {
+      return false;
+    }
+    contact.time = t;
+    contact.normalX = (x + dx * t - cornerX) / RADIUS;
+    contact.normalY = (y + dy * t - cornerY) / RADIUS;
+    return dx * contact.normalX + dy * contact.normalY < ZERO;
+  }
+
+  contact.time = entryTime;
+  if (enterAlongX) {
+    contact.normalX = dx > ZERO ? -ONE : ONE;
+    contact.normalY = ZERO;
+  } else {
+    contact.normalX = ZERO;
+    contact.normalY = dy > ZERO ? -ONE : ONE;
+  }
+  return true;
+}
+
+void considerContact(bool hit, const Contact &candidate, int8_t paddle, Contact &best, bool &found) {
+  if (hit && (!found || candidate.time < best.time)) {
+    best = candidate;
+    best.paddle = paddle;
+    found = true;
+  }
+}
+
+void reflectBall(SimState &state, const Contact &contact) {
+  SimScalar along = state.ballVX * contact.normalX + state.ballVY * contact.normalY;
+  state.ballVX -= TWO * along * contact.normalX;
+  state.ballVY -= TWO * along * contact.normalY;
+}
+
+void bounceOffPaddle(SimState &state, const Contact &contact) {
+  SimScalar paddleY = contact.paddle < 0 ? state.hostPaddleY : state.clientPaddleY;
+  SimScalar facing = contact.paddle < 0 ? ONE : -ONE;  // direction the paddle's front face points
+  bool frontFace = contact.normalX * facing > ZERO &&
+                   simAbs(contact.normalX) >= simAbs(contact.normalY);
+  if (frontFace) {
+    SimScalar speedX = simAbs(state.ballVX) * SPEED_GROWTH;
+    state.ballVX = facing * (speedX < SPEED_MAX ? speedX : SPEED_MAX);
+    SimScalar offset = clampScalar((state.ballY - paddleY) / HALF_HEIGHT, -ONE, ONE);
+    state.ballVY = clampScalar(state.ballVY + offset * SPIN, -SPEED_MAX, SPEED_MAX);
+    // A corner hit can leave the spin pointing back into the paddle; drop that
+    // part so the same contact cannot trigger again at t = 0.
+    if (state.ballVX * contact.normalX + state.ballVY * contact.normalY < ZERO) {
+      reflectBall(state, contact);
+    }
+    return;
+  }
+  // Top, bottom or back edge: plain reflection, no speed-up.
+  reflectBall(state, contact);
+}
+
+// Moves the ball through one tick, stopping at every wall or paddle contact on
+// the way (wall then paddle, paddle then wall, ...) so no speed can carry it
+// through a paddle.
+void moveBallSwept(SimState &state, uint8_t &events) {
+  constexpr int MAX_CONTACTS_PER_TICK = 8;
+  SimScalar remaining = TICK_DT;
+
+  for (int i = 0; i < MAX_CONTACTS_PER_TICK && remaining > ZERO; ++i) {
+    SimScalar dx = state.ballVX * remaining;
+    SimScalar dy = state.ballVY * remaining;
+    Contact best;
+    bool found = false;
+
+    if (dy < ZERO) {
+      Contact wall;
+      wall.time = clampScalar((RADIUS - state.ballY) / dy, ZERO, ONE);
+      wall.normalY = ONE;
+      considerContact(state.ballY + dy <= RADIUS, wall, 0, best, found);
+    } else if (dy > ZERO) {
+      Contact wall;
+      wall.time = clampScalar((FIELD_HEIGHT - RADIUS - state.ballY) / dy, ZERO, ONE);
+      wall.normalY = -ONE;
+      considerContact(state.ballY + dy >= FIELD_HEIGHT - RADIUS, wall, 0, best, found);
+    }
+
+    Contact hostContact;
+    bool hostHit = sweepBallAgainstBox(state.ballX, state.ballY, dx, dy, HOST_LEFT, state.hostPaddleY - HALF_HEIGHT,
+                                       HOST_RIGHT, state.hostPaddleY + HALF_HEIGHT, hostContact);
+    considerContact(hostHit, hostContact, -1, best, found);
+
+    Contact clientContact;
+    bool clientHit = sweepBallAgainstBox(state.ballX, state.ballY, dx, dy, CLIENT_LEFT,
+                                         state.clientPaddleY - HALF_HEIGHT, CLIENT_RIGHT,
+                                         state.clientPaddleY + HALF_HEIGHT, clientContact);
+    considerContact(clientHit, clientContact, 1, best, found);
+
+    if (!found) {
+      state.ballX += dx;
+      state.ballY += dy;
+      break;
+    }
+    state.ballX += dx * best.time;
+    state.ballY += dy * best.time;
+    remaining -= remaining * best.time;
+
+    if (best.paddle == 0) {
+      state.ballY = best.normalY > ZERO ? RADIUS : FIELD_HEIGHT - RADIUS;
+      state.ballVY = -state.ballVY;
+      events |= SIM_EVENT_WALL_BOUNCE;
+    } else {
+      bounceOffPaddle(state, best);
+      events |= SIM_EVENT_PADDLE_HIT;
+    }
+  }
+}
+
+void hashWord(uint32_t &hash, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    hash ^= (value >> (i * 8)) & 0xFFu;
+    hash *= 16777619u;
+  }
+}
+
+}  // namespace
+
+void simSeed(SimState &state, uint32_t seed) {
+  state.rng = seed != 0 ? seed : 0x9E3779B9u;
+}
+
+void simCenterBall(SimState &state) {
+  state.ballX = FIELD_WIDTH * 0.5f;
+  state.ballY = FIELD_HEIGHT * 0.5f;
+  state.ballVX = ZERO;
+  state.ballVY = ZERO;
+}
+
+void simResetPaddles(SimState &state) {
+  state.hostPaddleY = FIELD_HEIGHT * 0.5f;
+  state.clientPaddleY = FIELD_HEIGHT * 0.5f;
+}
+
+void simResetMatch(SimState &state) {
+  state.hostScore = 0;
+  state.clientScore = 0;
+  state.gameOver = false;
+  state.matchActive = false;
+  state.waitingForServe = false;
+  state.serveTicksLeft = 0;
+  state.tick = 0;
+  simResetPaddles(state);
+  simCenterBall(state);
+}
+
+void simPrepareServe(SimState &state, int direction) {
+  state.serveDirection = static_cast<int8_t>(direction < 0 ? -1 : 1);
+  state.waitingForServe = true;
+  state.matchActive = true;
+  state.serveTicksLeft = static_cast<uint16_t>(SERVE_DELAY_TICKS);
+  simCenterBall(state);
+}
+
+void simLaunchBall(SimState &state) {
+  state.waitingForServe = false;
+  state.serveTicksLeft = 0;
+  state.ballVX = SERVE_SPEED * SimScalar(static_cast<int>(state.serveDirection));
+  SimScalar arc = SimScalar(static_cast<int>(randomRange(state, -60, 60))) / SimScalar(100);  // -0.60 .. 0.60
+  state.ballVY = SERVE_SPEED * SERVE_ARC * arc;
+}
+
+SimScalar simClampPaddleY(SimScalar paddleY) {
+  return clampScalar(paddleY, HALF_HEIGHT, FIELD_HEIGHT - HALF_HEIGHT);
+}
+
+uint8_t simStep(SimState &state, const SimInput &input) {
+  if (!state.matchActive && !state.waitingForServe) {
+    return 0;
+  }
+
+  uint8_t events = 0;
+  ++state.tick;
+
+  state.hostPaddleY = simClampPaddleY(state.hostPaddleY + SimScalar(static_cast<int>(input.hostPaddleDir)) * PADDLE_STEP);
+  state.clientPaddleY =
+      simClampPaddleY(state.clientPaddleY + SimScalar(static_cast<int>(input.clientPaddleDir)) * PADDLE_STEP);
+
+  if (state.waitingForServe) {
+    if (state.serveTicksLeft > 0) {
+      --state.serveTicksLeft;
+    }
+    if (state.serveTicksLeft > 0) {
+      return events;
+    }
+    simLaunchBall(state);
+    events |= SIM_EVENT_SERVE;
+  }
+
+  moveBallSwept(state, events);
+
+  // Scoring
+  if (state.ballX + RADIUS < ZERO) {
+    ++state.clientScore;
+    events |= SIM_EVENT_CLIENT_SCORED;
+    if (state.clientScore >= MAX_SCORE) {
+      state.gameOver = true;
+      state.matchActive = false;
+      state.waitingForServe = false;
+      simCenterBall(state);
+      return events | SIM_EVENT_GAME_OVER;
+    }
+    simPrepareServe(state, 1);
+  } else if (state.ballX - RADIUS > FIELD_WIDTH) {
+    ++state.hostScore;
+    events |= SIM_EVENT_HOST_SCORED;
+    if (state.hostScore >= MAX_SCORE) {
+      state.gameOver = true;
+      state.matchActive = false;
+      state.waitingForServe = false;
+      simCenterBall(state);
+      return events | SIM_EVENT_GAME_OVER;
+    }
+    simPrepareServe(state, -1);
+  }
+
+  return events;
+}
+
+uint32_t simStateHash(const SimState &state) {
+  uint32_t hash = 2166136261u;
+  hashWord(hash, simScalarBits(state.ballX));
+  hashWord(hash, simScalarBits(state.ballY));
+  hashWord(hash, simScalarBits(state.ballVX));
+  hashWord(hash, simScalarBits(state.ballVY));
+  hashWord(hash, simScalarBits(state.hostPaddleY));
+  hashWord(hash, simScalarBits(state.clientPaddleY));
+  hashWord(hash, state.tick);
+  hashWord(hash, state.rng);
+  hashWord(hash, state.serveTicksLeft);
+  hashWord(hash, static_cast<uint32_t>(state.hostScore) | (static_cast<uint32_t>(state.clientScore) << 8) |
+                     (static_cast<uint32_t>(static_cast<uint8_t>(state.serveDirection)) << 16));
+  hashWord(hash, (state.matchActive ? 1u : 0u) | (state.waitingForServe ? 2u : 0u) | (state.gameOver ? 4u : 0u));
+  return hash;
+}
+
+uint32_t simClockAdvance(SimClock &clock, uint32_t elapsedUs) {
+  constexpr uint64_t TICK_UNITS = 1000000ull;
+  clock.accumulator += static_cast<uint64_t>(elapsedUs) * SIM_TICK_HZ;
+  uint32_t ticks = static_cast<uint32_t>(clock.accumulator / TICK_UNITS);
+  clock.accumulator -= static_cast<uint64_t>(ticks) * TICK_UNITS;
+  if (ticks > clock.maxTicksPerUpdate) {
+    // A stall longer than the cap is skipped rather than replayed in a burst.
+    clock.droppedTicks += ticks - clock.maxTicksPerUpdate;
+    ticks = clock.maxTicksPerUpdate;
+  }
+  return ticks;
+}
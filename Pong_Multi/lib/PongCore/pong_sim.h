@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "fixed16.h"
+
+// Hardware-free Pong simulation shared by the Cardputer firmware and Linux
+// builds. Everything advances in fixed SIM_TICK_HZ steps so the same seed and
+// input sequence always produce the same state.
+//
+// Build with -DPONG_SIM_FIXED_POINT=1 to run it on Q16.16 numbers instead of
+// floats: two devices in lockstep then stay bit-identical even across
+// different compilers or CPU architectures, and lockstep sync packets carry
+// the raw fixed-point values. Snapshot State packets do not: state_codec.h
+// quantizes them to 1/16 px in either build, since that client only draws and
+// predicts from the host's state and never has to reproduce it.
+
+// -----------------------------------------------------------------------------
+// Gameplay configuration -----------------------------------------------------
+
+constexpr int SCREEN_WIDTH = 240;
+constexpr int SCREEN_HEIGHT = 135;
+
+constexpr float PADDLE_WIDTH = 8.0f;
+constexpr float PADDLE_HEIGHT = 34.0f;
+constexpr float PADDLE_HALF_HEIGHT = PADDLE_HEIGHT * 0.5f;
+constexpr float HOST_PADDLE_X = 16.0f;
+constexpr float CLIENT_PADDLE_X = SCREEN_WIDTH - HOST_PADDLE_X - PADDLE_WIDTH;
+constexpr float PADDLE_SPEED = 170.0f;  // pixels per second
+
+constexpr float BALL_RADIUS = 5.0f;
+constexpr float BALL_SPEED_INITIAL = 170.0f;
+constexpr float BALL_SPEED_GROWTH = 1.06f;
+constexpr float BALL_SPEED_MAX = 6000.0f;  // per axis; keeps endless rallies finite, far beyond playable
+constexpr float PADDLE_SPIN = 45.0f;  // vertical speed added at the paddle tips
+constexpr uint8_t MAX_SCORE = 7;
+
+constexpr uint32_t SIM_TICK_HZ = 240;
+constexpr float SIM_DT = 1.0f / static_cast<float>(SIM_TICK_HZ);
+constexpr uint32_t SERVE_DELAY_MS = 1300;
+constexpr uint32_t SERVE_DELAY_TICKS = SERVE_DELAY_MS * SIM_TICK_HZ / 1000;
+
+// -----------------------------------------------------------------------------
+// Numeric representation -----------------------------------------------------
+
+#ifndef PONG_SIM_FIXED_POINT
+#define PONG_SIM_FIXED_POINT 0
+#endif
+
+#if PONG_SIM_FIXED_POINT
+using SimScalar = Fixed16;
+using SimWire = int32_t;  // raw Q16.16 in lockstep sync packets
+
+inline float simToFloat(SimScalar value) {
+  return value.toFloat();
+}
+inline SimScalar simAbs(SimScalar value) {
+  return fixedAbs(value);
+}
+inline SimScalar simSqrt(SimScalar value) {
+  return fixedSqrt(value);
+}
+inline SimWire simToWire(SimScalar value) {
+  return value.raw();
+}
+inline SimScalar simFromWire(SimWire value) {
+  return Fixed16::fromRaw(value);
+}
+inline uint32_t simScalarBits(SimScalar value) {
+  return static_cast<uint32_t>(value.raw());
+}
+#else
+using SimScalar = float;
+using SimWire = float;
+
+inline float simToFloat(SimScalar value) {
+  return value;
+}
+inline SimScalar simAbs(SimScalar value) {
+  return fabsf(value);
+}
+inline SimScalar simSqrt(SimScalar value) {
+  return sqrtf(value);
+}
+inline SimWire simToWire(SimScalar value) {
+  return value;
+}
+inline SimScalar simFromWire(SimWire value) {
+  return value;
+}
+inline uint32_t simScalarBits(SimScalar value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+#endif
+
+// -----------------------------------------------------------------------------
+// State ----------------------------------------------------------------------
+
+struct SimState {
+  SimScalar ballX = SCREEN_WIDTH * 0.5f;
+  SimScalar ballY = SCREEN_HEIGHT * 0.5f;
+  SimScalar ballVX = 0.0f;
+  SimScalar ballVY = 0.0f;
+  SimScalar hostPaddleY = SCREEN_HEIGHT * 0.5f;
+  SimScalar clientPaddleY = SCREEN_HEIGHT * 0.5f;
+  uint32_t tick = 0;
+  uint32_t rng = 1;
+  uint16_t serveTicksLeft = 0;
+  uint8_t hostScore = 0;
+  uint8_t clientScore = 0;
+  int8_t serveDirection = 1;  // +1 -> to client, -1 -> to host
+  bool matchActive = false;
+  bool waitingForServe = false;
+  bool gameOver = false;
+};
+
+// Paddle directions for one tick: -1 up, 0 still, +1 down.
+struct SimInput {
+  int8_t hostPaddleDir = 0;
+  int8_t clientPaddleDir = 0;
+};
+
+// Bits returned by simStep() describing what happened during the tick.
+constexpr uint8_t SIM_EVENT_SERVE = 0x01;
+constexpr uint8_t SIM_EVENT_WALL_BOUNCE = 0x02;
+constexpr uint8_t SIM_EVENT_PADDLE_HIT = 0x04;
+constexpr uint8_t SIM_EVENT_HOST_SCORED = 0x08;
+constexpr uint8_t SIM_EVENT_CLIENT_SCORED = 0x10;
+constexpr uint8_t SIM_EVENT_GAME_OVER = 0x20;
+
+// -----------------------------------------------------------------------------
+// API ------------------------------------------------------------------------
+
+void simSeed(SimState &state, uint32_t seed);
+void simResetMatch(SimState &state);
+void simResetPaddles(SimState &state);
+void simCenterBall(SimState &state);
+void simPrepareServe(SimState &state, int direction);
+void simLaunchBall(SimState &state);
+SimScalar simClampPaddleY(SimScalar paddleY);
+
+// FNV-1a over every field in a fixed order, for comparing two simulations
+// frame by frame (lockstep desync checks, cross-build comparisons).
+uint32_t simStateHash(const SimState &state);
+
+// Advances the match by exactly one SIM_DT tick and returns SIM_EVENT_* bits.
+uint8_t simStep(SimState &state, const SimInput &input);
+
+// Fixed-timestep driver: feed it elapsed wall time, it reports how many ticks
+// to run. Works in integer microseconds so the tick count never drifts.
+struct SimClock {
+  uint64_t accumulator = 0;  // microseconds * SIM_TICK_HZ
+  uint32_t maxTicksPerUpdate = SIM_TICK_HZ / 10;
+  uint32_t droppedTicks = 0;
+};
+
+uint32_t simClockAdvance(SimClock &clock, uint32_t elapsedUs);
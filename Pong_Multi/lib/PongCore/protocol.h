@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Wire format shared by the firmware and the Linux tools. Packets are packed
+// structs sent as-is; both ends are little-endian. State, paddle and lockstep
+// packets are the exception: they are bit-packed by state_codec.h,
+// paddle_codec.h and lockstep.h. Lobby beacons carry a length-prefixed name
+// (lobby_table.h). Only lockstep sync carries simulation values exactly (raw
+// SimWire); State and Paddle positions are quantized, so a snapshot client is
+// never bit-identical to the host, fixed-point build or not.
+
+constexpr uint16_t UDP_PORT = 41000;
+constexpr uint16_t SPECTATE_PORT = 41001;  // multicast copies of the host's state
+constexpr size_t PLAYER_NAME_MAX_LEN = 16;
+constexpr size_t MAX_DATAGRAM_SIZE = 128;  // receive buffer; anything this big is dropped
+
+enum class PacketType : uint8_t {
+  Join = 1,
+  JoinAck = 2,
+  State = 3,
+  Paddle = 4,
+  Start = 5,
+  Ping = 6,
+  Pong = 7,
+  LockstepInput = 8,
+  LockstepSync = 9,
+  Spectate = 10,
+  SpectateAck = 11,
+  LobbyBeacon = 12,  // variable length, see lobby_table.h
+  LobbyProbe = 13,
+  LobbyProbeAck = 14,
+};
+
+// How a match is kept in step, chosen by the host in the Start packet.
+enum class NetMode : uint8_t {
+  Snapshot = 0,  // host simulates and streams state, client sends its paddle
+  Lockstep = 1,  // both simulate from the seed and trade per-tick inputs (lockstep.h)
+};
+
+constexpr uint8_t FLAG_MATCH_ACTIVE = 0x01;
+constexpr uint8_t FLAG_WAITING_SERVE = 0x02;
+constexpr uint8_t FLAG_GAME_OVER = 0x04;
+constexpr uint8_t FLAG_PAUSED = 0x08;
+
+// Multicast group a host mirrors its match to, picked from the session token
+// so matches on one network rarely share one: 239.255.x.y, which stays on the
+// local network. Host byte order, like NetAddress::ip.
+inline uint32_t spectateGroupIp(uint32_t sessionToken) {
+  uint32_t low = (sessionToken ^ (sessionToken >> 16)) & 0xFFFFu;
+  return 0xEFFF0000u | (low != 0 ? low : 1u);
+}
+
+#pragma pack(push, 1)
+// sessionToken is 0 for a new player. A client that lost the host sends the
+// token from its JoinAck to be put back into the running match, whatever
+// address it comes from now.
+struct JoinPacket {
+  uint8_t type;
+  char name[PLAYER_NAME_MAX_LEN];
+  uint32_t sessionToken;
+};
+
+struct JoinAckPacket {
+  uint8_t type;
+  char name[PLAYER_NAME_MAX_LEN];
+  uint32_t sessionToken;
+  uint8_t resumed;  // 1: back in the match the token belongs to
+};
+
+struct StartPacket {
+  uint8_t type;
+  uint32_t seed;
+  uint8_t netMode;  // NetMode
+};
+
+// Ping stamps are the sender's clocks; Pong echoes them with the time the peer
+// received the ping and how long it held it before answering.
+struct PingPacket {
+  uint8_t type;
+  uint32_t originUs;
+  uint32_t originMs;
+};
+
+struct PongPacket {
+  uint8_t type;
+  uint32_t originUs;
+  uint32_t originMs;
+  uint32_t receiveMs;
+  uint32_t holdUs;
+};
+
+// A spectator asking to watch: broadcast while it looks for a match, then sent
+// to the host every couple of seconds so it keeps mirroring state to the
+// group. snapshot asks for the newest state as well, to start or catch up.
+struct SpectatePacket {
+  uint8_t type;
+  uint8_t snapshot;
+};
+
+// The host's answer: where its state goes and who is playing. A snapshot, if
+// asked for, follows as a State keyframe.
+struct SpectateAckPacket {
+  uint8_t type;
+  uint32_t groupIp;  // host byte order
+  uint16_t groupPort;
+  uint8_t netMode;  // NetMode
+  char hostName[PLAYER_NAME_MAX_LEN];
+  char clientName[PLAYER_NAME_MAX_LEN];
+};
+
+// A browsing client timing a lobby it heard a beacon from; the host echoes
+// the stamp straight back.
+struct LobbyProbePacket {
+  uint8_t type;
+  uint32_t originUs;
+};
+
+struct LobbyProbeAckPacket {
+  uint8_t type;
+  uint32_t originUs;
+  uint32_t lobbyId;
+};
+#pragma pack(pop)
+
+// Copies a received datagram into a packet struct when it is long enough.
+template <typename Packet>
+bool readPacket(const uint8_t *data, int length, Packet &packet) {
+  if (length < static_cast<int>(sizeof(Packet))) {
+    return false;
+  }
+  memcpy(&packet, data, sizeof(Packet));
+  return true;
+}
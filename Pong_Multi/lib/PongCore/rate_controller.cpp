@@ -0,0 +1,106 @@
+#include "rate_controller.h"
+
+namespace {
+
+uint32_t minNonZero(uint32_t a, uint32_t b) {
+  if (a == 0) {
+    return b;
+  }
+  if (b == 0) {
+    return a;
+  }
+  return a < b ? a : b;
+}
+
+void startWindow(RateController &controller, const NetClock &clock, uint32_t nowMs) {
+  controller.windowStartMs = nowMs;
+  controller.windowPingsSent = clock.pingsSent;
+  controller.windowPongsReceived = clock.pongsReceived;
+  controller.windowAckGapMs = 0;
+}
+
+void trackBaseRtt(RateController &controller, const NetClock &clock, uint32_t nowMs) {
+  if (!clock.hasSample) {
+    return;
+  }
+  controller.periodMinRttUs = minNonZero(controller.periodMinRttUs, clock.lastRttUs);
+  controller.baseRttUs = minNonZero(controller.baseRttUs, clock.lastRttUs);
+  if (nowMs - controller.periodStartMs >= RATE_BASE_RTT_PERIOD_MS) {
+    // Let the base follow a route that really got slower, a period late.
+    controller.baseRttUs = controller.periodMinRttUs;
+    controller.periodMinRttUs = 0;
+    controller.periodStartMs = nowMs;
+  }
+}
+
+RateSignal readWindow(RateController &controller, const NetClock &clock) {
+  RateStats &stats = controller.stats;
+  uint32_t sent = clock.pingsSent - controller.windowPingsSent;
+  uint32_t answered = clock.pongsReceived - controller.windowPongsReceived;
+  // The newest ping may still be on its way.
+  uint32_t lost = sent > answered + 1 ? sent - answered - 1 : 0;
+  stats.lossPercent = sent > 0 ? lost * 100 / sent : 0;
+  stats.rttRiseUs = clock.hasSample && controller.baseRttUs != 0 && clock.srttUs > controller.baseRttUs
+                        ? clock.srttUs - controller.baseRttUs
+                        : 0;
+  uint32_t ackLimitMs = clock.srttUs / 500 + RATE_ACK_SLACK_MS;
+
+  if (stats.lossPercent > RATE_LOSS_PERCENT) {
+    return RateSignal::Loss;
+  }
+  if (stats.rttRiseUs > RATE_RTT_RISE_US) {
+    return RateSignal::Delay;
+  }
+  if (controller.windowAckGapMs > ackLimitMs) {
+    return RateSignal::AckGap;
+  }
+  return RateSignal::Clean;
+}
+
+}  // namespace
+
+void rateControllerInit(RateController &controller, uint32_t minIntervalMs, uint32_t maxIntervalMs,
+                        uint32_t initialIntervalMs) {
+  controller = RateController();
+  controller.minIntervalMs = minIntervalMs;
+  controller.maxIntervalMs = maxIntervalMs;
+  controller.intervalMs = initialIntervalMs;
+}
+
+bool rateControllerUpdate(RateController &controller, const NetClock &clock, uint32_t nowMs) {
+  if (!controller.started) {
+    controller.started = true;
+    controller.periodStartMs = nowMs;
+    startWindow(controller, clock, nowMs);
+    return false;
+  }
+  trackBaseRtt(controller, clock, nowMs);
+  if (nowMs - controller.windowStartMs < RATE_WINDOW_MS) {
+    return false;
+  }
+
+  RateSignal signal = readWindow(controller, clock);
+  startWindow(controller, clock, nowMs);
+  controller.stats.lastSignal = signal;
+  uint32_t previous = controller.intervalMs;
+  if (signal == RateSignal::Clean) {
+    uint32_t step = controller.intervalMs / 4 > RATE_STEP_MS ? controller.intervalMs / 4 : RATE_STEP_MS;
+    uint32_t shorter = controller.intervalMs > step ? controller.intervalMs - step : 0;
+    controller.intervalMs = shorter < controller.minIntervalMs ? controller.minIntervalMs : shorter;
+    if (controller.intervalMs != previous) {
+      ++controller.stats.increases;
+    }
+  } else {
+    uint32_t longer = controller.intervalMs + controller.intervalMs / 2;
+    controller.intervalMs = longer > controller.maxIntervalMs ? controller.maxIntervalMs : longer;
+    ++controller.stats.backoffs;
+    if (signal == RateSignal::Loss) {
+      ++controller.stats.lossBackoffs;
+    } else if (signal == RateSignal::Delay) {
+      ++controller.stats.delayBackoffs;
+    } else {
+      ++controller.stats.ackBackoffs;
+    }
+  }
+  return controller.intervalMs != previous;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+
+#include "net_clock.h"
+
+// Send-interval controller for the streams that can go faster or slower: the
+// host's paddle-motion state updates and the client's paddle updates. Every
+// RATE_WINDOW_MS it reads the link: ping loss, how far the RTT has risen above
+// the lowest seen lately (queues filling up), and on the host how long state
+// went unacknowledged. Any of these is congestion and the interval grows by
+// half; a clean window shortens it by a quarter, at least RATE_STEP_MS. A quiet
+// LAN climbs to the minimum interval, a busy shared AP gets backed off quickly
+// and is given the rate back over a few clean windows once it settles.
+
+constexpr uint32_t RATE_WINDOW_MS = 2000;        // ~8 pings at the 250 ms ping interval
+constexpr uint32_t RATE_STEP_MS = 4;             // smallest clean-window step
+constexpr uint32_t RATE_LOSS_PERCENT = 15;       // ping loss above this is congestion
+constexpr uint32_t RATE_RTT_RISE_US = 30000;     // RTT this far over the base is queueing
+constexpr uint32_t RATE_BASE_RTT_PERIOD_MS = 10000;  // base RTT is the minimum over about this long
+constexpr uint32_t RATE_ACK_SLACK_MS = 150;      // unacked age tolerated on top of two RTTs
+
+enum class RateSignal : uint8_t {
+  Clean,
+  Loss,
+  Delay,
+  AckGap,
+};
+
+struct RateStats {
+  uint32_t increases = 0;
+  uint32_t backoffs = 0;
+  uint32_t lossBackoffs = 0;
+  uint32_t delayBackoffs = 0;
+  uint32_t ackBackoffs = 0;
+  uint32_t lossPercent = 0;  // last window
+  uint32_t rttRiseUs = 0;    // last window
+  RateSignal lastSignal = RateSignal::Clean;
+};
+
+struct RateController {
+  uint32_t minIntervalMs = 16;
+  uint32_t maxIntervalMs = 100;
+  uint32_t intervalMs = 32;
+  bool started = false;
+  uint32_t windowStartMs = 0;
+  uint32_t windowPingsSent = 0;
+  uint32_t windowPongsReceived = 0;
+  uint32_t windowAckGapMs = 0;  // worst seen this window
+  uint32_t baseRttUs = 0;       // lowest RTT of the previous period (0: none yet)
+  uint32_t periodMinRttUs = 0;
+  uint32_t periodStartMs = 0;
+  RateStats stats;
+};
+
+void rateControllerInit(RateController &controller, uint32_t minIntervalMs, uint32_t maxIntervalMs,
+                        uint32_t initialIntervalMs);
+
+// Host: how long the oldest unacknowledged state frame has been out.
+inline void rateControllerNoteAckGap(RateController &controller, uint32_t ackGapMs) {
+  if (ackGapMs > controller.windowAckGapMs) {
+    controller.windowAckGapMs = ackGapMs;
+  }
+}
+
+// Call every loop; acts once per window. Returns true when intervalMs changed.
+bool rateControllerUpdate(RateController &controller, const NetClock &clock, uint32_t nowMs);
+
+inline uint32_t rateControllerHz(const RateController &controller) {
+  return 1000 / controller.intervalMs;
+}
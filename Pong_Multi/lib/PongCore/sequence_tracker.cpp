@@ -0,0 +1,43 @@
+#include "sequence_tracker.h"
+
+void sequenceReset(SequenceTracker &tracker) {
+  tracker = SequenceTracker();
+}
+
+SequenceVerdict sequenceTrack(SequenceTracker &tracker, uint32_t sequence) {
+  if (!tracker.started) {
+    tracker.started = true;
+    tracker.newest = sequence;
+    tracker.window = 1;
+    ++tracker.stats.received;
+    return SequenceVerdict::Newer;
+  }
+
+  int32_t ahead = static_cast<int32_t>(sequence - tracker.newest);
+  if (ahead > 0) {
+    // Everything skipped counts as lost until it shows up late.
+    tracker.stats.lost += static_cast<uint32_t>(ahead - 1);
+    tracker.window = static_cast<uint32_t>(ahead) < SEQUENCE_WINDOW ? (tracker.window << ahead) | 1u : 1u;
+    tracker.newest = sequence;
+    ++tracker.stats.received;
+    return SequenceVerdict::Newer;
+  }
+
+  uint32_t behind = static_cast<uint32_t>(-static_cast<int64_t>(ahead));
+  if (behind < SEQUENCE_WINDOW) {
+    uint32_t bit = 1u << behind;
+    if (tracker.window & bit) {
+      ++tracker.stats.duplicates;
+      return SequenceVerdict::Duplicate;
+    }
+    tracker.window |= bit;
+    if (tracker.stats.lost > 0) {
+      --tracker.stats.lost;
+    }
+  }
+  // Beyond the window a late copy and a duplicate look the same; either way it
+  // is too old to use, so call it late.
+  ++tracker.stats.received;
+  ++tracker.stats.reordered;
+  return SequenceVerdict::Late;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+// Receive-side bookkeeping for a stream of sequence-numbered packets. It says
+// whether each arrival is the newest so far, late (overtaken by a newer one)
+// or a duplicate, and keeps loss and reorder counts. All comparisons survive
+// the counter wrapping; the state is a few words and nothing is allocated.
+
+constexpr uint32_t SEQUENCE_WINDOW = 32;  // ids behind the newest still told apart
+
+// Wraparound-safe "a is later than b" for 32-bit sequence numbers.
+inline bool sequenceNewer(uint32_t a, uint32_t b) {
+  return static_cast<int32_t>(a - b) > 0;
+}
+
+enum class SequenceVerdict : uint8_t {
+  Newer,      // newest so far: apply it
+  Late,       // first copy, but something newer already arrived
+  Duplicate,  // seen before
+};
+
+struct SequenceStats {
+  uint32_t received = 0;    // first copies, in order or not
+  uint32_t lost = 0;        // ids skipped and not (yet) filled in by a late arrival
+  uint32_t reordered = 0;   // first copies that arrived after a newer id
+  uint32_t duplicates = 0;
+};
+
+struct SequenceTracker {
+  uint32_t newest = 0;
+  uint32_t window = 0;  // bit i set: newest - i has arrived
+  bool started = false;
+  SequenceStats stats;
+};
+
+void sequenceReset(SequenceTracker &tracker);
+
+SequenceVerdict sequenceTrack(SequenceTracker &tracker, uint32_t sequence);
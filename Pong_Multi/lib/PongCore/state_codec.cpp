@@ -0,0 +1,213 @@
+#include "state_codec.h"
+
+#include <cmath>
+
+#include "bit_packer.h"
+#include "protocol.h"
+
+namespace {
+
+constexpr uint8_t POSITION_BITS = 14;  // signed, +-512 px
+constexpr uint8_t PADDLE_BITS = 13;    // signed, +-256 px
+constexpr uint8_t VELOCITY_BITS = 18;  // signed, +-16384 px/s
+constexpr uint8_t FLAG_BITS = 4;
+constexpr uint8_t SCORE_BITS = 4;
+constexpr uint32_t PREDICTION_MAX_MS = 2000;
+
+static_assert(STATE_PACKET_MAX <= MAX_DATAGRAM_SIZE, "State packets fit the receive buffer");
+
+int32_t quantize(float value, uint8_t fractionBits) {
+  return static_cast<int32_t>(lroundf(value * static_cast<float>(1 << fractionBits)));
+}
+
+float dequantize(int32_t value, uint8_t fractionBits) {
+  return static_cast<float>(value) / static_cast<float>(1 << fractionBits);
+}
+
+// Where the baseline's velocity puts the ball after elapsedMs. Integer-only
+// so host and client arrive at exactly the same prediction.
+int32_t predictPosition(int32_t position, int32_t velocity, uint32_t elapsedMs) {
+  if (elapsedMs > PREDICTION_MAX_MS) {
+    elapsedMs = PREDICTION_MAX_MS;
+  }
+  // position units = velocity units * ms * 2^P / (1000 * 2^V)
+  constexpr int64_t DIVISOR = 1000 << STATE_VELOCITY_FRACTION_BITS >> STATE_POSITION_FRACTION_BITS;
+  return position + static_cast<int32_t>(static_cast<int64_t>(velocity) * elapsedMs / DIVISOR);
+}
+
+void writeKeyframe(BitWriter &writer, const StateFrame &frame) {
+  bitWrite(writer, frame.frameId, 32);
+  bitWrite(writer, frame.hostTimeMs, 32);
+  bitWrite(writer, frame.ackInputSeq, 16);
+  bitWrite(writer, frame.flags, FLAG_BITS);
+  bitWrite(writer, frame.hostScore, SCORE_BITS);
+  bitWrite(writer, frame.clientScore, SCORE_BITS);
+  bitWriteSigned(writer, frame.ballX, POSITION_BITS);
+  bitWriteSigned(writer, frame.ballY, POSITION_BITS);
+  bitWriteSigned(writer, frame.ballVX, VELOCITY_BITS);
+  bitWriteSigned(writer, frame.ballVY, VELOCITY_BITS);
+  bitWriteSigned(writer, frame.hostPaddleY, PADDLE_BITS);
+  bitWriteSigned(writer, frame.clientPaddleY, PADDLE_BITS);
+}
+
+void readKeyframe(BitReader &reader, StateFrame &frame) {
+  frame.frameId = bitRead(reader, 32);
+  frame.hostTimeMs = bitRead(reader, 32);
+  frame.ackInputSeq = static_cast<uint16_t>(bitRead(reader, 16));
+  frame.flags = static_cast<uint8_t>(bitRead(reader, FLAG_BITS));
+  frame.hostScore = static_cast<uint8_t>(bitRead(reader, SCORE_BITS));
+  frame.clientScore = static_cast<uint8_t>(bitRead(reader, SCORE_BITS));
+  frame.ballX = bitReadSigned(reader, POSITION_BITS);
+  frame.ballY = bitReadSigned(reader, POSITION_BITS);
+  frame.ballVX = bitReadSigned(reader, VELOCITY_BITS);
+  frame.ballVY = bitReadSigned(reader, VELOCITY_BITS);
+  frame.hostPaddleY = bitReadSigned(reader, PADDLE_BITS);
+  frame.clientPaddleY = bitReadSigned(reader, PADDLE_BITS);
+}
+
+void writeDelta(BitWriter &writer, const StateFrame &frame, const StateFrame &base) {
+  bitWrite(writer, frame.frameId, 16);
+  bitWrite(writer, frame.frameId - base.frameId, 8);
+  uint32_t elapsedMs = frame.hostTimeMs - base.hostTimeMs;
+  bitWriteVar(writer, elapsedMs);
+  bitWriteVar(writer, static_cast<uint16_t>(frame.ackInputSeq - base.ackInputSeq));
+
+  bool flagsChanged = frame.flags != base.flags;
+  bitWrite(writer, flagsChanged, 1);
+  if (flagsChanged) {
+    bitWrite(writer, frame.flags, FLAG_BITS);
+  }
+  bool scoresChanged = frame.hostScore != base.hostScore || frame.clientScore != base.clientScore;
+  bitWrite(writer, scoresChanged, 1);
+  if (scoresChanged) {
+    bitWrite(writer, frame.hostScore, SCORE_BITS);
+    bitWrite(writer, frame.clientScore, SCORE_BITS);
+  }
+  bool velocityChanged = frame.ballVX != base.ballVX || frame.ballVY != base.ballVY;
+  bitWrite(writer, velocityChanged, 1);
+  if (velocityChanged) {
+    bitWriteSigned(writer, frame.ballVX, VELOCITY_BITS);
+    bitWriteSigned(writer, frame.ballVY, VELOCITY_BITS);
+  }
+  bitWriteSignedVar(writer, frame.ballX - predictPosition(base.ballX, base.ballVX, elapsedMs));
+  bitWriteSignedVar(writer, frame.ballY - predictPosition(base.ballY, base.ballVY, elapsedMs));
+
+  bool hostPaddleMoved = frame.hostPaddleY != base.hostPaddleY;
+  bitWrite(writer, hostPaddleMoved, 1);
+  if (hostPaddleMoved) {
+    bitWriteSignedVar(writer, frame.hostPaddleY - base.hostPaddleY);
+  }
+  bool clientPaddleMoved = frame.clientPaddleY != base.clientPaddleY;
+  bitWrite(writer, clientPaddleMoved, 1);
+  if (clientPaddleMoved) {
+    bitWriteSignedVar(writer, frame.clientPaddleY - base.clientPaddleY);
+  }
+}
+
+void readDelta(BitReader &reader, StateFrame &frame, const StateFrame &base) {
+  uint32_t elapsedMs = bitReadVar(reader);
+  frame.hostTimeMs = base.hostTimeMs + elapsedMs;
+  frame.ackInputSeq = static_cast<uint16_t>(base.ackInputSeq + bitReadVar(reader));
+
+  frame.flags = bitRead(reader, 1) ? static_cast<uint8_t>(bitRead(reader, FLAG_BITS)) : base.flags;
+  if (bitRead(reader, 1)) {
+    frame.hostScore = static_cast<uint8_t>(bitRead(reader, SCORE_BITS));
+    frame.clientScore = static_cast<uint8_t>(bitRead(reader, SCORE_BITS));
+  } else {
+    frame.hostScore = base.hostScore;
+    frame.clientScore = base.clientScore;
+  }
+  if (bitRead(reader, 1)) {
+    frame.ballVX = bitReadSigned(reader, VELOCITY_BITS);
+    frame.ballVY = bitReadSigned(reader, VELOCITY_BITS);
+  } else {
+    frame.ballVX = base.ballVX;
+    frame.ballVY = base.ballVY;
+  }
+  frame.ballX = predictPosition(base.ballX, base.ballVX, elapsedMs) + bitReadSignedVar(reader);
+  frame.ballY = predictPosition(base.ballY, base.ballVY, elapsedMs) + bitReadSignedVar(reader);
+  frame.hostPaddleY = base.hostPaddleY + (bitRead(reader, 1) ? bitReadSignedVar(reader) : 0);
+  frame.clientPaddleY = base.clientPaddleY + (bitRead(reader, 1) ? bitReadSignedVar(reader) : 0);
+}
+
+}  // namespace
+
+int32_t quantizePosition(float pixels) {
+  return quantize(pixels, STATE_POSITION_FRACTION_BITS);
+}
+
+float dequantizePosition(int32_t quantized) {
+  return dequantize(quantized, STATE_POSITION_FRACTION_BITS);
+}
+
+int32_t quantizeVelocity(float pixelsPerSecond) {
+  return quantize(pixelsPerSecond, STATE_VELOCITY_FRACTION_BITS);
+}
+
+float dequantizeVelocity(int32_t quantized) {
+  return dequantize(quantized, STATE_VELOCITY_FRACTION_BITS);
+}
+
+void stateHistoryReset(StateHistory &history) {
+  history.next = 0;
+  history.count = 0;
+}
+
+void stateHistoryPush(StateHistory &history, const StateFrame &frame) {
+  history.frames[history.next] = frame;
+  history.next = (history.next + 1) % STATE_HISTORY_SIZE;
+  if (history.count < STATE_HISTORY_SIZE) {
+    ++history.count;
+  }
+}
+
+const StateFrame *stateHistoryFind(const StateHistory &history, uint32_t frameId) {
+  for (size_t i = 0; i < history.count; ++i) {
+    const StateFrame &frame = history.frames[(history.next + STATE_HISTORY_SIZE - 1 - i) % STATE_HISTORY_SIZE];
+    if (frame.frameId == frameId) {
+      return &frame;
+    }
+  }
+  return nullptr;
+}
+
+size_t stateEncode(const StateFrame &frame, const StateFrame *baseline, uint8_t *out, size_t capacity) {
+  if (baseline != nullptr && frame.frameId - baseline->frameId - 1 >= STATE_MAX_BASELINE_AGE) {
+    baseline = nullptr;  // not strictly older, or too old to name in 8 bits
+  }
+  BitWriter writer = bitWriter(out, capacity);
+  bitWrite(writer, static_cast<uint8_t>(PacketType::State), 8);
+  bitWrite(writer, baseline == nullptr, 1);
+  if (baseline == nullptr) {
+    writeKeyframe(writer, frame);
+  } else {
+    writeDelta(writer, frame, *baseline);
+  }
+  return writer.overflow ? 0 : bitWriterBytes(writer);
+}
+
+StateDecodeResult stateDecode(const uint8_t *data, size_t length, const StateHistory &history,
+                              uint32_t referenceFrameId, StateFrame &out) {
+  BitReader reader = bitReader(data, length);
+  if (bitRead(reader, 8) != static_cast<uint8_t>(PacketType::State)) {
+    return StateDecodeResult::Malformed;
+  }
+  if (bitRead(reader, 1)) {
+    readKeyframe(reader, out);
+  } else {
+    uint16_t lowBits = static_cast<uint16_t>(bitRead(reader, 16));
+    uint32_t baseDistance = bitRead(reader, 8);
+    int16_t offset = static_cast<int16_t>(static_cast<uint16_t>(lowBits - static_cast<uint16_t>(referenceFrameId)));
+    uint32_t frameId = referenceFrameId + static_cast<uint32_t>(static_cast<int32_t>(offset));
+    const StateFrame *base = stateHistoryFind(history, frameId - baseDistance);
+    if (reader.overflow) {
+      return StateDecodeResult::Malformed;
+    }
+    if (base == nullptr || baseDistance == 0) {
+      return StateDecodeResult::MissingBaseline;
+    }
+    out.frameId = frameId;
+    readDelta(reader, out, *base);
+  }
+  return reader.overflow ? StateDecodeResult::Malformed : StateDecodeResult::Ok;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Host state on the wire. Positions are quantized to 1/16 px and velocities to
+// 1/8 px/s, then each packet is written as changes against a baseline frame
+// the client has acknowledged: frame id and time as small deltas, the ball as
+// the error against where the baseline's velocity would have put it, and
+// velocities, paddles, scores and flags only when they differ. Without an
+// acknowledged baseline a self-contained keyframe is sent instead.
+//
+// The quantization applies to -DPONG_SIM_FIXED_POINT=1 builds too: a Q16.16
+// value is rounded to the same grid, not sent raw. Exact state only travels in
+// lockstep sync packets.
+
+constexpr uint8_t STATE_POSITION_FRACTION_BITS = 4;
+constexpr uint8_t STATE_VELOCITY_FRACTION_BITS = 3;
+constexpr size_t STATE_HISTORY_SIZE = 32;   // ~1 s of frames at the 32 ms send interval
+constexpr uint32_t STATE_MAX_BASELINE_AGE = 255;  // frames; older baselines force a keyframe
+constexpr size_t STATE_PACKET_MAX = 48;     // worst-case delta is well under this
+
+// One host state as it exists on both ends of the link, already quantized.
+struct StateFrame {
+  uint32_t frameId = 0;
+  uint32_t hostTimeMs = 0;
+  uint16_t ackInputSeq = 0;  // last client input folded into clientPaddleY
+  uint8_t flags = 0;         // FLAG_* bits
+  uint8_t hostScore = 0;
+  uint8_t clientScore = 0;
+  int32_t ballX = 0;  // 1/16 px
+  int32_t ballY = 0;
+  int32_t ballVX = 0;  // 1/8 px/s
+  int32_t ballVY = 0;
+  int32_t hostPaddleY = 0;  // 1/16 px
+  int32_t clientPaddleY = 0;
+};
+
+int32_t quantizePosition(float pixels);
+float dequantizePosition(int32_t quantized);
+int32_t quantizeVelocity(float pixelsPerSecond);
+float dequantizeVelocity(int32_t quantized);
+
+// Ring of recent frames: the host keeps what it sent, the client what it
+// accepted, so both can look up the same baseline by frame id.
+struct StateHistory {
+  StateFrame frames[STATE_HISTORY_SIZE];
+  size_t next = 0;
+  size_t count = 0;
+};
+
+void stateHistoryReset(StateHistory &history);
+void stateHistoryPush(StateHistory &history, const StateFrame &frame);
+const StateFrame *stateHistoryFind(const StateHistory &history, uint32_t frameId);
+
+// Writes a PacketType::State datagram into out and returns its length, or 0
+// if it did not fit. baseline is null for a keyframe.
+size_t stateEncode(const StateFrame &frame, const StateFrame *baseline, uint8_t *out, size_t capacity);
+
+enum class StateDecodeResult : uint8_t {
+  Ok,
+  Malformed,
+  MissingBaseline,  // delta against a frame no longer (or never) in history
+};
+
+// Reads a State datagram. referenceFrameId is any recent frame id the
+// receiver has seen (its newest); deltas carry only the low 16 bits of their
+// id and are placed next to it.
+StateDecodeResult stateDecode(const uint8_t *data, size_t length, const StateHistory &history,
+                              uint32_t referenceFrameId, StateFrame &out);
@@ -0,0 +1,40 @@
+#include "state_send_policy.h"
+
+void sendPolicyReset(StateSendPolicy &policy) {
+  policy.pendingEvents = 0;
+  policy.pendingForced = true;
+}
+
+StateSendReason sendPolicyCheck(const StateSendPolicy &policy, const SimState &state, uint32_t nowMs) {
+  if (policy.pendingEvents != 0 || policy.pendingForced) {
+    return StateSendReason::Event;
+  }
+  uint32_t sinceMs = nowMs - policy.lastSentMs;
+  if (state.hostPaddleY != policy.sentHostPaddleY && sinceMs >= policy.motionIntervalMs) {
+    return StateSendReason::Motion;
+  }
+  if (sinceMs >= policy.keyframeIntervalMs) {
+    return StateSendReason::Keyframe;
+  }
+  return StateSendReason::None;
+}
+
+void sendPolicySent(StateSendPolicy &policy, const SimState &state, uint32_t nowMs, StateSendReason reason) {
+  policy.lastSentMs = nowMs;
+  policy.pendingEvents = 0;
+  policy.pendingForced = false;
+  policy.sentHostPaddleY = state.hostPaddleY;
+  switch (reason) {
+    case StateSendReason::Event:
+      ++policy.stats.events;
+      break;
+    case StateSendReason::Motion:
+      ++policy.stats.motion;
+      break;
+    case StateSendReason::Keyframe:
+      ++policy.stats.keyframes;
+      break;
+    case StateSendReason::None:
+      break;
+  }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+#include "pong_sim.h"
+
+// Decides when the host sends state. A ball in straight flight is exactly
+// what the client extrapolates, so between discontinuities only keyframes go
+// out. Anything the client cannot predict is sent at once: serve, bounce,
+// hit, score, game over and pause (every SIM_EVENT_* plus a pause toggle),
+// and the host paddle is streamed at motionIntervalMs while it moves.
+
+constexpr uint32_t STATE_KEYFRAME_INTERVAL_MS = 200;
+constexpr uint32_t STATE_MOTION_INTERVAL_MS = 32;
+
+enum class StateSendReason : uint8_t {
+  None,
+  Event,     // something the client cannot extrapolate just happened
+  Motion,    // the host paddle moved since the last packet
+  Keyframe,  // nothing happened for keyframeIntervalMs
+};
+
+struct StateSendStats {
+  uint32_t events = 0;
+  uint32_t motion = 0;
+  uint32_t keyframes = 0;
+};
+
+struct StateSendPolicy {
+  uint32_t keyframeIntervalMs = STATE_KEYFRAME_INTERVAL_MS;
+  uint32_t motionIntervalMs = STATE_MOTION_INTERVAL_MS;
+  uint32_t lastSentMs = 0;
+  uint8_t pendingEvents = 0;  // SIM_EVENT_* bits since the last packet
+  bool pendingForced = false;
+  SimScalar sentHostPaddleY = 0.0f;
+  StateSendStats stats;
+};
+
+// Forgets pending events and makes the next check send right away.
+void sendPolicyReset(StateSendPolicy &policy);
+
+// Records simStep() events; any bit makes the next check send.
+inline void sendPolicyNoteEvents(StateSendPolicy &policy, uint8_t events) {
+  policy.pendingEvents |= events;
+}
+
+// For discontinuities outside the simulation, such as pause.
+inline void sendPolicyForce(StateSendPolicy &policy) {
+  policy.pendingForced = true;
+}
+
+StateSendReason sendPolicyCheck(const StateSendPolicy &policy, const SimState &state, uint32_t nowMs);
+
+// Call after every state packet, whatever triggered it.
+void sendPolicySent(StateSendPolicy &policy, const SimState &state, uint32_t nowMs, StateSendReason reason);
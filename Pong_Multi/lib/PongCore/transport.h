@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Datagram transport the game talks to instead of a concrete UDP class, so the
+// same netcode runs over WiFiUDP on the Cardputer, over plain sockets on Linux,
+// or through a test decorator.
+
+// IPv4 address and port. ip is in host byte order: a.b.c.d is 0xAABBCCDD.
+struct NetAddress {
+  uint32_t ip = 0;
+  uint16_t port = 0;
+};
+
+inline NetAddress netAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint16_t port) {
+  NetAddress address;
+  address.ip = (static_cast<uint32_t>(a) << 24) | (static_cast<uint32_t>(b) << 16) | (static_cast<uint32_t>(c) << 8) | d;
+  address.port = port;
+  return address;
+}
+
+inline uint8_t netAddressOctet(const NetAddress &address, int index) {
+  return static_cast<uint8_t>(address.ip >> (24 - 8 * index));
+}
+
+// 224.0.0.0/4: a group address rather than a host.
+inline bool netAddressIsMulticast(const NetAddress &address) {
+  return (address.ip >> 28) == 0xE;
+}
+
+inline bool operator==(const NetAddress &a, const NetAddress &b) {
+  return a.ip == b.ip && a.port == b.port;
+}
+
+inline bool operator!=(const NetAddress &a, const NetAddress &b) {
+  return !(a == b);
+}
+
+class Transport {
+ public:
+  virtual ~Transport() = default;
+
+  // Opens the endpoint on a local port (0 picks any free one). Rebinding an
+  // open transport closes it first.
+  virtual bool bind(uint16_t port) = 0;
+  virtual void close() = 0;
+
+  virtual bool sendTo(const NetAddress &to, const uint8_t *data, size_t length) = 0;
+
+  // Sends to every host on the local subnet at the given port.
+  virtual bool broadcast(uint16_t port, const uint8_t *data, size_t length) = 0;
+
+  // Also delivers datagrams sent to group (a multicast address and port)
+  // through receive(), until leaveGroup(), close() or a rebind. One group at a
+  // time; joining another leaves the first. Sending to a group needs nothing
+  // special: sendTo() it.
+  virtual bool joinGroup(const NetAddress &group) = 0;
+  virtual void leaveGroup() = 0;
+
+  // Never blocks. Copies the next waiting datagram into buffer and returns its
+  // length, or 0 when nothing is waiting. Datagrams that would fill the whole
+  // buffer count as oversized and are dropped.
+  virtual int receive(uint8_t *buffer, size_t capacity, NetAddress &from) = 0;
+};
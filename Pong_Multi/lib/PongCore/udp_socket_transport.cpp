@@ -0,0 +1,157 @@
+#include "udp_socket_transport.h"
+
+#if defined(ARDUINO)
+#include <lwip/sockets.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+#include <unistd.h>
+
+#include <cstring>
+
+namespace {
+
+sockaddr_in toSockaddr(const NetAddress &address) {
+  sockaddr_in out;
+  memset(&out, 0, sizeof(out));
+  out.sin_family = AF_INET;
+  out.sin_addr.s_addr = htonl(address.ip);
+  out.sin_port = htons(address.port);
+  return out;
+}
+
+}  // namespace
+
+UdpSocketTransport::~UdpSocketTransport() {
+  close();
+}
+
+bool UdpSocketTransport::bind(uint16_t port) {
+  close();
+  int fd = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (fd < 0) {
+    return false;
+  }
+  int enable = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+  if (port != 0) {
+    // Only for a fixed port: with it set, Linux can hand two bind(0) sockets
+    // the same ephemeral port and deliver one's datagrams to the other.
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  }
+
+  sockaddr_in local = toSockaddr(NetAddress());
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  local.sin_port = htons(port);
+  if (::bind(fd, reinterpret_cast<sockaddr *>(&local), sizeof(local)) != 0) {
+    ::close(fd);
+    return false;
+  }
+  socklen_t localLength = sizeof(local);
+  if (::getsockname(fd, reinterpret_cast<sockaddr *>(&local), &localLength) == 0) {
+    localPort_ = ntohs(local.sin_port);
+  }
+  socket_ = fd;
+  setMulticastInterface(multicastInterface_);
+  return true;
+}
+
+void UdpSocketTransport::close() {
+  leaveGroup();
+  if (socket_ >= 0) {
+    ::close(socket_);
+    socket_ = -1;
+  }
+  localPort_ = 0;
+}
+
+void UdpSocketTransport::setMulticastInterface(uint32_t ip) {
+  multicastInterface_ = ip;
+  if (socket_ >= 0) {
+    in_addr address;
+    address.s_addr = htonl(ip);
+    ::setsockopt(socket_, IPPROTO_IP, IP_MULTICAST_IF, &address, sizeof(address));
+  }
+}
+
+bool UdpSocketTransport::joinGroup(const NetAddress &group) {
+  leaveGroup();
+  if (socket_ < 0 || !netAddressIsMulticast(group)) {
+    return false;
+  }
+  // The group has its own port, shared by every member on the host, so it
+  // gets its own socket: the main one stays on a port of its own, where
+  // unicast replies reach exactly this endpoint.
+  int fd = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (fd < 0) {
+    return false;
+  }
+  int enable = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  sockaddr_in local = toSockaddr(NetAddress());
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  local.sin_port = htons(group.port);
+  ip_mreq membership;
+  memset(&membership, 0, sizeof(membership));
+  membership.imr_multiaddr.s_addr = htonl(group.ip);
+  membership.imr_interface.s_addr = htonl(multicastInterface_);
+  if (::bind(fd, reinterpret_cast<sockaddr *>(&local), sizeof(local)) != 0 ||
+      ::setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0) {
+    ::close(fd);
+    return false;
+  }
+  groupSocket_ = fd;
+  return true;
+}
+
+void UdpSocketTransport::leaveGroup() {
+  // Closing the socket drops its membership.
+  if (groupSocket_ >= 0) {
+    ::close(groupSocket_);
+    groupSocket_ = -1;
+  }
+}
+
+bool UdpSocketTransport::sendTo(const NetAddress &to, const uint8_t *data, size_t length) {
+  if (socket_ < 0) {
+    return false;
+  }
+  sockaddr_in target = toSockaddr(to);
+  ssize_t sent = ::sendto(socket_, data, length, 0, reinterpret_cast<sockaddr *>(&target), sizeof(target));
+  return sent == static_cast<ssize_t>(length);
+}
+
+bool UdpSocketTransport::broadcast(uint16_t port, const uint8_t *data, size_t length) {
+  return sendTo(netAddress(255, 255, 255, 255, port), data, length);
+}
+
+int UdpSocketTransport::receive(uint8_t *buffer, size_t capacity, NetAddress &from) {
+  if (socket_ < 0) {
+    return 0;
+  }
+  int length = receiveFrom(socket_, buffer, capacity, from);
+  if (length == 0 && groupSocket_ >= 0) {
+    length = receiveFrom(groupSocket_, buffer, capacity, from);
+  }
+  return length;
+}
+
+int UdpSocketTransport::receiveFrom(int fd, uint8_t *buffer, size_t capacity, NetAddress &from) {
+  for (;;) {
+    sockaddr_in source;
+    socklen_t sourceLength = sizeof(source);
+    ssize_t length = ::recvfrom(fd, buffer, capacity, MSG_DONTWAIT, reinterpret_cast<sockaddr *>(&source),
+                                &sourceLength);
+    if (length <= 0) {
+      return 0;  // nothing waiting (EAGAIN) or a socket error
+    }
+    if (static_cast<size_t>(length) >= capacity) {
+      continue;  // oversized or truncated
+    }
+    from.ip = ntohl(source.sin_addr.s_addr);
+    from.port = ntohs(source.sin_port);
+    return static_cast<int>(length);
+  }
+}
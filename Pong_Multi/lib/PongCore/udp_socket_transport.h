@@ -0,0 +1,47 @@
+#pragma once
+
+#include "transport.h"
+
+// Transport over a non-blocking BSD datagram socket. Builds against Linux
+// sockets and against lwIP on the ESP32, where it avoids the per-packet heap
+// buffer WiFiUDP allocates on receive.
+class UdpSocketTransport : public Transport {
+ public:
+  UdpSocketTransport() = default;
+  ~UdpSocketTransport() override;
+
+  UdpSocketTransport(const UdpSocketTransport &) = delete;
+  UdpSocketTransport &operator=(const UdpSocketTransport &) = delete;
+
+  bool bind(uint16_t port) override;
+  void close() override;
+  bool sendTo(const NetAddress &to, const uint8_t *data, size_t length) override;
+  bool broadcast(uint16_t port, const uint8_t *data, size_t length) override;
+  bool joinGroup(const NetAddress &group) override;
+  void leaveGroup() override;
+  int receive(uint8_t *buffer, size_t capacity, NetAddress &from) override;
+
+  // Interface (its IPv4 address, host order) that group traffic is sent from
+  // and joined on; 0, the default, lets the routing table pick. Lasts across
+  // rebinds. Setting 127.0.0.1 keeps multicast on loopback for local tests.
+  void setMulticastInterface(uint32_t ip);
+
+  // Port actually bound, useful after bind(0).
+  uint16_t localPort() const {
+    return localPort_;
+  }
+
+  // The socket itself, for callers that wait on it with poll() or epoll (-1
+  // when closed). Group datagrams arrive on a second socket, not this one.
+  int descriptor() const {
+    return socket_;
+  }
+
+ private:
+  int receiveFrom(int fd, uint8_t *buffer, size_t capacity, NetAddress &from);
+
+  int socket_ = -1;
+  int groupSocket_ = -1;  // bound to the group's port, joined to the group
+  uint16_t localPort_ = 0;
+  uint32_t multicastInterface_ = 0;
+};
@@ -4,13 +4,31 @@
 #include <WiFiUdp.h>
 #include <Preferences.h>
 
+#include <fixed_string.h>
+#include <impaired_transport.h>
+#include <interp_buffer.h>
+#include <key_set.h>
+#include <link_monitor.h>
+#include <lobby_table.h>
+#include <lockstep.h>
+#include <net_clock.h>
+#include <paddle_codec.h>
+#include <paddle_predictor.h>
+#include <protocol.h>
+#include <rate_controller.h>
+#include <sequence_tracker.h>
+#include <state_codec.h>
+#include <state_send_policy.h>
+#include <transport.h>
+#include <udp_socket_transport.h>
+#include <pong_sim.h>
+
 #include <algorithm>
 #include <array>
 #include <cctype>
 #include <cmath>
 #include <cstdint>
 #include <cstring>
-#include <initializer_list>
 #include <vector>
 
 // Basic RGB565 colors used by the UI.
@@ -25,43 +43,46 @@ constexpr uint8_t HID_KEY_ENTER = 0x28;
 constexpr uint8_t HID_KEY_ESCAPE = 0x29;
 constexpr char ASCII_ESC = 0x1B;
 
-constexpr size_t PLAYER_NAME_MAX_LEN = 16;
+constexpr size_t WIFI_SSID_MAX_LEN = 32;
+constexpr size_t WIFI_PASSWORD_MAX_LEN = 63;
+
+using PlayerName = FixedString<PLAYER_NAME_MAX_LEN>;
+using SsidString = FixedString<WIFI_SSID_MAX_LEN>;
+using PasswordString = FixedString<WIFI_PASSWORD_MAX_LEN>;
+using HudText = FixedString<40>;  // one line of size-1 text across the panel
 
 // -----------------------------------------------------------------------------
 // Wi-Fi configuration --------------------------------------------------------
+// UDP port and packet layouts live in protocol.h.
 
-constexpr uint16_t UDP_PORT = 41000;
 constexpr uint32_t WIFI_CONNECT_TIMEOUT_MS = 20000;
 
 // -----------------------------------------------------------------------------
 // Gameplay configuration -----------------------------------------------------
-
-constexpr int SCREEN_WIDTH = 240;
-constexpr int SCREEN_HEIGHT = 135;
-
-constexpr float PADDLE_WIDTH = 8.0f;
-constexpr float PADDLE_HEIGHT = 34.0f;
-constexpr float PADDLE_HALF_HEIGHT = PADDLE_HEIGHT * 0.5f;
-constexpr float HOST_PADDLE_X = 16.0f;
-constexpr float CLIENT_PADDLE_X = SCREEN_WIDTH - HOST_PADDLE_X - PADDLE_WIDTH;
-constexpr float PADDLE_SPEED = 170.0f;  // pixels per second
-
-constexpr float BALL_RADIUS = 5.0f;
-constexpr float BALL_SPEED_INITIAL = 170.0f;
-constexpr float BALL_SPEED_GROWTH = 1.06f;
-constexpr uint8_t MAX_SCORE = 7;
-
-constexpr uint32_t SERVE_DELAY_MS = 1300;
-constexpr uint32_t STATE_SEND_INTERVAL_MS = 32;     // ~30 FPS broadcast
-constexpr uint32_t PADDLE_SEND_INTERVAL_MS = 45;    // client paddle updates
-constexpr uint32_t JOIN_BROADCAST_INTERVAL_MS = 800;
-constexpr uint32_t CONNECTION_TIMEOUT_MS = 4000;
+// Playfield and physics constants live in pong_sim.h.
+
+constexpr uint32_t PADDLE_SEND_INTERVAL_MS = 45;    // client paddle ack while idle, when there is new state
+constexpr uint32_t SEND_INTERVAL_MIN_MS = 16;       // adaptive send rate: ~60 Hz on a clean link
+constexpr uint32_t SEND_INTERVAL_MAX_MS = 100;      // down to 10 Hz on a congested one
+constexpr uint32_t JOIN_INTERVAL_MS = 800;
+constexpr uint32_t PING_INTERVAL_MS = 250;
+constexpr uint32_t SESSION_RESUME_WINDOW_MS = 60000;  // how long a dropped match waits for its client
+constexpr uint32_t INTERP_DELAY_MS = 50;            // client renders host state this far in the past
+constexpr uint32_t INTERP_DELAY_STEP_MS = 10;
+constexpr uint32_t INTERP_DELAY_MAX_MS = 200;
+constexpr uint32_t SPECTATE_INTERP_DELAY_MS = 100;   // spectators have no pings to measure jitter with
+constexpr uint32_t SPECTATE_STALE_MS = 1000;         // spectator asks for a snapshot after this long without state
+constexpr uint32_t SPECTATE_KEEPALIVE_MS = 2000;     // spectator reminds the host it is watching
+constexpr uint32_t SPECTATE_IDLE_MS = 6000;          // host stops mirroring state this long after the last reminder
 constexpr int WIFI_MENU_VISIBLE_ROWS = 4;
+constexpr int LOBBY_MENU_VISIBLE_ROWS = 4;
+constexpr uint32_t LOBBY_REDRAW_MS = 1000;  // lobby list: round trips change without a beacon
 
 // -----------------------------------------------------------------------------
 // Button mapping -------------------------------------------------------------
 // Host:    W (up) / S (down)   |  Space = serve/rematch   |  Q = quit lobby
 // Client:  I (up) / K (down)   |  Q = leave lobby
+// Spectator: V on role select  |  Q = stop watching
 
 // -----------------------------------------------------------------------------
 
@@ -69,6 +90,7 @@ enum class Role : uint8_t {
   None,
   Host,
   Client,
+  Spectator,  // watches a match from the multicast copy of the host's state
 };
 
 enum class Screen : uint8_t {
@@ -84,56 +106,118 @@ enum class Screen : uint8_t {
   Error,
 };
 
-enum class PacketType : uint8_t {
-  Join = 1,
-  JoinAck = 2,
-  State = 3,
-  Paddle = 4,
-  Start = 5,
-};
 
-constexpr uint8_t FLAG_MATCH_ACTIVE = 0x01;
-constexpr uint8_t FLAG_WAITING_SERVE = 0x02;
-constexpr uint8_t FLAG_GAME_OVER = 0x04;
-constexpr uint8_t FLAG_PAUSED = 0x08;
+// -----------------------------------------------------------------------------
+// UDP transport --------------------------------------------------------------
+// WiFiUDP is the default backend; build with -DPONG_SOCKET_TRANSPORT=1 to use
+// the lwIP socket backend from lib/PongCore instead.
 
-#pragma pack(push, 1)
-struct JoinPacket {
-  uint8_t type;
-  char name[PLAYER_NAME_MAX_LEN];
-};
+#ifndef PONG_SOCKET_TRANSPORT
+#define PONG_SOCKET_TRANSPORT 0
+#endif
 
-struct JoinAckPacket {
-  uint8_t type;
-  char name[PLAYER_NAME_MAX_LEN];
-};
+class WiFiUdpTransport : public Transport {
+ public:
+  bool bind(uint16_t port) override {
+    leaveGroup();
+    udp_.stop();
+    return udp_.begin(port) != 0;
+  }
 
-struct StartPacket {
-  uint8_t type;
-  uint32_t seed;
-};
+  void close() override {
+    leaveGroup();
+    udp_.stop();
+  }
 
-struct PaddlePacket {
-  uint8_t type;
-  float paddleY;
-};
+  bool sendTo(const NetAddress &to, const uint8_t *data, size_t length) override {
+    IPAddress ip(netAddressOctet(to, 0), netAddressOctet(to, 1), netAddressOctet(to, 2), netAddressOctet(to, 3));
+    if (!udp_.beginPacket(ip, to.port)) {
+      return false;
+    }
+    udp_.write(data, length);
+    return udp_.endPacket() != 0;
+  }
+
+  bool broadcast(uint16_t port, const uint8_t *data, size_t length) override {
+    return sendTo(netAddress(255, 255, 255, 255, port), data, length);
+  }
+
+  // The group listens on its own WiFiUDP so udp_ keeps its port for unicast.
+  bool joinGroup(const NetAddress &group) override {
+    leaveGroup();
+    IPAddress ip(netAddressOctet(group, 0), netAddressOctet(group, 1), netAddressOctet(group, 2),
+                 netAddressOctet(group, 3));
+    inGroup_ = group_.beginMulticast(ip, group.port) != 0;
+    return inGroup_;
+  }
+
+  void leaveGroup() override {
+    if (inGroup_) {
+      group_.stop();
+      inGroup_ = false;
+    }
+  }
 
-struct StatePacket {
-  uint8_t type;
-  uint8_t flags;
-  uint8_t hostScore;
-  uint8_t clientScore;
-  uint32_t frameId;
-  float ballX;
-  float ballY;
-  float ballVX;
-  float ballVY;
-  float hostPaddleY;
-  float clientPaddleY;
+  int receive(uint8_t *buffer, size_t capacity, NetAddress &from) override {
+    int length = receiveFrom(udp_, buffer, capacity, from);
+    if (length == 0 && inGroup_) {
+      length = receiveFrom(group_, buffer, capacity, from);
+    }
+    return length;
+  }
+
+ private:
+  // parsePacket() mallocs a buffer for each datagram, so receiving is not
+  // heap-free on this backend; the heap watermark starts after it.
+  static int receiveFrom(WiFiUDP &udp, uint8_t *buffer, size_t capacity, NetAddress &from) {
+    int size;
+    while ((size = udp.parsePacket()) > 0) {
+      if (static_cast<size_t>(size) >= capacity) {
+        while (udp.available()) {
+          udp.read();
+        }
+        continue;
+      }
+      int length = udp.read(buffer, static_cast<size_t>(size));
+      if (length <= 0) {
+        continue;
+      }
+      IPAddress ip = udp.remoteIP();
+      from = netAddress(ip[0], ip[1], ip[2], ip[3], udp.remotePort());
+      return length;
+    }
+    return 0;
+  }
+
+  WiFiUDP udp_;
+  WiFiUDP group_;
+  bool inGroup_ = false;
 };
-#pragma pack(pop)
 
-static_assert(sizeof(StatePacket) <= 64, "StatePacket stays under UDP buffer");
+// Build with -DPONG_NET_IMPAIRMENT=1 to push every datagram, in and out,
+// through ImpairedTransport with the profile below. Both devices then see the
+// same seeded delay, burst loss, reordering and duplication on every run.
+
+#ifndef PONG_NET_IMPAIRMENT
+#define PONG_NET_IMPAIRMENT 0
+#endif
+
+constexpr uint32_t NET_IMPAIRMENT_SEED = 0x5EEDu;
+
+ImpairmentProfile netImpairmentProfile() {
+  // A congested 2.4 GHz channel: long-tailed jitter and short loss bursts.
+  ImpairmentProfile profile;
+  profile.delayMs = 15;
+  profile.jitterMs = 40;
+  profile.shape = DelayShape::Pareto;
+  profile.lossGood = 0.01f;
+  profile.lossBad = 0.6f;
+  profile.burstEnter = 0.02f;
+  profile.burstExit = 0.25f;
+  profile.reorder = 0.02f;
+  profile.duplicate = 0.01f;
+  return profile;
+}
 
 // -----------------------------------------------------------------------------
 // Globals --------------------------------------------------------------------
@@ -143,7 +227,7 @@ Screen g_screen = Screen::WifiSelect;
 bool g_screenDirty = true;
 
 struct WifiNetworkInfo {
-  String ssid;
+  SsidString ssid;
   int32_t rssi;
   wifi_auth_mode_t authMode;
   bool isManual = false;
@@ -152,46 +236,106 @@ struct WifiNetworkInfo {
 std::vector<WifiNetworkInfo> g_wifiNetworks;
 int g_wifiSelectedIndex = 0;
 bool g_wifiPasswordVisible = false;
-String g_wifiSSID;
-String g_wifiPassword;
+SsidString g_wifiSSID;
+PasswordString g_wifiPassword;
+
+PlayerName g_localPlayerName = "Player";
+PlayerName g_remotePlayerName = "Opponent";
+PlayerName g_spectatedClientName = "Challenger";  // spectator: the host is g_remotePlayerName
+
+#if PONG_SOCKET_TRANSPORT
+UdpSocketTransport g_deviceTransport;
+#else
+WiFiUdpTransport g_deviceTransport;
+#endif
+#if PONG_NET_IMPAIRMENT
+ImpairedTransport g_impairedTransport(
+    g_deviceTransport, []() -> uint32_t { return millis(); }, NET_IMPAIRMENT_SEED);
+Transport &g_transport = g_impairedTransport;
+#else
+Transport &g_transport = g_deviceTransport;
+#endif
+NetAddress g_peer;
+bool g_hasPeer = false;
 
-String g_localPlayerName = "Player";
-String g_remotePlayerName = "Opponent";
+// Ball, paddles and score. The host advances it with simStep(); the client
+// mirrors it from state packets.
+SimState g_sim;
+SimClock g_simClock;
 
-WiFiUDP g_udp;
-IPAddress g_peerIp;
-uint16_t g_peerPort = UDP_PORT;
-bool g_hasPeer = false;
+// Client: state packets queued for interpolation, and how far behind the host
+// the client draws.
+InterpBuffer g_interp;
+uint32_t g_interpDelayMs = INTERP_DELAY_MS;
+bool g_interpDelayAuto = true;  // follow the measured jitter until - or = is pressed
+
+NetClock g_netClock;
+
+// Client: locally predicted paddle. Host: client inputs applied so far.
+PaddlePredictor g_paddlePredictor;
+uint16_t g_lastSentInputSeq = 0;
+uint32_t g_lastSentAckFrameId = 0;
+PaddleReceiver g_paddleReceiver;
 
-float g_hostPaddleY = SCREEN_HEIGHT * 0.5f;
-float g_clientPaddleY = SCREEN_HEIGHT * 0.5f;
-float g_ballX = SCREEN_WIDTH * 0.5f;
-float g_ballY = SCREEN_HEIGHT * 0.5f;
-float g_ballVX = 0.0f;
-float g_ballVY = 0.0f;
-
-uint8_t g_hostScore = 0;
-uint8_t g_clientScore = 0;
-bool g_matchActive = false;
-bool g_waitingForServe = false;
-bool g_gameOver = false;
-int g_serveDirection = 1;  // +1 -> to client, -1 -> to host
-
-unsigned long g_lastStateSent = 0;
 unsigned long g_lastPaddleSent = 0;
-unsigned long g_lastJoinBroadcast = 0;
-unsigned long g_lastStateReceived = 0;
+NetMode g_netMode = NetMode::Snapshot;  // host: picked in the lobby; client: from Start
+Lockstep g_lockstep;
+uint32_t g_matchSeed = 0;
+unsigned long g_lastLockstepSent = 0;
+unsigned long g_lastLockstepHandshake = 0;  // host: Start and sync resends
+unsigned long g_lastJoinSent = 0;
+LinkMonitor g_linkMonitor;
+uint32_t g_sessionToken = 0;  // the match a client can rejoin (0: none)
+bool g_awaitingRejoin = false;  // host: match kept for a dropped client; client: trying to get back in
+unsigned long g_awaitingRejoinSince = 0;
+unsigned long g_lastPingSent = 0;
 unsigned long g_lastFrameTick = 0;
-unsigned long g_serveRequestTs = 0;
+unsigned long g_lastSimTickUs = 0;
+// Host: id of the last state frame sent. It runs for the whole session, not
+// per match, so a delayed packet from the previous match is still "older".
 uint32_t g_frameCounter = 0;
-
-String g_errorMessage;
+// Client: ordering and loss of the state frames received.
+SequenceTracker g_stateSequence;
+// Host: frames sent, and the newest one the client acknowledged as a delta
+// baseline. Client: frames accepted, the baselines the host may refer to.
+StateHistory g_stateHistory;
+StateSendPolicy g_stateSendPolicy;  // host: when the next state packet is due
+uint32_t g_ackGapFromFrameId = 1;   // host: older frames are from before this match
+// Host: interval for paddle-motion state. Client: interval for paddle updates.
+RateController g_sendRate;
+uint32_t g_stateAckFrameId = 0;
+uint32_t g_stateBaselineMisses = 0;
+// Host: when a spectator last asked for the match; state is mirrored to the
+// group only while that is recent. Spectator: its requests and the last state.
+unsigned long g_lastSpectateRequest = 0;
+unsigned long g_lastSpectateSent = 0;
+unsigned long g_lastSpectatorStateMs = 0;
+// Host: the lobby this session announces. Client: every lobby heard while
+// searching, the one under the cursor and the one asked for a seat (or, when
+// rejoining, the host that kept the match).
+uint32_t g_lobbyId = 0;
+uint8_t g_beaconSeq = 0;
+LobbyState g_beaconState = LobbyState::Open;
+unsigned long g_lastBeaconSent = 0;
+LobbyTable g_lobbies;
+int g_lobbyCursor = 0;
+uint32_t g_selectedLobbyId = 0;
+uint32_t g_joinLobbyId = 0;
+NetAddress g_joinTarget;
+bool g_hasJoinTarget = false;
+unsigned long g_lastLobbyProbe = 0;
+unsigned long g_lastLobbyDraw = 0;
+
+HudText g_errorMessage;
 
 Preferences g_preferences;
 bool g_gamePaused = false;
+bool g_autoPausedForRejoin = false;  // host: the pause is ours, taken when the peer went missing
+
+constexpr KeySet KEYS_ENTER = KeySet().hid(HID_KEY_ENTER);
 
-constexpr size_t KEY_LATCH_SIZE = 512;
-std::array<bool, KEY_LATCH_SIZE> g_keyLatch{};
+KeySet g_keysDown;  // snapshot of the keyboard taken once per loop
+KeySet g_keyLatch;  // keys seen held by the last just-pressed query that covered them
 
 struct MenuStar {
   float x = 0.0f;
@@ -215,135 +359,177 @@ bool g_confettiActive = false;
 
 uint8_t g_frameDelayMs = 5;
 
-void onScreenEnter(Screen screen);
+// Playing screen render path. Canvas composes the frame off-screen and pushes it
+// with one DMA transfer; Direct is the original draw-to-panel path kept for comparison.
+enum class RenderPath : uint8_t {
+  Direct,
+  Canvas,
+};
 
-// -----------------------------------------------------------------------------
-// Helpers --------------------------------------------------------------------
+RenderPath g_renderPath = RenderPath::Canvas;
+M5Canvas g_frameCanvasA(&M5.Display);
+M5Canvas g_frameCanvasB(&M5.Display);
+std::array<M5Canvas *, 2> g_frameCanvases{{&g_frameCanvasA, &g_frameCanvasB}};
+uint8_t g_frameCanvasCount = 0;  // 0 = no canvas memory, 1 = single buffer, 2 = double buffer
+uint8_t g_frameCanvasIndex = 0;
+bool g_framePushPending = false;
+
+// Screen-space rectangle used by the dirty-rectangle renderer. Empty when w or h is 0.
+struct DirtyRect {
+  int16_t x = 0;
+  int16_t y = 0;
+  int16_t w = 0;
+  int16_t h = 0;
+};
 
-template <typename T>
-T clampValue(T value, T minValue, T maxValue) {
-  if (value < minValue) {
-    return minValue;
-  }
-  if (value > maxValue) {
-    return maxValue;
-  }
-  return value;
+// Everything on the playfield that only changes on a point, a pause or a rename.
+// A frame whose static layer differs from what a buffer holds gets a full redraw.
+struct PlayfieldStatics {
+  PlayerName hostName;
+  PlayerName clientName;
+  uint8_t hostScore = 0;
+  uint8_t clientScore = 0;
+  bool waitingForServe = false;
+  bool paused = false;
+  bool awaitingRejoin = false;
+  bool desynced = false;
+  LinkState linkState = LinkState::Connected;
+  uint8_t statsLines = 0;
+};
+
+// What a canvas (or the panel) currently shows, so the next frame can erase
+// only the rectangles the moving objects used to cover.
+struct PlayfieldContent {
+  bool valid = false;
+  PlayfieldStatics statics;
+  DirtyRect hostPaddle;
+  DirtyRect clientPaddle;
+  DirtyRect ball;
+};
+
+constexpr size_t MAX_DIRTY_RECTS = 8;
+std::array<PlayfieldContent, 2> g_canvasContent{};
+PlayfieldContent g_panelContent;
+
+struct FrameStats {
+  uint32_t frameUs = 0;   // smoothed loop-to-loop time
+  uint32_t renderUs = 0;  // smoothed drawGameFrame() time
+  uint32_t pushedPixels = 0;  // smoothed pixels sent to the panel per frame
+  uint32_t renderPeakUs = 0;
+  uint32_t windowPeakUs = 0;
+  unsigned long windowStartMs = 0;
+  unsigned long lastFrameUs = 0;
+};
+
+FrameStats g_frameStats;
+bool g_showFrameStats = false;
+bool g_showNetStats = false;
+
+// Heap allocations made by the loop task. malloc, calloc and realloc are
+// wrapped at link time (-Wl,--wrap in platformio.ini), which also catches
+// operator new and String; allocations of the Wi-Fi and lwIP tasks are not
+// counted, as they never run on the loop task.
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *block, size_t size);
 }
 
-size_t asciiLatchIndex(char key) {
-  return static_cast<size_t>(static_cast<uint8_t>(key));
+TaskHandle_t g_loopTask = nullptr;  // set in setup()
+uint32_t g_loopAllocations = 0;     // only ever written by the loop task
+
+void countLoopAllocation() {
+  if (g_loopTask != nullptr && xTaskGetCurrentTaskHandle() == g_loopTask) {
+    ++g_loopAllocations;
+  }
 }
 
-size_t hidLatchIndex(uint8_t code) {
-  return static_cast<size_t>(256 + code);
+extern "C" void *__wrap_malloc(size_t size) {
+  countLoopAllocation();
+  return __real_malloc(size);
 }
 
-bool asciiKeyPressed(char key) {
-  return M5Cardputer.Keyboard.isKeyPressed(key);
+extern "C" void *__wrap_calloc(size_t count, size_t size) {
+  countLoopAllocation();
+  return __real_calloc(count, size);
 }
 
-bool hidKeyPressed(uint8_t code) {
-  const auto &hidKeys = M5Cardputer.Keyboard.keysState().hid_keys;
-  return std::find(hidKeys.begin(), hidKeys.end(), code) != hidKeys.end();
+extern "C" void *__wrap_realloc(void *block, size_t size) {
+  countLoopAllocation();
+  return __real_realloc(block, size);
 }
 
-bool cardKeyPressedVectors(const std::vector<char> &asciiKeys, const std::vector<uint8_t> &hidKeys) {
-  for (char key : asciiKeys) {
-    if (asciiKeyPressed(key)) {
-      return true;
-    }
+// Allocation check over every Playing frame, from the top of loop() to the
+// end of the render: input, receive, simulation, sends and drawing. It counts
+// calls rather than comparing free heap, so a block freed again within the
+// frame still shows. The WiFiUDP build cannot read zero here:
+// WiFiUDP::parsePacket() mallocs a buffer for each datagram it receives, which
+// receiveAllocations shows. Build with -DPONG_SOCKET_TRANSPORT=1, which
+// receives straight into our buffer, for a heap-free match.
+struct HeapWatermark {
+  uint32_t frames = 0;
+  uint32_t allocatingFrames = 0;
+  uint32_t worstFrameAllocations = 0;
+  uint32_t receiveAllocations = 0;  // all frames, made inside processNetwork()
+  uint32_t lowestFree = UINT32_MAX;
+};
+
+HeapWatermark g_heapWatermark;
+
+void onScreenEnter(Screen screen);
+
+// -----------------------------------------------------------------------------
+// Helpers --------------------------------------------------------------------
+
+template <typename T>
+T clampValue(T value, T minValue, T maxValue) {
+  if (value < minValue) {
+    return minValue;
   }
-  for (uint8_t code : hidKeys) {
-    if (hidKeyPressed(code)) {
-      return true;
-    }
+  if (value > maxValue) {
+    return maxValue;
   }
-  return false;
+  return value;
 }
 
-bool cardKeyJustPressedVectors(const std::vector<char> &asciiKeys, const std::vector<uint8_t> &hidKeys) {
-  bool anyJustPressed = false;
-
-  for (char key : asciiKeys) {
-    size_t idx = asciiLatchIndex(key) % KEY_LATCH_SIZE;
-    bool pressed = asciiKeyPressed(key);
-    if (pressed && !g_keyLatch[idx]) {
-      anyJustPressed = true;
-    }
-    g_keyLatch[idx] = pressed;
+// Rebuilds g_keysDown from the keyboard driver. Call once per loop after
+// M5Cardputer.update(); every key query until the next call is a bit test.
+void captureKeySnapshot() {
+  auto &keyboard = M5Cardputer.Keyboard;
+  g_keysDown.clear();
+  for (const auto &position : keyboard.keyList()) {
+    g_keysDown.setAscii(static_cast<char>(keyboard.getKey(position)));
   }
-
-  for (uint8_t code : hidKeys) {
-    size_t idx = hidLatchIndex(code) % KEY_LATCH_SIZE;
-    bool pressed = hidKeyPressed(code);
-    if (pressed && !g_keyLatch[idx]) {
-      anyJustPressed = true;
-    }
-    g_keyLatch[idx] = pressed;
+  for (uint8_t code : keyboard.keysState().hid_keys) {
+    g_keysDown.setHid(code);
   }
-
-  return anyJustPressed;
 }
 
-bool cardKeyPressedAny(std::initializer_list<char> asciiKeys, std::initializer_list<uint8_t> hidKeys = {}) {
-  return cardKeyPressedVectors(std::vector<char>(asciiKeys), std::vector<uint8_t>(hidKeys));
+bool cardKeysPressed(const KeySet &keys) {
+  return keySetAny(g_keysDown, keys);
 }
 
-bool cardKeyJustPressedAny(std::initializer_list<char> asciiKeys, std::initializer_list<uint8_t> hidKeys = {}) {
-  return cardKeyJustPressedVectors(std::vector<char>(asciiKeys), std::vector<uint8_t>(hidKeys));
+bool cardKeysJustPressed(const KeySet &keys) {
+  return keySetJustPressed(g_keysDown, g_keyLatch, keys);
 }
 
 bool cardKeyPressed(char key) {
-  if (std::isalpha(static_cast<unsigned char>(key))) {
-    char lower = static_cast<char>(std::tolower(static_cast<unsigned char>(key)));
-    char upper = static_cast<char>(std::toupper(static_cast<unsigned char>(key)));
-    if (lower == upper) {
-      return cardKeyPressedAny({lower});
-    }
-    if (key == lower) {
-      return cardKeyPressedAny({lower, upper});
-    }
-    if (key == upper) {
-      return cardKeyPressedAny({upper, lower});
-    }
-    return cardKeyPressedAny({key, lower, upper});
-  }
-  return cardKeyPressedAny({key});
+  return cardKeysPressed(KeySet().letter(key));
 }
 
 bool cardKeyJustPressed(char key) {
-  if (std::isalpha(static_cast<unsigned char>(key))) {
-    char lower = static_cast<char>(std::tolower(static_cast<unsigned char>(key)));
-    char upper = static_cast<char>(std::toupper(static_cast<unsigned char>(key)));
-    if (lower == upper) {
-      return cardKeyJustPressedAny({lower});
-    }
-    if (key == lower) {
-      return cardKeyJustPressedAny({lower, upper});
-    }
-    if (key == upper) {
-      return cardKeyJustPressedAny({upper, lower});
-    }
-    return cardKeyJustPressedAny({key, lower, upper});
-  }
-  return cardKeyJustPressedAny({key});
+  return cardKeysJustPressed(KeySet().letter(key));
 }
 
 void resetKeyLatch() {
-  g_keyLatch.fill(false);
+  captureKeySnapshot();
+  g_keyLatch = g_keysDown;
   const auto &state = M5Cardputer.Keyboard.keysState();
   for (char c : state.word) {
-    size_t idx = asciiLatchIndex(c) % KEY_LATCH_SIZE;
-    g_keyLatch[idx] = true;
-  }
-  for (uint8_t hid : state.hid_keys) {
-    size_t idx = hidLatchIndex(hid) % KEY_LATCH_SIZE;
-    g_keyLatch[idx] = true;
+    g_keyLatch.setAscii(c);
   }
   for (uint8_t mod : state.modifier_keys) {
-    size_t idx = hidLatchIndex(mod) % KEY_LATCH_SIZE;
-    g_keyLatch[idx] = true;
+    g_keyLatch.setHid(mod);
   }
 }
 
@@ -358,18 +544,27 @@ void setScreen(Screen next) {
 
 void resetMatchState();
 void hostStartMatch(uint32_t seed);
-void clientStartMatch(uint32_t seed);
+void clientStartMatch(uint32_t seed, NetMode mode);
 void drawStaticScreen();
 void drawGameFrame();
+void finishFramePush();
+void invalidatePlayfieldContent();
 void processNetwork();
-void sendJoinBroadcast();
-void sendJoinAck();
+void sendJoinRequest();
+void sendJoinAck(bool resumed = false);
 void sendStartPacket(uint32_t seed);
-void sendStatePacket();
+void sendStatePacket(StateSendReason reason = StateSendReason::Event);
+void sendSpectatorState(StateSendReason reason = StateSendReason::Event);
+bool spectatorsWatching(unsigned long now);
 void sendPaddlePacket();
-void updateHostGameplay(float dtSeconds);
+void sendPingPacket();
+void updateHostGameplay();
 void updateClientGameplay(float dtSeconds);
+void updateLockstepGameplay();
+void sendLockstepPackets(unsigned long now);
 void handleConnectionTimeout();
+bool linkStalled();
+void resumeSession(const NetAddress &from);
 bool connectToWiFi();
 void resetToMainMenu();
 void resetToWifiSetup();
@@ -381,9 +576,9 @@ void drawWifiPasswordScreen();
 void drawNameEntryScreen();
 void initConfetti();
 void drawGameOverFrameAnimated(float dtSeconds);
-void handleTextInput(String &buffer, size_t maxLength, bool allowSpaces = true);
+template <size_t Capacity>
+void handleTextInput(FixedString<Capacity> &buffer, size_t maxLength, bool allowSpaces = true);
 void setRemotePlayerName(const char *name);
-void drawPauseOverlay();
 void saveWifiCredentials();
 void loadWifiCredentials();
 
@@ -391,36 +586,27 @@ uint32_t nextRandomSeed() {
   return millis() ^ (micros() << 8);
 }
 
-void centerBallStationary() {
-  g_ballX = SCREEN_WIDTH * 0.5f;
-  g_ballY = SCREEN_HEIGHT * 0.5f;
-  g_ballVX = 0.0f;
-  g_ballVY = 0.0f;
-}
-
-void prepareServe(int direction) {
-  g_serveDirection = direction;
-  g_waitingForServe = true;
-  g_matchActive = true;
-  g_serveRequestTs = millis();
-  centerBallStationary();
+uint32_t newSessionToken() {
+  uint32_t token = esp_random();
+  return token != 0 ? token : 1;
 }
 
 void setRemotePlayerName(const char *name) {
   if (name == nullptr || name[0] == '\0') {
-    g_remotePlayerName = (g_role == Role::Host) ? String("Challenger") : String("Host");
+    g_remotePlayerName = (g_role == Role::Host) ? "Challenger" : "Host";
     return;
   }
-  String candidate = String(name);
+  PlayerName candidate = name;
   candidate.trim();
   if (candidate.isEmpty()) {
-    g_remotePlayerName = (g_role == Role::Host) ? String("Challenger") : String("Host");
+    g_remotePlayerName = (g_role == Role::Host) ? "Challenger" : "Host";
   } else {
     g_remotePlayerName = candidate;
   }
 }
 
-void handleTextInput(String &buffer, size_t maxLength, bool allowSpaces) {
+template <size_t Capacity>
+void handleTextInput(FixedString<Capacity> &buffer, size_t maxLength, bool allowSpaces) {
   if (!M5Cardputer.Keyboard.isChange()) {
     return;
   }
@@ -431,7 +617,7 @@ void handleTextInput(String &buffer, size_t maxLength, bool allowSpaces) {
   const auto &state = M5Cardputer.Keyboard.keysState();
 
   if (state.del && !buffer.isEmpty()) {
-    buffer.remove(buffer.length() - 1);
+    buffer.removeLast();
   }
 
   for (char raw : state.word) {
@@ -445,42 +631,29 @@ void handleTextInput(String &buffer, size_t maxLength, bool allowSpaces) {
     if (buffer.length() >= maxLength) {
       break;
     }
-    buffer += c;
+    buffer.append(c);
   }
 }
 
-void launchBall() {
-  g_waitingForServe = false;
-  float speed = BALL_SPEED_INITIAL;
-  g_ballVX = speed * static_cast<float>(g_serveDirection);
-  float arc = static_cast<float>(random(-60, 61)) / 100.0f;  // -0.60 .. 0.60
-  g_ballVY = speed * 0.6f * arc;
-}
-
-void resetPaddles() {
-  g_hostPaddleY = SCREEN_HEIGHT * 0.5f;
-  g_clientPaddleY = SCREEN_HEIGHT * 0.5f;
-}
-
 void resetMatchState() {
-  g_hostScore = 0;
-  g_clientScore = 0;
-  g_gameOver = false;
-  g_matchActive = false;
-  g_waitingForServe = false;
+  simResetMatch(g_sim);
+  g_simClock = SimClock();
   g_gamePaused = false;
-  g_frameCounter = 0;
-  resetPaddles();
-  centerBallStationary();
+  g_autoPausedForRejoin = false;
+  sendPolicyReset(g_stateSendPolicy);
+  g_ackGapFromFrameId = g_frameCounter + 1;
+  interpReset(g_interp);
+  predictorReset(g_paddlePredictor, g_sim.clientPaddleY);
+  g_lastSentInputSeq = g_paddlePredictor.lastSeq;
+  paddleReceiverReset(g_paddleReceiver);
 }
 
+// UI side of a finished match; the simulation has already settled g_sim.
 void markGameOver() {
-  g_gameOver = true;
-  g_matchActive = false;
-  g_waitingForServe = false;
-  centerBallStationary();
-  if (g_role == Role::Host) {
+  if (g_role == Role::Host && g_netMode == NetMode::Snapshot) {
     sendStatePacket();
+  } else if (g_role == Role::Host && spectatorsWatching(millis())) {
+    sendSpectatorState();
   }
   setScreen(Screen::GameOver);
 }
@@ -488,10 +661,9 @@ void markGameOver() {
 // -----------------------------------------------------------------------------
 // Rendering helpers ----------------------------------------------------------
 
-void drawCenteredText(const String &text, int16_t y, uint8_t size = 2) {
-  auto &display = M5.Display;
+void drawCenteredText(lgfx::LovyanGFX &display, const char *text, int16_t y, uint8_t size = 2) {
   display.setTextSize(size);
-  int16_t x = (SCREEN_WIDTH - (text.length() * 6 * size)) / 2;
+  int16_t x = (SCREEN_WIDTH - (static_cast<int>(strlen(text)) * 6 * size)) / 2;
   if (x < 0) {
     x = 0;
   }
@@ -499,33 +671,37 @@ void drawCenteredText(const String &text, int16_t y, uint8_t size = 2) {
   display.print(text);
 }
 
-String truncatedName(const String &name, size_t maxChars) {
-  if (name.length() <= maxChars) {
-    return name;
-  }
-  if (maxChars <= 3) {
-    return name.substring(0, maxChars);
-  }
-  return name.substring(0, maxChars - 3) + "...";
+void drawCenteredText(const char *text, int16_t y, uint8_t size = 2) {
+  drawCenteredText(M5.Display, text, y, size);
+}
+
+template <size_t Capacity>
+HudText truncatedName(const FixedString<Capacity> &name, size_t maxChars) {
+  HudText result;
+  result.assignTruncated(name.c_str(), maxChars);
+  return result;
 }
 
-String hostNameForDisplay() {
+const PlayerName &hostNameForDisplay() {
   if (g_role == Role::Host) {
     return g_localPlayerName;
   }
-  if (g_role == Role::Client) {
+  if (g_role == Role::Client || g_role == Role::Spectator) {
     return g_remotePlayerName;
   }
   return g_localPlayerName;
 }
 
-String clientNameForDisplay() {
+const PlayerName &clientNameForDisplay() {
   if (g_role == Role::Host) {
     return g_remotePlayerName;
   }
   if (g_role == Role::Client) {
     return g_localPlayerName;
   }
+  if (g_role == Role::Spectator) {
+    return g_spectatedClientName;
+  }
   return g_remotePlayerName;
 }
 
@@ -542,7 +718,7 @@ void drawHostWaiting() {
   display.setTextSize(1);
   display.setCursor(12, 50);
   display.print("Player: ");
-  display.print(g_localPlayerName);
+  display.print(g_localPlayerName.c_str());
   display.setCursor(12, 66);
   display.setCursor(12, 126);
   display.print(WiFi.localIP());
@@ -554,22 +730,110 @@ void drawHostWaiting() {
   display.print("Q = back");
 }
 
+// Client: every lobby heard, in the order they turned up, with the round trip
+// to each. Lobbies already in a match are listed but cannot be joined.
+void drawLobbyBrowser() {
+  auto &display = M5.Display;
+  display.fillScreen(COLOR_BLACK);
+  display.setTextColor(COLOR_WHITE, COLOR_BLACK);
+  HudText title;
+  title.appendFormat("Lobbies (%u)", static_cast<unsigned>(g_lobbies.count));
+  drawCenteredText(title.c_str(), 14, 2);
+  display.setTextSize(1);
+
+  int count = static_cast<int>(g_lobbies.count);
+  if (count == 0) {
+    display.setCursor(12, 48);
+    display.print("Listening on: ");
+    display.print(g_wifiSSID.c_str());
+    display.setCursor(12, 64);
+    display.print("No host waiting yet...");
+  } else {
+    int visibleCount = std::min(LOBBY_MENU_VISIBLE_ROWS, count);
+    int firstIndex = g_lobbyCursor - visibleCount / 2;
+    if (firstIndex < 0) {
+      firstIndex = 0;
+    }
+    if (firstIndex + visibleCount > count) {
+      firstIndex = std::max(0, count - visibleCount);
+    }
+
+    for (int i = 0; i < visibleCount; ++i) {
+      int idx = firstIndex + i;
+      int y = 42 + (i * 16);
+      const LobbyEntry &lobby = lobbyTableAt(g_lobbies, static_cast<size_t>(idx));
+      bool open = lobby.beacon.state == LobbyState::Open;
+      uint16_t ink = open ? COLOR_WHITE : COLOR_NET;
+      if (idx == g_lobbyCursor) {
+        display.fillRoundRect(10, y - 3, SCREEN_WIDTH - 20, 14, 2, COLOR_NET);
+        display.setTextColor(open ? COLOR_BLACK : COLOR_WHITE, COLOR_NET);
+      } else {
+        display.setTextColor(ink, COLOR_BLACK);
+      }
+      display.setCursor(14, y);
+      display.print(lobby.beacon.name[0] != '\0' ? lobby.beacon.name : "Host");
+      display.setCursor(SCREEN_WIDTH - 110, y);
+      if (lobby.srttUs == 0) {
+        display.print("--");
+      } else if (lobby.srttUs < 1000) {
+        display.print("<1ms");
+      } else {
+        display.printf("%lums", static_cast<unsigned long>(lobby.srttUs / 1000));
+      }
+      display.setCursor(SCREEN_WIDTH - 64, y);
+      if (g_hasJoinTarget && lobby.beacon.lobbyId == g_joinLobbyId) {
+        display.print("join..");
+      } else {
+        display.print(open ? "open" : "busy");
+      }
+      if (lobby.beacon.netMode == NetMode::Lockstep) {
+        display.setCursor(SCREEN_WIDTH - 22, y);
+        display.print("L");
+      }
+    }
+    display.setTextColor(COLOR_WHITE, COLOR_BLACK);
+  }
+
+  if (!g_errorMessage.isEmpty()) {
+    display.setTextColor(COLOR_RED, COLOR_BLACK);
+    display.setCursor(12, SCREEN_HEIGHT - 40);
+    display.print(g_errorMessage.c_str());
+    display.setTextColor(COLOR_WHITE, COLOR_BLACK);
+  }
+
+  display.setCursor(12, SCREEN_HEIGHT - 26);
+  display.print("; up  . dn  Enter=join");
+  display.setCursor(12, SCREEN_HEIGHT - 14);
+  display.print("Q=back");
+  g_lastLobbyDraw = millis();
+}
+
 void drawClientSearching() {
+  if (g_role == Role::Client && !g_awaitingRejoin) {
+    drawLobbyBrowser();
+    return;
+  }
   auto &display = M5.Display;
   display.fillScreen(COLOR_BLACK);
   display.setTextColor(COLOR_WHITE, COLOR_BLACK);
-  drawCenteredText("Searching...", 18, 2);
+  drawCenteredText(g_awaitingRejoin ? "Rejoining..." : "Searching...", 18, 2);
 
   display.setTextSize(1);
   display.setCursor(12, 56);
   display.print("Looking on: ");
-  display.print(g_wifiSSID);
+  display.print(g_wifiSSID.c_str());
   display.setCursor(12, 72);
-  display.print("Host must be waiting");
+  if (g_role == Role::Spectator) {
+    display.print("Watching the first match found");
+  } else {
+    display.print("Match kept by host");
+  }
   display.setCursor(12, 114);
   display.print("Q = back");
-  display.setCursor(12, 126);
-  display.print("; up  . dn move");
+  if (g_role != Role::Spectator) {
+    display.setCursor(12, 126);
+    display.print("; up  . dn move");
+  }
 }
 
 void drawWifiSelectScreen() {
@@ -605,11 +869,11 @@ void drawWifiSelectScreen() {
       }
       const auto &info = g_wifiNetworks[idx];
       display.setCursor(14, y);
-      String ssid = info.ssid;
+      SsidString ssid = info.ssid;
       if (ssid.isEmpty()) {
         ssid = "<Hidden>";
       }
-      display.print(truncatedName(ssid, 16));
+      display.print(truncatedName(ssid, 16).c_str());
       display.setCursor(SCREEN_WIDTH - 70, y);
       display.printf("%ddBm", info.rssi);
       if (info.authMode != WIFI_AUTH_OPEN) {
@@ -623,7 +887,7 @@ void drawWifiSelectScreen() {
   if (!g_errorMessage.isEmpty()) {
     display.setTextColor(COLOR_RED, COLOR_BLACK);
     display.setCursor(12, SCREEN_HEIGHT - 46);
-    display.print(g_errorMessage);
+    display.print(g_errorMessage.c_str());
     display.setTextColor(COLOR_WHITE, COLOR_BLACK);
   }
 
@@ -643,28 +907,27 @@ void drawWifiPasswordScreen() {
   display.setCursor(12, 52);
   display.print("SSID:");
   display.setCursor(12, 64);
-  display.print(truncatedName(g_wifiSSID, 18));
+  display.print(truncatedName(g_wifiSSID, 18).c_str());
 
-  String shown = g_wifiPassword;
+  PasswordString shown = g_wifiPassword;
   if (!g_wifiPasswordVisible) {
-    shown = "";
-    shown.reserve(g_wifiPassword.length());
-    for (size_t i = 0; i < static_cast<size_t>(g_wifiPassword.length()); ++i) {
-      shown += '*';
+    shown.clear();
+    for (size_t i = 0; i < g_wifiPassword.length(); ++i) {
+      shown.append('*');
     }
   }
 
   display.setCursor(12, 82);
   display.print("Pass:");
   display.setCursor(12, 94);
-  display.print(truncatedName(shown, 18));
+  display.print(truncatedName(shown, 18).c_str());
 
   display.setTextSize(1);
   int infoY = 110;
   if (!g_errorMessage.isEmpty()) {
     display.setTextColor(COLOR_RED, COLOR_BLACK);
     display.setCursor(12, infoY);
-    display.print(g_errorMessage);
+    display.print(g_errorMessage.c_str());
     display.setTextColor(COLOR_WHITE, COLOR_BLACK);
     infoY += 12;
   }
@@ -685,7 +948,7 @@ void drawNameEntryScreen() {
   display.print("Enter the name to show opponents:");
 
   display.setCursor(12, 76);
-  display.print(g_localPlayerName);
+  display.print(g_localPlayerName.c_str());
 
   display.setCursor(12, 118);
   display.print("Enter=continue  Backspace=erase  Fn+Q=WiFi");
@@ -732,12 +995,12 @@ void drawRoleSelectFrame(float dtSeconds) {
   display.setTextSize(1);
   display.setCursor(12, 48);
   display.print("Player: ");
-  display.print(truncatedName(g_localPlayerName, 16));
+  display.print(truncatedName(g_localPlayerName, 16).c_str());
 
   display.setCursor(12, 64);
   display.print("WiFi: ");
   if (WiFi.status() == WL_CONNECTED) {
-    display.print(truncatedName(g_wifiSSID, 18));
+    display.print(truncatedName(g_wifiSSID, 18).c_str());
   } else {
     display.print("not connected");
   }
@@ -747,7 +1010,7 @@ void drawRoleSelectFrame(float dtSeconds) {
   display.print(WiFi.localIP());
 
   display.setCursor(12, 100);
-  display.print("[H] Host match    [J] Join match");
+  display.print("[H] Host  [J] Join  [V] Watch");
   display.setCursor(12, 114);
   display.print("; up  . down  |  Space serve");
   display.setCursor(12, 126);
@@ -803,34 +1066,34 @@ void drawGameOverFrameAnimated(float dtSeconds) {
   }
 
   display.setTextColor(COLOR_WHITE, COLOR_BLACK);
-  String hostName = hostNameForDisplay();
-  String clientName = clientNameForDisplay();
+  const PlayerName &hostName = hostNameForDisplay();
+  const PlayerName &clientName = clientNameForDisplay();
 
-  bool tie = g_hostScore == g_clientScore;
-  String winnerLine;
+  bool tie = g_sim.hostScore == g_sim.clientScore;
+  HudText winnerLine;
   if (tie) {
     winnerLine = "Draw Game";
-  } else if (g_hostScore > g_clientScore) {
-    winnerLine = truncatedName(hostName, 16) + " wins!";
+  } else if (g_sim.hostScore > g_sim.clientScore) {
+    winnerLine.format("%s wins!", truncatedName(hostName, 16).c_str());
   } else {
-    winnerLine = truncatedName(clientName, 16) + " wins!";
+    winnerLine.format("%s wins!", truncatedName(clientName, 16).c_str());
   }
 
-  drawCenteredText(winnerLine, 16, 2);
+  drawCenteredText(winnerLine.c_str(), 16, 2);
 
   display.setTextSize(2);
   display.setCursor(60, 56);
-  display.printf("%u", g_hostScore);
+  display.printf("%u", g_sim.hostScore);
   display.setCursor(SCREEN_WIDTH - 60, 56);
-  display.printf("%u", g_clientScore);
+  display.printf("%u", g_sim.clientScore);
 
   display.setTextSize(1);
   display.setCursor(12, 84);
   display.print("Left: ");
-  display.print(truncatedName(hostName, 14));
+  display.print(truncatedName(hostName, 14).c_str());
   display.setCursor(12, 100);
   display.print("Right: ");
-  display.print(truncatedName(clientName, 14));
+  display.print(truncatedName(clientName, 14).c_str());
 
   display.setCursor(12, 118);
   if (g_role == Role::Host) {
@@ -845,17 +1108,34 @@ void drawLobby() {
   auto &display = M5.Display;
   display.fillScreen(COLOR_BLACK);
   display.setTextColor(COLOR_WHITE, COLOR_BLACK);
+  if (g_role == Role::Spectator) {
+    drawCenteredText("Watching", 16, 2);
+    display.setTextSize(1);
+    display.setCursor(12, 48);
+    display.print("Left: ");
+    display.print(truncatedName(hostNameForDisplay(), 18).c_str());
+    display.setCursor(12, 64);
+    display.print("Right: ");
+    display.print(truncatedName(clientNameForDisplay(), 18).c_str());
+    display.setCursor(12, 96);
+    display.print("Waiting for host to serve...");
+    display.setCursor(12, 126);
+    display.print("Press Q to stop watching");
+    return;
+  }
   drawCenteredText("Opponent Linked", 16, 2);
 
   display.setTextSize(1);
   display.setCursor(12, 48);
   display.print("You: ");
-  display.print(truncatedName(g_localPlayerName, 18));
+  display.print(truncatedName(g_localPlayerName, 18).c_str());
   display.setCursor(12, 64);
   display.print("Opponent: ");
-  display.print(truncatedName(g_remotePlayerName, 18));
+  display.print(truncatedName(g_remotePlayerName, 18).c_str());
 
   if (g_role == Role::Host) {
+    display.setCursor(12, 80);
+    display.print(g_netMode == NetMode::Lockstep ? "Netcode: lockstep  (L)" : "Netcode: snapshots (L)");
     display.setCursor(12, 96);
     display.print("Space to serve the first ball.");
     display.setCursor(12, 112);
@@ -885,7 +1165,7 @@ void drawErrorScreen() {
   drawCenteredText("Connection Error", 18, 2);
   display.setTextSize(1);
   display.setCursor(12, 62);
-  display.print(g_errorMessage);
+  display.print(g_errorMessage.c_str());
   display.setCursor(12, 90);
   display.print("Press Q to reconfigure");
 }
@@ -926,6 +1206,8 @@ void drawStaticScreen() {
 }
 
 void onScreenEnter(Screen screen) {
+  finishFramePush();
+  invalidatePlayfieldContent();
   switch (screen) {
     case Screen::WifiSelect:
       g_errorMessage.clear();
@@ -944,6 +1226,9 @@ void onScreenEnter(Screen screen) {
       g_menuStarsInitialized = false;
       initMenuStars();
       break;
+    case Screen::Playing:
+      g_heapWatermark = HeapWatermark();
+      break;
     case Screen::GameOver:
       g_confettiActive = false;
       break;
@@ -952,9 +1237,234 @@ void onScreenEnter(Screen screen) {
   }
 }
 
-void drawGameFrame() {
-  auto &display = M5.Display;
-  display.startWrite();
+void drawOverlayBox(lgfx::LovyanGFX &display, const char *title, const char *hint) {
+  display.fillRoundRect(24, 40, SCREEN_WIDTH - 48, 56, 6, COLOR_BLACK);
+  display.drawRoundRect(24, 40, SCREEN_WIDTH - 48, 56, 6, COLOR_WHITE);
+  display.setTextColor(COLOR_WHITE, COLOR_BLACK);
+  display.setTextSize(1);
+  display.setCursor(38, 56);
+  display.print(title);
+  display.setCursor(30, 72);
+  display.print(hint);
+}
+
+void drawPauseOverlay(lgfx::LovyanGFX &display) {
+  drawOverlayBox(display, "Game Paused", "Esc resume   Q menu");
+}
+
+constexpr int16_t HUD_LINE_HEIGHT = 9;
+
+// F shows the frame and heap lines, N the three network lines.
+uint8_t hudStatsLines() {
+  uint8_t lines = g_showFrameStats ? 2 : 0;
+  if (g_showNetStats) {
+    lines += 3;
+  }
+  return lines;
+}
+
+int16_t hudStatsTop() {
+  return static_cast<int16_t>(SCREEN_HEIGHT - HUD_LINE_HEIGHT * hudStatsLines());
+}
+
+void drawHudStats(lgfx::LovyanGFX &display) {
+  display.setTextSize(1);
+  display.setTextColor(COLOR_NET, COLOR_BLACK);
+  int16_t y = hudStatsTop();
+  if (g_showFrameStats) {
+    display.setCursor(4, y);
+    display.printf("%s %lums %luus pk%lu %lupx",
+                   g_renderPath == RenderPath::Canvas ? (g_frameCanvasCount > 1 ? "DMAx2" : "DMA") : "direct",
+                   static_cast<unsigned long>(g_frameStats.frameUs / 1000),
+                   static_cast<unsigned long>(g_frameStats.renderUs),
+                   static_cast<unsigned long>(g_frameStats.renderPeakUs),
+                   static_cast<unsigned long>(g_frameStats.pushedPixels));
+    y += HUD_LINE_HEIGHT;
+    display.setCursor(4, y);
+    display.printf("heap %lu alloc %lu/%lu max%lu rx%lu",
+                   static_cast<unsigned long>(g_heapWatermark.lowestFree == UINT32_MAX ? 0 : g_heapWatermark.lowestFree),
+                   static_cast<unsigned long>(g_heapWatermark.allocatingFrames),
+                   static_cast<unsigned long>(g_heapWatermark.frames),
+                   static_cast<unsigned long>(g_heapWatermark.worstFrameAllocations),
+                   static_cast<unsigned long>(g_heapWatermark.receiveAllocations));
+    y += HUD_LINE_HEIGHT;
+  }
+  if (g_showNetStats) {
+    display.setCursor(4, y);
+    if (g_netClock.hasSample) {
+      display.printf("rtt %lu.%lums jit %lu.%lums off %+ldms %luHz",
+                     static_cast<unsigned long>(g_netClock.srttUs / 1000),
+                     static_cast<unsigned long>(g_netClock.srttUs / 100 % 10),
+                     static_cast<unsigned long>(g_netClock.rttVarUs / 1000),
+                     static_cast<unsigned long>(g_netClock.rttVarUs / 100 % 10),
+                     static_cast<long>(g_netClock.offsetMs),
+                     static_cast<unsigned long>(rateControllerHz(g_sendRate)));
+    } else {
+      display.printf("rtt --  pings %lu", static_cast<unsigned long>(g_netClock.pingsSent));
+    }
+    y += HUD_LINE_HEIGHT;
+    if (g_netMode == NetMode::Lockstep) {
+      display.setCursor(4, y);
+      display.printf("lock tick %lu buf %lu stall %lu drop %lu",
+                     static_cast<unsigned long>(g_lockstep.tick),
+                     static_cast<unsigned long>(g_lockstep.remoteEnd - g_lockstep.tick),
+                     static_cast<unsigned long>(g_lockstep.stats.stalls),
+                     static_cast<unsigned long>(g_lockstep.stats.droppedTicks));
+      y += HUD_LINE_HEIGHT;
+      display.setCursor(4, y);
+      display.printf("hash %lu desync %lu resync %lu",
+                     static_cast<unsigned long>(g_lockstep.stats.hashesChecked),
+                     static_cast<unsigned long>(g_lockstep.stats.desyncs),
+                     static_cast<unsigned long>(g_lockstep.stats.resyncs));
+    } else if (g_role == Role::Host) {
+      display.setCursor(4, y);
+      display.printf("state tx ev %lu mv %lu key %lu",
+                     static_cast<unsigned long>(g_stateSendPolicy.stats.events),
+                     static_cast<unsigned long>(g_stateSendPolicy.stats.motion),
+                     static_cast<unsigned long>(g_stateSendPolicy.stats.keyframes));
+      y += HUD_LINE_HEIGHT;
+      display.setCursor(4, y);
+      display.printf("pad in %lu rec %lu lost %lu rs %lu clamp %lu",
+                     static_cast<unsigned long>(g_paddleReceiver.stats.inputsApplied),
+                     static_cast<unsigned long>(g_paddleReceiver.stats.inputsRecovered),
+                     static_cast<unsigned long>(g_paddleReceiver.stats.inputsLost),
+                     static_cast<unsigned long>(g_paddleReceiver.stats.resyncs),
+                     static_cast<unsigned long>(g_paddleReceiver.stats.clamped));
+    } else {
+      display.setCursor(4, y);
+      display.printf("interp %lums%s buf %lu lead %ld under %lu",
+                     static_cast<unsigned long>(g_interpDelayMs),
+                     g_interpDelayAuto ? "A" : "",
+                     static_cast<unsigned long>(g_interp.stats.buffered),
+                     static_cast<long>(g_interp.stats.leadMs),
+                     static_cast<unsigned long>(g_interp.stats.underruns));
+      y += HUD_LINE_HEIGHT;
+      display.setCursor(4, y);
+      display.printf("state rx %lu lost %lu reord %lu dup %lu nb %lu",
+                     static_cast<unsigned long>(g_stateSequence.stats.received),
+                     static_cast<unsigned long>(g_stateSequence.stats.lost),
+                     static_cast<unsigned long>(g_stateSequence.stats.reordered),
+                     static_cast<unsigned long>(g_stateSequence.stats.duplicates),
+                     static_cast<unsigned long>(g_stateBaselineMisses));
+    }
+  }
+  display.setTextColor(COLOR_WHITE, COLOR_BLACK);
+}
+
+// allocationsAtFrameStart and allocationsAfterReceive are g_loopAllocations at
+// the top of loop() and after processNetwork().
+void updateHeapWatermark(uint32_t allocationsAtFrameStart, uint32_t allocationsAfterReceive) {
+  uint32_t allocations = g_loopAllocations - allocationsAtFrameStart;
+  ++g_heapWatermark.frames;
+  if (allocations != 0) {
+    ++g_heapWatermark.allocatingFrames;
+    g_heapWatermark.worstFrameAllocations = std::max(g_heapWatermark.worstFrameAllocations, allocations);
+  }
+  g_heapWatermark.receiveAllocations += allocationsAfterReceive - allocationsAtFrameStart;
+  g_heapWatermark.lowestFree = std::min(g_heapWatermark.lowestFree, static_cast<uint32_t>(ESP.getFreeHeap()));
+}
+
+bool rectEmpty(const DirtyRect &rect) {
+  return rect.w <= 0 || rect.h <= 0;
+}
+
+int32_t rectArea(const DirtyRect &rect) {
+  return rectEmpty(rect) ? 0 : static_cast<int32_t>(rect.w) * rect.h;
+}
+
+DirtyRect clipToScreen(int x, int y, int w, int h) {
+  int x0 = std::max(x, 0);
+  int y0 = std::max(y, 0);
+  int x1 = std::min(x + w, SCREEN_WIDTH);
+  int y1 = std::min(y + h, SCREEN_HEIGHT);
+  DirtyRect rect;
+  if (x1 > x0 && y1 > y0) {
+    rect.x = static_cast<int16_t>(x0);
+    rect.y = static_cast<int16_t>(y0);
+    rect.w = static_cast<int16_t>(x1 - x0);
+    rect.h = static_cast<int16_t>(y1 - y0);
+  }
+  return rect;
+}
+
+DirtyRect rectUnion(const DirtyRect &a, const DirtyRect &b) {
+  if (rectEmpty(a)) {
+    return b;
+  }
+  if (rectEmpty(b)) {
+    return a;
+  }
+  int x0 = std::min(a.x, b.x);
+  int y0 = std::min(a.y, b.y);
+  int x1 = std::max(a.x + a.w, b.x + b.w);
+  int y1 = std::max(a.y + a.h, b.y + b.h);
+  return clipToScreen(x0, y0, x1 - x0, y1 - y0);
+}
+
+struct DirtyList {
+  std::array<DirtyRect, MAX_DIRTY_RECTS> rects{};
+  size_t count = 0;
+};
+
+// Adds the area covered by an object before and after a move. The two boxes are
+// merged when that costs little extra area, otherwise they are kept separate so
+// a fast ball does not drag a screen-wide strip along with it.
+void addDirtyMove(DirtyList &list, const DirtyRect &before, const DirtyRect &after) {
+  if (rectEmpty(before) && rectEmpty(after)) {
+    return;
+  }
+  if (before.x == after.x && before.y == after.y && before.w == after.w && before.h == after.h) {
+    return;
+  }
+  DirtyRect merged = rectUnion(before, after);
+  if (rectArea(merged) <= 2 * (rectArea(before) + rectArea(after)) || list.count + 2 > MAX_DIRTY_RECTS) {
+    if (list.count < MAX_DIRTY_RECTS) {
+      list.rects[list.count++] = merged;
+    }
+    return;
+  }
+  if (!rectEmpty(before)) {
+    list.rects[list.count++] = before;
+  }
+  if (!rectEmpty(after)) {
+    list.rects[list.count++] = after;
+  }
+}
+
+DirtyRect paddleBounds(float paddleX, SimScalar paddleY) {
+  int y = static_cast<int>(roundf(simToFloat(paddleY) - PADDLE_HALF_HEIGHT));
+  return clipToScreen(static_cast<int>(paddleX), y, static_cast<int>(PADDLE_WIDTH), static_cast<int>(PADDLE_HEIGHT));
+}
+
+DirtyRect ballBounds() {
+  int radius = static_cast<int>(BALL_RADIUS);
+  int x = static_cast<int>(roundf(simToFloat(g_sim.ballX) - BALL_RADIUS));
+  int y = static_cast<int>(roundf(simToFloat(g_sim.ballY) - BALL_RADIUS));
+  // fillCircle covers centre +/- radius inclusive.
+  return clipToScreen(x, y, radius * 2 + 1, radius * 2 + 1);
+}
+
+void capturePlayfieldStatics(PlayfieldStatics &statics) {
+  statics.hostName.assignTruncated(hostNameForDisplay().c_str(), 12);
+  statics.clientName.assignTruncated(clientNameForDisplay().c_str(), 12);
+  statics.hostScore = g_sim.hostScore;
+  statics.clientScore = g_sim.clientScore;
+  statics.waitingForServe = g_sim.waitingForServe;
+  statics.paused = g_gamePaused;
+  statics.awaitingRejoin = g_awaitingRejoin;
+  statics.desynced = g_netMode == NetMode::Lockstep && g_lockstep.desynced;
+  statics.linkState = g_linkMonitor.state;
+  statics.statsLines = hudStatsLines();
+}
+
+bool sameStatics(const PlayfieldStatics &a, const PlayfieldStatics &b) {
+  return a.hostScore == b.hostScore && a.clientScore == b.clientScore && a.waitingForServe == b.waitingForServe &&
+         a.paused == b.paused && a.awaitingRejoin == b.awaitingRejoin && a.desynced == b.desynced && a.linkState == b.linkState && a.statsLines == b.statsLines && a.hostName == b.hostName && a.clientName == b.clientName;
+}
+
+// Net, names, scores and the serve banner. Honours the target's clip rect, so it
+// doubles as the eraser for the dirty-rectangle path.
+void renderPlayfieldBackground(lgfx::LovyanGFX &display, const PlayfieldStatics &statics) {
   display.fillScreen(COLOR_BLACK);
   display.setTextColor(COLOR_WHITE, COLOR_BLACK);
 
@@ -964,231 +1474,684 @@ void drawGameFrame() {
   }
 
   display.setTextSize(1);
-  String hostName = truncatedName(hostNameForDisplay(), 12);
-  String clientName = truncatedName(clientNameForDisplay(), 12);
   display.setCursor(12, 6);
-  display.print(hostName);
-  int clientWidth = static_cast<int>(clientName.length()) * 6;
+  display.print(statics.hostName.c_str());
+  int clientWidth = static_cast<int>(statics.clientName.length()) * 6;
   display.setCursor(SCREEN_WIDTH - clientWidth - 12, 6);
-  display.print(clientName);
+  display.print(statics.clientName.c_str());
 
   // Scores
   display.setTextSize(2);
   display.setCursor(60, 8);
-  display.printf("%u", g_hostScore);
+  display.printf("%u", statics.hostScore);
   display.setCursor(SCREEN_WIDTH - 60, 8);
-  display.printf("%u", g_clientScore);
+  display.printf("%u", statics.clientScore);
 
   display.setTextSize(1);
-  if (g_waitingForServe) {
-    drawCenteredText("Serve ready...", 28, 1);
+  if (statics.waitingForServe) {
+    drawCenteredText(display, "Serve ready...", 28, 1);
+  }
+  if (statics.desynced) {
+    drawCenteredText(display, "Resyncing...", 18, 1);
+  } else if (statics.linkState == LinkState::Degraded) {
+    drawCenteredText(display, "Weak link", 18, 1);
   }
+}
 
+// Paddles, ball and the overlays that sit on top of them.
+void renderPlayfieldForeground(lgfx::LovyanGFX &display) {
   // Paddles
-  int hostY = static_cast<int>(roundf(g_hostPaddleY - PADDLE_HALF_HEIGHT));
-  int clientY = static_cast<int>(roundf(g_clientPaddleY - PADDLE_HALF_HEIGHT));
+  int hostY = static_cast<int>(roundf(simToFloat(g_sim.hostPaddleY) - PADDLE_HALF_HEIGHT));
+  int clientY = static_cast<int>(roundf(simToFloat(g_sim.clientPaddleY) - PADDLE_HALF_HEIGHT));
   display.fillRect(static_cast<int>(HOST_PADDLE_X), hostY, static_cast<int>(PADDLE_WIDTH), static_cast<int>(PADDLE_HEIGHT), COLOR_WHITE);
   display.fillRect(static_cast<int>(CLIENT_PADDLE_X), clientY, static_cast<int>(PADDLE_WIDTH), static_cast<int>(PADDLE_HEIGHT), COLOR_WHITE);
 
   // Ball
-  int ballX = static_cast<int>(roundf(g_ballX - BALL_RADIUS));
-  int ballY = static_cast<int>(roundf(g_ballY - BALL_RADIUS));
+  int ballX = static_cast<int>(roundf(simToFloat(g_sim.ballX) - BALL_RADIUS));
+  int ballY = static_cast<int>(roundf(simToFloat(g_sim.ballY) - BALL_RADIUS));
   display.fillCircle(ballX + static_cast<int>(BALL_RADIUS), ballY + static_cast<int>(BALL_RADIUS), static_cast<int>(BALL_RADIUS), COLOR_WHITE);
 
-  display.endWrite();
+  if (g_awaitingRejoin) {
+    drawOverlayBox(display, "Waiting for rejoin...", "Q menu");
+  } else if (linkStalled()) {
+    drawOverlayBox(display, "Reconnecting...", "Q menu");
+  } else if (g_gamePaused) {
+    drawPauseOverlay(display);
+  }
+  if (hudStatsLines() > 0) {
+    display.fillRect(0, hudStatsTop(), SCREEN_WIDTH, SCREEN_HEIGHT - hudStatsTop(), COLOR_BLACK);
+    drawHudStats(display);
+  }
+}
+
+void capturePlayfieldContent(PlayfieldContent &content, const PlayfieldStatics &statics) {
+  content.valid = true;
+  content.statics = statics;
+  content.hostPaddle = paddleBounds(HOST_PADDLE_X, g_sim.hostPaddleY);
+  content.clientPaddle = paddleBounds(CLIENT_PADDLE_X, g_sim.clientPaddleY);
+  content.ball = ballBounds();
+}
+
+void invalidatePlayfieldContent() {
+  for (auto &content : g_canvasContent) {
+    content.valid = false;
+  }
+  g_panelContent.valid = false;
+}
+
+// Brings a canvas up to date with the current frame. If its static layer is
+// still current, only the rectangles the moving objects used to cover are
+// repainted from the background layer before the foreground goes on top.
+void composePlayfieldCanvas(M5Canvas &canvas, PlayfieldContent &content, const PlayfieldStatics &statics) {
+  if (!content.valid || !sameStatics(content.statics, statics)) {
+    renderPlayfieldBackground(canvas, statics);
+  } else {
+    const DirtyRect stale[] = {content.hostPaddle, content.clientPaddle, content.ball};
+    for (const DirtyRect &rect : stale) {
+      if (rectEmpty(rect)) {
+        continue;
+      }
+      canvas.setClipRect(rect.x, rect.y, rect.w, rect.h);
+      renderPlayfieldBackground(canvas, statics);
+    }
+    canvas.clearClipRect();
+  }
+  renderPlayfieldForeground(canvas);
+  capturePlayfieldContent(content, statics);
+}
+
+void renderPlayfield(lgfx::LovyanGFX &display) {
+  PlayfieldStatics statics;
+  capturePlayfieldStatics(statics);
+  renderPlayfieldBackground(display, statics);
+  renderPlayfieldForeground(display);
+}
+
+void initFrameCanvases() {
+  g_frameCanvasCount = 0;
+  for (M5Canvas *canvas : g_frameCanvases) {
+    canvas->setColorDepth(16);
+    canvas->setPsram(false);  // DMA needs internal RAM; two 64.8 KB buffers fit next to the Wi-Fi stack
+    if (canvas->createSprite(SCREEN_WIDTH, SCREEN_HEIGHT) == nullptr) {
+      break;
+    }
+    ++g_frameCanvasCount;
+  }
+  if (g_frameCanvasCount == 0) {
+    g_renderPath = RenderPath::Direct;
+  }
+  invalidatePlayfieldContent();
 }
 
-void drawPauseOverlay() {
+// Closes the SPI transaction left open by the previous DMA push. endWrite()
+// blocks until the transfer has drained, so call this before the panel or the
+// buffer being pushed is touched again.
+void finishFramePush() {
+  if (g_framePushPending) {
+    M5.Display.endWrite();
+    g_framePushPending = false;
+  }
+}
+
+// Sends only the listed rectangles of the canvas to the panel. The clip rect
+// makes pushImageDMA() skip every row and column outside it.
+uint32_t pushFrameCanvas(M5Canvas &canvas, const DirtyList &dirty) {
   auto &display = M5.Display;
-  display.fillRoundRect(24, 40, SCREEN_WIDTH - 48, 56, 6, COLOR_BLACK);
-  display.drawRoundRect(24, 40, SCREEN_WIDTH - 48, 56, 6, COLOR_WHITE);
-  display.setTextColor(COLOR_WHITE, COLOR_BLACK);
-  display.setTextSize(1);
-  display.setCursor(38, 56);
-  display.print("Game Paused");
-  display.setCursor(30, 72);
-  display.print("Esc resume   Q menu");
+  const auto *pixels = static_cast<const lgfx::swap565_t *>(canvas.getBuffer());
+  uint32_t pushed = 0;
+  finishFramePush();
+  display.startWrite();
+  for (size_t i = 0; i < dirty.count; ++i) {
+    const DirtyRect &rect = dirty.rects[i];
+    display.setClipRect(rect.x, rect.y, rect.w, rect.h);
+    display.pushImageDMA(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, pixels);
+    pushed += static_cast<uint32_t>(rectArea(rect));
+  }
+  display.clearClipRect();
+  // Leave the transaction open so the transfer overlaps the next frame's
+  // simulation; finishFramePush() closes it.
+  g_framePushPending = true;
+  return pushed;
+}
+
+void drawGameFrame() {
+  unsigned long startUs = micros();
+  uint32_t pushedPixels = static_cast<uint32_t>(SCREEN_WIDTH) * SCREEN_HEIGHT;
+
+  if (g_renderPath == RenderPath::Canvas && g_frameCanvasCount > 0) {
+    if (g_frameCanvasCount == 1) {
+      finishFramePush();  // single buffer: the previous push still reads from it
+    }
+    PlayfieldStatics statics;
+    capturePlayfieldStatics(statics);
+    M5Canvas &canvas = *g_frameCanvases[g_frameCanvasIndex];
+    composePlayfieldCanvas(canvas, g_canvasContent[g_frameCanvasIndex], statics);
+
+    const PlayfieldContent &shown = g_canvasContent[g_frameCanvasIndex];
+    DirtyList dirty;
+    if (!g_panelContent.valid || !sameStatics(g_panelContent.statics, statics)) {
+      dirty.rects[dirty.count++] = clipToScreen(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+    } else {
+      addDirtyMove(dirty, g_panelContent.hostPaddle, shown.hostPaddle);
+      addDirtyMove(dirty, g_panelContent.clientPaddle, shown.clientPaddle);
+      addDirtyMove(dirty, g_panelContent.ball, shown.ball);
+      if (hudStatsLines() > 0 && dirty.count < MAX_DIRTY_RECTS) {
+        dirty.rects[dirty.count++] = clipToScreen(0, hudStatsTop(), SCREEN_WIDTH, SCREEN_HEIGHT - hudStatsTop());
+      }
+    }
+    pushedPixels = pushFrameCanvas(canvas, dirty);
+    g_panelContent = shown;
+    g_frameCanvasIndex = static_cast<uint8_t>((g_frameCanvasIndex + 1) % g_frameCanvasCount);
+  } else {
+    finishFramePush();
+    auto &display = M5.Display;
+    display.startWrite();
+    renderPlayfield(display);
+    display.endWrite();
+    g_panelContent.valid = false;
+  }
+
+  uint32_t renderUs = static_cast<uint32_t>(micros() - startUs);
+  g_frameStats.renderUs = (g_frameStats.renderUs * 7 + renderUs) / 8;
+  g_frameStats.windowPeakUs = std::max(g_frameStats.windowPeakUs, renderUs);
+  g_frameStats.pushedPixels = (g_frameStats.pushedPixels * 7 + pushedPixels) / 8;
+}
+
+void updateFrameStats() {
+  unsigned long nowUs = micros();
+  if (g_frameStats.lastFrameUs != 0) {
+    uint32_t frameUs = static_cast<uint32_t>(nowUs - g_frameStats.lastFrameUs);
+    g_frameStats.frameUs = (g_frameStats.frameUs * 7 + frameUs) / 8;
+  }
+  g_frameStats.lastFrameUs = nowUs;
+
+  unsigned long nowMs = millis();
+  if (nowMs - g_frameStats.windowStartMs >= 1000) {
+    g_frameStats.renderPeakUs = g_frameStats.windowPeakUs;
+    g_frameStats.windowPeakUs = 0;
+    g_frameStats.windowStartMs = nowMs;
+  }
 }
 
 // -----------------------------------------------------------------------------
 // Networking -----------------------------------------------------------------
 
-void sendJoinBroadcast() {
+template <typename Packet>
+void sendToPeer(const Packet &packet) {
+  g_transport.sendTo(g_peer, reinterpret_cast<const uint8_t *>(&packet), sizeof(packet));
+}
+
+// Client: asks the lobby picked from the list, or when rejoining the host
+// that kept the match, for a seat.
+void sendJoinRequest() {
+  if (!g_hasJoinTarget) {
+    return;
+  }
   JoinPacket packet{};
   packet.type = static_cast<uint8_t>(PacketType::Join);
   memset(packet.name, 0, sizeof(packet.name));
-  g_localPlayerName.toCharArray(packet.name, PLAYER_NAME_MAX_LEN);
-  g_udp.beginPacket(IPAddress(255, 255, 255, 255), UDP_PORT);
-  g_udp.write(reinterpret_cast<uint8_t *>(&packet), sizeof(packet));
-  g_udp.endPacket();
+  g_localPlayerName.copyTo(packet.name, PLAYER_NAME_MAX_LEN);
+  packet.sessionToken = g_sessionToken;
+  g_transport.sendTo(g_joinTarget, reinterpret_cast<const uint8_t *>(&packet), sizeof(packet));
+}
+
+// Host: announces the lobby to the subnet, once a second while it waits for a
+// player and every LOBBY_BEACON_BUSY_INTERVAL_MS once it has one, so a match
+// stays listed without inviting joins. A change of state goes out at once.
+void updateLobbyBeacon(unsigned long now) {
+  if (g_role != Role::Host || g_screen < Screen::HostWaiting || g_screen == Screen::Error) {
+    return;
+  }
+  LobbyState state = g_screen == Screen::HostWaiting ? LobbyState::Open : LobbyState::Playing;
+  if (state == g_beaconState && now - g_lastBeaconSent < lobbyBeaconIntervalMs(state)) {
+    return;
+  }
+  LobbyBeacon beacon;
+  beacon.lobbyId = g_lobbyId;
+  beacon.seq = ++g_beaconSeq;
+  beacon.state = state;
+  beacon.netMode = g_netMode;
+  g_localPlayerName.copyTo(beacon.name, sizeof(beacon.name));
+  uint8_t packet[LOBBY_BEACON_MAX];
+  size_t length = lobbyBeaconEncode(beacon, packet, sizeof(packet));
+  g_transport.broadcast(UDP_PORT, packet, length);
+  g_beaconState = state;
+  g_lastBeaconSent = now;
 }
 
-void sendJoinAck() {
+// Client: whether beacons and probe answers are wanted, i.e. the lobby list
+// is on screen.
+bool browsingLobbies() {
+  return g_role == Role::Client && g_screen == Screen::ClientSearching && !g_awaitingRejoin;
+}
+
+void sendJoinAck(bool resumed) {
   if (!g_hasPeer) {
     return;
   }
   JoinAckPacket packet{};
   packet.type = static_cast<uint8_t>(PacketType::JoinAck);
   memset(packet.name, 0, sizeof(packet.name));
-  g_localPlayerName.toCharArray(packet.name, PLAYER_NAME_MAX_LEN);
-  g_udp.beginPacket(g_peerIp, g_peerPort);
-  g_udp.write(reinterpret_cast<uint8_t *>(&packet), sizeof(packet));
-  g_udp.endPacket();
+  g_localPlayerName.copyTo(packet.name, PLAYER_NAME_MAX_LEN);
+  packet.sessionToken = g_sessionToken;
+  packet.resumed = resumed ? 1 : 0;
+  sendToPeer(packet);
 }
 
 void sendStartPacket(uint32_t seed) {
   if (!g_hasPeer) {
     return;
   }
-  StartPacket packet{static_cast<uint8_t>(PacketType::Start), seed};
-  g_udp.beginPacket(g_peerIp, g_peerPort);
-  g_udp.write(reinterpret_cast<uint8_t *>(&packet), sizeof(packet));
-  g_udp.endPacket();
+  StartPacket packet{static_cast<uint8_t>(PacketType::Start), seed, static_cast<uint8_t>(g_netMode)};
+  sendToPeer(packet);
 }
 
-void sendStatePacket() {
-  if (!g_hasPeer || g_role != Role::Host) {
-    return;
+// Host: the simulation as the next frame of the state stream.
+void fillStateFrame(StateFrame &frame) {
+  if (g_sim.matchActive) {
+    frame.flags |= FLAG_MATCH_ACTIVE;
   }
-
-  StatePacket packet{};
-  packet.type = static_cast<uint8_t>(PacketType::State);
-  packet.flags = 0;
-  if (g_matchActive) {
-    packet.flags |= FLAG_MATCH_ACTIVE;
+  if (g_sim.waitingForServe) {
+    frame.flags |= FLAG_WAITING_SERVE;
   }
-  if (g_waitingForServe) {
-    packet.flags |= FLAG_WAITING_SERVE;
-  }
-  if (g_gameOver) {
-    packet.flags |= FLAG_GAME_OVER;
+  if (g_sim.gameOver) {
+    frame.flags |= FLAG_GAME_OVER;
   }
   if (g_gamePaused) {
-    packet.flags |= FLAG_PAUSED;
+    frame.flags |= FLAG_PAUSED;
+  }
+  frame.hostScore = g_sim.hostScore;
+  frame.clientScore = g_sim.clientScore;
+  frame.frameId = ++g_frameCounter;
+  frame.hostTimeMs = millis();
+  frame.ackInputSeq = g_paddleReceiver.appliedSeq;
+  frame.ballX = quantizePosition(simToFloat(g_sim.ballX));
+  frame.ballY = quantizePosition(simToFloat(g_sim.ballY));
+  frame.ballVX = quantizeVelocity(simToFloat(g_sim.ballVX));
+  frame.ballVY = quantizeVelocity(simToFloat(g_sim.ballVY));
+  frame.hostPaddleY = quantizePosition(simToFloat(g_sim.hostPaddleY));
+  frame.clientPaddleY = quantizePosition(simToFloat(g_sim.clientPaddleY));
+}
+
+NetAddress spectateGroup() {
+  NetAddress group;
+  group.ip = spectateGroupIp(g_sessionToken);
+  group.port = SPECTATE_PORT;
+  return group;
+}
+
+// Host: whether someone asked to watch recently enough to keep mirroring.
+bool spectatorsWatching(unsigned long now) {
+  return g_lastSpectateRequest != 0 && now - g_lastSpectateRequest < SPECTATE_IDLE_MS;
+}
+
+void sendStatePacket(StateSendReason reason) {
+  if (!g_hasPeer || g_role != Role::Host) {
+    return;
   }
-  packet.hostScore = g_hostScore;
-  packet.clientScore = g_clientScore;
-  packet.frameId = ++g_frameCounter;
-  packet.ballX = g_ballX;
-  packet.ballY = g_ballY;
-  packet.ballVX = g_ballVX;
-  packet.ballVY = g_ballVY;
-  packet.hostPaddleY = g_hostPaddleY;
-  packet.clientPaddleY = g_clientPaddleY;
 
-  g_udp.beginPacket(g_peerIp, g_peerPort);
-  g_udp.write(reinterpret_cast<uint8_t *>(&packet), sizeof(packet));
-  g_udp.endPacket();
-  g_lastStateSent = millis();
+  StateFrame frame;
+  fillStateFrame(frame);
+  uint8_t packet[STATE_PACKET_MAX];
+  const StateFrame *baseline = g_stateAckFrameId != 0 ? stateHistoryFind(g_stateHistory, g_stateAckFrameId) : nullptr;
+  size_t length = stateEncode(frame, baseline, packet, sizeof(packet));
+  stateHistoryPush(g_stateHistory, frame);
+  g_transport.sendTo(g_peer, packet, length);
+  // The same bytes, once, for every spectator: they hear the client's
+  // baselines too, and ask for a snapshot when they miss one for long.
+  if (spectatorsWatching(millis())) {
+    g_transport.sendTo(spectateGroup(), packet, length);
+  }
+  sendPolicySent(g_stateSendPolicy, g_sim, millis(), reason);
+}
+
+// Host, lockstep: the client needs no state but spectators do. They get
+// keyframes at the pace the snapshot stream would have.
+void sendSpectatorState(StateSendReason reason) {
+  StateFrame frame;
+  fillStateFrame(frame);
+  uint8_t packet[STATE_PACKET_MAX];
+  size_t length = stateEncode(frame, nullptr, packet, sizeof(packet));
+  stateHistoryPush(g_stateHistory, frame);
+  g_transport.sendTo(spectateGroup(), packet, length);
+  sendPolicySent(g_stateSendPolicy, g_sim, millis(), reason);
+}
+
+// Host: a spectator wants the match. It learns the group and the players and,
+// when it asks for a snapshot, the newest state as a keyframe since it may
+// hold none of the baselines.
+void answerSpectator(const NetAddress &from, bool snapshot) {
+  g_lastSpectateRequest = millis();
+  if (!snapshot) {
+    return;  // just a reminder that it is still watching
+  }
+  SpectateAckPacket packet{};
+  packet.type = static_cast<uint8_t>(PacketType::SpectateAck);
+  NetAddress group = spectateGroup();
+  packet.groupIp = group.ip;
+  packet.groupPort = group.port;
+  g_localPlayerName.copyTo(packet.hostName, PLAYER_NAME_MAX_LEN);
+  g_remotePlayerName.copyTo(packet.clientName, PLAYER_NAME_MAX_LEN);
+  g_transport.sendTo(from, reinterpret_cast<const uint8_t *>(&packet), sizeof(packet));
+
+  const StateFrame *frame = g_frameCounter != 0 ? stateHistoryFind(g_stateHistory, g_frameCounter) : nullptr;
+  if (frame != nullptr) {
+    uint8_t state[STATE_PACKET_MAX];
+    size_t length = stateEncode(*frame, nullptr, state, sizeof(state));
+    g_transport.sendTo(from, state, length);
+  }
+}
+
+// Spectator: asks to watch (broadcast while searching) or reminds the host it
+// still is, with snapshot set when its view has gone stale.
+void sendSpectateRequest(bool snapshot) {
+  SpectatePacket packet{static_cast<uint8_t>(PacketType::Spectate), static_cast<uint8_t>(snapshot ? 1 : 0)};
+  if (g_hasPeer) {
+    sendToPeer(packet);
+  } else {
+    g_transport.broadcast(UDP_PORT, reinterpret_cast<const uint8_t *>(&packet), sizeof(packet));
+  }
+  g_lastSpectateSent = millis();
 }
 
 void sendPaddlePacket() {
   if (!g_hasPeer || g_role != Role::Client) {
     return;
   }
-  PaddlePacket packet{};
-  packet.type = static_cast<uint8_t>(PacketType::Paddle);
-  packet.paddleY = g_clientPaddleY;
-  g_udp.beginPacket(g_peerIp, g_peerPort);
-  g_udp.write(reinterpret_cast<uint8_t *>(&packet), sizeof(packet));
-  g_udp.endPacket();
+  PaddleMessage message;
+  paddleMessageFill(message, g_paddlePredictor, g_stateSequence.started ? g_stateSequence.newest : 0,
+                    g_lastSentInputSeq);
+  uint8_t packet[PADDLE_PACKET_MAX];
+  size_t length = paddleEncode(message, packet, sizeof(packet));
+  if (length != 0) {
+    g_transport.sendTo(g_peer, packet, length);
+  }
+  g_lastSentInputSeq = message.newestSeq;
+  g_lastSentAckFrameId = message.ackFrameId;
   g_lastPaddleSent = millis();
 }
 
-void processStatePacket(const StatePacket &packet) {
-  g_hostScore = packet.hostScore;
-  g_clientScore = packet.clientScore;
-  g_ballX = packet.ballX;
-  g_ballY = packet.ballY;
-  g_ballVX = packet.ballVX;
-  g_ballVY = packet.ballVY;
-  g_hostPaddleY = packet.hostPaddleY;
-  g_clientPaddleY = packet.clientPaddleY;
+void sendPingPacket() {
+  PingPacket packet{};
+  packet.type = static_cast<uint8_t>(PacketType::Ping);
+  packet.originUs = micros();
+  packet.originMs = millis();
+  sendToPeer(packet);
+  ++g_netClock.pingsSent;
+  g_lastPingSent = packet.originMs;
+}
 
-  bool wasGameOver = g_gameOver;
+void sendPongPacket(const PingPacket &ping, uint32_t receiveUs, uint32_t receiveMs) {
+  PongPacket packet{};
+  packet.type = static_cast<uint8_t>(PacketType::Pong);
+  packet.originUs = ping.originUs;
+  packet.originMs = ping.originMs;
+  packet.receiveMs = receiveMs;
+  packet.holdUs = micros() - receiveUs;
+  sendToPeer(packet);
+}
+
+// Both sides get a fresh clock estimate and a full timeout for a new peer.
+void onPeerConnected() {
+  netClockReset(g_netClock);
+  g_frameCounter = 0;
+  sequenceReset(g_stateSequence);
+  stateHistoryReset(g_stateHistory);
+  g_stateAckFrameId = 0;
+  g_ackGapFromFrameId = 1;
+  rateControllerInit(g_sendRate, SEND_INTERVAL_MIN_MS, SEND_INTERVAL_MAX_MS, STATE_MOTION_INTERVAL_MS);
+  linkMonitorReset(g_linkMonitor, millis());
+  g_lastPingSent = 0;
+  g_lastSentAckFrameId = 0;
+}
+
+void processStatePacket(const uint8_t *data, size_t length) {
+  StateFrame frame;
+  StateDecodeResult result = stateDecode(data, length, g_stateHistory, g_stateSequence.newest, frame);
+  if (result == StateDecodeResult::MissingBaseline) {
+    ++g_stateBaselineMisses;
+  }
+  if (result != StateDecodeResult::Ok) {
+    return;
+  }
+  // Duplicates and packets overtaken by a newer one carry nothing we still
+  // need, and their flags could revive a finished match.
+  if (sequenceTrack(g_stateSequence, frame.frameId) != SequenceVerdict::Newer) {
+    return;
+  }
+  stateHistoryPush(g_stateHistory, frame);
 
-  g_gameOver = (packet.flags & FLAG_GAME_OVER) != 0;
-  g_waitingForServe = (packet.flags & FLAG_WAITING_SERVE) != 0;
-  g_gamePaused = (packet.flags & FLAG_PAUSED) != 0;
-  g_matchActive = (packet.flags & FLAG_MATCH_ACTIVE) != 0 || g_waitingForServe;
+  unsigned long now = millis();
 
-  if (g_gameOver && !wasGameOver) {
+  // Ball and host paddle are drawn from the interpolation buffer; scores and
+  // flags apply straight away.
+  Snapshot snapshot;
+  snapshot.frameId = frame.frameId;
+  snapshot.hostTimeMs = frame.hostTimeMs;
+  snapshot.arrivalMs = static_cast<uint32_t>(now);
+  snapshot.ballX = dequantizePosition(frame.ballX);
+  snapshot.ballY = dequantizePosition(frame.ballY);
+  snapshot.ballVX = dequantizeVelocity(frame.ballVX);
+  snapshot.ballVY = dequantizeVelocity(frame.ballVY);
+  snapshot.hostPaddleY = dequantizePosition(frame.hostPaddleY);
+  snapshot.clientPaddleY = dequantizePosition(frame.clientPaddleY);
+  snapshot.points = static_cast<uint8_t>(frame.hostScore + frame.clientScore);
+  if (!interpPush(g_interp, snapshot)) {
+    return;  // older than what we already have
+  }
+
+  g_sim.hostScore = frame.hostScore;
+  g_sim.clientScore = frame.clientScore;
+  g_sim.ballVX = SimScalar(dequantizeVelocity(frame.ballVX));
+  g_sim.ballVY = SimScalar(dequantizeVelocity(frame.ballVY));
+  predictorReconcile(g_paddlePredictor, frame.ackInputSeq, SimScalar(dequantizePosition(frame.clientPaddleY)));
+  g_sim.clientPaddleY = g_paddlePredictor.predictedY;
+
+  bool wasGameOver = g_sim.gameOver;
+
+  g_sim.gameOver = (frame.flags & FLAG_GAME_OVER) != 0;
+  g_sim.waitingForServe = (frame.flags & FLAG_WAITING_SERVE) != 0;
+  g_gamePaused = (frame.flags & FLAG_PAUSED) != 0;
+  g_sim.matchActive = (frame.flags & FLAG_MATCH_ACTIVE) != 0 || g_sim.waitingForServe;
+
+  if (g_sim.gameOver && !wasGameOver) {
     setScreen(Screen::GameOver);
-  } else if (!g_gameOver && g_matchActive && g_screen != Screen::Playing) {
+  } else if (!g_sim.gameOver && g_sim.matchActive && g_screen != Screen::Playing) {
     setScreen(Screen::Playing);
   }
-  g_lastStateReceived = millis();
 }
 
-void processNetwork() {
-  int packetSize;
-  while ((packetSize = g_udp.parsePacket()) > 0) {
-    if (packetSize > 128) {
-      while (g_udp.available()) {
-        g_udp.read();
-      }
-      continue;
-    }
+void setSpectatedNames(SpectateAckPacket &packet) {
+  packet.hostName[PLAYER_NAME_MAX_LEN - 1] = '\0';
+  packet.clientName[PLAYER_NAME_MAX_LEN - 1] = '\0';
+  setRemotePlayerName(packet.hostName);
+  PlayerName clientName = packet.clientName;
+  clientName.trim();
+  g_spectatedClientName = clientName.isEmpty() ? PlayerName("Challenger") : clientName;
+  g_screenDirty = true;
+}
 
-    uint8_t buffer[128];
-    int len = g_udp.read(buffer, packetSize);
-    if (len <= 0) {
-      continue;
-    }
+// Spectator: a host answered. Its state comes from the group from now on; the
+// snapshot that follows the answer moves us on to Playing or GameOver.
+void watchMatch(const NetAddress &host, SpectateAckPacket &packet) {
+  NetAddress group;
+  group.ip = packet.groupIp;
+  group.port = packet.groupPort;
+  if (!g_transport.joinGroup(group)) {
+    g_errorMessage = "Multicast join failed.";
+    setScreen(Screen::Error);
+    return;
+  }
+  setSpectatedNames(packet);
+  g_peer = host;
+  g_hasPeer = true;
+  onPeerConnected();
+  resetMatchState();
+  g_lastSpectatorStateMs = millis();
+  setScreen(Screen::Lobby);
+}
+
+void processNetwork() {
+  uint8_t buffer[MAX_DATAGRAM_SIZE];
+  NetAddress from;
+  int len;
+  while ((len = g_transport.receive(buffer, sizeof(buffer), from)) > 0) {
+    uint32_t receiveUs = micros();
+    uint32_t receiveMs = millis();
 
     PacketType type = static_cast<PacketType>(buffer[0]);
     switch (type) {
       case PacketType::Join:
-        if (static_cast<size_t>(len) >= sizeof(JoinPacket) && g_role == Role::Host && g_screen == Screen::HostWaiting) {
+        if (static_cast<size_t>(len) >= sizeof(JoinPacket) && g_role == Role::Host) {
           JoinPacket pkt;
           memcpy(&pkt, buffer, sizeof(JoinPacket));
-          pkt.name[PLAYER_NAME_MAX_LEN - 1] = '\0';
-          setRemotePlayerName(pkt.name);
-          g_peerIp = g_udp.remoteIP();
-          g_peerPort = g_udp.remotePort();
-          g_hasPeer = true;
-          sendJoinAck();
-          resetMatchState();
-          setScreen(Screen::Lobby);
+          if (g_screen == Screen::HostWaiting) {
+            pkt.name[PLAYER_NAME_MAX_LEN - 1] = '\0';
+            setRemotePlayerName(pkt.name);
+            g_peer = from;
+            g_hasPeer = true;
+            onPeerConnected();
+            g_sessionToken = newSessionToken();
+            sendJoinAck();
+            resetMatchState();
+            setScreen(Screen::Lobby);
+          } else if (pkt.sessionToken != 0 && pkt.sessionToken == g_sessionToken && g_screen >= Screen::Lobby &&
+                     g_screen != Screen::Error) {
+            resumeSession(from);
+          }
         }
         break;
       case PacketType::JoinAck:
-        if (static_cast<size_t>(len) >= sizeof(JoinAckPacket) && g_role == Role::Client && g_screen == Screen::ClientSearching) {
+        if (static_cast<size_t>(len) >= sizeof(JoinAckPacket) && g_role == Role::Client &&
+            g_screen == Screen::ClientSearching && g_hasJoinTarget && from == g_joinTarget) {
           JoinAckPacket pkt;
           memcpy(&pkt, buffer, sizeof(JoinAckPacket));
           pkt.name[PLAYER_NAME_MAX_LEN - 1] = '\0';
           setRemotePlayerName(pkt.name);
-          g_peerIp = g_udp.remoteIP();
-          g_peerPort = g_udp.remotePort();
+          g_peer = from;
           g_hasPeer = true;
+          g_sessionToken = pkt.sessionToken;
+          g_awaitingRejoin = false;
+          g_hasJoinTarget = false;
+          onPeerConnected();
           resetMatchState();
+          // A resumed match follows with the host's state, which moves us on
+          // to Playing or GameOver.
           setScreen(Screen::Lobby);
         }
         break;
       case PacketType::Start: {
-        if (static_cast<size_t>(len) >= sizeof(StartPacket)) {
+        if (static_cast<size_t>(len) >= sizeof(StartPacket) && g_hasPeer && from == g_peer) {
           StartPacket pkt;
           memcpy(&pkt, buffer, sizeof(StartPacket));
           if (g_role == Role::Host) {
             hostStartMatch(pkt.seed);
           } else {
-            clientStartMatch(pkt.seed);
+            clientStartMatch(pkt.seed, static_cast<NetMode>(pkt.netMode));
           }
         }
         break;
       }
       case PacketType::State:
-        if (static_cast<size_t>(len) >= sizeof(StatePacket) && g_role == Role::Client) {
-          StatePacket pkt;
-          memcpy(&pkt, buffer, sizeof(StatePacket));
-          processStatePacket(pkt);
+        // Only the host this client joined; anything else on the port (a
+        // stale session, another host's unicast) must not move the view.
+        if (g_role == Role::Client && g_hasPeer && from == g_peer) {
+          linkMonitorHeard(g_linkMonitor, receiveMs);
+          processStatePacket(buffer, static_cast<size_t>(len));
+        } else if (g_role == Role::Spectator && g_hasPeer && from.ip == g_peer.ip) {
+          // From the group or, for a snapshot, straight from the host.
+          linkMonitorHeard(g_linkMonitor, receiveMs);
+          g_lastSpectatorStateMs = receiveMs;
+          processStatePacket(buffer, static_cast<size_t>(len));
+        }
+        break;
+      case PacketType::Spectate:
+        if (static_cast<size_t>(len) >= sizeof(SpectatePacket) && g_role == Role::Host && g_sessionToken != 0 &&
+            g_screen >= Screen::Lobby && g_screen != Screen::Error) {
+          SpectatePacket pkt;
+          memcpy(&pkt, buffer, sizeof(SpectatePacket));
+          answerSpectator(from, pkt.snapshot != 0);
+        }
+        break;
+      case PacketType::SpectateAck:
+        if (static_cast<size_t>(len) >= sizeof(SpectateAckPacket) && g_role == Role::Spectator) {
+          SpectateAckPacket pkt;
+          memcpy(&pkt, buffer, sizeof(SpectateAckPacket));
+          if (g_screen == Screen::ClientSearching) {
+            watchMatch(from, pkt);
+          } else if (g_hasPeer && from == g_peer) {
+            linkMonitorHeard(g_linkMonitor, receiveMs);
+            setSpectatedNames(pkt);  // the host may have a new opponent since
+          }
+        }
+        break;
+      case PacketType::LobbyBeacon:
+        if (browsingLobbies()) {
+          LobbyBeacon beacon;
+          if (lobbyBeaconDecode(buffer, static_cast<size_t>(len), beacon) &&
+              lobbyTableHeard(g_lobbies, from, beacon, receiveMs)) {
+            g_screenDirty = true;
+          }
+        }
+        break;
+      case PacketType::LobbyProbe:
+        if (static_cast<size_t>(len) >= sizeof(LobbyProbePacket) && g_role == Role::Host) {
+          LobbyProbePacket pkt;
+          memcpy(&pkt, buffer, sizeof(LobbyProbePacket));
+          LobbyProbeAckPacket ack{static_cast<uint8_t>(PacketType::LobbyProbeAck), pkt.originUs, g_lobbyId};
+          g_transport.sendTo(from, reinterpret_cast<const uint8_t *>(&ack), sizeof(ack));
+        }
+        break;
+      case PacketType::LobbyProbeAck:
+        if (static_cast<size_t>(len) >= sizeof(LobbyProbeAckPacket) && browsingLobbies()) {
+          LobbyProbeAckPacket pkt;
+          memcpy(&pkt, buffer, sizeof(LobbyProbeAckPacket));
+          lobbyTableAnswer(g_lobbies, from, pkt.lobbyId, pkt.originUs, receiveUs);
         }
         break;
       case PacketType::Paddle:
-        if (static_cast<size_t>(len) >= sizeof(PaddlePacket) && g_role == Role::Host && g_hasPeer) {
-          PaddlePacket pkt;
-          memcpy(&pkt, buffer, sizeof(PaddlePacket));
-          g_clientPaddleY = clampValue(pkt.paddleY, PADDLE_HALF_HEIGHT, SCREEN_HEIGHT - PADDLE_HALF_HEIGHT);
+        if (g_role == Role::Host && g_hasPeer && from == g_peer) {
+          PaddleMessage pkt;
+          if (!paddleDecode(buffer, static_cast<size_t>(len), pkt)) {
+            break;
+          }
+          linkMonitorHeard(g_linkMonitor, receiveMs);
+          paddleReceiverApply(g_paddleReceiver, pkt, g_sim.clientPaddleY);
+          if (pkt.ackFrameId != 0 && (g_stateAckFrameId == 0 || sequenceNewer(pkt.ackFrameId, g_stateAckFrameId))) {
+            g_stateAckFrameId = pkt.ackFrameId;
+          }
+        }
+        break;
+      case PacketType::Ping:
+        if (static_cast<size_t>(len) >= sizeof(PingPacket) && g_hasPeer && from == g_peer) {
+          PingPacket pkt;
+          memcpy(&pkt, buffer, sizeof(PingPacket));
+          linkMonitorHeard(g_linkMonitor, receiveMs);
+          sendPongPacket(pkt, receiveUs, receiveMs);
+        }
+        break;
+      case PacketType::Pong:
+        if (static_cast<size_t>(len) >= sizeof(PongPacket) && g_hasPeer && from == g_peer) {
+          PongPacket pkt;
+          memcpy(&pkt, buffer, sizeof(PongPacket));
+          linkMonitorHeard(g_linkMonitor, receiveMs);
+          netClockAddSample(g_netClock, pkt.originUs, pkt.originMs, pkt.receiveMs, pkt.holdUs, receiveUs);
+        }
+        break;
+      case PacketType::LockstepInput:
+        if (g_hasPeer && g_netMode == NetMode::Lockstep && from == g_peer &&
+            lockstepReadPacket(g_lockstep, buffer, static_cast<size_t>(len))) {
+          linkMonitorHeard(g_linkMonitor, receiveMs);
+        }
+        break;
+      case PacketType::LockstepSync:
+        if (g_role == Role::Client && g_hasPeer && g_netMode == NetMode::Lockstep && from == g_peer &&
+            lockstepReadSync(g_lockstep, g_sim, buffer, static_cast<size_t>(len))) {
+          linkMonitorHeard(g_linkMonitor, receiveMs);
+          g_gamePaused = g_lockstep.paused;
+          g_lastSimTickUs = micros();
+          setScreen(g_sim.gameOver ? Screen::GameOver : Screen::Playing);
+          invalidatePlayfieldContent();
         }
         break;
       default:
@@ -1200,108 +2163,325 @@ void processNetwork() {
 // -----------------------------------------------------------------------------
 // Game logic -----------------------------------------------------------------
 
+// Game streams stop while the peer is silent long enough to be reconnecting;
+// pings carry on and tell us when it is back.
+bool linkStalled() {
+  return g_linkMonitor.state == LinkState::Reconnecting;
+}
+
+void loseConnection() {
+  g_errorMessage = g_role == Role::Client ? "Lost connection to host." : "Lost connection to client.";
+  g_sessionToken = 0;
+  g_awaitingRejoin = false;
+  setScreen(Screen::Error);
+  g_hasPeer = false;
+}
+
+// The peer is gone but the session may come back. The host keeps the match
+// paused where it was; the client goes back to searching with its token.
+void startAwaitingRejoin() {
+  g_hasPeer = false;
+  g_awaitingRejoin = true;
+  g_awaitingRejoinSince = millis();
+  if (g_role == Role::Host) {
+    // A pause the host chose stays when the client returns; ours does not.
+    if (g_screen == Screen::Playing && !g_gamePaused) {
+      g_gamePaused = true;
+      g_autoPausedForRejoin = true;
+    }
+    invalidatePlayfieldContent();
+    return;
+  }
+  g_joinTarget = g_peer;
+  g_hasJoinTarget = true;
+  g_lastJoinSent = 0;
+  setScreen(Screen::ClientSearching);
+}
+
+// Host: the client with our session token is back, possibly from a new
+// address. The match carries on from where it stopped.
+void resumeSession(const NetAddress &from) {
+  bool samePeer = g_hasPeer && from == g_peer;
+  g_peer = from;
+  g_hasPeer = true;
+  g_awaitingRejoin = false;
+  if (g_autoPausedForRejoin) {
+    g_gamePaused = false;
+    g_autoPausedForRejoin = false;
+  }
+  if (!samePeer) {
+    netClockReset(g_netClock);
+    rateControllerInit(g_sendRate, SEND_INTERVAL_MIN_MS, SEND_INTERVAL_MAX_MS, STATE_MOTION_INTERVAL_MS);
+  }
+  linkMonitorReset(g_linkMonitor, millis());
+  // The client starts over without a baseline or a paddle history.
+  g_stateAckFrameId = 0;
+  g_ackGapFromFrameId = g_frameCounter + 1;
+  paddleReceiverReset(g_paddleReceiver);
+  sendJoinAck(true);
+  if (g_netMode == NetMode::Lockstep) {
+    // A restarted client has neither the seed nor the state: Start, then a
+    // sync onto the running match.
+    g_lockstep.peerSeen = false;
+    lockstepBeginResync(g_lockstep);
+    g_lastLockstepHandshake = 0;
+  } else if (g_screen == Screen::Playing) {
+    sendPolicyForce(g_stateSendPolicy);
+  } else if (g_screen == Screen::GameOver) {
+    sendStatePacket();
+  }
+  invalidatePlayfieldContent();
+}
+
+// Spectator: the host went quiet. Look for a match again rather than fail.
+void stopWatching() {
+  g_transport.leaveGroup();
+  g_hasPeer = false;
+  g_peer = NetAddress();
+  g_lastSpectateSent = 0;
+  setScreen(Screen::ClientSearching);
+}
+
 void handleConnectionTimeout() {
+  if (g_awaitingRejoin) {
+    if (millis() - g_awaitingRejoinSince > SESSION_RESUME_WINDOW_MS) {
+      loseConnection();
+    }
+    return;
+  }
   if (!g_hasPeer) {
     return;
   }
-  unsigned long now = millis();
-  if (g_role == Role::Client && g_screen >= Screen::Playing) {
-    if (now - g_lastStateReceived > CONNECTION_TIMEOUT_MS) {
-      g_errorMessage = "Lost connection to host.";
-      setScreen(Screen::Error);
-      g_hasPeer = false;
+  if (g_screen < Screen::Lobby || g_screen == Screen::Error) {
+    return;
+  }
+  LinkState previous = g_linkMonitor.state;
+  LinkState state = linkMonitorUpdate(g_linkMonitor, millis(), netClockTimeoutMs(g_netClock, 0));
+  if (state == LinkState::Dropped) {
+    if (g_role == Role::Spectator) {
+      stopWatching();
+    } else if (g_sessionToken != 0) {
+      startAwaitingRejoin();
+    } else {
+      loseConnection();
     }
+  } else if (previous == LinkState::Reconnecting && state != previous && g_role == Role::Host) {
+    sendPolicyForce(g_stateSendPolicy);  // the client has seen nothing for a while
   }
-  if (g_role == Role::Host && g_screen >= Screen::Lobby) {
-    // Basic heartbeat: if we haven't heard a paddle update in a while, assume drop.
-    // parsePacket already refreshed remote even if nothing arrives, so rely on state send difference.
-    // For host we allow longer, as state packets go one-way.
-    (void)now;
+}
+
+// Client: whether the host has sent state this side has not acknowledged yet.
+bool paddleAckPending() {
+  return g_stateSequence.started && g_stateSequence.newest != g_lastSentAckFrameId;
+}
+
+// Spectators stay silent apart from their requests, so a crowd costs the
+// host nothing per frame.
+void updatePing(unsigned long now) {
+  if (g_hasPeer && g_role != Role::Spectator && g_screen >= Screen::Lobby && now - g_lastPingSent >= PING_INTERVAL_MS) {
+    sendPingPacket();
   }
 }
 
-void checkForServeLaunch() {
-  if (g_waitingForServe) {
-    if (millis() - g_serveRequestTs >= SERVE_DELAY_MS) {
-      launchBall();
+// Spectator: broadcasts for a match while searching; once watching, reminds
+// the host every SPECTATE_KEEPALIVE_MS and asks for a snapshot once a second
+// while no state arrives (the lobby, a lost stretch of the stream).
+void updateSpectator(unsigned long now) {
+  if (g_role != Role::Spectator) {
+    return;
+  }
+  if (g_screen == Screen::ClientSearching) {
+    if (now - g_lastSpectateSent > JOIN_INTERVAL_MS) {
+      sendSpectateRequest(true);
     }
+    return;
+  }
+  if (!g_hasPeer || g_screen < Screen::Lobby || g_screen == Screen::Error) {
+    return;
+  }
+  bool stale = now - g_lastSpectatorStateMs > SPECTATE_STALE_MS;
+  unsigned long sinceSent = now - g_lastSpectateSent;
+  if ((stale && sinceSent >= SPECTATE_STALE_MS) || sinceSent >= SPECTATE_KEEPALIVE_MS) {
+    sendSpectateRequest(stale);
   }
 }
 
-void updateHostGameplay(float dtSeconds) {
-  if (!g_matchActive && !g_waitingForServe) {
-    return;
+// Client: keeps the lobby list current while searching. Hosts that stopped
+// beaconing age out, one lobby at a time is probed for its round trip, and
+// Enter asks the lobby under the cursor for a seat.
+void updateLobbyBrowser(unsigned long now) {
+  if (lobbyTableExpire(g_lobbies, now) != 0) {
+    g_screenDirty = true;
+  }
+  if (now - g_lastLobbyProbe >= LOBBY_PROBE_SPACING_MS) {
+    g_lastLobbyProbe = now;
+    const LobbyEntry *lobby = lobbyTableNextProbe(g_lobbies, now);
+    if (lobby != nullptr) {
+      LobbyProbePacket probe{static_cast<uint8_t>(PacketType::LobbyProbe), static_cast<uint32_t>(micros())};
+      g_transport.sendTo(lobby->address, reinterpret_cast<const uint8_t *>(&probe), sizeof(probe));
+    }
+  }
+  if (g_hasJoinTarget) {
+    int joining = lobbyTableFind(g_lobbies, g_joinLobbyId);
+    if (joining < 0 || lobbyTableAt(g_lobbies, static_cast<size_t>(joining)).beacon.state != LobbyState::Open) {
+      g_hasJoinTarget = false;
+      g_errorMessage = joining < 0 ? "Lobby went away." : "Lobby filled up.";
+      g_screenDirty = true;
+    }
   }
 
-  if (cardKeyPressed(';')) {
-    g_hostPaddleY -= PADDLE_SPEED * dtSeconds;
+  int count = static_cast<int>(g_lobbies.count);
+  int cursor = lobbyTableFind(g_lobbies, g_selectedLobbyId);
+  if (cursor < 0) {
+    cursor = std::max(0, std::min(g_lobbyCursor, count - 1));  // it went away: stay at the same row
   }
-  if (cardKeyPressed('.')) {
-    g_hostPaddleY += PADDLE_SPEED * dtSeconds;
+  if (cardKeyJustPressed(';') && cursor > 0) {
+    --cursor;
+    g_errorMessage.clear();
   }
-  g_hostPaddleY = clampValue(g_hostPaddleY, PADDLE_HALF_HEIGHT, SCREEN_HEIGHT - PADDLE_HALF_HEIGHT);
+  if (cardKeyJustPressed('.') && cursor + 1 < count) {
+    ++cursor;
+    g_errorMessage.clear();
+  }
+  uint32_t selectedId = count > 0 ? lobbyTableAt(g_lobbies, static_cast<size_t>(cursor)).beacon.lobbyId : 0;
+  if (cursor != g_lobbyCursor || selectedId != g_selectedLobbyId) {
+    g_lobbyCursor = cursor;
+    g_selectedLobbyId = selectedId;
+    g_screenDirty = true;
+  }
+  if (count > 0 && cardKeysJustPressed(KEYS_ENTER)) {
+    const LobbyEntry &lobby = lobbyTableAt(g_lobbies, static_cast<size_t>(cursor));
+    if (lobby.beacon.state == LobbyState::Open) {
+      g_joinTarget = lobby.address;
+      g_joinLobbyId = lobby.beacon.lobbyId;
+      g_hasJoinTarget = true;
+      g_lastJoinSent = 0;
+      g_errorMessage.clear();
+    } else {
+      g_errorMessage = "In a match: pick another.";
+    }
+    g_screenDirty = true;
+  }
+  if (now - g_lastLobbyDraw >= LOBBY_REDRAW_MS) {
+    g_screenDirty = true;
+  }
+}
 
-  checkForServeLaunch();
+// How long the oldest state frame of this match the client has not
+// acknowledged has been out; 0 when everything is acknowledged.
+uint32_t stateAckGapMs(uint32_t now) {
+  uint32_t firstUnacked = g_stateAckFrameId + 1;
+  if (sequenceNewer(g_ackGapFromFrameId, firstUnacked)) {
+    firstUnacked = g_ackGapFromFrameId;
+  }
+  if (sequenceNewer(firstUnacked, g_frameCounter)) {
+    return 0;
+  }
+  const StateFrame *frame = stateHistoryFind(g_stateHistory, firstUnacked);
+  if (frame == nullptr) {
+    // Evicted already: the oldest frame still kept is at least as telling.
+    frame = stateHistoryFind(g_stateHistory, g_frameCounter - static_cast<uint32_t>(g_stateHistory.count) + 1);
+  }
+  return frame != nullptr ? now - frame->hostTimeMs : 0;
+}
 
-  if (g_waitingForServe) {
+void updateSendRate(unsigned long now) {
+  if (!g_hasPeer || g_role == Role::Spectator || g_screen < Screen::Lobby) {
     return;
   }
+  if (g_role == Role::Host && g_screen == Screen::Playing && !g_gamePaused && !linkStalled()) {
+    rateControllerNoteAckGap(g_sendRate, stateAckGapMs(now));
+  }
+  rateControllerUpdate(g_sendRate, g_netClock, now);
+  g_stateSendPolicy.motionIntervalMs = g_sendRate.intervalMs;
+}
 
-  g_ballX += g_ballVX * dtSeconds;
-  g_ballY += g_ballVY * dtSeconds;
+// Runs the shared simulation at SIM_TICK_HZ regardless of how long the last
+// loop took, so a slow frame no longer changes bounce angles or collisions.
+void updateHostGameplay() {
+  unsigned long nowUs = micros();
+  uint32_t elapsedUs = static_cast<uint32_t>(nowUs - g_lastSimTickUs);
+  g_lastSimTickUs = nowUs;
 
-  if (g_ballY - BALL_RADIUS <= 0) {
-    g_ballY = BALL_RADIUS;
-    g_ballVY = -g_ballVY;
+  if (g_gamePaused || linkStalled() || (!g_sim.matchActive && !g_sim.waitingForServe)) {
+    return;
   }
-  if (g_ballY + BALL_RADIUS >= SCREEN_HEIGHT) {
-    g_ballY = SCREEN_HEIGHT - BALL_RADIUS;
-    g_ballVY = -g_ballVY;
+
+  SimInput input;
+  if (cardKeyPressed(';')) {
+    --input.hostPaddleDir;
+  }
+  if (cardKeyPressed('.')) {
+    ++input.hostPaddleDir;
   }
 
-  // Host paddle collision
-  if (g_ballVX < 0) {
-    float paddleLeft = HOST_PADDLE_X;
-    float paddleRight = HOST_PADDLE_X + PADDLE_WIDTH;
-    if (g_ballX - BALL_RADIUS <= paddleRight && g_ballX - BALL_RADIUS >= paddleLeft) {
-      if (g_ballY >= g_hostPaddleY - PADDLE_HALF_HEIGHT && g_ballY <= g_hostPaddleY + PADDLE_HALF_HEIGHT) {
-        g_ballX = paddleRight + BALL_RADIUS;
-        g_ballVX = fabsf(g_ballVX) * BALL_SPEED_GROWTH;
-        float offset = (g_ballY - g_hostPaddleY) / PADDLE_HALF_HEIGHT;
-        g_ballVY += offset * 45.0f;
-      }
+  uint32_t ticks = simClockAdvance(g_simClock, elapsedUs);
+  for (uint32_t i = 0; i < ticks; ++i) {
+    uint8_t events = simStep(g_sim, input);
+    sendPolicyNoteEvents(g_stateSendPolicy, events);
+    if (events & SIM_EVENT_GAME_OVER) {
+      markGameOver();
+      return;
     }
   }
+}
 
-  // Client paddle collision
-  if (g_ballVX > 0) {
-    float paddleLeft = CLIENT_PADDLE_X;
-    float paddleRight = CLIENT_PADDLE_X + PADDLE_WIDTH;
-    if (g_ballX + BALL_RADIUS >= paddleLeft && g_ballX + BALL_RADIUS <= paddleRight) {
-      if (g_ballY >= g_clientPaddleY - PADDLE_HALF_HEIGHT && g_ballY <= g_clientPaddleY + PADDLE_HALF_HEIGHT) {
-        g_ballX = paddleLeft - BALL_RADIUS;
-        g_ballVX = -fabsf(g_ballVX) * BALL_SPEED_GROWTH;
-        float offset = (g_ballY - g_clientPaddleY) / PADDLE_HALF_HEIGHT;
-        g_ballVY += offset * 45.0f;
-      }
-    }
+// Both sides run the simulation from their own and the peer's inputs; only
+// those inputs (and state hashes) cross the link. The host's pause travels as
+// an input bit so both screens hold on the same tick.
+void updateLockstepGameplay() {
+  unsigned long nowUs = micros();
+  uint32_t elapsedUs = static_cast<uint32_t>(nowUs - g_lastSimTickUs);
+  g_lastSimTickUs = nowUs;
+
+  int direction = 0;
+  if (cardKeyPressed(';')) {
+    --direction;
+  }
+  if (cardKeyPressed('.')) {
+    ++direction;
+  }
+  bool hostPaused = g_role == Role::Host && g_gamePaused;
+  uint8_t events = 0;
+  lockstepAdvance(g_lockstep, g_sim, simClockAdvance(g_simClock, elapsedUs), lockstepInput(direction, hostPaused),
+                  events);
+  if (g_role == Role::Client) {
+    g_gamePaused = g_lockstep.paused;
   }
+  sendPolicyNoteEvents(g_stateSendPolicy, events);  // paces the spectators' keyframes
+  if (events & SIM_EVENT_GAME_OVER) {
+    markGameOver();
+  }
+}
 
-  // Scoring
-  if (g_ballX + BALL_RADIUS < 0) {
-    ++g_clientScore;
-    if (g_clientScore >= MAX_SCORE) {
-      markGameOver();
-      return;
+// Input packets while there is something to tell the peer. The host repeats
+// Start until the client answers and a sync until it answers from the new epoch.
+void sendLockstepPackets(unsigned long now) {
+  if (!g_hasPeer) {
+    return;
+  }
+  if (lockstepSendDue(g_lockstep, static_cast<uint32_t>(now - g_lastLockstepSent))) {
+    uint8_t packet[LOCKSTEP_PACKET_MAX];
+    size_t length = lockstepWritePacket(g_lockstep, packet, sizeof(packet));
+    if (length != 0) {
+      g_transport.sendTo(g_peer, packet, length);
     }
-    prepareServe(1);
-  } else if (g_ballX - BALL_RADIUS > SCREEN_WIDTH) {
-    ++g_hostScore;
-    if (g_hostScore >= MAX_SCORE) {
-      markGameOver();
-      return;
+    g_lastLockstepSent = now;
+  }
+  if (g_role != Role::Host || (g_lockstep.peerSeen && !lockstepSyncPending(g_lockstep)) ||
+      now - g_lastLockstepHandshake < LOCKSTEP_SYNC_RESEND_MS) {
+    return;
+  }
+  g_lastLockstepHandshake = now;
+  if (!g_lockstep.peerSeen) {
+    sendStartPacket(g_matchSeed);
+  }
+  if (lockstepSyncPending(g_lockstep)) {
+    uint8_t packet[LOCKSTEP_SYNC_PACKET_MAX];
+    size_t length = lockstepWriteSync(g_lockstep, g_sim, packet, sizeof(packet));
+    if (length != 0) {
+      g_transport.sendTo(g_peer, packet, length);
     }
-    prepareServe(-1);
   }
 }
 
@@ -1311,22 +2491,56 @@ void updateClientGameplay(float dtSeconds) {
   }
 
   bool moved = false;
+  SimScalar step = PADDLE_SPEED * dtSeconds;
+  SimScalar dy = 0.0f;
   if (cardKeyPressed(';')) {
-    g_clientPaddleY -= PADDLE_SPEED * dtSeconds;
+    dy -= step;
     moved = true;
   }
   if (cardKeyPressed('.')) {
-    g_clientPaddleY += PADDLE_SPEED * dtSeconds;
+    dy += step;
     moved = true;
   }
-  g_clientPaddleY = clampValue(g_clientPaddleY, PADDLE_HALF_HEIGHT, SCREEN_HEIGHT - PADDLE_HALF_HEIGHT);
+  if (moved) {
+    predictorApply(g_paddlePredictor, dy, millis());
+  }
+  g_sim.clientPaddleY = g_paddlePredictor.predictedY;
 
-  unsigned long now = millis();
-  if (moved || (now - g_lastPaddleSent) > PADDLE_SEND_INTERVAL_MS) {
+  unsigned long sinceSentMs = millis() - g_lastPaddleSent;
+  if ((moved && sinceSentMs >= g_sendRate.intervalMs) ||
+      (paddleAckPending() && sinceSentMs > std::max(PADDLE_SEND_INTERVAL_MS, g_sendRate.intervalMs))) {
     sendPaddlePacket();
   }
 }
 
+// Places the ball and host paddle where the host had them g_interpDelayMs ago.
+// The delay follows the measured jitter unless it was set by hand.
+void updateClientInterpolation() {
+  if (g_interpDelayAuto && g_netClock.hasSample) {
+    g_interpDelayMs = netClockRenderDelayMs(g_netClock, STATE_MOTION_INTERVAL_MS, INTERP_DELAY_MAX_MS);
+  }
+  InterpSample sample;
+  if (!interpSample(g_interp, millis(), g_interpDelayMs, sample)) {
+    return;
+  }
+  g_sim.ballX = sample.ballX;
+  g_sim.ballY = sample.ballY;
+  g_sim.hostPaddleY = sample.hostPaddleY;
+  if (g_role == Role::Spectator) {
+    g_sim.clientPaddleY = sample.clientPaddleY;  // nobody predicts it here
+  }
+}
+
+void handleInterpDelayKeys() {
+  if (cardKeyJustPressed('-') && g_interpDelayMs >= INTERP_DELAY_STEP_MS) {
+    g_interpDelayMs -= INTERP_DELAY_STEP_MS;
+    g_interpDelayAuto = false;
+  } else if (cardKeyJustPressed('=') && g_interpDelayMs < INTERP_DELAY_MAX_MS) {
+    g_interpDelayMs += INTERP_DELAY_STEP_MS;
+    g_interpDelayAuto = false;
+  }
+}
+
 // -----------------------------------------------------------------------------
 // Wi-Fi and session setup ----------------------------------------------------
 
@@ -1337,8 +2551,8 @@ void saveWifiCredentials() {
   if (!g_preferences.begin("cpong", false)) {
     return;
   }
-  g_preferences.putString("ssid", g_wifiSSID);
-  g_preferences.putString("pass", g_wifiPassword);
+  g_preferences.putString("ssid", g_wifiSSID.c_str());
+  g_preferences.putString("pass", g_wifiPassword.c_str());
   g_preferences.end();
 }
 
@@ -1346,10 +2560,12 @@ void loadWifiCredentials() {
   if (!g_preferences.begin("cpong", true)) {
     return;
   }
-  String storedSsid = g_preferences.getString("ssid", "");
-  String storedPass = g_preferences.getString("pass", "");
+  char storedSsid[WIFI_SSID_MAX_LEN + 1] = {};
+  char storedPass[WIFI_PASSWORD_MAX_LEN + 1] = {};
+  g_preferences.getString("ssid", storedSsid, sizeof(storedSsid));
+  g_preferences.getString("pass", storedPass, sizeof(storedPass));
   g_preferences.end();
-  if (!storedSsid.isEmpty()) {
+  if (storedSsid[0] != '\0') {
     g_wifiSSID = storedSsid;
     g_wifiPassword = storedPass;
   }
@@ -1364,7 +2580,7 @@ void scanAvailableNetworks() {
     g_wifiNetworks.reserve(static_cast<size_t>(count));
     for (int16_t i = 0; i < count; ++i) {
       WifiNetworkInfo info;
-      info.ssid = WiFi.SSID(i);
+      info.ssid = WiFi.SSID(i).c_str();
       info.rssi = WiFi.RSSI(i);
       info.authMode = WiFi.encryptionType(i);
       g_wifiNetworks.push_back(info);
@@ -1393,7 +2609,7 @@ bool connectToWiFi() {
   display.setTextSize(1);
   display.setCursor(12, 70);
   display.print("SSID: ");
-  display.print(g_wifiSSID);
+  display.print(g_wifiSSID.c_str());
 
   g_errorMessage.clear();
 
@@ -1435,8 +2651,7 @@ bool connectToWiFi() {
 }
 
 bool resetUdp() {
-  g_udp.stop();
-  if (!g_udp.begin(UDP_PORT)) {
+  if (!g_transport.bind(UDP_PORT)) {
     g_errorMessage = "UDP bind failed.";
     setScreen(Screen::Error);
     drawErrorScreen();
@@ -1446,9 +2661,13 @@ bool resetUdp() {
 }
 
 void resetToMainMenu() {
+  g_transport.leaveGroup();
+  g_lastSpectateRequest = 0;
+  g_hasJoinTarget = false;
   g_hasPeer = false;
-  g_peerIp = IPAddress();
-  g_peerPort = UDP_PORT;
+  g_sessionToken = 0;
+  g_awaitingRejoin = false;
+  g_peer = NetAddress();
   g_role = Role::None;
   resetMatchState();
   resetKeyLatch();
@@ -1457,9 +2676,12 @@ void resetToMainMenu() {
 }
 
 void resetToWifiSetup() {
+  g_transport.leaveGroup();
+  g_lastSpectateRequest = 0;
   g_hasPeer = false;
-  g_peerIp = IPAddress();
-  g_peerPort = UDP_PORT;
+  g_sessionToken = 0;
+  g_awaitingRejoin = false;
+  g_peer = NetAddress();
   g_role = Role::None;
   resetMatchState();
   resetKeyLatch();
@@ -1474,6 +2696,13 @@ void startHosting() {
   }
   g_role = Role::Host;
   g_hasPeer = false;
+  g_sessionToken = 0;
+  g_awaitingRejoin = false;
+  g_lastSpectateRequest = 0;
+  g_lobbyId = newSessionToken();
+  g_beaconSeq = 0;
+  g_beaconState = LobbyState::Open;
+  g_lastBeaconSent = millis() - LOBBY_BEACON_INTERVAL_MS;  // due straight away
   resetMatchState();
   g_remotePlayerName = "Opponent";
   setScreen(Screen::HostWaiting);
@@ -1485,28 +2714,65 @@ void startJoining() {
   }
   g_role = Role::Client;
   g_hasPeer = false;
+  g_sessionToken = 0;
+  g_awaitingRejoin = false;
+  g_netMode = NetMode::Snapshot;  // the host's Start says otherwise
   resetMatchState();
-  g_lastJoinBroadcast = 0;
+  lobbyTableReset(g_lobbies);
+  g_lobbyCursor = 0;
+  g_selectedLobbyId = 0;
+  g_hasJoinTarget = false;
+  g_lastJoinSent = 0;
+  g_errorMessage.clear();
   g_remotePlayerName = "Host";
   setScreen(Screen::ClientSearching);
 }
 
+// Watching needs neither a name nor a seat: any host with a match answers.
+void startSpectating() {
+  if (!resetUdp()) {
+    return;
+  }
+  g_role = Role::Spectator;
+  g_hasPeer = false;
+  g_sessionToken = 0;
+  g_awaitingRejoin = false;
+  g_netMode = NetMode::Snapshot;  // whatever the players use, spectators get state
+  g_interpDelayMs = SPECTATE_INTERP_DELAY_MS;
+  g_interpDelayAuto = true;
+  resetMatchState();
+  g_lastSpectateSent = 0;
+  g_remotePlayerName = "Host";
+  g_spectatedClientName = "Challenger";
+  setScreen(Screen::ClientSearching);
+}
+
 void hostStartMatch(uint32_t seed) {
-  (void)seed;
-  randomSeed(seed);
   resetMatchState();
-  prepareServe(1);
+  simSeed(g_sim, seed);
+  simPrepareServe(g_sim, 1);
+  g_lastSimTickUs = micros();
+  g_matchSeed = seed;
+  lockstepReset(g_lockstep, seed, true);
+  g_lastLockstepHandshake = millis();
   setScreen(Screen::Playing);
-  sendStatePacket();
+  if (g_netMode == NetMode::Snapshot) {
+    sendStatePacket();
+  }
 }
 
-void clientStartMatch(uint32_t seed) {
-  (void)seed;
-  randomSeed(seed);
+void clientStartMatch(uint32_t seed, NetMode mode) {
+  if (mode == NetMode::Lockstep && g_netMode == mode && seed == g_matchSeed &&
+      (g_screen == Screen::Playing || g_screen == Screen::GameOver)) {
+    return;  // the host repeats Start until it hears from this match
+  }
+  g_netMode = mode;
+  g_matchSeed = seed;
   resetMatchState();
-  g_waitingForServe = true;
-  g_matchActive = true;
-  g_serveDirection = 1;
+  simSeed(g_sim, seed);
+  simPrepareServe(g_sim, 1);
+  g_lastSimTickUs = micros();
+  lockstepReset(g_lockstep, seed, false);
   setScreen(Screen::Playing);
 }
 
@@ -1514,15 +2780,20 @@ void clientStartMatch(uint32_t seed) {
 // Arduino main loop ----------------------------------------------------------
 
 void setup() {
+  g_loopTask = xTaskGetCurrentTaskHandle();
   auto cfg = M5.config();
   M5.begin(cfg);
   M5Cardputer.begin();
   M5.Display.setRotation(1);
   M5.Display.setTextColor(COLOR_WHITE, COLOR_BLACK);
+  initFrameCanvases();
 
   WiFi.mode(WIFI_STA);
   WiFi.disconnect(true);
   loadWifiCredentials();
+#if PONG_NET_IMPAIRMENT
+  g_impairedTransport.setProfile(netImpairmentProfile());
+#endif
 
   g_screenDirty = true;
   onScreenEnter(g_screen);
@@ -1543,12 +2814,21 @@ void setup() {
 }
 
 void loop() {
+  // The Playing allocation check covers the whole frame; see HeapWatermark.
+  bool playingAtFrameStart = g_screen == Screen::Playing;
+  uint32_t allocationsAtFrameStart = g_loopAllocations;
   M5.update();
   M5Cardputer.update();
+  captureKeySnapshot();
   processNetwork();
+  uint32_t allocationsAfterReceive = g_loopAllocations;
   handleConnectionTimeout();
 
   unsigned long now = millis();
+  updatePing(now);
+  updateSendRate(now);
+  updateSpectator(now);
+  updateLobbyBeacon(now);
   float dt = (now - g_lastFrameTick) / 1000.0f;
   g_lastFrameTick = now;
 
@@ -1589,7 +2869,7 @@ void loop() {
         }
       }
 
-      if (cardKeyJustPressedAny({}, {HID_KEY_ENTER})) {
+      if (cardKeysJustPressed(KEYS_ENTER)) {
         if (!g_wifiNetworks.empty()) {
           int safeIndex = g_wifiSelectedIndex;
           safeIndex = clampValue(safeIndex, 0, static_cast<int>(g_wifiNetworks.size()) - 1);
@@ -1608,8 +2888,8 @@ void loop() {
       break;
     }
     case Screen::WifiPassword: {
-      String previousPassword = g_wifiPassword;
-      handleTextInput(g_wifiPassword, 63);
+      PasswordString previousPassword = g_wifiPassword;
+      handleTextInput(g_wifiPassword, WIFI_PASSWORD_MAX_LEN);
       if (previousPassword != g_wifiPassword) {
         g_screenDirty = true;
       }
@@ -1621,7 +2901,7 @@ void loop() {
 
       if (cardKeyJustPressed('Q')) {
         setScreen(Screen::WifiSelect);
-      } else if (cardKeyJustPressedAny({}, {HID_KEY_ENTER})) {
+      } else if (cardKeysJustPressed(KEYS_ENTER)) {
         if (connectToWiFi()) {
           g_errorMessage.clear();
           setScreen(Screen::NameEntry);
@@ -1632,7 +2912,7 @@ void loop() {
       break;
     }
     case Screen::NameEntry: {
-      String previousName = g_localPlayerName;
+      PlayerName previousName = g_localPlayerName;
       handleTextInput(g_localPlayerName, PLAYER_NAME_MAX_LEN);
       if (previousName != g_localPlayerName) {
         g_screenDirty = true;
@@ -1640,8 +2920,8 @@ void loop() {
 
       if (cardKeyJustPressed('Q') && keysState.fn) {
         resetToWifiSetup();
-      } else if (cardKeyJustPressedAny({}, {HID_KEY_ENTER})) {
-        String trimmed = g_localPlayerName;
+      } else if (cardKeysJustPressed(KEYS_ENTER)) {
+        PlayerName trimmed = g_localPlayerName;
         trimmed.trim();
         if (trimmed.isEmpty()) {
           trimmed = "Player";
@@ -1659,6 +2939,8 @@ void loop() {
         startHosting();
       } else if (cardKeyJustPressed('J')) {
         startJoining();
+      } else if (cardKeyJustPressed('V')) {
+        startSpectating();
       } else if (cardKeyJustPressed('Q') && keysState.fn) {
         resetToWifiSetup();
       }
@@ -1673,16 +2955,25 @@ void loop() {
         resetToMainMenu();
         break;
       }
-      if (now - g_lastJoinBroadcast > JOIN_BROADCAST_INTERVAL_MS) {
-        sendJoinBroadcast();
-        g_lastJoinBroadcast = now;
+      if (g_role != Role::Client) {
+        break;
+      }
+      if (!g_awaitingRejoin) {
+        updateLobbyBrowser(now);
+      }
+      if (g_hasJoinTarget && now - g_lastJoinSent > JOIN_INTERVAL_MS) {
+        sendJoinRequest();
+        g_lastJoinSent = now;
       }
       break;
     }
     case Screen::Lobby:
       if (cardKeyJustPressed('Q')) {
         resetToMainMenu();
-      } else if (g_role == Role::Host && cardKeyJustPressed(' ')) {
+      } else if (g_role == Role::Host && cardKeyJustPressed('L')) {
+        g_netMode = g_netMode == NetMode::Lockstep ? NetMode::Snapshot : NetMode::Lockstep;
+        g_screenDirty = true;
+      } else if (g_role == Role::Host && g_hasPeer && cardKeyJustPressed(' ')) {
         uint32_t seed = nextRandomSeed();
         sendStartPacket(seed);
         hostStartMatch(seed);
@@ -1690,26 +2981,66 @@ void loop() {
       break;
     case Screen::Playing: {
       bool escJustPressed = cardKeyJustPressed(ASCII_ESC);
-      if (escJustPressed && g_role == Role::Host) {
+      if (escJustPressed && g_role == Role::Host && g_hasPeer) {
         g_gamePaused = !g_gamePaused;
       }
 
-      if (g_role == Role::Host) {
-        if (!g_gamePaused) {
-          updateHostGameplay(dt);
+      if (g_role == Role::Spectator) {
+        handleInterpDelayKeys();
+        updateClientInterpolation();
+      } else if (g_netMode == NetMode::Lockstep) {
+        if (!linkStalled()) {
+          updateLockstepGameplay();
+          sendLockstepPackets(now);
+          StateSendReason reason = g_role == Role::Host && spectatorsWatching(now)
+                                       ? sendPolicyCheck(g_stateSendPolicy, g_sim, static_cast<uint32_t>(now))
+                                       : StateSendReason::None;
+          if (reason != StateSendReason::None) {
+            sendSpectatorState(reason);
+          }
+        }
+      } else if (g_role == Role::Host) {
+        if (escJustPressed) {
+          sendPolicyForce(g_stateSendPolicy);
         }
-        if (escJustPressed || (now - g_lastStateSent > STATE_SEND_INTERVAL_MS)) {
-          sendStatePacket();
+        updateHostGameplay();
+        StateSendReason reason =
+            linkStalled() ? StateSendReason::None : sendPolicyCheck(g_stateSendPolicy, g_sim, static_cast<uint32_t>(now));
+        if (reason != StateSendReason::None) {
+          sendStatePacket(reason);
         }
       } else {
-        if (!g_gamePaused) {
+        if (linkStalled()) {
+          // Frozen like the host until it answers again.
+        } else if (!g_gamePaused) {
           updateClientGameplay(dt);
+        } else if (paddleAckPending() && now - g_lastPaddleSent > PADDLE_SEND_INTERVAL_MS) {
+          sendPaddlePacket();  // keeps acknowledging state while paused
+        }
+        handleInterpDelayKeys();
+        updateClientInterpolation();
+      }
+
+      if (cardKeyJustPressed('F')) {
+        if (keysState.fn) {
+          if (g_renderPath == RenderPath::Direct && g_frameCanvasCount > 0) {
+            g_renderPath = RenderPath::Canvas;
+          } else {
+            g_renderPath = RenderPath::Direct;
+          }
+          g_frameStats = FrameStats();
+        } else {
+          g_showFrameStats = !g_showFrameStats;
         }
       }
+      if (cardKeyJustPressed('N')) {
+        g_showNetStats = !g_showNetStats;
+      }
 
+      updateFrameStats();
       drawGameFrame();
-      if (g_gamePaused) {
-        drawPauseOverlay();
+      if (playingAtFrameStart) {
+        updateHeapWatermark(allocationsAtFrameStart, allocationsAfterReceive);
       }
 
       if (cardKeyJustPressed('Q')) {
@@ -1719,9 +3050,12 @@ void loop() {
     }
     case Screen::GameOver:
       drawGameOverFrameAnimated(dt);
+      if (g_netMode == NetMode::Lockstep) {
+        sendLockstepPackets(now);  // the peer may still need our last inputs
+      }
       if (cardKeyJustPressed('Q')) {
         resetToMainMenu();
-      } else if (g_role == Role::Host && cardKeyJustPressed(' ')) {
+      } else if (g_role == Role::Host && g_hasPeer && cardKeyJustPressed(' ')) {
         uint32_t seed = nextRandomSeed();
         sendStartPacket(seed);
         hostStartMatch(seed);
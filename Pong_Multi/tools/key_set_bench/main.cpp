@@ -0,0 +1,317 @@
+// Compares the two ways the firmware has asked the keyboard about keys, on the
+// queries the game screen makes every frame (paddle keys held, and just
+// pressed for the interp delay, Esc, F, N, Q and Space):
+//
+//   vectors  the old cardKeyPressedAny()/cardKeyJustPressedAny(): two
+//            std::vectors built per query, each key looked up by scanning
+//            the keys held in the driver
+//   KeySet   one snapshot of the driver per frame, then word-wise bit tests
+//            against compile-time KeySets
+//
+// The driver is a stand-in for M5Cardputer's Keyboard_Class with the same
+// data layout (held key positions, keymap lookup, HID usage vector). Prints
+// nanoseconds and heap allocations per frame with 0, 1 and 3 keys held.
+//
+//   key_set_bench [--frames N]
+
+#include <key_set.h>
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <vector>
+
+namespace {
+size_t g_allocations = 0;
+}  // namespace
+
+void *operator new(size_t size) {
+  ++g_allocations;
+  void *block = malloc(size != 0 ? size : 1);
+  if (block == nullptr) {
+    throw std::bad_alloc();
+  }
+  return block;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *block) noexcept {
+  free(block);
+}
+
+void operator delete[](void *block) noexcept {
+  free(block);
+}
+
+void operator delete(void *block, size_t) noexcept {
+  free(block);
+}
+
+void operator delete[](void *block, size_t) noexcept {
+  free(block);
+}
+
+namespace {
+
+constexpr uint8_t HID_KEY_ENTER = 0x28;
+constexpr char ASCII_ESC = 0x1B;
+constexpr size_t KEY_LATCH_SIZE = 512;
+
+// Keyboard driver ------------------------------------------------------------
+
+struct Point2D {
+  int x;
+  int y;
+};
+
+// Cardputer layout: unshifted and shifted value of each of the 4x14 keys.
+const char KEY_MAP[4][14][2] = {
+    {{'`', '~'}, {'1', '!'}, {'2', '@'}, {'3', '#'}, {'4', '$'}, {'5', '%'}, {'6', '^'},
+     {'7', '&'}, {'8', '*'}, {'9', '('}, {'0', ')'}, {'-', '_'}, {'=', '+'}, {0x08, 0x08}},
+    {{0x09, 0x09}, {'q', 'Q'}, {'w', 'W'}, {'e', 'E'}, {'r', 'R'}, {'t', 'T'}, {'y', 'Y'},
+     {'u', 'U'}, {'i', 'I'}, {'o', 'O'}, {'p', 'P'}, {'[', '{'}, {']', '}'}, {'\\', '|'}},
+    {{0, 0}, {0, 0}, {'a', 'A'}, {'s', 'S'}, {'d', 'D'}, {'f', 'F'}, {'g', 'G'},
+     {'h', 'H'}, {'j', 'J'}, {'k', 'K'}, {'l', 'L'}, {';', ':'}, {'\'', '"'}, {0x0D, 0x0D}},
+    {{0, 0}, {0, 0}, {0, 0}, {'z', 'Z'}, {'x', 'X'}, {'c', 'C'}, {'v', 'V'},
+     {'b', 'B'}, {'n', 'N'}, {'m', 'M'}, {',', '<'}, {'.', '>'}, {'/', '?'}, {' ', ' '}},
+};
+
+struct Keyboard {
+  std::vector<Point2D> keys;  // held positions
+  std::vector<uint8_t> hidKeys;
+  bool shift = false;
+
+  char getKey(const Point2D &position) const {
+    return KEY_MAP[position.y][position.x][shift ? 1 : 0];
+  }
+
+  bool isKeyPressed(char key) const {
+    for (const Point2D &position : keys) {
+      if (getKey(position) == key) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+// Old path: vectors per query ------------------------------------------------
+
+struct VectorKeys {
+  const Keyboard *keyboard;
+  std::array<bool, KEY_LATCH_SIZE> latch{};
+
+  bool hidKeyPressed(uint8_t code) const {
+    for (uint8_t held : keyboard->hidKeys) {
+      if (held == code) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool pressedVectors(const std::vector<char> &asciiKeys, const std::vector<uint8_t> &hidKeys) const {
+    for (char key : asciiKeys) {
+      if (keyboard->isKeyPressed(key)) {
+        return true;
+      }
+    }
+    for (uint8_t code : hidKeys) {
+      if (hidKeyPressed(code)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool justPressedVectors(const std::vector<char> &asciiKeys, const std::vector<uint8_t> &hidKeys) {
+    bool anyJustPressed = false;
+    for (char key : asciiKeys) {
+      size_t idx = static_cast<uint8_t>(key) % KEY_LATCH_SIZE;
+      bool pressed = keyboard->isKeyPressed(key);
+      if (pressed && !latch[idx]) {
+        anyJustPressed = true;
+      }
+      latch[idx] = pressed;
+    }
+    for (uint8_t code : hidKeys) {
+      size_t idx = (256u + code) % KEY_LATCH_SIZE;
+      bool pressed = hidKeyPressed(code);
+      if (pressed && !latch[idx]) {
+        anyJustPressed = true;
+      }
+      latch[idx] = pressed;
+    }
+    return anyJustPressed;
+  }
+
+  bool pressedAny(std::initializer_list<char> asciiKeys, std::initializer_list<uint8_t> hidKeys = {}) {
+    return pressedVectors(std::vector<char>(asciiKeys), std::vector<uint8_t>(hidKeys));
+  }
+
+  bool justPressedAny(std::initializer_list<char> asciiKeys, std::initializer_list<uint8_t> hidKeys = {}) {
+    return justPressedVectors(std::vector<char>(asciiKeys), std::vector<uint8_t>(hidKeys));
+  }
+
+  // Letters went through the same case folding as cardKeyPressed().
+  bool letterJustPressed(char lower) {
+    return justPressedAny({lower, static_cast<char>(lower - 'a' + 'A')});
+  }
+
+  int frame() {
+    int hits = 0;
+    hits += pressedAny({';'});
+    hits += pressedAny({'.'});
+    hits += justPressedAny({'-'});
+    hits += justPressedAny({'='});
+    hits += justPressedAny({ASCII_ESC});
+    hits += letterJustPressed('f');
+    hits += letterJustPressed('n');
+    hits += letterJustPressed('q');
+    hits += justPressedAny({' '});
+    hits += justPressedAny({}, {HID_KEY_ENTER});
+    return hits;
+  }
+};
+
+// New path: one snapshot, bit tests ------------------------------------------
+
+constexpr KeySet KEYS_UP = KeySet().ascii(';');
+constexpr KeySet KEYS_DOWN = KeySet().ascii('.');
+constexpr KeySet KEYS_SLOWER = KeySet().ascii('-');
+constexpr KeySet KEYS_FASTER = KeySet().ascii('=');
+constexpr KeySet KEYS_ESC = KeySet().ascii(ASCII_ESC);
+constexpr KeySet KEYS_FRAME_TIME = KeySet().letter('f');
+constexpr KeySet KEYS_NET_STATS = KeySet().letter('n');
+constexpr KeySet KEYS_QUIT = KeySet().letter('q');
+constexpr KeySet KEYS_SERVE = KeySet().ascii(' ');
+constexpr KeySet KEYS_ENTER = KeySet().hid(HID_KEY_ENTER);
+
+struct BitKeys {
+  const Keyboard *keyboard;
+  KeySet down;
+  KeySet latch;
+
+  void capture() {
+    down.clear();
+    for (const Point2D &position : keyboard->keys) {
+      down.setAscii(keyboard->getKey(position));
+    }
+    for (uint8_t code : keyboard->hidKeys) {
+      down.setHid(code);
+    }
+  }
+
+  int frame() {
+    capture();
+    int hits = 0;
+    hits += keySetAny(down, KEYS_UP);
+    hits += keySetAny(down, KEYS_DOWN);
+    hits += keySetJustPressed(down, latch, KEYS_SLOWER);
+    hits += keySetJustPressed(down, latch, KEYS_FASTER);
+    hits += keySetJustPressed(down, latch, KEYS_ESC);
+    hits += keySetJustPressed(down, latch, KEYS_FRAME_TIME);
+    hits += keySetJustPressed(down, latch, KEYS_NET_STATS);
+    hits += keySetJustPressed(down, latch, KEYS_QUIT);
+    hits += keySetJustPressed(down, latch, KEYS_SERVE);
+    hits += keySetJustPressed(down, latch, KEYS_ENTER);
+    return hits;
+  }
+};
+
+struct Held {
+  const char *name;
+  std::vector<Point2D> keys;
+  std::vector<uint8_t> hidKeys;
+};
+
+struct Timing {
+  double nsPerFrame;
+  double allocationsPerFrame;
+  long hits;
+};
+
+template <typename Path>
+Timing run(Path &path, Keyboard &keyboard, const Held &held, uint32_t frames) {
+  Timing timing{};
+  size_t allocationsBefore = g_allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t frame = 0; frame < frames; ++frame) {
+    // Every 32nd frame the keys are let go, so just-pressed fires again.
+    if ((frame & 31) == 31) {
+      keyboard.keys.clear();
+      keyboard.hidKeys.clear();
+    } else {
+      keyboard.keys.assign(held.keys.begin(), held.keys.end());
+      keyboard.hidKeys.assign(held.hidKeys.begin(), held.hidKeys.end());
+    }
+    timing.hits += path.frame();
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+  timing.nsPerFrame = static_cast<double>(elapsed.count()) / frames;
+  timing.allocationsPerFrame = static_cast<double>(g_allocations - allocationsBefore) / frames;
+  return timing;
+}
+
+// The key changes themselves (vector assign above) cost the same for both
+// paths; timed alone and taken off.
+Timing baseline(Keyboard &keyboard, const Held &held, uint32_t frames) {
+  struct Idle {
+    int frame() {
+      return 0;
+    }
+  } idle;
+  return run(idle, keyboard, held, frames);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  uint32_t frames = 2000000;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--frames") == 0) {
+      frames = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+    } else {
+      fprintf(stderr, "usage: key_set_bench [--frames N]\n");
+      return 2;
+    }
+  }
+
+  const Held HELD[] = {
+      {"nothing held", {}, {}},
+      {"';' held", {{11, 2}}, {}},
+      {"';' 'f' enter held", {{11, 2}, {5, 2}, {13, 2}}, {HID_KEY_ENTER}},
+  };
+
+  printf("%u frames, 10 key queries per frame\n", frames);
+  printf("%-20s %12s %12s %12s %12s %8s\n", "keys", "vectors ns", "allocs", "KeySet ns", "allocs", "speedup");
+  int failures = 0;
+  for (const Held &held : HELD) {
+    Keyboard keyboard;
+    keyboard.keys.reserve(4);
+    keyboard.hidKeys.reserve(4);
+    Timing idle = baseline(keyboard, held, frames);
+    VectorKeys vectors{&keyboard};
+    Timing old = run(vectors, keyboard, held, frames);
+    BitKeys bits{&keyboard, KeySet(), KeySet()};
+    Timing now = run(bits, keyboard, held, frames);
+    if (old.hits != now.hits) {
+      printf("%-20s answers differ: %ld against %ld\n", held.name, old.hits, now.hits);
+      ++failures;
+      continue;
+    }
+    double oldNs = old.nsPerFrame - idle.nsPerFrame;
+    double newNs = now.nsPerFrame - idle.nsPerFrame;
+    printf("%-20s %12.1f %12.1f %12.1f %12.1f %7.1fx\n", held.name, oldNs,
+           old.allocationsPerFrame - idle.allocationsPerFrame, newNs,
+           now.allocationsPerFrame - idle.allocationsPerFrame, newNs > 0.0 ? oldNs / newNs : 0.0);
+  }
+  return failures == 0 ? 0 : 1;
+}
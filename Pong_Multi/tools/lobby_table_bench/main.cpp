@@ -0,0 +1,341 @@
+// What a searching client pays to keep its lobby list: plays H hosts beaconing
+// on one subnet in simulated time, with loss, jitter, hosts starting and
+// leaving matches, restarting and going away, against one LobbyTable fed the
+// way the firmware feeds it (decode, hear, expire and one probe per
+// LOBBY_PROBE_SPACING_MS, probe answers after each host's round trip). For
+// each H it prints the nanoseconds per beacon and per browser tick, how many
+// lobbies the table lists against how many are live, the table's counters,
+// how far the smoothed round trips are from the true ones, and the heap
+// allocations made while the table ran, which must be none.
+//
+//   lobby_table_bench [--hosts 10,50,100,128,200] [--seconds S] [--loss PCT] [--seed N]
+//
+// Above LOBBY_TABLE_CAPACITY hosts the table stays full: a newcomer only
+// takes the place of a lobby about to expire, or of one in a match, and is
+// turned away otherwise, so the list does not churn.
+
+#include <lobby_table.h>
+#include <protocol.h>
+#include <transport.h>
+
+#include <time.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+// Heap accounting ------------------------------------------------------------
+// Every allocation in the process goes through here; the bench compares the
+// count before and after the measured run.
+
+namespace {
+size_t g_allocations = 0;
+}  // namespace
+
+void *operator new(size_t size) {
+  ++g_allocations;
+  void *block = malloc(size != 0 ? size : 1);
+  if (block == nullptr) {
+    throw std::bad_alloc();
+  }
+  return block;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *block) noexcept {
+  free(block);
+}
+
+void operator delete[](void *block) noexcept {
+  free(block);
+}
+
+void operator delete(void *block, size_t) noexcept {
+  free(block);
+}
+
+void operator delete[](void *block, size_t) noexcept {
+  free(block);
+}
+
+namespace {
+
+constexpr uint32_t BEACON_JITTER_MS = 50;      // hosts' loops are not exact
+constexpr uint32_t PROBE_JITTER_MS = 4;        // on top of each host's base round trip
+constexpr uint32_t STATE_CHANGE_PERMILLE = 50;  // per beacon: a player joins or a match ends
+constexpr uint32_t RESTART_PERMILLE = 2;        // per beacon: the host starts a new session
+constexpr uint32_t LEAVE_PERMILLE = 5;          // per beacon: the host goes away, another appears
+constexpr size_t MAX_PENDING_ANSWERS = 64;
+
+struct Options {
+  std::vector<uint32_t> hosts{10, 50, 100, 128, 200};
+  uint32_t seconds = 120;
+  uint32_t lossPercent = 10;
+  uint32_t seed = 12345;
+};
+
+bool parseList(const char *text, std::vector<uint32_t> &out) {
+  out.clear();
+  while (*text != '\0') {
+    char *end = nullptr;
+    unsigned long value = strtoul(text, &end, 10);
+    if (end == text || value == 0) {
+      return false;
+    }
+    out.push_back(static_cast<uint32_t>(value));
+    text = *end == ',' ? end + 1 : end;
+  }
+  return !out.empty();
+}
+
+uint32_t nextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+bool chance(uint32_t &rng, uint32_t permille) {
+  return nextRandom(rng) % 1000 < permille;
+}
+
+uint64_t monotonicNs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+}
+
+// What one pair of clock reads costs, taken off every timed call.
+uint64_t timerOverheadNs() {
+  constexpr int ROUNDS = 100000;
+  uint64_t total = 0;
+  for (int i = 0; i < ROUNDS; ++i) {
+    uint64_t start = monotonicNs();
+    total += monotonicNs() - start;
+  }
+  return total / ROUNDS;
+}
+
+struct SimHost {
+  NetAddress address;
+  uint32_t lobbyId = 0;
+  uint8_t seq = 0;
+  LobbyState state = LobbyState::Open;
+  uint32_t nextBeaconMs = 0;
+  uint32_t rttMs = 0;
+  char name[LOBBY_NAME_MAX + 1] = {};
+};
+
+struct PendingAnswer {
+  NetAddress from;
+  uint32_t lobbyId = 0;
+  uint32_t sentUs = 0;
+  uint32_t dueMs = 0;
+};
+
+struct RunResult {
+  uint64_t beacons = 0;
+  uint64_t beaconNs = 0;
+  uint64_t beaconMaxNs = 0;
+  uint64_t ticks = 0;
+  uint64_t tickNs = 0;
+  uint64_t tickMaxNs = 0;
+  double listedSum = 0.0;  // sampled once a second
+  double liveSum = 0.0;
+  uint32_t samples = 0;
+  double rttErrorMs = 0.0;  // mean over listed lobbies with an answer, at the end
+  size_t allocations = 0;
+  LobbyTableStats stats;
+};
+
+void newSession(SimHost &host, uint32_t &rng) {
+  host.lobbyId = nextRandom(rng);
+  host.seq = 0;
+  host.state = LobbyState::Open;
+}
+
+void newHost(SimHost &host, uint32_t index, uint32_t &rng) {
+  host.address = netAddress(10, static_cast<uint8_t>(index >> 16), static_cast<uint8_t>(index >> 8),
+                            static_cast<uint8_t>(index), UDP_PORT);
+  host.rttMs = 2 + nextRandom(rng) % 40;
+  snprintf(host.name, sizeof(host.name), "Player%u", index);
+  newSession(host, rng);
+}
+
+// The host the table should have for this address and session, if it is live.
+const SimHost *liveHost(const std::vector<SimHost> &hosts, const LobbyEntry &entry) {
+  for (const SimHost &host : hosts) {
+    if (host.address == entry.address && host.lobbyId == entry.beacon.lobbyId) {
+      return &host;
+    }
+  }
+  return nullptr;
+}
+
+void runTable(const Options &options, uint32_t hostCount, LobbyTable &table, RunResult &result) {
+  uint32_t rng = options.seed * 2654435761u + hostCount;
+  rng = rng != 0 ? rng : 1;
+  std::vector<SimHost> hosts(hostCount);
+  uint32_t nextIndex = 1;
+  for (SimHost &host : hosts) {
+    newHost(host, nextIndex++, rng);
+    host.nextBeaconMs = nextRandom(rng) % LOBBY_BEACON_INTERVAL_MS;
+  }
+  PendingAnswer pending[MAX_PENDING_ANSWERS];
+  size_t pendingCount = 0;
+  lobbyTableReset(table);
+  uint64_t overheadNs = timerOverheadNs();
+  auto timed = [overheadNs](uint64_t startNs) {
+    uint64_t elapsed = monotonicNs() - startNs;
+    return elapsed > overheadNs ? elapsed - overheadNs : 0;
+  };
+
+  size_t allocationsBefore = g_allocations;
+  uint32_t endMs = options.seconds * 1000u;
+  uint32_t nextProbeMs = 0;
+  for (uint32_t nowMs = 1; nowMs <= endMs; ++nowMs) {
+    for (SimHost &host : hosts) {
+      if (nowMs < host.nextBeaconMs) {
+        continue;
+      }
+      if (chance(rng, LEAVE_PERMILLE)) {
+        newHost(host, nextIndex++, rng);
+      } else if (chance(rng, RESTART_PERMILLE)) {
+        newSession(host, rng);
+      } else if (chance(rng, STATE_CHANGE_PERMILLE)) {
+        host.state = host.state == LobbyState::Open ? LobbyState::Playing : LobbyState::Open;
+      }
+      LobbyBeacon beacon;
+      beacon.lobbyId = host.lobbyId;
+      beacon.seq = ++host.seq;
+      beacon.state = host.state;
+      memcpy(beacon.name, host.name, sizeof(beacon.name));
+      uint32_t interval = lobbyBeaconIntervalMs(host.state);
+      host.nextBeaconMs = nowMs + interval - BEACON_JITTER_MS / 2 + nextRandom(rng) % BEACON_JITTER_MS;
+      if (nextRandom(rng) % 100 < options.lossPercent) {
+        continue;
+      }
+      uint8_t packet[LOBBY_BEACON_MAX];
+      size_t length = lobbyBeaconEncode(beacon, packet, sizeof(packet));
+
+      uint64_t startNs = monotonicNs();
+      LobbyBeacon heard;
+      if (lobbyBeaconDecode(packet, length, heard)) {
+        lobbyTableHeard(table, host.address, heard, nowMs);
+      }
+      uint64_t costNs = timed(startNs);
+      ++result.beacons;
+      result.beaconNs += costNs;
+      result.beaconMaxNs = costNs > result.beaconMaxNs ? costNs : result.beaconMaxNs;
+    }
+
+    for (size_t i = 0; i < pendingCount;) {
+      if (nowMs < pending[i].dueMs) {
+        ++i;
+        continue;
+      }
+      lobbyTableAnswer(table, pending[i].from, pending[i].lobbyId, pending[i].sentUs, nowMs * 1000u);
+      pending[i] = pending[--pendingCount];
+    }
+
+    if (nowMs >= nextProbeMs) {
+      nextProbeMs = nowMs + LOBBY_PROBE_SPACING_MS;
+      uint64_t startNs = monotonicNs();
+      lobbyTableExpire(table, nowMs);
+      const LobbyEntry *probed = lobbyTableNextProbe(table, nowMs);
+      uint64_t costNs = timed(startNs);
+      ++result.ticks;
+      result.tickNs += costNs;
+      result.tickMaxNs = costNs > result.tickMaxNs ? costNs : result.tickMaxNs;
+      const SimHost *host = probed != nullptr ? liveHost(hosts, *probed) : nullptr;
+      bool lost = nextRandom(rng) % 100 < options.lossPercent || nextRandom(rng) % 100 < options.lossPercent;
+      if (host != nullptr && !lost && pendingCount < MAX_PENDING_ANSWERS) {
+        PendingAnswer &answer = pending[pendingCount++];
+        answer.from = host->address;
+        answer.lobbyId = host->lobbyId;
+        answer.sentUs = nowMs * 1000u;
+        answer.dueMs = nowMs + host->rttMs + nextRandom(rng) % (PROBE_JITTER_MS + 1);
+      }
+    }
+
+    if (nowMs % 1000 == 0) {
+      uint32_t live = 0;
+      for (size_t i = 0; i < table.count; ++i) {
+        live += liveHost(hosts, lobbyTableAt(table, i)) != nullptr ? 1 : 0;
+      }
+      result.listedSum += static_cast<double>(table.count);
+      result.liveSum += static_cast<double>(live);
+      ++result.samples;
+    }
+  }
+  result.allocations = g_allocations - allocationsBefore;
+
+  uint32_t measured = 0;
+  for (size_t i = 0; i < table.count; ++i) {
+    const LobbyEntry &entry = lobbyTableAt(table, i);
+    const SimHost *host = liveHost(hosts, entry);
+    if (host != nullptr && entry.srttUs != 0) {
+      double trueMs = host->rttMs + PROBE_JITTER_MS / 2.0;
+      result.rttErrorMs += std::fabs(entry.srttUs / 1000.0 - trueMs);
+      ++measured;
+    }
+  }
+  result.rttErrorMs = measured != 0 ? result.rttErrorMs / measured : 0.0;
+  result.stats = table.stats;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--hosts") == 0) {
+      if (!parseList(argv[i + 1], options.hosts)) {
+        fprintf(stderr, "lobby_table_bench: bad --hosts list\n");
+        return 2;
+      }
+    } else if (strcmp(argv[i], "--seconds") == 0) {
+      options.seconds = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+    } else if (strcmp(argv[i], "--loss") == 0) {
+      options.lossPercent = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+    } else if (strcmp(argv[i], "--seed") == 0) {
+      options.seed = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+    } else {
+      fprintf(stderr, "usage: lobby_table_bench [--hosts 10,50,100,128,200] [--seconds S] [--loss PCT] [--seed N]\n");
+      return 2;
+    }
+  }
+  if (options.seconds == 0) {
+    options.seconds = 1;
+  }
+
+  static LobbyTable table;  // as on the device: one fixed table, reused
+  printf("%u s simulated per row, %u%% loss each way; table of %u entries, %u bytes\n", options.seconds,
+         options.lossPercent, static_cast<unsigned>(LOBBY_TABLE_CAPACITY), static_cast<unsigned>(sizeof(LobbyTable)));
+  printf("%6s %7s %6s %8s %8s %8s %8s %6s %6s %6s %6s %6s %7s %7s %7s %7s\n", "hosts", "listed", "live", "beacons",
+         "ns/bcn", "max ns", "ns/tick", "added", "restrt", "expird", "evictd", "away", "probes", "answers", "rtt err",
+         "allocs");
+  int failures = 0;
+  for (uint32_t count : options.hosts) {
+    RunResult result;
+    runTable(options, count, table, result);
+    const LobbyTableStats &stats = result.stats;
+    printf("%6u %7.1f %6.1f %8llu %8.1f %8llu %8.1f %6u %6u %6u %6u %6u %7u %7u %5.2fms %7zu\n", count,
+           result.listedSum / result.samples, result.liveSum / result.samples,
+           static_cast<unsigned long long>(result.beacons),
+           static_cast<double>(result.beaconNs) / static_cast<double>(result.beacons),
+           static_cast<unsigned long long>(result.beaconMaxNs),
+           static_cast<double>(result.tickNs) / static_cast<double>(result.ticks), stats.added, stats.restarted,
+           stats.expired, stats.evicted, stats.turnedAway, stats.probes, stats.answers, result.rttErrorMs,
+           result.allocations);
+    failures += result.allocations != 0 ? 1 : 0;
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+// Checks that the NTP-style clock estimate converges on loopback. Two UDP
+// sockets in one process play the two devices: the peer's millis() runs a
+// known offset ahead of (or behind) the local one, and the local side sends
+// pings through an ImpairedTransport with the delay, jitter and loss of each
+// scenario, folding the pongs into a NetClock exactly as the firmware does.
+// Once the sample filter is full every estimate must stay within the
+// scenario's bound of the true offset (shifted by half the difference between
+// the legs when they are not symmetric); exits 1 otherwise.
+//
+//   net_clock_loopback [--seconds S] [--port N]
+
+#include <impaired_transport.h>
+#include <net_clock.h>
+#include <protocol.h>
+#include <udp_socket_transport.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+constexpr uint32_t PING_INTERVAL_MS = 50;
+
+struct Scenario {
+  const char *name;
+  int32_t peerOffsetMs;  // peer millis() minus local millis()
+  uint32_t outMs;        // ping leg
+  uint32_t backMs;       // pong leg
+  uint32_t jitterMs;     // each leg
+  DelayShape shape;
+  float loss;            // each leg
+  int32_t boundMs;
+};
+
+// Bounds: 1 ms for the millisecond stamps, plus half the worst difference
+// between the two legs of the quickest exchange in the filter. Pareto
+// queueing leaves that exchange close to the base delay both ways.
+const Scenario SCENARIOS[] = {
+    {"clean", 123456, 0, 0, 0, DelayShape::Uniform, 0.0f, 1},
+    {"20 ms, 0-10 ms jitter", -98765, 20, 20, 10, DelayShape::Uniform, 0.0f, 6},
+    {"60 ms, 15 ms Pareto queueing", 5000000, 60, 60, 15, DelayShape::Pareto, 0.0f, 12},
+    {"30 ms, 0-20 ms jitter, 20% loss", -42, 30, 30, 20, DelayShape::Uniform, 0.2f, 11},
+    {"40 ms out, 10 ms back", 777, 40, 10, 0, DelayShape::Uniform, 0.0f, 1},
+};
+
+uint64_t monotonicUs() {
+  using namespace std::chrono;
+  static const steady_clock::time_point start = steady_clock::now();
+  return static_cast<uint64_t>(duration_cast<microseconds>(steady_clock::now() - start).count());
+}
+
+uint32_t micros32() {
+  return static_cast<uint32_t>(monotonicUs());
+}
+
+uint32_t millis32() {
+  return static_cast<uint32_t>(monotonicUs() / 1000);
+}
+
+template <typename Packet>
+bool sendPacket(Transport &transport, const NetAddress &to, const Packet &packet) {
+  return transport.sendTo(to, reinterpret_cast<const uint8_t *>(&packet), sizeof(packet));
+}
+
+struct Result {
+  uint32_t pongs = 0;
+  int32_t finalError = 0;
+  int32_t worstError = 0;  // largest |error| once the filter was full
+  uint32_t srttUs = 0;
+};
+
+bool runScenario(const Scenario &scenario, uint16_t port, uint32_t seconds, Result &result) {
+  UdpSocketTransport localSocket;
+  UdpSocketTransport peerSocket;
+  if (!localSocket.bind(port) || !peerSocket.bind(static_cast<uint16_t>(port + 1))) {
+    fprintf(stderr, "net_clock_loopback: cannot bind ports %u-%u\n", port, port + 1);
+    return false;
+  }
+  ImpairedTransport local(localSocket, millis32, 0xC10C4u + port);
+  ImpairmentProfile out;
+  out.delayMs = scenario.outMs;
+  out.jitterMs = scenario.jitterMs;
+  out.shape = scenario.shape;
+  out.lossGood = scenario.loss;
+  ImpairmentProfile back = out;
+  back.delayMs = scenario.backMs;
+  local.setOutgoingProfile(out);
+  local.setIncomingProfile(back);
+  local.setEnabled(true);
+
+  NetAddress localAddress = netAddress(127, 0, 0, 1, port);
+  NetAddress peerAddress = netAddress(127, 0, 0, 1, static_cast<uint16_t>(port + 1));
+  // Only differences of the peer's micros() reach the estimate, so it can
+  // share the local clock; its millis() carries the offset under test.
+  auto peerMillis = [&]() { return millis32() + static_cast<uint32_t>(scenario.peerOffsetMs); };
+  // The filter picks the quickest exchange, so a leg with a constant extra
+  // delay shifts every sample by half of it.
+  int32_t expectedMs =
+      scenario.peerOffsetMs + (static_cast<int32_t>(scenario.outMs) - static_cast<int32_t>(scenario.backMs)) / 2;
+
+  NetClock clock;
+  netClockReset(clock);
+  uint32_t startMs = millis32();
+  uint32_t lastPingMs = startMs - PING_INTERVAL_MS;
+  uint8_t buffer[64];
+  while (millis32() - startMs < seconds * 1000) {
+    uint32_t nowMs = millis32();
+    if (nowMs - lastPingMs >= PING_INTERVAL_MS) {
+      lastPingMs = nowMs;
+      PingPacket ping{};
+      ping.type = static_cast<uint8_t>(PacketType::Ping);
+      ping.originUs = micros32();
+      ping.originMs = nowMs;
+      sendPacket(local, peerAddress, ping);
+      ++clock.pingsSent;
+    }
+
+    NetAddress from;
+    int length;
+    while ((length = peerSocket.receive(buffer, sizeof(buffer), from)) > 0) {
+      uint32_t receiveUs = micros32();
+      uint32_t receiveMs = peerMillis();
+      PingPacket ping;
+      if (buffer[0] != static_cast<uint8_t>(PacketType::Ping) || !readPacket(buffer, length, ping)) {
+        continue;
+      }
+      PongPacket pong{};
+      pong.type = static_cast<uint8_t>(PacketType::Pong);
+      pong.originUs = ping.originUs;
+      pong.originMs = ping.originMs;
+      pong.receiveMs = receiveMs;
+      pong.holdUs = micros32() - receiveUs;
+      sendPacket(peerSocket, localAddress, pong);
+    }
+    while ((length = local.receive(buffer, sizeof(buffer), from)) > 0) {
+      uint32_t receiveUs = micros32();
+      PongPacket pong;
+      if (buffer[0] != static_cast<uint8_t>(PacketType::Pong) || !readPacket(buffer, length, pong)) {
+        continue;
+      }
+      netClockAddSample(clock, pong.originUs, pong.originMs, pong.receiveMs, pong.holdUs, receiveUs);
+      int32_t error = clock.offsetMs - expectedMs;
+      if (clock.sampleCount == NET_CLOCK_FILTER_SIZE) {
+        int32_t magnitude = error < 0 ? -error : error;
+        if (magnitude > result.worstError) {
+          result.worstError = magnitude;
+        }
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+  result.pongs = clock.pongsReceived;
+  result.finalError = clock.offsetMs - expectedMs;
+  result.srttUs = clock.srttUs;
+  return clock.sampleCount == NET_CLOCK_FILTER_SIZE;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  uint32_t seconds = 4;
+  uint16_t port = 41510;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--seconds") == 0) {
+      seconds = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+    } else if (strcmp(argv[i], "--port") == 0) {
+      port = static_cast<uint16_t>(strtoul(argv[i + 1], nullptr, 10));
+    } else {
+      fprintf(stderr, "usage: net_clock_loopback [--seconds S] [--port N]\n");
+      return 2;
+    }
+  }
+
+  printf("%-34s %10s %7s %8s %9s %9s %7s\n", "scenario", "offset ms", "pongs", "srtt ms", "final err", "worst err",
+         "bound");
+  int failures = 0;
+  for (const Scenario &scenario : SCENARIOS) {
+    Result result;
+    bool converged = runScenario(scenario, port, seconds, result);
+    bool passed = converged && result.worstError <= scenario.boundMs;
+    printf("%-34s %10d %7u %8.1f %9d %9d %7d%s\n", scenario.name, scenario.peerOffsetMs, result.pongs,
+           result.srttUs / 1000.0, result.finalError, result.worstError, scenario.boundMs,
+           passed ? "" : (converged ? "  FAIL" : "  FAIL: too few pongs"));
+    if (!passed) {
+      ++failures;
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
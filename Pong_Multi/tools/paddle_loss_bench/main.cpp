@@ -0,0 +1,243 @@
+// Sweeps packet loss over the client paddle link and samples, every client
+// frame, how far the host's copy of the client paddle is from where the
+// client's newest paddle packet put it (px) and how many ms older the packet
+// the host last applied is than that newest one. Reported as mean and p99 for
+// different numbers of inputs repeated per paddle packet; 0 repeats is the old
+// position-only packet, which the host just takes as the new position. Also
+// counts how many moves reached the host as inputs it could check against
+// PADDLE_SPEED, and how often it had to jump to a reported position after a
+// lost packet. With no loss every row must track the client to within
+// quantization, or the run exits 1.
+//
+//   paddle_loss_bench [--seconds S] [--send-ms MS]
+
+#include <paddle_codec.h>
+#include <paddle_predictor.h>
+#include <pong_sim.h>
+#include <state_codec.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t FRAME_MS = 16;          // client frame, ~60 fps
+constexpr uint32_t STATE_INTERVAL_MS = 50;  // how often the host acknowledges
+constexpr uint32_t ACK_DELAY_MS = 30;       // state travel time back to the client
+constexpr size_t REPEATS[] = {0, 2, 4, 8, 16};
+constexpr double LOSSLESS_MAX_ERROR_PX = 0.1;  // a few 1/16 px quantization steps
+
+struct LossModel {
+  const char *name;
+  float lossGood;    // per packet
+  float burstEnter;  // Gilbert-Elliott; 0 for plain random loss
+  float burstExit;
+};
+
+const LossModel LOSS_MODELS[] = {
+    {"none", 0.0f, 0.0f, 0.0f},          {"random 5%", 0.05f, 0.0f, 0.0f},
+    {"random 10%", 0.10f, 0.0f, 0.0f},   {"random 20%", 0.20f, 0.0f, 0.0f},
+    {"random 30%", 0.30f, 0.0f, 0.0f},   {"burst 2%/25%", 0.0f, 0.02f, 0.25f},
+    {"burst 5%/15%", 0.01f, 0.05f, 0.15f},
+};
+
+struct Random {
+  uint32_t state = 0x2545F491u;
+  float next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return static_cast<float>(state >> 8) / 16777216.0f;
+  }
+};
+
+struct Channel {
+  const LossModel *model = nullptr;
+  Random random;
+  bool bad = false;
+
+  bool deliver() {
+    if (model->burstEnter > 0.0f) {
+      bad = bad ? random.next() >= model->burstExit : random.next() < model->burstEnter;
+      if (bad) {
+        return false;
+      }
+    }
+    return random.next() >= model->lossGood;
+  }
+};
+
+struct Ack {
+  uint32_t arriveMs;
+  uint16_t seq;
+  SimScalar paddleY;
+};
+
+struct Result {
+  uint32_t inputs = 0;  // moves the client made
+  uint32_t packets = 0;
+  uint64_t bytes = 0;
+  uint32_t corrections = 0;
+  uint32_t jumps = 0;  // delivered packets after a loss that snapped the host to the reported position
+  PaddleReceiveStats host;
+  std::vector<double> errorPx;  // one sample per client frame
+  std::vector<double> staleMs;
+};
+
+struct Summary {
+  double mean = 0.0;
+  double p99 = 0.0;
+};
+
+Summary summarize(std::vector<double> &samples) {
+  Summary summary;
+  if (samples.empty()) {
+    return summary;
+  }
+  double total = 0.0;
+  for (double sample : samples) {
+    total += sample;
+  }
+  summary.mean = total / samples.size();
+  size_t rank = (samples.size() * 99) / 100;
+  std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+  summary.p99 = samples[rank];
+  return summary;
+}
+
+// The client chases a target that jumps somewhere new every so often, which
+// gives runs of held key with pauses in between.
+Result runLink(const LossModel &model, size_t repeats, uint32_t seconds, uint32_t sendIntervalMs) {
+  Result result;
+  Channel up;
+  up.model = &model;
+  Channel down;
+  down.model = &model;
+  down.random.state = 0x9E3779B9u;
+  Random target;
+  target.state = 0x1234567u;
+
+  PaddlePredictor predictor;
+  predictorReset(predictor, SCREEN_HEIGHT * 0.5f);
+  uint16_t lastSentSeq = predictor.lastSeq;
+  PaddleReceiver receiver;
+  SimScalar hostY = SCREEN_HEIGHT * 0.5f;
+  std::deque<Ack> acks;
+  float targetY = SCREEN_HEIGHT * 0.5f;
+  uint32_t lastSendMs = 0;
+  uint32_t lastStateMs = 0;
+  // What the newest paddle packet said, and when the one the host holds was sent.
+  bool sentAny = false;
+  float sentY = 0.0f;
+  uint32_t hostSentMs = 0;
+  bool missed = false;
+  result.errorPx.reserve(seconds * 1000u / FRAME_MS);
+  result.staleMs.reserve(seconds * 1000u / FRAME_MS);
+
+  for (uint32_t nowMs = 0; nowMs < seconds * 1000u; nowMs += FRAME_MS) {
+    while (!acks.empty() && acks.front().arriveMs <= nowMs) {
+      predictorReconcile(predictor, acks.front().seq, acks.front().paddleY);
+      acks.pop_front();
+    }
+    if (nowMs % 700 == 0) {
+      targetY = 10.0f + target.next() * (SCREEN_HEIGHT - 20.0f);
+    }
+    float y = simToFloat(predictor.predictedY);
+    if (targetY < y - 2.0f || targetY > y + 2.0f) {
+      float dy = (targetY < y ? -PADDLE_SPEED : PADDLE_SPEED) * static_cast<float>(FRAME_MS) / 1000.0f;
+      predictorApply(predictor, SimScalar(dy), nowMs);
+      ++result.inputs;
+    }
+
+    if (nowMs - lastSendMs >= sendIntervalMs) {
+      lastSendMs = nowMs;
+      PaddleMessage message;
+      paddleMessageFill(message, predictor, 0, lastSentSeq, repeats);
+      lastSentSeq = message.newestSeq;
+      uint8_t packet[PADDLE_PACKET_MAX];
+      size_t length = paddleEncode(message, packet, sizeof(packet));
+      ++result.packets;
+      result.bytes += length;
+      sentAny = true;
+      sentY = dequantizePosition(message.paddleY);
+      PaddleMessage received;
+      if (up.deliver() && paddleDecode(packet, length, received)) {
+        uint32_t resyncsBefore = receiver.stats.resyncs;
+        paddleReceiverApply(receiver, received, hostY);
+        if (missed && receiver.stats.resyncs != resyncsBefore) {
+          ++result.jumps;
+        }
+        hostSentMs = nowMs;
+        missed = false;
+      } else {
+        missed = true;
+      }
+    }
+    if (sentAny && receiver.valid) {
+      result.errorPx.push_back(std::fabs(simToFloat(hostY) - sentY));
+      result.staleMs.push_back(static_cast<double>(lastSendMs - hostSentMs));
+    }
+    if (nowMs - lastStateMs >= STATE_INTERVAL_MS) {
+      lastStateMs = nowMs;
+      if (receiver.valid && down.deliver()) {
+        acks.push_back(Ack{nowMs + ACK_DELAY_MS, receiver.appliedSeq, hostY});
+      }
+    }
+  }
+  result.corrections = predictor.corrections;
+  result.host = receiver.stats;
+  return result;
+}
+
+double percentOf(uint32_t part, uint32_t whole) {
+  return whole != 0 ? 100.0 * part / whole : 0.0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  uint32_t seconds = 300;
+  uint32_t sendIntervalMs = 32;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--seconds") == 0) {
+      seconds = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+    } else if (strcmp(argv[i], "--send-ms") == 0) {
+      sendIntervalMs = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+    } else {
+      fprintf(stderr, "usage: paddle_loss_bench [--seconds S] [--send-ms MS]\n");
+      return 2;
+    }
+  }
+  if (sendIntervalMs < FRAME_MS) {
+    sendIntervalMs = FRAME_MS;
+  }
+
+  printf("%u s per run, paddle packet every %u ms, ack every %u ms\n", seconds, sendIntervalMs, STATE_INTERVAL_MS);
+  printf("%-14s %7s %6s %8s %8s %8s %8s %8s %9s %6s %5s\n", "loss", "repeats", "avg B", "err px", "p99 px",
+         "stale ms", "p99 ms", "checked", "recovered", "jumps", "corr");
+  int failures = 0;
+  for (const LossModel &model : LOSS_MODELS) {
+    for (size_t repeats : REPEATS) {
+      Result result = runLink(model, repeats, seconds, sendIntervalMs);
+      const PaddleReceiveStats &host = result.host;
+      Summary error = summarize(result.errorPx);
+      Summary stale = summarize(result.staleMs);
+      bool lossless = model.lossGood == 0.0f && model.burstEnter == 0.0f;
+      printf("%-14s %7zu %6.1f %8.3f %8.3f %8.1f %8.1f %7.1f%% %8.1f%% %6u %5u\n", model.name, repeats,
+             static_cast<double>(result.bytes) / result.packets, error.mean, error.p99, stale.mean, stale.p99,
+             percentOf(host.inputsApplied, result.inputs), percentOf(host.inputsRecovered, result.inputs),
+             result.jumps, result.corrections);
+      // Honest moves are never clamped, replayed inputs land exactly where the
+      // client put them, and a clean link leaves nothing to catch up on.
+      if (host.clamped != 0 || result.corrections != 0 || (lossless && error.p99 > LOSSLESS_MAX_ERROR_PX)) {
+        ++failures;
+      }
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
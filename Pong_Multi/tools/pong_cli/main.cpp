@@ -0,0 +1,1481 @@
+// Headless host or client for running the Pong netcode on Linux.
+//
+//   pong_cli host   [--port N] [--seconds S] [--seed N]
+//   pong_cli client [--connect A.B.C.D[:PORT]] [--port N] [--seconds S]
+//   pong_cli spectate [--connect A.B.C.D[:PORT]] [--port N] [--seconds S]
+//   pong_cli browse [--port N] [--seconds S]
+//
+// Either side can impair its own traffic, in and out, to reproduce bad Wi-Fi:
+//   --delay MS --jitter MS --shape uniform|normal|pareto
+//   --loss PCT --burst ENTER:EXIT[:LOSS] --reorder PCT --dup PCT --impair-seed N
+//   --impair-between FROM:UNTIL (seconds into the run; default the whole run)
+//
+// --link DEGRADED:RECONNECTING:DROPPED sets the silence thresholds in ms. A
+// dropped client joins again with its session token and the host keeps the
+// match frozen for it for SESSION_RESUME_WINDOW_MS. --session-file PATH makes
+// the client keep its token across runs, so killing and restarting the client
+// process drops it back into the same match.
+//
+// --netcode lockstep on the host plays the match in lockstep instead: both
+// sides simulate and only per-tick inputs and state hashes cross the link.
+// --desync-at TICK nudges the client's ball once at that tick to show a hash
+// mismatch being caught and repaired.
+//
+// spectate asks the host to watch, joins the multicast group it names and
+// follows the match from the state the host sends there once for every
+// spectator, with a snapshot whenever its view goes stale. On loopback give
+// the host and every spectator --multicast-if 127.0.0.1, and several
+// spectators can watch from one machine.
+//
+// The host beacons its lobby like a hosting Cardputer, to the subnet's
+// broadcast address or to --beacon-to A.B.C.D[:PORT], and answers round-trip
+// probes. browse listens for beacons on --port (UDP_PORT by default), keeps
+// the lobby table a searching Cardputer keeps and prints it every second; on
+// loopback point the hosts' --beacon-to at its port.
+//
+// The host waits for a Join, starts a match straight away and plays its paddle
+// with a simple tracker; the client joins, tracks the interpolated ball and
+// reports what it sees. Run one of each on loopback:
+//
+//   pong_cli host --seconds 30 &
+//   pong_cli client --connect 127.0.0.1 --seconds 30 --jitter 40 --burst 2:25:60
+
+#include <impaired_transport.h>
+#include <interp_buffer.h>
+#include <link_monitor.h>
+#include <lobby_table.h>
+#include <lockstep.h>
+#include <net_clock.h>
+#include <paddle_codec.h>
+#include <paddle_predictor.h>
+#include <pong_sim.h>
+#include <protocol.h>
+#include <rate_controller.h>
+#include <sequence_tracker.h>
+#include <state_codec.h>
+#include <state_send_policy.h>
+#include <udp_socket_transport.h>
+
+#include <arpa/inet.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+
+namespace {
+
+constexpr uint32_t PADDLE_SEND_INTERVAL_MS = 45;
+constexpr uint32_t SEND_INTERVAL_MIN_MS = 16;  // at most one update per device frame
+constexpr uint32_t SEND_INTERVAL_MAX_MS = 100;
+constexpr uint32_t CLIENT_FRAME_US = 16667;  // the client moves its paddle at device frame rate
+constexpr uint32_t JOIN_INTERVAL_MS = 800;
+constexpr uint32_t PING_INTERVAL_MS = 250;
+constexpr uint32_t REPORT_INTERVAL_MS = 1000;
+constexpr uint32_t SESSION_RESUME_WINDOW_MS = 60000;
+constexpr uint32_t INTERP_MAX_DELAY_MS = 200;
+constexpr uint32_t SPECTATE_INTERP_DELAY_MS = 100;
+constexpr uint32_t SPECTATE_STALE_MS = 1000;
+constexpr uint32_t SPECTATE_KEEPALIVE_MS = 2000;
+constexpr uint32_t SPECTATE_IDLE_MS = 6000;
+
+// -----------------------------------------------------------------------------
+// Clock and options ----------------------------------------------------------
+
+uint64_t monotonicUs() {
+  using namespace std::chrono;
+  static const steady_clock::time_point start = steady_clock::now();
+  return static_cast<uint64_t>(duration_cast<microseconds>(steady_clock::now() - start).count());
+}
+
+// Same wrapping 32-bit clocks as Arduino's micros() and millis().
+uint32_t micros32() {
+  return static_cast<uint32_t>(monotonicUs());
+}
+
+uint32_t millis32() {
+  return static_cast<uint32_t>(monotonicUs() / 1000);
+}
+
+enum class Mode {
+  Host,
+  Client,
+  Spectate,
+  Browse,
+};
+
+struct Options {
+  Mode mode = Mode::Host;
+  uint16_t port = 0;  // local port; host defaults to UDP_PORT, client to any
+  NetAddress connect = netAddress(127, 0, 0, 1, UDP_PORT);
+  uint32_t seconds = 10;
+  uint32_t seed = 0;
+  bool impaired = false;
+  uint32_t impairSeed = 1;
+  uint32_t impairFromS = 0;
+  uint32_t impairUntilS = 0;  // 0: until the end
+  ImpairmentProfile impairment;
+  LinkThresholds link;
+  const char *sessionFile = nullptr;  // client: where the session token is kept
+  NetMode netMode = NetMode::Snapshot;  // host
+  uint32_t desyncAtTick = 0;            // client, lockstep: 0 never
+  uint32_t multicastInterface = 0;      // 0: let the routing table pick
+  NetAddress beaconTo;                  // host; ip 0: broadcast to UDP_PORT
+};
+
+bool parseAddress(const char *text, NetAddress &out) {
+  char host[32];
+  const char *colon = strchr(text, ':');
+  size_t hostLength = colon != nullptr ? static_cast<size_t>(colon - text) : strlen(text);
+  if (hostLength == 0 || hostLength >= sizeof(host)) {
+    return false;
+  }
+  memcpy(host, text, hostLength);
+  host[hostLength] = '\0';
+  in_addr parsed;
+  if (inet_pton(AF_INET, host, &parsed) != 1) {
+    return false;
+  }
+  out.ip = ntohl(parsed.s_addr);
+  out.port = colon != nullptr ? static_cast<uint16_t>(atoi(colon + 1)) : UDP_PORT;
+  return out.port != 0;
+}
+
+float parsePercent(const char *text) {
+  return static_cast<float>(atof(text)) / 100.0f;
+}
+
+// ENTER:EXIT[:LOSS] in percent; LOSS defaults to 100.
+bool parseBurst(const char *text, ImpairmentProfile &profile) {
+  float enter = 0.0f;
+  float exit = 0.0f;
+  float loss = 100.0f;
+  if (sscanf(text, "%f:%f:%f", &enter, &exit, &loss) < 2) {
+    return false;
+  }
+  profile.burstEnter = enter / 100.0f;
+  profile.burstExit = exit / 100.0f;
+  profile.lossBad = loss / 100.0f;
+  return true;
+}
+
+bool parseWindow(const char *text, uint32_t &fromS, uint32_t &untilS) {
+  unsigned from = 0;
+  unsigned until = 0;
+  if (sscanf(text, "%u:%u", &from, &until) != 2 || until <= from) {
+    return false;
+  }
+  fromS = from;
+  untilS = until;
+  return true;
+}
+
+bool parseLinkThresholds(const char *text, LinkThresholds &link) {
+  unsigned degraded = 0;
+  unsigned reconnecting = 0;
+  unsigned dropped = 0;
+  if (sscanf(text, "%u:%u:%u", &degraded, &reconnecting, &dropped) != 3 || degraded >= reconnecting ||
+      reconnecting >= dropped) {
+    return false;
+  }
+  link.degradedMs = degraded;
+  link.reconnectingMs = reconnecting;
+  link.droppedMs = dropped;
+  return true;
+}
+
+bool parseNetMode(const char *text, NetMode &mode) {
+  if (strcmp(text, "snapshot") == 0) {
+    mode = NetMode::Snapshot;
+  } else if (strcmp(text, "lockstep") == 0) {
+    mode = NetMode::Lockstep;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool parseShape(const char *text, DelayShape &shape) {
+  if (strcmp(text, "uniform") == 0) {
+    shape = DelayShape::Uniform;
+  } else if (strcmp(text, "normal") == 0) {
+    shape = DelayShape::Normal;
+  } else if (strcmp(text, "pareto") == 0) {
+    shape = DelayShape::Pareto;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void printUsage() {
+  fprintf(stderr,
+          "usage: pong_cli host   [--port N] [--seconds S] [--seed N] [--netcode snapshot|lockstep] [impairment]\n"
+          "       pong_cli client [--connect A.B.C.D[:PORT]] [--port N] [--seconds S] [impairment]\n"
+          "       pong_cli spectate [--connect A.B.C.D[:PORT]] [--port N] [--seconds S] [impairment]\n"
+          "       pong_cli browse [--port N] [--seconds S] [impairment]\n"
+          "impairment: --delay MS --jitter MS --shape uniform|normal|pareto --loss PCT\n"
+          "            --burst ENTER:EXIT[:LOSS] --reorder PCT --dup PCT --impair-seed N\n"
+          "            --impair-between FROM:UNTIL\n"
+          "link:       --link DEGRADED:RECONNECTING:DROPPED (ms)\n"
+          "client:     --session-file PATH --desync-at TICK\n"
+          "multicast:  --multicast-if A.B.C.D (interface for spectator state)\n"
+          "lobby:      --beacon-to A.B.C.D[:PORT] (host; default: broadcast)\n");
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+  if (argc < 2) {
+    return false;
+  }
+  if (strcmp(argv[1], "host") == 0) {
+    options.mode = Mode::Host;
+    options.port = UDP_PORT;
+  } else if (strcmp(argv[1], "client") == 0) {
+    options.mode = Mode::Client;
+  } else if (strcmp(argv[1], "spectate") == 0) {
+    options.mode = Mode::Spectate;
+  } else if (strcmp(argv[1], "browse") == 0) {
+    options.mode = Mode::Browse;
+    options.port = UDP_PORT;
+  } else {
+    return false;
+  }
+  for (int i = 2; i < argc; ++i) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (value == nullptr) {
+      return false;
+    }
+    if (strcmp(arg, "--port") == 0) {
+      options.port = static_cast<uint16_t>(atoi(value));
+    } else if (strcmp(arg, "--connect") == 0) {
+      if (!parseAddress(value, options.connect)) {
+        return false;
+      }
+    } else if (strcmp(arg, "--seconds") == 0) {
+      options.seconds = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+    } else if (strcmp(arg, "--seed") == 0) {
+      options.seed = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+    } else if (strcmp(arg, "--delay") == 0) {
+      options.impairment.delayMs = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+      options.impaired = true;
+    } else if (strcmp(arg, "--jitter") == 0) {
+      options.impairment.jitterMs = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+      options.impaired = true;
+    } else if (strcmp(arg, "--shape") == 0) {
+      if (!parseShape(value, options.impairment.shape)) {
+        return false;
+      }
+    } else if (strcmp(arg, "--loss") == 0) {
+      options.impairment.lossGood = parsePercent(value);
+      options.impaired = true;
+    } else if (strcmp(arg, "--burst") == 0) {
+      if (!parseBurst(value, options.impairment)) {
+        return false;
+      }
+      options.impaired = true;
+    } else if (strcmp(arg, "--reorder") == 0) {
+      options.impairment.reorder = parsePercent(value);
+      options.impaired = true;
+    } else if (strcmp(arg, "--dup") == 0) {
+      options.impairment.duplicate = parsePercent(value);
+      options.impaired = true;
+    } else if (strcmp(arg, "--impair-seed") == 0) {
+      options.impairSeed = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+    } else if (strcmp(arg, "--session-file") == 0) {
+      options.sessionFile = value;
+    } else if (strcmp(arg, "--netcode") == 0) {
+      if (!parseNetMode(value, options.netMode)) {
+        return false;
+      }
+    } else if (strcmp(arg, "--desync-at") == 0) {
+      options.desyncAtTick = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+    } else if (strcmp(arg, "--link") == 0) {
+      if (!parseLinkThresholds(value, options.link)) {
+        return false;
+      }
+    } else if (strcmp(arg, "--multicast-if") == 0) {
+      NetAddress address;
+      if (!parseAddress(value, address)) {
+        return false;
+      }
+      options.multicastInterface = address.ip;
+    } else if (strcmp(arg, "--beacon-to") == 0) {
+      if (!parseAddress(value, options.beaconTo)) {
+        return false;
+      }
+    } else if (strcmp(arg, "--impair-between") == 0) {
+      if (!parseWindow(value, options.impairFromS, options.impairUntilS)) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+    ++i;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Shared session plumbing ----------------------------------------------------
+
+struct Link {
+  Transport *transport = nullptr;
+  ImpairedTransport *impairment = nullptr;  // set when --delay/--loss/... are in use
+  NetAddress peer;
+  bool hasPeer = false;
+  NetClock clock;
+  RateController rate;  // host: paddle-motion state interval, client: paddle update interval
+  LinkMonitor monitor;
+  bool silent = false;  // spectator: no pings, the host only hears its requests
+  uint32_t lastPingMs = 0;
+  uint32_t packetsIn = 0;
+  uint32_t packetsOut = 0;
+  uint64_t bytesIn = 0;
+  uint64_t bytesOut = 0;
+};
+
+void sendBytes(Link &link, const uint8_t *data, size_t length) {
+  if (link.transport->sendTo(link.peer, data, length)) {
+    ++link.packetsOut;
+    link.bytesOut += length;
+  }
+}
+
+template <typename Packet>
+void sendPacket(Link &link, const Packet &packet) {
+  sendBytes(link, reinterpret_cast<const uint8_t *>(&packet), sizeof(packet));
+}
+
+void sendPing(Link &link) {
+  PingPacket packet{};
+  packet.type = static_cast<uint8_t>(PacketType::Ping);
+  packet.originUs = micros32();
+  packet.originMs = millis32();
+  sendPacket(link, packet);
+  ++link.clock.pingsSent;
+  link.lastPingMs = packet.originMs;
+}
+
+void updatePing(Link &link, uint32_t nowMs) {
+  if (link.hasPeer && !link.silent && nowMs - link.lastPingMs >= PING_INTERVAL_MS) {
+    sendPing(link);
+  }
+}
+
+void startLink(Link &link, Transport &transport, ImpairedTransport *impairment, const LinkThresholds &thresholds) {
+  link.transport = &transport;
+  link.impairment = impairment;
+  link.monitor.thresholds = thresholds;
+}
+
+// Fresh clock, send rate and liveness for a new peer.
+void connectLink(Link &link, const NetAddress &peer) {
+  link.peer = peer;
+  link.hasPeer = true;
+  netClockReset(link.clock);
+  rateControllerInit(link.rate, SEND_INTERVAL_MIN_MS, SEND_INTERVAL_MAX_MS, STATE_MOTION_INTERVAL_MS);
+  linkMonitorReset(link.monitor, millis32());
+  link.lastPingMs = 0;
+}
+
+// Game streams stop while reconnecting; pings carry on as probes.
+bool linkStalled(const Link &link) {
+  return link.hasPeer && link.monitor.state == LinkState::Reconnecting;
+}
+
+// Shared per-loop work after the session's own update. Returns the link
+// state before this update so the session can react to a change.
+LinkState updateLink(Link &link, const Options &options, uint32_t elapsedMs, uint32_t nowMs, const char *who) {
+  if (link.impairment != nullptr && options.impairUntilS != 0) {
+    link.impairment->setEnabled(elapsedMs >= options.impairFromS * 1000u && elapsedMs < options.impairUntilS * 1000u);
+  }
+  updatePing(link, nowMs);
+  LinkState previous = link.monitor.state;
+  if (!link.hasPeer) {
+    return previous;
+  }
+  rateControllerUpdate(link.rate, link.clock, nowMs);
+  LinkState state = linkMonitorUpdate(link.monitor, nowMs, netClockTimeoutMs(link.clock, 0));
+  if (state != previous) {
+    printf("%s: link %s after %ums of silence\n", who, linkStateName(state), nowMs - link.monitor.lastHeardMs);
+  }
+  return previous;
+}
+
+// Answers pings and folds in pongs; returns true when the packet was one of them.
+bool handleClockPacket(Link &link, const uint8_t *data, int length, uint32_t receiveUs, uint32_t receiveMs) {
+  PacketType type = static_cast<PacketType>(data[0]);
+  if (type == PacketType::Ping) {
+    PingPacket ping;
+    if (link.hasPeer && readPacket(data, length, ping)) {
+      PongPacket pong{};
+      pong.type = static_cast<uint8_t>(PacketType::Pong);
+      pong.originUs = ping.originUs;
+      pong.originMs = ping.originMs;
+      pong.receiveMs = receiveMs;
+      pong.holdUs = micros32() - receiveUs;
+      sendPacket(link, pong);
+    }
+    return true;
+  }
+  if (type == PacketType::Pong) {
+    PongPacket pong;
+    if (link.hasPeer && readPacket(data, length, pong)) {
+      netClockAddSample(link.clock, pong.originUs, pong.originMs, pong.receiveMs, pong.holdUs, receiveUs);
+    }
+    return true;
+  }
+  return false;
+}
+
+void fillName(char (&name)[PLAYER_NAME_MAX_LEN], const char *text) {
+  memset(name, 0, sizeof(name));
+  strncpy(name, text, sizeof(name) - 1);
+}
+
+// Moves a paddle towards targetY at PADDLE_SPEED: -1, 0 or +1.
+int trackDirection(float paddleY, float targetY) {
+  constexpr float DEAD_ZONE = 3.0f;
+  if (targetY < paddleY - DEAD_ZONE) {
+    return -1;
+  }
+  if (targetY > paddleY + DEAD_ZONE) {
+    return 1;
+  }
+  return 0;
+}
+
+// What a client or spectator keeps of the host's state stream.
+struct StateView {
+  InterpBuffer interp;
+  SequenceTracker sequence;
+  StateHistory received;
+  uint32_t baselineMisses = 0;
+};
+
+void stateViewReset(StateView &view) {
+  interpReset(view.interp);
+  sequenceReset(view.sequence);
+  stateHistoryReset(view.received);
+}
+
+// Decodes a state packet into the interpolation buffer. False when it is
+// undecodable, a duplicate or older than what is already there.
+bool acceptState(StateView &view, const uint8_t *data, size_t length, uint32_t receiveMs, StateFrame &frame) {
+  StateDecodeResult result = stateDecode(data, length, view.received, view.sequence.newest, frame);
+  if (result == StateDecodeResult::MissingBaseline) {
+    ++view.baselineMisses;
+  }
+  if (result != StateDecodeResult::Ok || sequenceTrack(view.sequence, frame.frameId) != SequenceVerdict::Newer) {
+    return false;
+  }
+  stateHistoryPush(view.received, frame);
+  Snapshot snapshot;
+  snapshot.frameId = frame.frameId;
+  snapshot.hostTimeMs = frame.hostTimeMs;
+  snapshot.arrivalMs = receiveMs;
+  snapshot.ballX = dequantizePosition(frame.ballX);
+  snapshot.ballY = dequantizePosition(frame.ballY);
+  snapshot.ballVX = dequantizeVelocity(frame.ballVX);
+  snapshot.ballVY = dequantizeVelocity(frame.ballVY);
+  snapshot.hostPaddleY = dequantizePosition(frame.hostPaddleY);
+  snapshot.clientPaddleY = dequantizePosition(frame.clientPaddleY);
+  snapshot.points = static_cast<uint8_t>(frame.hostScore + frame.clientScore);
+  return interpPush(view.interp, snapshot);
+}
+
+void printStateViewStats(const StateView &view, uint32_t delayMs) {
+  const SequenceStats &sequence = view.sequence.stats;
+  const InterpStats &interp = view.interp.stats;
+  printf(" rx %u lost %u reord %u dup %u nb %u delay %ums lead %dms under %u ext %u stale %u", sequence.received,
+         sequence.lost, sequence.reordered, sequence.duplicates, view.baselineMisses, delayMs, interp.leadMs,
+         interp.underruns, interp.extrapolatedFrames, interp.staleDropped);
+}
+
+void printLockstepStats(const Lockstep &lockstep) {
+  const LockstepStats &stats = lockstep.stats;
+  printf(" | lockstep tick %u buf %u stall %u drop %u hash %u desync %u resync %u", lockstep.tick,
+         lockstep.remoteEnd - lockstep.tick, stats.stalls, stats.droppedTicks, stats.hashesChecked, stats.desyncs,
+         stats.resyncs);
+}
+
+// Input packets whenever lockstepSendDue() says so.
+void sendLockstepInputs(Link &link, Lockstep &lockstep, uint32_t &lastSentMs, uint32_t nowMs) {
+  if (!lockstepSendDue(lockstep, nowMs - lastSentMs)) {
+    return;
+  }
+  uint8_t packet[LOCKSTEP_PACKET_MAX];
+  size_t length = lockstepWritePacket(lockstep, packet, sizeof(packet));
+  if (length != 0) {
+    sendBytes(link, packet, length);
+  }
+  lastSentMs = nowMs;
+}
+
+void printLinkStats(const Link &link) {
+  const RateStats &rate = link.rate.stats;
+  printf(" rtt %.2fms jit %.2fms off %+dms in %u/%lluB out %u/%lluB | rate %uHz up %u back %u (loss %u rtt %u ack %u)",
+         link.clock.srttUs / 1000.0, link.clock.rttVarUs / 1000.0, link.clock.offsetMs, link.packetsIn,
+         static_cast<unsigned long long>(link.bytesIn), link.packetsOut, static_cast<unsigned long long>(link.bytesOut),
+         rateControllerHz(link.rate), rate.increases, rate.backoffs, rate.lossBackoffs, rate.delayBackoffs,
+         rate.ackBackoffs);
+  const LinkStats &liveness = link.monitor.stats;
+  printf(" | link %s deg %u reconn %u back %u quiet %ums", linkStateName(link.monitor.state), liveness.degraded,
+         liveness.reconnecting, liveness.recovered, liveness.longestSilenceMs);
+  if (link.impairment != nullptr && link.impairment->enabled()) {
+    const ImpairmentStats &out = link.impairment->outgoingStats();
+    const ImpairmentStats &in = link.impairment->incomingStats();
+    printf(" | imp out drop %u(%u) reord %u dup %u in drop %u(%u) reord %u dup %u full %u", out.dropped,
+           out.burstDropped, out.reordered, out.duplicated, in.dropped, in.burstDropped, in.reordered, in.duplicated,
+           out.queueFull + in.queueFull);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Host -----------------------------------------------------------------------
+
+struct HostSession {
+  Link link;
+  SimState sim;
+  SimClock simClock;
+  uint32_t lastTickUs = 0;
+  uint32_t frameCounter = 0;
+  PaddleReceiver paddle;
+  StateHistory sentStates;
+  uint32_t stateAckFrameId = 0;
+  StateSendPolicy sendPolicy;
+  bool playing = false;
+  uint32_t seed = 0;
+  uint32_t matches = 0;
+  uint32_t sessionToken = 0;
+  bool awaitingRejoin = false;  // the client dropped; the match waits for its token
+  uint32_t awaitingRejoinSinceMs = 0;
+  NetMode netMode = NetMode::Snapshot;
+  Lockstep lockstep;
+  uint32_t lastLockstepSentMs = 0;
+  uint32_t lastHandshakeMs = 0;  // lockstep: Start and sync resends
+  uint32_t lastSpectateMs = 0;   // last spectator request; 0: nobody watching
+  uint32_t spectateRequests = 0;
+  uint32_t mirroredPackets = 0;  // state sent to the spectators' group
+  uint64_t mirroredBytes = 0;
+  NetAddress beaconTo;  // ip 0: broadcast
+  uint32_t lobbyId = 0;
+  uint8_t beaconSeq = 0;
+  LobbyState beaconState = LobbyState::Open;
+  uint32_t lastBeaconMs = 0;
+  uint32_t beacons = 0;
+  uint32_t probesAnswered = 0;
+};
+
+void hostSendStart(HostSession &host) {
+  StartPacket start{static_cast<uint8_t>(PacketType::Start), host.seed, static_cast<uint8_t>(host.netMode)};
+  sendPacket(host.link, start);
+}
+
+void sendJoinAck(HostSession &host, bool resumed) {
+  JoinAckPacket ack{};
+  ack.type = static_cast<uint8_t>(PacketType::JoinAck);
+  fillName(ack.name, "cli host");
+  ack.sessionToken = host.sessionToken;
+  ack.resumed = resumed ? 1 : 0;
+  sendPacket(host.link, ack);
+}
+
+void hostFillFrame(HostSession &host, StateFrame &frame) {
+  frame.flags = (host.sim.matchActive ? FLAG_MATCH_ACTIVE : 0) | (host.sim.waitingForServe ? FLAG_WAITING_SERVE : 0) |
+                (host.sim.gameOver ? FLAG_GAME_OVER : 0);
+  frame.hostScore = host.sim.hostScore;
+  frame.clientScore = host.sim.clientScore;
+  frame.frameId = ++host.frameCounter;
+  frame.hostTimeMs = millis32();
+  frame.ackInputSeq = host.paddle.appliedSeq;
+  frame.ballX = quantizePosition(simToFloat(host.sim.ballX));
+  frame.ballY = quantizePosition(simToFloat(host.sim.ballY));
+  frame.ballVX = quantizeVelocity(simToFloat(host.sim.ballVX));
+  frame.ballVY = quantizeVelocity(simToFloat(host.sim.ballVY));
+  frame.hostPaddleY = quantizePosition(simToFloat(host.sim.hostPaddleY));
+  frame.clientPaddleY = quantizePosition(simToFloat(host.sim.clientPaddleY));
+}
+
+bool hostSpectatorsWatching(const HostSession &host, uint32_t nowMs) {
+  return host.lastSpectateMs != 0 && nowMs - host.lastSpectateMs < SPECTATE_IDLE_MS;
+}
+
+// One send to the group however many spectators are in it.
+void hostMirror(HostSession &host, const uint8_t *packet, size_t length) {
+  NetAddress group;
+  group.ip = spectateGroupIp(host.sessionToken);
+  group.port = SPECTATE_PORT;
+  if (host.link.transport->sendTo(group, packet, length)) {
+    ++host.mirroredPackets;
+    host.mirroredBytes += length;
+  }
+}
+
+void hostSendState(HostSession &host, StateSendReason reason) {
+  StateFrame frame;
+  hostFillFrame(host, frame);
+  uint8_t packet[STATE_PACKET_MAX];
+  const StateFrame *baseline =
+      host.stateAckFrameId != 0 ? stateHistoryFind(host.sentStates, host.stateAckFrameId) : nullptr;
+  size_t length = stateEncode(frame, baseline, packet, sizeof(packet));
+  stateHistoryPush(host.sentStates, frame);
+  sendBytes(host.link, packet, length);
+  if (hostSpectatorsWatching(host, millis32())) {
+    hostMirror(host, packet, length);
+  }
+  sendPolicySent(host.sendPolicy, host.sim, millis32(), reason);
+}
+
+// Lockstep: only spectators need state, and only keyframes since they
+// never see the inputs.
+void hostSendSpectatorState(HostSession &host, StateSendReason reason) {
+  StateFrame frame;
+  hostFillFrame(host, frame);
+  uint8_t packet[STATE_PACKET_MAX];
+  size_t length = stateEncode(frame, nullptr, packet, sizeof(packet));
+  stateHistoryPush(host.sentStates, frame);
+  hostMirror(host, packet, length);
+  sendPolicySent(host.sendPolicy, host.sim, millis32(), reason);
+}
+
+// The group and the players; with snapshot set, also the newest state as a
+// keyframe, straight to the spectator that asked.
+void hostAnswerSpectator(HostSession &host, const NetAddress &from, bool snapshot) {
+  host.lastSpectateMs = millis32();
+  ++host.spectateRequests;
+  if (!snapshot) {
+    return;
+  }
+  SpectateAckPacket ack{};
+  ack.type = static_cast<uint8_t>(PacketType::SpectateAck);
+  ack.groupIp = spectateGroupIp(host.sessionToken);
+  ack.groupPort = SPECTATE_PORT;
+  fillName(ack.hostName, "cli host");
+  fillName(ack.clientName, "cli client");
+  host.link.transport->sendTo(from, reinterpret_cast<const uint8_t *>(&ack), sizeof(ack));
+  const StateFrame *frame = host.frameCounter != 0 ? stateHistoryFind(host.sentStates, host.frameCounter) : nullptr;
+  if (frame != nullptr) {
+    uint8_t packet[STATE_PACKET_MAX];
+    size_t length = stateEncode(*frame, nullptr, packet, sizeof(packet));
+    host.link.transport->sendTo(from, packet, length);
+  }
+}
+
+void hostStartMatch(HostSession &host) {
+  host.seed = host.seed * 1664525u + 1013904223u;
+  hostSendStart(host);
+  simResetMatch(host.sim);
+  simSeed(host.sim, host.seed);
+  simPrepareServe(host.sim, 1);
+  host.simClock = SimClock();
+  paddleReceiverReset(host.paddle);
+  host.lastTickUs = micros32();
+  host.playing = true;
+  ++host.matches;
+  sendPolicyReset(host.sendPolicy);
+  if (host.netMode == NetMode::Lockstep) {
+    lockstepReset(host.lockstep, host.seed, true);
+    host.lastHandshakeMs = millis32();
+    return;
+  }
+  hostSendState(host, StateSendReason::Event);
+}
+
+uint32_t newSessionToken(HostSession &host) {
+  uint32_t token = host.seed ^ static_cast<uint32_t>(monotonicUs() * 2654435761u);
+  return token != 0 ? token : 1;
+}
+
+// The client holding our token is back, maybe from another address. The
+// match carries on; the client starts over without baselines or inputs.
+void hostResume(HostSession &host, const NetAddress &from, const char *name) {
+  connectLink(host.link, from);
+  host.awaitingRejoin = false;
+  host.stateAckFrameId = 0;
+  paddleReceiverReset(host.paddle);
+  sendJoinAck(host, true);
+  if (host.netMode == NetMode::Lockstep) {
+    // A restarted client has neither the seed nor the state: Start, then a
+    // sync onto the running match.
+    host.lockstep.peerSeen = false;
+    lockstepBeginResync(host.lockstep);
+    host.lastHandshakeMs = 0;
+  } else {
+    sendPolicyForce(host.sendPolicy);
+  }
+  printf("host: %s resumed from %u.%u.%u.%u:%u at %u-%u\n", name, netAddressOctet(from, 0), netAddressOctet(from, 1),
+         netAddressOctet(from, 2), netAddressOctet(from, 3), from.port, host.sim.hostScore, host.sim.clientScore);
+}
+
+// Announces the lobby: once a second while no client has joined, every
+// LOBBY_BEACON_BUSY_INTERVAL_MS while a match is on or kept for a rejoin.
+void hostBeacon(HostSession &host, uint32_t nowMs) {
+  LobbyState state = host.link.hasPeer || host.awaitingRejoin ? LobbyState::Playing : LobbyState::Open;
+  if (host.beacons != 0 && state == host.beaconState && nowMs - host.lastBeaconMs < lobbyBeaconIntervalMs(state)) {
+    return;
+  }
+  LobbyBeacon beacon;
+  beacon.lobbyId = host.lobbyId;
+  beacon.seq = ++host.beaconSeq;
+  beacon.state = state;
+  beacon.netMode = host.netMode;
+  strncpy(beacon.name, "cli host", LOBBY_NAME_MAX);
+  uint8_t packet[LOBBY_BEACON_MAX];
+  size_t length = lobbyBeaconEncode(beacon, packet, sizeof(packet));
+  bool sent = host.beaconTo.ip != 0 ? host.link.transport->sendTo(host.beaconTo, packet, length)
+                                    : host.link.transport->broadcast(UDP_PORT, packet, length);
+  if (sent) {
+    ++host.link.packetsOut;
+    host.link.bytesOut += length;
+  }
+  host.beaconState = state;
+  host.lastBeaconMs = nowMs;
+  ++host.beacons;
+}
+
+void hostAnswerProbe(HostSession &host, const NetAddress &from, const LobbyProbePacket &probe) {
+  LobbyProbeAckPacket ack{static_cast<uint8_t>(PacketType::LobbyProbeAck), probe.originUs, host.lobbyId};
+  if (host.link.transport->sendTo(from, reinterpret_cast<const uint8_t *>(&ack), sizeof(ack))) {
+    ++host.link.packetsOut;
+    host.link.bytesOut += sizeof(ack);
+  }
+  ++host.probesAnswered;
+}
+
+void hostReceive(HostSession &host) {
+  uint8_t buffer[MAX_DATAGRAM_SIZE];
+  NetAddress from;
+  int length;
+  while ((length = host.link.transport->receive(buffer, sizeof(buffer), from)) > 0) {
+    uint32_t receiveUs = micros32();
+    uint32_t receiveMs = millis32();
+    ++host.link.packetsIn;
+    host.link.bytesIn += static_cast<uint64_t>(length);
+    if (host.link.hasPeer && from == host.link.peer) {
+      linkMonitorHeard(host.link.monitor, receiveMs);
+    }
+    if (handleClockPacket(host.link, buffer, length, receiveUs, receiveMs)) {
+      continue;
+    }
+    PacketType type = static_cast<PacketType>(buffer[0]);
+    if (type == PacketType::LobbyProbe) {
+      LobbyProbePacket probe;
+      if (readPacket(buffer, length, probe)) {
+        hostAnswerProbe(host, from, probe);
+      }
+    } else if (type == PacketType::Spectate) {
+      SpectatePacket spectate;
+      if (host.sessionToken != 0 && readPacket(buffer, length, spectate)) {
+        hostAnswerSpectator(host, from, spectate.snapshot != 0);
+      }
+    } else if (type == PacketType::Join) {
+      JoinPacket join;
+      if (!readPacket(buffer, length, join)) {
+        continue;
+      }
+      join.name[PLAYER_NAME_MAX_LEN - 1] = '\0';
+      if (join.sessionToken != 0 && join.sessionToken == host.sessionToken) {
+        hostResume(host, from, join.name);
+        continue;
+      }
+      if (host.link.hasPeer || host.awaitingRejoin) {
+        if (host.link.hasPeer && from == host.link.peer) {
+          // The client is still asking, so our JoinAck or Start was lost.
+          sendJoinAck(host, false);
+          hostSendStart(host);
+        }
+        continue;
+      }
+      connectLink(host.link, from);
+      host.sessionToken = newSessionToken(host);
+      printf("host: %s joined from %u.%u.%u.%u:%u\n", join.name, netAddressOctet(from, 0), netAddressOctet(from, 1),
+             netAddressOctet(from, 2), netAddressOctet(from, 3), from.port);
+      sendJoinAck(host, false);
+      hostStartMatch(host);
+    } else if (type == PacketType::Paddle && host.link.hasPeer && from == host.link.peer) {
+      PaddleMessage paddle;
+      if (!paddleDecode(buffer, static_cast<size_t>(length), paddle)) {
+        continue;
+      }
+      paddleReceiverApply(host.paddle, paddle, host.sim.clientPaddleY);
+      if (paddle.ackFrameId != 0 && (host.stateAckFrameId == 0 || sequenceNewer(paddle.ackFrameId, host.stateAckFrameId))) {
+        host.stateAckFrameId = paddle.ackFrameId;
+      }
+    } else if (type == PacketType::LockstepInput && host.link.hasPeer && from == host.link.peer) {
+      uint32_t desyncs = host.lockstep.stats.desyncs;
+      lockstepReadPacket(host.lockstep, buffer, static_cast<size_t>(length));
+      if (host.lockstep.stats.desyncs != desyncs) {
+        printf("host: desync at tick %u, resyncing the client\n", host.lockstep.desyncTick);
+      }
+    }
+  }
+}
+
+// How long the oldest state frame the client has not acknowledged has been out.
+uint32_t hostAckGapMs(const HostSession &host, uint32_t nowMs) {
+  if (host.stateAckFrameId == host.frameCounter) {
+    return 0;
+  }
+  const StateFrame *frame = stateHistoryFind(host.sentStates, host.stateAckFrameId + 1);
+  if (frame == nullptr) {
+    frame = stateHistoryFind(host.sentStates,
+                             host.frameCounter - static_cast<uint32_t>(host.sentStates.count) + 1);
+  }
+  return frame != nullptr ? nowMs - frame->hostTimeMs : 0;
+}
+
+void hostDropPeer(HostSession &host) {
+  host.link.hasPeer = false;
+  host.awaitingRejoin = true;
+  host.awaitingRejoinSinceMs = millis32();
+  printf("host: client dropped, keeping the match for its session\n");
+}
+
+void hostEndSession(HostSession &host) {
+  host.awaitingRejoin = false;
+  host.sessionToken = 0;
+  host.playing = false;
+  host.stateAckFrameId = 0;
+  stateHistoryReset(host.sentStates);
+  paddleReceiverReset(host.paddle);
+  printf("host: session expired, waiting for a new client\n");
+}
+
+// Like a person, only chase the ball while it is coming this way.
+int hostDirection(const HostSession &host) {
+  if (host.sim.ballVX < SimScalar(0.0f)) {
+    return trackDirection(simToFloat(host.sim.hostPaddleY), simToFloat(host.sim.ballY));
+  }
+  return 0;
+}
+
+void hostUpdateLockstep(HostSession &host, uint32_t elapsedUs) {
+  uint32_t nowMs = millis32();
+  uint8_t events = 0;
+  lockstepAdvance(host.lockstep, host.sim, simClockAdvance(host.simClock, elapsedUs),
+                  lockstepInput(hostDirection(host), false), events);
+  sendPolicyNoteEvents(host.sendPolicy, events);
+  bool watched = hostSpectatorsWatching(host, nowMs);
+  if (events & SIM_EVENT_GAME_OVER) {
+    if (watched) {
+      hostSendSpectatorState(host, StateSendReason::Event);
+    }
+    printf("host: match %u over %u-%u\n", host.matches, host.sim.hostScore, host.sim.clientScore);
+    hostStartMatch(host);
+    return;
+  }
+  sendLockstepInputs(host.link, host.lockstep, host.lastLockstepSentMs, nowMs);
+  StateSendReason reason = watched ? sendPolicyCheck(host.sendPolicy, host.sim, nowMs) : StateSendReason::None;
+  if (reason != StateSendReason::None) {
+    hostSendSpectatorState(host, reason);
+  }
+  if ((!host.lockstep.peerSeen || lockstepSyncPending(host.lockstep)) &&
+      nowMs - host.lastHandshakeMs >= LOCKSTEP_SYNC_RESEND_MS) {
+    host.lastHandshakeMs = nowMs;
+    if (!host.lockstep.peerSeen) {
+      hostSendStart(host);
+    }
+    if (lockstepSyncPending(host.lockstep)) {
+      uint8_t packet[LOCKSTEP_SYNC_PACKET_MAX];
+      size_t length = lockstepWriteSync(host.lockstep, host.sim, packet, sizeof(packet));
+      if (length != 0) {
+        sendBytes(host.link, packet, length);
+      }
+    }
+  }
+}
+
+void hostUpdate(HostSession &host) {
+  uint32_t nowUs = micros32();
+  uint32_t elapsedUs = nowUs - host.lastTickUs;
+  host.lastTickUs = nowUs;
+  if (!host.playing || !host.link.hasPeer || linkStalled(host.link)) {
+    return;
+  }
+  if (host.netMode == NetMode::Lockstep) {
+    hostUpdateLockstep(host, elapsedUs);
+    return;
+  }
+  SimInput input;
+  input.hostPaddleDir = static_cast<int8_t>(hostDirection(host));
+  uint32_t ticks = simClockAdvance(host.simClock, elapsedUs);
+  for (uint32_t i = 0; i < ticks; ++i) {
+    uint8_t events = simStep(host.sim, input);
+    sendPolicyNoteEvents(host.sendPolicy, events);
+    if (events & SIM_EVENT_GAME_OVER) {
+      hostSendState(host, StateSendReason::Event);
+      printf("host: match %u over %u-%u\n", host.matches, host.sim.hostScore, host.sim.clientScore);
+      hostStartMatch(host);
+      return;
+    }
+  }
+  uint32_t nowMs = millis32();
+  rateControllerNoteAckGap(host.link.rate, hostAckGapMs(host, nowMs));
+  host.sendPolicy.motionIntervalMs = host.link.rate.intervalMs;
+  StateSendReason reason = sendPolicyCheck(host.sendPolicy, host.sim, nowMs);
+  if (reason != StateSendReason::None) {
+    hostSendState(host, reason);
+  }
+}
+
+int runHost(const Options &options, Transport &transport, ImpairedTransport *impairment) {
+  HostSession host;
+  startLink(host.link, transport, impairment, options.link);
+  host.seed = options.seed != 0 ? options.seed : static_cast<uint32_t>(monotonicUs());
+  host.netMode = options.netMode;
+  host.beaconTo = options.beaconTo;
+  host.lobbyId = std::random_device()();  // hosts started together must still differ
+  printf("host: waiting on port %u (%s)\n", options.port, host.netMode == NetMode::Lockstep ? "lockstep" : "snapshots");
+
+  uint32_t startMs = millis32();
+  uint32_t lastReportMs = startMs;
+  while (millis32() - startMs < options.seconds * 1000u) {
+    hostReceive(host);
+    hostUpdate(host);
+    uint32_t nowMs = millis32();
+    hostBeacon(host, nowMs);
+    LinkState previous = updateLink(host.link, options, nowMs - startMs, nowMs, "host");
+    if (host.link.monitor.state == LinkState::Dropped && host.link.hasPeer) {
+      hostDropPeer(host);
+    } else if (host.awaitingRejoin && nowMs - host.awaitingRejoinSinceMs > SESSION_RESUME_WINDOW_MS) {
+      hostEndSession(host);
+    } else if (previous == LinkState::Reconnecting && host.link.monitor.state != previous) {
+      sendPolicyForce(host.sendPolicy);  // the client has seen nothing for a while
+    }
+    if (nowMs - lastReportMs >= REPORT_INTERVAL_MS) {
+      lastReportMs = nowMs;
+      const StateSendStats &sends = host.sendPolicy.stats;
+      const PaddleReceiveStats &paddle = host.paddle.stats;
+      printf("host: tick %u score %u-%u dropped %u tx ev %u mv %u key %u pad in %u rec %u lost %u rs %u clamp %u",
+             host.sim.tick, host.sim.hostScore, host.sim.clientScore, host.simClock.droppedTicks, sends.events,
+             sends.motion, sends.keyframes, paddle.inputsApplied, paddle.inputsRecovered, paddle.inputsLost,
+             paddle.resyncs, paddle.clamped);
+      if (host.netMode == NetMode::Lockstep) {
+        printLockstepStats(host.lockstep);
+      }
+      printf(" | spec req %u mc %u/%lluB | beacons %u probes %u", host.spectateRequests, host.mirroredPackets,
+             static_cast<unsigned long long>(host.mirroredBytes), host.beacons, host.probesAnswered);
+      printLinkStats(host.link);
+      printf("\n");
+      fflush(stdout);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return host.link.hasPeer ? 0 : 1;
+}
+
+// -----------------------------------------------------------------------------
+// Client ---------------------------------------------------------------------
+
+struct ClientSession {
+  Link link;
+  NetAddress server;
+  SimState view;  // what the client would draw
+  StateView state;
+  PaddlePredictor predictor;
+  uint16_t lastSentInputSeq = 0;
+  uint32_t lastSentAckFrameId = 0;
+  uint32_t lastJoinMs = 0;
+  uint32_t lastPaddleMs = 0;
+  uint32_t lastFrameUs = 0;
+  uint32_t interpDelayMs = 50;
+  uint32_t sessionToken = 0;
+  const char *sessionFile = nullptr;
+  NetMode netMode = NetMode::Snapshot;  // of the current match, from its Start
+  bool started = false;
+  uint32_t matchSeed = 0;
+  Lockstep lockstep;
+  SimClock simClock;
+  uint32_t lastTickUs = 0;
+  uint32_t lastLockstepSentMs = 0;
+  uint32_t desyncAtTick = 0;
+};
+
+// The token survives the process in a one-line text file, so a restarted
+// client gets the match it left instead of a new one.
+uint32_t loadSessionToken(const char *path) {
+  FILE *file = path != nullptr ? fopen(path, "r") : nullptr;
+  if (file == nullptr) {
+    return 0;
+  }
+  unsigned long token = 0;
+  if (fscanf(file, "%lx", &token) != 1) {
+    token = 0;
+  }
+  fclose(file);
+  return static_cast<uint32_t>(token);
+}
+
+void saveSessionToken(const char *path, uint32_t token) {
+  FILE *file = path != nullptr ? fopen(path, "w") : nullptr;
+  if (file == nullptr) {
+    return;
+  }
+  fprintf(file, "%08lx\n", static_cast<unsigned long>(token));
+  fclose(file);
+}
+
+void clientSendPaddle(ClientSession &client) {
+  PaddleMessage message;
+  paddleMessageFill(message, client.predictor, client.state.sequence.started ? client.state.sequence.newest : 0,
+                    client.lastSentInputSeq);
+  uint8_t packet[PADDLE_PACKET_MAX];
+  size_t length = paddleEncode(message, packet, sizeof(packet));
+  if (length != 0) {
+    sendBytes(client.link, packet, length);
+  }
+  client.lastSentInputSeq = message.newestSeq;
+  client.lastSentAckFrameId = message.ackFrameId;
+  client.lastPaddleMs = millis32();
+}
+
+void clientReceiveState(ClientSession &client, const uint8_t *data, size_t length, uint32_t receiveMs) {
+  StateFrame frame;
+  if (!acceptState(client.state, data, length, receiveMs, frame)) {
+    return;
+  }
+  client.view.hostScore = frame.hostScore;
+  client.view.clientScore = frame.clientScore;
+  predictorReconcile(client.predictor, frame.ackInputSeq, SimScalar(dequantizePosition(frame.clientPaddleY)));
+}
+
+void clientStartMatch(ClientSession &client, const StartPacket &start) {
+  NetMode mode = static_cast<NetMode>(start.netMode);
+  if (client.started && mode == NetMode::Lockstep && client.netMode == mode && start.seed == client.matchSeed) {
+    return;  // the host repeats Start until it hears from this match
+  }
+  client.started = true;
+  client.netMode = mode;
+  client.matchSeed = start.seed;
+  simResetMatch(client.view);
+  interpReset(client.state.interp);
+  predictorReset(client.predictor, client.view.clientPaddleY);
+  client.lastSentInputSeq = client.predictor.lastSeq;
+  if (mode == NetMode::Lockstep) {
+    simSeed(client.view, start.seed);
+    simPrepareServe(client.view, 1);
+    lockstepReset(client.lockstep, start.seed, false);
+    client.simClock = SimClock();
+    client.lastTickUs = micros32();
+  }
+}
+
+void clientUpdateLockstep(ClientSession &client, uint32_t nowMs) {
+  uint32_t nowUs = micros32();
+  uint32_t elapsedUs = nowUs - client.lastTickUs;
+  client.lastTickUs = nowUs;
+  if (client.desyncAtTick != 0 && client.lockstep.tick >= client.desyncAtTick) {
+    client.desyncAtTick = 0;
+    client.view.ballY = client.view.ballY + SimScalar(1.0f);
+    printf("client: nudged the ball at tick %u\n", client.lockstep.tick);
+  }
+  int direction = trackDirection(simToFloat(client.view.clientPaddleY), simToFloat(client.view.ballY));
+  uint8_t events = 0;
+  lockstepAdvance(client.lockstep, client.view, simClockAdvance(client.simClock, elapsedUs),
+                  lockstepInput(direction, false), events);
+  if (events & SIM_EVENT_GAME_OVER) {
+    printf("client: match over %u-%u\n", client.view.hostScore, client.view.clientScore);
+  }
+  sendLockstepInputs(client.link, client.lockstep, client.lastLockstepSentMs, nowMs);
+}
+
+void clientReceive(ClientSession &client) {
+  uint8_t buffer[MAX_DATAGRAM_SIZE];
+  NetAddress from;
+  int length;
+  while ((length = client.link.transport->receive(buffer, sizeof(buffer), from)) > 0) {
+    uint32_t receiveUs = micros32();
+    uint32_t receiveMs = millis32();
+    ++client.link.packetsIn;
+    client.link.bytesIn += static_cast<uint64_t>(length);
+    if (client.link.hasPeer && from == client.link.peer) {
+      linkMonitorHeard(client.link.monitor, receiveMs);
+    }
+    if (handleClockPacket(client.link, buffer, length, receiveUs, receiveMs)) {
+      continue;
+    }
+    PacketType type = static_cast<PacketType>(buffer[0]);
+    if (type == PacketType::JoinAck && !client.link.hasPeer) {
+      JoinAckPacket ack;
+      if (!readPacket(buffer, length, ack)) {
+        continue;
+      }
+      ack.name[PLAYER_NAME_MAX_LEN - 1] = '\0';
+      connectLink(client.link, from);
+      client.lastSentAckFrameId = 0;
+      if (ack.sessionToken != client.sessionToken) {
+        client.sessionToken = ack.sessionToken;
+        saveSessionToken(client.sessionFile, client.sessionToken);
+      }
+      printf("client: %s %s\n", ack.resumed ? "resumed match with" : "joined", ack.name);
+    } else if (type == PacketType::Start && client.link.hasPeer && from == client.link.peer) {
+      StartPacket start;
+      if (readPacket(buffer, length, start)) {
+        clientStartMatch(client, start);
+      }
+    } else if (type == PacketType::LockstepInput && client.link.hasPeer && from == client.link.peer &&
+               client.netMode == NetMode::Lockstep) {
+      lockstepReadPacket(client.lockstep, buffer, static_cast<size_t>(length));
+    } else if (type == PacketType::LockstepSync && client.link.hasPeer && from == client.link.peer &&
+               client.netMode == NetMode::Lockstep) {
+      if (lockstepReadSync(client.lockstep, client.view, buffer, static_cast<size_t>(length))) {
+        printf("client: synced to the host at tick %u, %u-%u\n", client.lockstep.tick, client.view.hostScore,
+               client.view.clientScore);
+      }
+    } else if (type == PacketType::State && client.link.hasPeer && from == client.link.peer) {
+      clientReceiveState(client, buffer, static_cast<size_t>(length), receiveMs);
+    }
+  }
+}
+
+void clientUpdate(ClientSession &client) {
+  uint32_t nowUs = micros32();
+  if (nowUs - client.lastFrameUs < CLIENT_FRAME_US) {
+    return;
+  }
+  float dtSeconds = static_cast<float>(nowUs - client.lastFrameUs) / 1000000.0f;
+  client.lastFrameUs = nowUs;
+  uint32_t nowMs = millis32();
+
+  if (!client.link.hasPeer) {
+    if (nowMs - client.lastJoinMs >= JOIN_INTERVAL_MS) {
+      JoinPacket join{};
+      join.type = static_cast<uint8_t>(PacketType::Join);
+      fillName(join.name, "cli client");
+      join.sessionToken = client.sessionToken;
+      client.link.transport->sendTo(client.server, reinterpret_cast<const uint8_t *>(&join), sizeof(join));
+      client.lastJoinMs = nowMs;
+    }
+    return;
+  }
+  if (linkStalled(client.link)) {
+    return;  // frozen like the host until it answers again
+  }
+  if (client.netMode == NetMode::Lockstep) {
+    clientUpdateLockstep(client, nowMs);
+    return;
+  }
+
+  if (client.link.clock.hasSample) {
+    client.interpDelayMs = netClockRenderDelayMs(client.link.clock, STATE_MOTION_INTERVAL_MS, INTERP_MAX_DELAY_MS);
+  }
+  InterpSample sample;
+  if (interpSample(client.state.interp, nowMs, client.interpDelayMs, sample)) {
+    client.view.ballX = sample.ballX;
+    client.view.ballY = sample.ballY;
+    client.view.hostPaddleY = sample.hostPaddleY;
+  }
+
+  int direction = trackDirection(simToFloat(client.predictor.predictedY), simToFloat(client.view.ballY));
+  if (direction != 0) {
+    predictorApply(client.predictor, SimScalar(static_cast<float>(direction) * PADDLE_SPEED * dtSeconds), nowMs);
+  }
+  client.view.clientPaddleY = client.predictor.predictedY;
+  uint32_t sinceSendMs = nowMs - client.lastPaddleMs;
+  uint32_t intervalMs = client.link.rate.intervalMs;
+  bool ackPending = client.state.sequence.started && client.state.sequence.newest != client.lastSentAckFrameId;
+  if ((direction != 0 && sinceSendMs >= intervalMs) ||
+      (ackPending && sinceSendMs > (intervalMs > PADDLE_SEND_INTERVAL_MS ? intervalMs : PADDLE_SEND_INTERVAL_MS))) {
+    clientSendPaddle(client);
+  }
+}
+
+void clientDropPeer(ClientSession &client) {
+  client.link.hasPeer = false;
+  stateViewReset(client.state);
+  client.lastJoinMs = 0;
+  printf("client: host dropped, joining again\n");
+}
+
+int runClient(const Options &options, Transport &transport, ImpairedTransport *impairment) {
+  ClientSession client;
+  startLink(client.link, transport, impairment, options.link);
+  client.server = options.connect;
+  client.lastFrameUs = micros32();
+  client.sessionFile = options.sessionFile;
+  client.sessionToken = loadSessionToken(client.sessionFile);
+  client.desyncAtTick = options.desyncAtTick;
+
+  uint32_t startMs = millis32();
+  uint32_t lastReportMs = startMs;
+  while (millis32() - startMs < options.seconds * 1000u) {
+    clientReceive(client);
+    clientUpdate(client);
+    uint32_t nowMs = millis32();
+    updateLink(client.link, options, nowMs - startMs, nowMs, "client");
+    if (client.link.monitor.state == LinkState::Dropped && client.link.hasPeer) {
+      clientDropPeer(client);
+    }
+    if (nowMs - lastReportMs >= REPORT_INTERVAL_MS) {
+      lastReportMs = nowMs;
+      printf("client: score %u-%u", client.view.hostScore, client.view.clientScore);
+      printStateViewStats(client.state, client.interpDelayMs);
+      printf(" corr %u", client.predictor.corrections);
+      if (client.netMode == NetMode::Lockstep) {
+        printLockstepStats(client.lockstep);
+      }
+      printLinkStats(client.link);
+      printf("\n");
+      fflush(stdout);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return client.link.hasPeer ? 0 : 1;
+}
+
+// -----------------------------------------------------------------------------
+// Spectator ------------------------------------------------------------------
+
+struct SpectatorSession {
+  Link link;
+  NetAddress server;
+  SimState view;
+  StateView state;
+  uint32_t lastRequestMs = 0;
+  uint32_t lastStateMs = 0;
+  uint32_t lastFrameUs = 0;
+  uint32_t snapshotsAsked = 0;
+};
+
+// Asks the host (or whoever answers at --connect) to watch, or reminds it.
+void spectatorRequest(SpectatorSession &spectator, bool snapshot) {
+  SpectatePacket packet{static_cast<uint8_t>(PacketType::Spectate), static_cast<uint8_t>(snapshot ? 1 : 0)};
+  const NetAddress &to = spectator.link.hasPeer ? spectator.link.peer : spectator.server;
+  if (spectator.link.transport->sendTo(to, reinterpret_cast<const uint8_t *>(&packet), sizeof(packet))) {
+    ++spectator.link.packetsOut;
+    spectator.link.bytesOut += sizeof(packet);
+  }
+  spectator.lastRequestMs = millis32();
+  spectator.snapshotsAsked += snapshot ? 1 : 0;
+}
+
+void spectatorReceive(SpectatorSession &spectator) {
+  uint8_t buffer[MAX_DATAGRAM_SIZE];
+  NetAddress from;
+  int length;
+  while ((length = spectator.link.transport->receive(buffer, sizeof(buffer), from)) > 0) {
+    uint32_t receiveMs = millis32();
+    ++spectator.link.packetsIn;
+    spectator.link.bytesIn += static_cast<uint64_t>(length);
+    bool fromHost = spectator.link.hasPeer && from == spectator.link.peer;
+    if (fromHost) {
+      linkMonitorHeard(spectator.link.monitor, receiveMs);
+    }
+    PacketType type = static_cast<PacketType>(buffer[0]);
+    if (type == PacketType::SpectateAck && !spectator.link.hasPeer) {
+      SpectateAckPacket ack;
+      if (!readPacket(buffer, length, ack)) {
+        continue;
+      }
+      ack.hostName[PLAYER_NAME_MAX_LEN - 1] = '\0';
+      ack.clientName[PLAYER_NAME_MAX_LEN - 1] = '\0';
+      NetAddress group;
+      group.ip = ack.groupIp;
+      group.port = ack.groupPort;
+      if (!spectator.link.transport->joinGroup(group)) {
+        printf("spectator: cannot join group %u.%u.%u.%u:%u\n", netAddressOctet(group, 0), netAddressOctet(group, 1),
+               netAddressOctet(group, 2), netAddressOctet(group, 3), group.port);
+        continue;
+      }
+      connectLink(spectator.link, from);
+      spectator.lastStateMs = receiveMs;
+      printf("spectator: watching %s vs %s on %u.%u.%u.%u:%u\n", ack.hostName, ack.clientName,
+             netAddressOctet(group, 0), netAddressOctet(group, 1), netAddressOctet(group, 2),
+             netAddressOctet(group, 3), group.port);
+    } else if (type == PacketType::State && fromHost) {
+      StateFrame frame;
+      if (acceptState(spectator.state, buffer, static_cast<size_t>(length), receiveMs, frame)) {
+        spectator.view.hostScore = frame.hostScore;
+        spectator.view.clientScore = frame.clientScore;
+        spectator.lastStateMs = receiveMs;
+      }
+    }
+  }
+}
+
+void spectatorUpdate(SpectatorSession &spectator) {
+  uint32_t nowUs = micros32();
+  if (nowUs - spectator.lastFrameUs < CLIENT_FRAME_US) {
+    return;
+  }
+  spectator.lastFrameUs = nowUs;
+  uint32_t nowMs = millis32();
+  if (!spectator.link.hasPeer) {
+    if (nowMs - spectator.lastRequestMs >= JOIN_INTERVAL_MS) {
+      spectatorRequest(spectator, true);
+    }
+    return;
+  }
+  // A snapshot once a second while nothing useful arrives, otherwise just a
+  // reminder so the host keeps mirroring.
+  bool stale = nowMs - spectator.lastStateMs > SPECTATE_STALE_MS;
+  uint32_t sinceRequestMs = nowMs - spectator.lastRequestMs;
+  if ((stale && sinceRequestMs >= SPECTATE_STALE_MS) || sinceRequestMs >= SPECTATE_KEEPALIVE_MS) {
+    spectatorRequest(spectator, stale);
+  }
+  InterpSample sample;
+  if (interpSample(spectator.state.interp, nowMs, SPECTATE_INTERP_DELAY_MS, sample)) {
+    spectator.view.ballX = sample.ballX;
+    spectator.view.ballY = sample.ballY;
+    spectator.view.hostPaddleY = sample.hostPaddleY;
+    spectator.view.clientPaddleY = sample.clientPaddleY;
+  }
+}
+
+void spectatorDropHost(SpectatorSession &spectator) {
+  spectator.link.transport->leaveGroup();
+  spectator.link.hasPeer = false;
+  stateViewReset(spectator.state);
+  spectator.lastRequestMs = 0;
+  printf("spectator: host gone quiet, looking for a match again\n");
+}
+
+int runSpectator(const Options &options, Transport &transport, ImpairedTransport *impairment) {
+  SpectatorSession spectator;
+  startLink(spectator.link, transport, impairment, options.link);
+  spectator.link.silent = true;
+  spectator.server = options.connect;
+  spectator.lastFrameUs = micros32();
+
+  uint32_t startMs = millis32();
+  uint32_t lastReportMs = startMs;
+  while (millis32() - startMs < options.seconds * 1000u) {
+    spectatorReceive(spectator);
+    spectatorUpdate(spectator);
+    uint32_t nowMs = millis32();
+    updateLink(spectator.link, options, nowMs - startMs, nowMs, "spectator");
+    if (spectator.link.monitor.state == LinkState::Dropped && spectator.link.hasPeer) {
+      spectatorDropHost(spectator);
+    }
+    if (nowMs - lastReportMs >= REPORT_INTERVAL_MS) {
+      lastReportMs = nowMs;
+      printf("spectator: score %u-%u", spectator.view.hostScore, spectator.view.clientScore);
+      printStateViewStats(spectator.state, SPECTATE_INTERP_DELAY_MS);
+      printf(" snap %u in %u/%lluB out %u/%lluB\n", spectator.snapshotsAsked, spectator.link.packetsIn,
+             static_cast<unsigned long long>(spectator.link.bytesIn), spectator.link.packetsOut,
+             static_cast<unsigned long long>(spectator.link.bytesOut));
+      fflush(stdout);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return spectator.link.hasPeer ? 0 : 1;
+}
+
+// -----------------------------------------------------------------------------
+// Lobby browser --------------------------------------------------------------
+
+struct BrowserSession {
+  Transport *transport = nullptr;
+  LobbyTable table;
+  uint32_t lastProbeMs = 0;
+};
+
+void browserReceive(BrowserSession &browser) {
+  uint8_t buffer[MAX_DATAGRAM_SIZE];
+  NetAddress from;
+  int length;
+  while ((length = browser.transport->receive(buffer, sizeof(buffer), from)) > 0) {
+    uint32_t receiveUs = micros32();
+    uint32_t receiveMs = millis32();
+    PacketType type = static_cast<PacketType>(buffer[0]);
+    if (type == PacketType::LobbyBeacon) {
+      LobbyBeacon beacon;
+      if (lobbyBeaconDecode(buffer, static_cast<size_t>(length), beacon)) {
+        lobbyTableHeard(browser.table, from, beacon, receiveMs);
+      }
+    } else if (type == PacketType::LobbyProbeAck) {
+      LobbyProbeAckPacket ack;
+      if (readPacket(buffer, length, ack)) {
+        lobbyTableAnswer(browser.table, from, ack.lobbyId, ack.originUs, receiveUs);
+      }
+    }
+  }
+}
+
+void browserUpdate(BrowserSession &browser, uint32_t nowMs) {
+  lobbyTableExpire(browser.table, nowMs);
+  if (nowMs - browser.lastProbeMs < LOBBY_PROBE_SPACING_MS) {
+    return;
+  }
+  browser.lastProbeMs = nowMs;
+  const LobbyEntry *lobby = lobbyTableNextProbe(browser.table, nowMs);
+  if (lobby != nullptr) {
+    LobbyProbePacket probe{static_cast<uint8_t>(PacketType::LobbyProbe), micros32()};
+    browser.transport->sendTo(lobby->address, reinterpret_cast<const uint8_t *>(&probe), sizeof(probe));
+  }
+}
+
+void printLobbies(const BrowserSession &browser, uint32_t nowMs) {
+  const LobbyTableStats &stats = browser.table.stats;
+  printf("browse: %u lobbies | beacons %u added %u restarted %u expired %u evicted %u away %u probes %u answers %u\n",
+         static_cast<unsigned>(browser.table.count), stats.beacons, stats.added, stats.restarted, stats.expired,
+         stats.evicted, stats.turnedAway, stats.probes, stats.answers);
+  for (size_t i = 0; i < browser.table.count; ++i) {
+    const LobbyEntry &lobby = lobbyTableAt(browser.table, i);
+    printf("  %-15s %u.%u.%u.%u:%-5u %-7s %-8s rtt %6.2f ms heard %u missed %u age %u ms\n", lobby.beacon.name,
+           netAddressOctet(lobby.address, 0), netAddressOctet(lobby.address, 1), netAddressOctet(lobby.address, 2),
+           netAddressOctet(lobby.address, 3), lobby.address.port,
+           lobby.beacon.state == LobbyState::Open ? "open" : "playing",
+           lobby.beacon.netMode == NetMode::Lockstep ? "lockstep" : "snapshot", lobby.srttUs / 1000.0,
+           lobby.beaconsHeard, lobby.beaconsMissed, nowMs - lobby.lastHeardMs);
+  }
+  fflush(stdout);
+}
+
+int runBrowser(const Options &options, Transport &transport) {
+  static BrowserSession browser;  // the table is a few KB: keep it off the stack
+  browser.transport = &transport;
+  lobbyTableReset(browser.table);
+  printf("browse: listening on port %u\n", options.port);
+
+  uint32_t startMs = millis32();
+  uint32_t lastReportMs = startMs;
+  while (millis32() - startMs < options.seconds * 1000u) {
+    browserReceive(browser);
+    uint32_t nowMs = millis32();
+    browserUpdate(browser, nowMs);
+    if (nowMs - lastReportMs >= REPORT_INTERVAL_MS) {
+      lastReportMs = nowMs;
+      printLobbies(browser, nowMs);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return browser.table.count != 0 ? 0 : 1;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage();
+    return 2;
+  }
+
+  UdpSocketTransport sockets;
+  sockets.setMulticastInterface(options.multicastInterface);
+  ImpairedTransport impaired(sockets, millis32, options.impairSeed);
+  impaired.setProfile(options.impairment);
+  Transport &transport = options.impaired ? static_cast<Transport &>(impaired) : sockets;
+  ImpairedTransport *impairment = options.impaired ? &impaired : nullptr;
+
+  if (!transport.bind(options.port)) {
+    fprintf(stderr, "pong_cli: cannot bind UDP port %u\n", options.port);
+    return 1;
+  }
+  switch (options.mode) {
+    case Mode::Host:
+      return runHost(options, transport, impairment);
+    case Mode::Client:
+      return runClient(options, transport, impairment);
+    case Mode::Spectate:
+      return runSpectator(options, transport, impairment);
+    case Mode::Browse:
+      return runBrowser(options, transport);
+  }
+  return 2;
+}
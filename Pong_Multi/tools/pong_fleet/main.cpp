@@ -0,0 +1,546 @@
+// Load generator for Linux: a fleet of bot clients against a host or server.
+//
+//   pong_fleet [--connect A.B.C.D[:PORT]] [--clients N] [--ramp N] [--seconds S]
+//              [--paddle track|sweep|idle] [--name PREFIX]
+//
+// Each bot is a full snapshot client on its own UDP socket: it sends Join
+// (broadcast, which any waiting host accepts, unless --connect names the
+// target) until a JoinAck arrives, answers and sends pings, decodes the
+// delta-coded state stream, and drives its paddle through paddle packets:
+// track follows the ball in the newest state, sweep runs up and down, idle
+// only acknowledges state. A bot the target has been silent to for
+// LINK_DROPPED_MS joins again with its session token. --ramp starts that many
+// bots per second (0: all at once).
+//
+// Anything that speaks the protocol can be the target: a Cardputer host, a
+// PONG_SOCKET_TRANSPORT build, pong_cli host or pong_server. A host plays one
+// opponent, so against it one bot gets a match and the rest keep asking,
+// which is itself the join storm a host sees on a busy network.
+//
+// Every second it prints the fleet's totals; at the end HDR histograms of the
+// handshake time (first Join to JoinAck), state latency (host send to arrival,
+// through the ping clock offset), the gap between states, ping RTT and each
+// bot's state loss.
+
+#include <hdr_histogram.h>
+#include <link_monitor.h>
+#include <net_clock.h>
+#include <paddle_codec.h>
+#include <paddle_predictor.h>
+#include <pong_sim.h>
+#include <protocol.h>
+#include <sequence_tracker.h>
+#include <state_codec.h>
+#include <udp_socket_transport.h>
+
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t FRAME_US = 16667;  // bots move at device frame rate
+constexpr uint32_t JOIN_INTERVAL_MS = 800;
+constexpr uint32_t PING_INTERVAL_MS = 250;
+constexpr uint32_t PADDLE_SEND_INTERVAL_MS = 32;  // while moving
+constexpr uint32_t PADDLE_ACK_INTERVAL_MS = 45;   // acknowledgement only
+constexpr uint32_t REPORT_INTERVAL_MS = 1000;
+constexpr size_t EPOLL_BATCH = 256;
+
+uint64_t monotonicUs() {
+  using namespace std::chrono;
+  static const steady_clock::time_point start = steady_clock::now();
+  return static_cast<uint64_t>(duration_cast<microseconds>(steady_clock::now() - start).count());
+}
+
+uint32_t micros32() {
+  return static_cast<uint32_t>(monotonicUs());
+}
+
+uint32_t millis32() {
+  return static_cast<uint32_t>(monotonicUs() / 1000);
+}
+
+enum class PaddleMode {
+  Track,
+  Sweep,
+  Idle,
+};
+
+struct Options {
+  NetAddress target = netAddress(255, 255, 255, 255, UDP_PORT);
+  bool broadcast = true;
+  uint32_t clients = 1000;
+  uint32_t ramp = 200;
+  uint32_t seconds = 30;
+  PaddleMode paddle = PaddleMode::Track;
+  const char *name = "bot";
+};
+
+bool parseAddress(const char *text, NetAddress &out) {
+  unsigned a, b, c, d, port = UDP_PORT;
+  int fields = sscanf(text, "%u.%u.%u.%u:%u", &a, &b, &c, &d, &port);
+  if (fields < 4 || a > 255 || b > 255 || c > 255 || d > 255 || port > 65535) {
+    return false;
+  }
+  out = netAddress(static_cast<uint8_t>(a), static_cast<uint8_t>(b), static_cast<uint8_t>(c),
+                   static_cast<uint8_t>(d), static_cast<uint16_t>(port));
+  return true;
+}
+
+bool parsePaddleMode(const char *text, PaddleMode &mode) {
+  if (strcmp(text, "track") == 0) {
+    mode = PaddleMode::Track;
+  } else if (strcmp(text, "sweep") == 0) {
+    mode = PaddleMode::Sweep;
+  } else if (strcmp(text, "idle") == 0) {
+    mode = PaddleMode::Idle;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void printUsage() {
+  fprintf(stderr,
+          "usage: pong_fleet [--connect A.B.C.D[:PORT]] [--clients N] [--ramp N] [--seconds S]\n"
+          "                  [--paddle track|sweep|idle] [--name PREFIX]\n");
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (value == nullptr) {
+      return false;
+    }
+    if (strcmp(arg, "--connect") == 0) {
+      if (!parseAddress(value, options.target)) {
+        return false;
+      }
+      options.broadcast = false;
+    } else if (strcmp(arg, "--clients") == 0) {
+      options.clients = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+    } else if (strcmp(arg, "--ramp") == 0) {
+      options.ramp = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+    } else if (strcmp(arg, "--seconds") == 0) {
+      options.seconds = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+    } else if (strcmp(arg, "--paddle") == 0) {
+      if (!parsePaddleMode(value, options.paddle)) {
+        return false;
+      }
+    } else if (strcmp(arg, "--name") == 0) {
+      options.name = value;
+    } else {
+      return false;
+    }
+    ++i;
+  }
+  return options.clients != 0;
+}
+
+// -----------------------------------------------------------------------------
+// Bots -----------------------------------------------------------------------
+
+struct Bot {
+  UdpSocketTransport socket;
+  char name[PLAYER_NAME_MAX_LEN] = {};
+  NetAddress peer;
+  bool joined = false;
+  bool started = false;
+  uint32_t token = 0;
+  uint32_t joinStartUs = 0;  // first Join of the current attempt
+  uint32_t lastJoinMs = 0;
+  uint32_t lastPingMs = 0;
+  uint32_t lastPaddleMs = 0;
+  uint32_t lastHeardMs = 0;
+  uint32_t lastStateUs = 0;
+  NetClock clock;
+  SequenceTracker states;
+  StateHistory received;
+  PaddlePredictor predictor;
+  uint16_t lastSentInputSeq = 0;
+  uint32_t lastSentAckFrameId = 0;
+  float ballY = SCREEN_HEIGHT * 0.5f;
+  int sweep = 1;
+  uint32_t lostBefore = 0;  // states lost in earlier sessions
+  uint32_t receivedBefore = 0;
+};
+
+struct FleetStats {
+  uint32_t packetsIn = 0;
+  uint32_t packetsOut = 0;
+  uint64_t bytesIn = 0;
+  uint64_t bytesOut = 0;
+  uint32_t joinsSent = 0;
+  uint32_t joined = 0;
+  uint32_t resumed = 0;
+  uint32_t drops = 0;  // target silent for LINK_DROPPED_MS
+  uint32_t starts = 0;
+  uint32_t states = 0;
+  uint32_t baselineMisses = 0;
+  HdrHistogram handshakeUs;
+  HdrHistogram stateLatencyUs;
+  HdrHistogram stateGapUs;
+  HdrHistogram rttUs;
+  HdrHistogram lossPermille;  // one record per bot, at the end
+};
+
+struct Fleet {
+  const Options *options = nullptr;
+  std::vector<std::unique_ptr<Bot>> bots;
+  int poller = -1;
+  FleetStats stats;
+};
+
+void sendBytes(Fleet &fleet, Bot &bot, const NetAddress &to, const uint8_t *data, size_t length) {
+  if (bot.socket.sendTo(to, data, length)) {
+    ++fleet.stats.packetsOut;
+    fleet.stats.bytesOut += length;
+  }
+}
+
+template <typename Packet>
+void sendPacket(Fleet &fleet, Bot &bot, const Packet &packet) {
+  sendBytes(fleet, bot, bot.peer, reinterpret_cast<const uint8_t *>(&packet), sizeof(packet));
+}
+
+void sendJoin(Fleet &fleet, Bot &bot, uint32_t nowMs) {
+  JoinPacket join{};
+  join.type = static_cast<uint8_t>(PacketType::Join);
+  memcpy(join.name, bot.name, sizeof(join.name));
+  join.sessionToken = bot.token;
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(&join);
+  if (fleet.options->broadcast) {
+    if (bot.socket.broadcast(fleet.options->target.port, data, sizeof(join))) {
+      ++fleet.stats.packetsOut;
+      fleet.stats.bytesOut += sizeof(join);
+    }
+  } else {
+    sendBytes(fleet, bot, fleet.options->target, data, sizeof(join));
+  }
+  if (bot.lastJoinMs == 0) {
+    bot.joinStartUs = micros32();
+  }
+  bot.lastJoinMs = nowMs;
+  ++fleet.stats.joinsSent;
+}
+
+void sendPing(Fleet &fleet, Bot &bot, uint32_t nowMs) {
+  PingPacket ping{};
+  ping.type = static_cast<uint8_t>(PacketType::Ping);
+  ping.originUs = micros32();
+  ping.originMs = nowMs;
+  sendPacket(fleet, bot, ping);
+  ++bot.clock.pingsSent;
+  bot.lastPingMs = nowMs;
+}
+
+void sendPaddle(Fleet &fleet, Bot &bot, uint32_t nowMs) {
+  PaddleMessage message;
+  paddleMessageFill(message, bot.predictor, bot.states.started ? bot.states.newest : 0, bot.lastSentInputSeq);
+  uint8_t packet[PADDLE_PACKET_MAX];
+  size_t length = paddleEncode(message, packet, sizeof(packet));
+  if (length != 0) {
+    sendBytes(fleet, bot, bot.peer, packet, length);
+  }
+  bot.lastSentInputSeq = message.newestSeq;
+  bot.lastSentAckFrameId = message.ackFrameId;
+  bot.lastPaddleMs = nowMs;
+}
+
+bool spawnBot(Fleet &fleet, uint32_t index) {
+  std::unique_ptr<Bot> bot(new Bot());
+  if (!bot->socket.bind(0)) {
+    return false;
+  }
+  snprintf(bot->name, sizeof(bot->name), "%s%u", fleet.options->name, index);
+  epoll_event watch{};
+  watch.events = EPOLLIN;
+  watch.data.u32 = index;
+  if (epoll_ctl(fleet.poller, EPOLL_CTL_ADD, bot->socket.descriptor(), &watch) != 0) {
+    return false;
+  }
+  fleet.bots.push_back(std::move(bot));
+  return true;
+}
+
+void receiveState(Fleet &fleet, Bot &bot, const uint8_t *data, size_t length, uint32_t receiveUs,
+                  uint32_t receiveMs) {
+  StateFrame frame;
+  StateDecodeResult result = stateDecode(data, length, bot.received, bot.states.newest, frame);
+  if (result == StateDecodeResult::MissingBaseline) {
+    ++fleet.stats.baselineMisses;
+  }
+  if (result != StateDecodeResult::Ok || sequenceTrack(bot.states, frame.frameId) != SequenceVerdict::Newer) {
+    return;
+  }
+  stateHistoryPush(bot.received, frame);
+  ++fleet.stats.states;
+  if (bot.clock.hasSample) {
+    int32_t ageMs = static_cast<int32_t>(netClockPeerTimeMs(bot.clock, receiveMs) - frame.hostTimeMs);
+    hdrRecord(fleet.stats.stateLatencyUs, ageMs > 0 ? static_cast<uint32_t>(ageMs) * 1000u : 0);
+  }
+  if (bot.lastStateUs != 0) {
+    hdrRecord(fleet.stats.stateGapUs, receiveUs - bot.lastStateUs);
+  }
+  bot.lastStateUs = receiveUs;
+  bot.ballY = dequantizePosition(frame.ballY);
+  predictorReconcile(bot.predictor, frame.ackInputSeq, SimScalar(dequantizePosition(frame.clientPaddleY)));
+}
+
+void receiveBot(Fleet &fleet, Bot &bot) {
+  uint8_t buffer[MAX_DATAGRAM_SIZE];
+  NetAddress from;
+  int length;
+  while ((length = bot.socket.receive(buffer, sizeof(buffer), from)) > 0) {
+    uint32_t receiveUs = micros32();
+    uint32_t receiveMs = millis32();
+    ++fleet.stats.packetsIn;
+    fleet.stats.bytesIn += static_cast<uint64_t>(length);
+    PacketType type = static_cast<PacketType>(buffer[0]);
+    if (type == PacketType::JoinAck && !bot.joined) {
+      JoinAckPacket ack;
+      if (!readPacket(buffer, length, ack)) {
+        continue;
+      }
+      bot.peer = from;
+      bot.joined = true;
+      bot.token = ack.sessionToken;
+      bot.lastHeardMs = receiveMs;
+      bot.lastPingMs = 0;
+      netClockReset(bot.clock);
+      hdrRecord(fleet.stats.handshakeUs, receiveUs - bot.joinStartUs);
+      ++(ack.resumed ? fleet.stats.resumed : fleet.stats.joined);
+      continue;
+    }
+    if (!bot.joined || from != bot.peer) {
+      continue;
+    }
+    bot.lastHeardMs = receiveMs;
+    if (type == PacketType::Ping) {
+      PingPacket ping;
+      if (readPacket(buffer, length, ping)) {
+        PongPacket pong{};
+        pong.type = static_cast<uint8_t>(PacketType::Pong);
+        pong.originUs = ping.originUs;
+        pong.originMs = ping.originMs;
+        pong.receiveMs = receiveMs;
+        pong.holdUs = micros32() - receiveUs;
+        sendPacket(fleet, bot, pong);
+      }
+    } else if (type == PacketType::Pong) {
+      PongPacket pong;
+      if (readPacket(buffer, length, pong)) {
+        netClockAddSample(bot.clock, pong.originUs, pong.originMs, pong.receiveMs, pong.holdUs, receiveUs);
+        hdrRecord(fleet.stats.rttUs, bot.clock.lastRttUs);
+      }
+    } else if (type == PacketType::Start) {
+      StartPacket start;
+      if (readPacket(buffer, length, start) && static_cast<NetMode>(start.netMode) == NetMode::Snapshot) {
+        bot.started = true;
+        SimState fresh;
+        predictorReset(bot.predictor, fresh.clientPaddleY);
+        bot.lastSentInputSeq = bot.predictor.lastSeq;
+        ++fleet.stats.starts;
+      }
+    } else if (type == PacketType::State) {
+      receiveState(fleet, bot, buffer, static_cast<size_t>(length), receiveUs, receiveMs);
+    }
+  }
+}
+
+// The target went quiet: keep the loss counted so far, then ask again with
+// the token like a dropped client.
+void dropBot(Fleet &fleet, Bot &bot) {
+  bot.lostBefore += bot.states.stats.lost;
+  bot.receivedBefore += bot.states.stats.received;
+  bot.joined = false;
+  bot.started = false;
+  bot.lastJoinMs = 0;
+  bot.lastStateUs = 0;
+  sequenceReset(bot.states);
+  stateHistoryReset(bot.received);
+  ++fleet.stats.drops;
+}
+
+int paddleDirection(const Options &options, Bot &bot) {
+  float paddleY = simToFloat(bot.predictor.predictedY);
+  if (options.paddle == PaddleMode::Track) {
+    constexpr float DEAD_ZONE = 3.0f;
+    return bot.ballY < paddleY - DEAD_ZONE ? -1 : (bot.ballY > paddleY + DEAD_ZONE ? 1 : 0);
+  }
+  if (options.paddle == PaddleMode::Sweep) {
+    if (paddleY <= PADDLE_HALF_HEIGHT + 1.0f) {
+      bot.sweep = 1;
+    } else if (paddleY >= SCREEN_HEIGHT - PADDLE_HALF_HEIGHT - 1.0f) {
+      bot.sweep = -1;
+    }
+    return bot.sweep;
+  }
+  return 0;
+}
+
+void updateBot(Fleet &fleet, Bot &bot, float dtSeconds, uint32_t nowMs) {
+  if (!bot.joined) {
+    if (bot.lastJoinMs == 0 || nowMs - bot.lastJoinMs >= JOIN_INTERVAL_MS) {
+      sendJoin(fleet, bot, nowMs);
+    }
+    return;
+  }
+  if (nowMs - bot.lastHeardMs > LINK_DROPPED_MS) {
+    dropBot(fleet, bot);
+    return;
+  }
+  if (nowMs - bot.lastPingMs >= PING_INTERVAL_MS) {
+    sendPing(fleet, bot, nowMs);
+  }
+  if (!bot.started) {
+    return;
+  }
+  int direction = paddleDirection(*fleet.options, bot);
+  if (direction != 0) {
+    predictorApply(bot.predictor, SimScalar(static_cast<float>(direction) * PADDLE_SPEED * dtSeconds), nowMs);
+  }
+  uint32_t sinceSendMs = nowMs - bot.lastPaddleMs;
+  bool ackPending = bot.states.started && bot.states.newest != bot.lastSentAckFrameId;
+  if ((direction != 0 && sinceSendMs >= PADDLE_SEND_INTERVAL_MS) || (ackPending && sinceSendMs >= PADDLE_ACK_INTERVAL_MS)) {
+    sendPaddle(fleet, bot, nowMs);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Reports --------------------------------------------------------------------
+
+void printProgress(const Fleet &fleet, uint32_t elapsedMs) {
+  uint32_t joined = 0;
+  uint32_t playing = 0;
+  uint32_t lost = 0;
+  uint32_t received = 0;
+  for (const auto &bot : fleet.bots) {
+    joined += bot->joined ? 1 : 0;
+    playing += bot->started && bot->states.started ? 1 : 0;
+    lost += bot->lostBefore + bot->states.stats.lost;
+    received += bot->receivedBefore + bot->states.stats.received;
+  }
+  const FleetStats &stats = fleet.stats;
+  printf("fleet: %5.1fs bots %zu joined %u playing %u | joins %u ok %u resumed %u drops %u | states %u lost %u nb %u"
+         " | in %u/%lluB out %u/%lluB\n",
+         elapsedMs / 1000.0, fleet.bots.size(), joined, playing, stats.joinsSent, stats.joined, stats.resumed,
+         stats.drops, received, lost, stats.baselineMisses, stats.packetsIn,
+         static_cast<unsigned long long>(stats.bytesIn), stats.packetsOut,
+         static_cast<unsigned long long>(stats.bytesOut));
+  fflush(stdout);
+}
+
+void printHistogram(const char *label, const HdrHistogram &histogram, double scale, const char *unit) {
+  if (histogram.total == 0) {
+    printf("  %-14s (none)\n", label);
+    return;
+  }
+  printf("  %-14s n %-8llu mean %8.1f p50 %8.1f p90 %8.1f p99 %8.1f p99.9 %8.1f max %8.1f %s\n", label,
+         static_cast<unsigned long long>(histogram.total), hdrMean(histogram) * scale,
+         hdrPercentile(histogram, 50.0) * scale, hdrPercentile(histogram, 90.0) * scale,
+         hdrPercentile(histogram, 99.0) * scale, hdrPercentile(histogram, 99.9) * scale, histogram.max * scale, unit);
+}
+
+void printSummary(Fleet &fleet) {
+  for (const auto &bot : fleet.bots) {
+    uint32_t lost = bot->lostBefore + bot->states.stats.lost;
+    uint32_t received = bot->receivedBefore + bot->states.stats.received;
+    if (received + lost != 0) {
+      hdrRecord(fleet.stats.lossPermille, static_cast<uint32_t>(1000ull * lost / (received + lost)));
+    }
+  }
+  const FleetStats &stats = fleet.stats;
+  printf("fleet summary: %zu bots, %u joined, %u resumed, %u drops, %u Start packets\n", fleet.bots.size(),
+         stats.joined, stats.resumed, stats.drops, stats.starts);
+  printHistogram("handshake", stats.handshakeUs, 0.001, "ms");
+  printHistogram("state latency", stats.stateLatencyUs, 0.001, "ms");
+  printHistogram("state gap", stats.stateGapUs, 0.001, "ms");
+  printHistogram("ping rtt", stats.rttUs, 0.001, "ms");
+  printHistogram("loss per bot", stats.lossPermille, 0.1, "%");
+  fflush(stdout);
+}
+
+// Thousands of bots need thousands of sockets.
+void raiseDescriptorLimit() {
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+int runFleet(const Options &options) {
+  raiseDescriptorLimit();
+  Fleet fleet;
+  fleet.options = &options;
+  fleet.poller = epoll_create1(0);
+  if (fleet.poller < 0) {
+    fprintf(stderr, "pong_fleet: cannot set up epoll\n");
+    return 1;
+  }
+  fleet.bots.reserve(options.clients);
+  printf("fleet: %u bots at %u/s against %u.%u.%u.%u:%u, paddle %s\n", options.clients, options.ramp,
+         netAddressOctet(options.target, 0), netAddressOctet(options.target, 1), netAddressOctet(options.target, 2),
+         netAddressOctet(options.target, 3), options.target.port,
+         options.paddle == PaddleMode::Track ? "track" : (options.paddle == PaddleMode::Sweep ? "sweep" : "idle"));
+
+  epoll_event ready[EPOLL_BATCH];
+  uint32_t wanted = options.clients;  // fewer if the descriptors run out
+  uint64_t startUs = monotonicUs();
+  uint64_t lastFrameUs = startUs;
+  uint32_t lastReportMs = millis32();
+  while (monotonicUs() - startUs < options.seconds * 1000000ull) {
+    uint64_t nowUs = monotonicUs();
+    uint64_t nextFrameUs = lastFrameUs + FRAME_US;
+    int waitMs = nextFrameUs > nowUs ? static_cast<int>((nextFrameUs - nowUs + 999) / 1000) : 0;
+    int count = epoll_wait(fleet.poller, ready, EPOLL_BATCH, waitMs);
+    for (int i = 0; i < count; ++i) {
+      receiveBot(fleet, *fleet.bots[ready[i].data.u32]);
+    }
+
+    nowUs = monotonicUs();
+    if (nowUs - lastFrameUs < FRAME_US) {
+      continue;
+    }
+    float dtSeconds = static_cast<float>(nowUs - lastFrameUs) / 1000000.0f;
+    lastFrameUs = nowUs;
+    uint64_t due = options.ramp == 0 ? wanted : (nowUs - startUs) * options.ramp / 1000000ull + 1;
+    while (fleet.bots.size() < wanted && fleet.bots.size() < due) {
+      if (!spawnBot(fleet, static_cast<uint32_t>(fleet.bots.size()))) {
+        wanted = static_cast<uint32_t>(fleet.bots.size());
+        fprintf(stderr, "pong_fleet: cannot open a socket for another bot, continuing with %u\n", wanted);
+      }
+    }
+    uint32_t nowMs = millis32();
+    for (auto &bot : fleet.bots) {
+      updateBot(fleet, *bot, dtSeconds, nowMs);
+    }
+    if (nowMs - lastReportMs >= REPORT_INTERVAL_MS) {
+      lastReportMs = nowMs;
+      printProgress(fleet, static_cast<uint32_t>((nowUs - startUs) / 1000));
+    }
+  }
+  printSummary(fleet);
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage();
+    return 2;
+  }
+  return runFleet(options);
+}
@@ -0,0 +1,1418 @@
+// Dedicated match server for Linux: hosts many snapshot matches at once on one
+// UDP socket, with both players joining as ordinary clients.
+//
+//   pong_server serve [--port N] [--seconds S] [--matches N] [--threads N] [--beacon-to A.B.C.D[:PORT]]
+//   pong_server bench [--matches N[,N...]] [--seconds S] [--threads N]
+//
+// serve speaks the same Join/JoinAck/Start/State/Paddle/Ping protocol as a
+// hosting Cardputer. Joins are paired first come, first served; each pair gets
+// a match, both seats receive state and send their paddle. Seat 0 plays the
+// right-hand paddle the firmware gives a client; seat 1 plays the left one but
+// is sent a mirrored picture, so on both screens the player is on the right.
+// A finished match restarts after REMATCH_DELAY_MS. A dropped player can come
+// back with its session token for SESSION_RESUME_WINDOW_MS while the match
+// waits, paused. Like a hosting Cardputer it beacons a lobby once a second
+// (to the broadcast address, or to --beacon-to) and answers round-trip probes,
+// so searching Cardputers list it; it shows as busy only when every row is
+// taken.
+//
+// Matches are rows of struct-of-arrays tables, one table (shard) per worker
+// thread; --matches is per shard. The main thread owns the socket: it waits
+// in epoll, reads datagrams in recvmmsg batches, pairs new players and places
+// each new match on the least loaded shard, and hands everything else to the
+// shard that holds the sender through a lock-free single-producer queue. Every
+// 1/60 s it starts a frame: each worker applies its queue, then all of them
+// tick matches in chunks, their own shard's from the front and, once that is
+// done, other shards' from the back, so a busy shard is finished by whoever
+// is free. State goes out in sendmmsg batches per worker; what the workers
+// need the main thread to know (a seat gone quiet, a freed match) comes back
+// on a queue per worker.
+//
+// bench runs the same frames without clients against bot paddles, as fast as
+// it can, sending into a local sink socket. For 1, 2, 4 ... --threads workers
+// it reports match throughput, how many matches that keeps at 60 Hz and the
+// p99 frame latency, with the matches spread evenly and with all of them on
+// one shard.
+
+#include <link_monitor.h>
+#include <lobby_table.h>
+#include <paddle_codec.h>
+#include <pong_sim.h>
+#include <protocol.h>
+#include <sequence_tracker.h>
+#include <state_codec.h>
+#include <state_send_policy.h>
+#include <udp_socket_transport.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t FRAME_US = 16667;  // 60 Hz, the rate the matches are ticked and sent at
+constexpr uint32_t REPORT_INTERVAL_MS = 1000;
+constexpr uint32_t REMATCH_DELAY_MS = 5000;
+constexpr uint32_t SESSION_RESUME_WINDOW_MS = 60000;
+constexpr uint32_t SEAT_DROP_MS = LINK_DROPPED_MS;
+constexpr size_t SEATS = 2;
+constexpr uint32_t NO_MATCH = UINT32_MAX;
+constexpr uint32_t CHUNK_MATCHES = 32;   // rows claimed at a time, by owner or thief
+constexpr size_t IO_BATCH = 64;          // datagrams per recvmmsg/sendmmsg
+constexpr size_t SHARD_QUEUE_SIZE = 1024;
+constexpr size_t DIRECTORY_QUEUE_SIZE = 1024;
+
+// -----------------------------------------------------------------------------
+// Clock and options ----------------------------------------------------------
+
+uint64_t monotonicUs() {
+  using namespace std::chrono;
+  static const steady_clock::time_point start = steady_clock::now();
+  return static_cast<uint64_t>(duration_cast<microseconds>(steady_clock::now() - start).count());
+}
+
+uint32_t micros32() {
+  return static_cast<uint32_t>(monotonicUs());
+}
+
+uint32_t millis32() {
+  return static_cast<uint32_t>(monotonicUs() / 1000);
+}
+
+enum class Mode {
+  Serve,
+  Bench,
+};
+
+struct Options {
+  Mode mode = Mode::Serve;
+  uint16_t port = UDP_PORT;
+  uint32_t seconds = 0;  // serve: 0 runs until killed
+  uint32_t matches = 256;
+  std::vector<uint32_t> benchMatches = {256, 4096};
+  uint32_t threads = 1;
+  NetAddress beaconTo;  // serve; ip 0: broadcast to UDP_PORT
+};
+
+bool parseCountList(const char *text, std::vector<uint32_t> &out) {
+  out.clear();
+  while (*text != '\0') {
+    char *end = nullptr;
+    unsigned long value = strtoul(text, &end, 10);
+    if (end == text || value == 0) {
+      return false;
+    }
+    out.push_back(static_cast<uint32_t>(value));
+    text = *end == ',' ? end + 1 : end;
+  }
+  return !out.empty();
+}
+
+// A.B.C.D[:PORT], the port defaulting to UDP_PORT.
+bool parseAddress(const char *text, NetAddress &out) {
+  unsigned a = 0;
+  unsigned b = 0;
+  unsigned c = 0;
+  unsigned d = 0;
+  unsigned port = UDP_PORT;
+  if (sscanf(text, "%u.%u.%u.%u:%u", &a, &b, &c, &d, &port) < 4 || a > 255 || b > 255 || c > 255 || d > 255 ||
+      port == 0 || port > 65535) {
+    return false;
+  }
+  out = netAddress(static_cast<uint8_t>(a), static_cast<uint8_t>(b), static_cast<uint8_t>(c),
+                   static_cast<uint8_t>(d), static_cast<uint16_t>(port));
+  return true;
+}
+
+void printUsage() {
+  fprintf(stderr,
+          "usage: pong_server serve [--port N] [--seconds S] [--matches N] [--threads N] [--beacon-to A.B.C.D[:PORT]]\n"
+          "       pong_server bench [--matches N[,N...]] [--seconds S] [--threads N]\n");
+}
+
+bool parseOptions(int argc, char **argv, Options &options) {
+  if (argc < 2) {
+    return false;
+  }
+  if (strcmp(argv[1], "serve") == 0) {
+    options.mode = Mode::Serve;
+  } else if (strcmp(argv[1], "bench") == 0) {
+    options.mode = Mode::Bench;
+    options.seconds = 5;
+    options.threads = std::max(1u, std::thread::hardware_concurrency());
+  } else {
+    return false;
+  }
+  for (int i = 2; i < argc; ++i) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (value == nullptr) {
+      return false;
+    }
+    if (strcmp(arg, "--port") == 0) {
+      options.port = static_cast<uint16_t>(atoi(value));
+    } else if (strcmp(arg, "--seconds") == 0) {
+      options.seconds = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+    } else if (strcmp(arg, "--matches") == 0) {
+      if (!parseCountList(value, options.benchMatches)) {
+        return false;
+      }
+      options.matches = options.benchMatches.front();
+    } else if (strcmp(arg, "--threads") == 0) {
+      options.threads = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+      if (options.threads == 0) {
+        return false;
+      }
+    } else if (strcmp(arg, "--beacon-to") == 0) {
+      if (!parseAddress(value, options.beaconTo)) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+    ++i;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Thread plumbing ------------------------------------------------------------
+
+// Lock-free ring for one producer thread and one consumer thread.
+template <typename T, size_t Capacity>
+class SpscQueue {
+  static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+ public:
+  bool push(const T &item) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    slots_[tail & (Capacity - 1)] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &item) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = slots_[head & (Capacity - 1)];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+  T slots_[Capacity];
+};
+
+// A shard's chunks for one frame: the owner takes from the front, thieves
+// from the back. Both ends live in one word so a single CAS claims a chunk.
+class ChunkRange {
+ public:
+  void reset(uint32_t count) {
+    range_.store(static_cast<uint64_t>(count) << 32, std::memory_order_relaxed);
+  }
+
+  bool takeFront(uint32_t &chunk) {
+    uint64_t range = range_.load(std::memory_order_relaxed);
+    for (;;) {
+      uint32_t front = static_cast<uint32_t>(range);
+      uint32_t back = static_cast<uint32_t>(range >> 32);
+      if (front >= back) {
+        return false;
+      }
+      if (range_.compare_exchange_weak(range, range + 1, std::memory_order_acq_rel)) {
+        chunk = front;
+        return true;
+      }
+    }
+  }
+
+  bool takeBack(uint32_t &chunk) {
+    uint64_t range = range_.load(std::memory_order_relaxed);
+    for (;;) {
+      uint32_t front = static_cast<uint32_t>(range);
+      uint32_t back = static_cast<uint32_t>(range >> 32);
+      if (front >= back) {
+        return false;
+      }
+      if (range_.compare_exchange_weak(range, range - (uint64_t{1} << 32), std::memory_order_acq_rel)) {
+        chunk = back - 1;
+        return true;
+      }
+    }
+  }
+
+ private:
+  alignas(64) std::atomic<uint64_t> range_{0};
+};
+
+sockaddr_in toSockaddr(const NetAddress &address) {
+  sockaddr_in out;
+  memset(&out, 0, sizeof(out));
+  out.sin_family = AF_INET;
+  out.sin_addr.s_addr = htonl(address.ip);
+  out.sin_port = htons(address.port);
+  return out;
+}
+
+// Outgoing datagrams gathered for one sendmmsg.
+struct SendBatch {
+  int socket = -1;
+  size_t count = 0;
+  mmsghdr messages[IO_BATCH];
+  iovec vectors[IO_BATCH];
+  sockaddr_in targets[IO_BATCH];
+  uint8_t data[IO_BATCH][MAX_DATAGRAM_SIZE];
+};
+
+// -----------------------------------------------------------------------------
+// Match table ----------------------------------------------------------------
+
+enum class MatchPhase : uint8_t {
+  Free,
+  Waiting,  // one seat taken; its player has no JoinAck yet and keeps asking
+  Playing,
+  GameOver,  // final state sent; restarts after REMATCH_DELAY_MS
+};
+
+// One player. Touched when its packets arrive or state goes out to it.
+struct Seat {
+  NetAddress address;
+  bool taken = false;
+  bool connected = false;
+  uint32_t token = 0;
+  uint32_t lastHeardMs = 0;
+  uint32_t leftMs = 0;
+  char name[PLAYER_NAME_MAX_LEN] = {};
+  PaddleReceiver paddle;
+  StateSendPolicy policy;
+  StateHistory sent;
+  uint32_t frameCounter = 0;
+  uint32_t ackFrameId = 0;
+};
+
+// Struct of arrays, indexed by match (seats by match * SEATS + seat). The
+// frame walks phases and sims for every match, so those stay dense; the
+// bulky per-player state is only reached for matches that send.
+struct MatchTable {
+  std::vector<MatchPhase> phases;
+  std::vector<SimState> sims;
+  std::vector<uint32_t> seeds;
+  std::vector<uint32_t> phaseSinceMs;
+  std::vector<Seat> seats;
+};
+
+void matchTableInit(MatchTable &table, uint32_t capacity) {
+  table.phases.assign(capacity, MatchPhase::Free);
+  table.sims.assign(capacity, SimState());
+  table.seeds.assign(capacity, 0);
+  table.phaseSinceMs.assign(capacity, 0);
+  table.seats.assign(static_cast<size_t>(capacity) * SEATS, Seat());
+}
+
+Seat &seatAt(MatchTable &table, uint32_t match, size_t seat) {
+  return table.seats[static_cast<size_t>(match) * SEATS + seat];
+}
+
+bool seatsConnected(MatchTable &table, uint32_t match) {
+  return seatAt(table, match, 0).connected && seatAt(table, match, 1).connected;
+}
+
+// Seat 0 holds the sim's client paddle, seat 1 its host paddle.
+SimScalar &seatPaddle(SimState &sim, size_t seat) {
+  return seat == 0 ? sim.clientPaddleY : sim.hostPaddleY;
+}
+
+// The match as seat 1 sees it: left and right swapped, so its own paddle is
+// the client one on the right.
+void mirrorSim(const SimState &in, SimState &out) {
+  out = in;
+  out.ballX = SimScalar(static_cast<float>(SCREEN_WIDTH)) - in.ballX;
+  out.ballVX = SimScalar(0.0f) - in.ballVX;
+  out.hostPaddleY = in.clientPaddleY;
+  out.clientPaddleY = in.hostPaddleY;
+  out.hostScore = in.clientScore;
+  out.clientScore = in.hostScore;
+}
+
+// -----------------------------------------------------------------------------
+// Shards and workers ---------------------------------------------------------
+
+// Main thread to shard: a datagram from one of its seats, or a seat the
+// directory filled.
+enum class ShardMessageKind : uint8_t {
+  Packet,
+  Seat,    // data holds the name; tokens are set once the match is full
+  Resume,  // the seat's player is back from address
+};
+
+struct ShardMessage {
+  ShardMessageKind kind = ShardMessageKind::Packet;
+  uint8_t seat = 0;
+  uint8_t length = 0;
+  uint32_t match = 0;
+  NetAddress address;
+  uint32_t receiveUs = 0;
+  uint32_t receiveMs = 0;
+  uint32_t tokens[SEATS] = {};
+  uint8_t data[MAX_DATAGRAM_SIZE];
+};
+
+// Worker to main thread.
+enum class DirectoryMessageKind : uint8_t {
+  SeatLeft,     // gone quiet; its address no longer belongs to it
+  MatchFreed,   // the row can take a new match
+};
+
+struct DirectoryMessage {
+  DirectoryMessageKind kind = DirectoryMessageKind::SeatLeft;
+  uint32_t shard = 0;
+  uint32_t match = 0;
+  uint8_t seat = 0;
+  NetAddress address;
+};
+
+struct WorkerStats {
+  uint32_t packetsOut = 0;
+  uint64_t bytesOut = 0;
+  uint32_t sendCalls = 0;
+  uint32_t resumes = 0;
+  uint32_t matchesStarted = 0;
+  uint32_t matchesFinished = 0;
+  uint32_t chunks = 0;
+  uint32_t steals = 0;  // chunks taken from another worker's shard
+};
+
+struct Shard {
+  MatchTable table;
+  SpscQueue<ShardMessage, SHARD_QUEUE_SIZE> inbox;  // from the main thread
+  ChunkRange chunks;
+};
+
+struct Worker {
+  uint32_t index = 0;
+  SendBatch batch;
+  WorkerStats stats;
+  SpscQueue<DirectoryMessage, DIRECTORY_QUEUE_SIZE> outbox;  // to the main thread
+  // Seeds for every match this worker starts. A rematch can start in a chunk
+  // stolen from another shard while that shard's owner works the front of it,
+  // so the generator belongs to the thread, not the shard.
+  uint32_t rng = 1;
+  uint64_t frameDoneUs = 0;  // read by the main thread once the frame is finished
+  std::thread thread;
+};
+
+// What the main thread sets before waking the workers for a frame.
+struct FrameOrder {
+  uint64_t sequence = 0;
+  uint32_t ticks = 0;
+  uint32_t nowMs = 0;
+  bool stop = false;
+};
+
+struct Server {
+  bool bots = false;  // bench: paddles chase the ball instead of following packets
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::mutex frameMutex;
+  std::condition_variable frameStart;
+  FrameOrder order;
+  std::atomic<uint32_t> drained{0};   // workers done with their inbox this frame
+  std::atomic<uint32_t> finished{0};  // workers done with the frame
+};
+
+uint32_t nextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+void batchFlush(Worker &worker) {
+  SendBatch &batch = worker.batch;
+  size_t sent = 0;
+  while (sent < batch.count) {
+    int result = sendmmsg(batch.socket, batch.messages + sent, static_cast<unsigned>(batch.count - sent), 0);
+    ++worker.stats.sendCalls;
+    if (result <= 0) {
+      break;  // a full socket buffer drops the rest, like a lost datagram
+    }
+    for (int i = 0; i < result; ++i) {
+      worker.stats.bytesOut += batch.messages[sent + static_cast<size_t>(i)].msg_len;
+    }
+    worker.stats.packetsOut += static_cast<uint32_t>(result);
+    sent += static_cast<size_t>(result);
+  }
+  batch.count = 0;
+}
+
+void sendBytes(Worker &worker, const NetAddress &to, const uint8_t *data, size_t length) {
+  SendBatch &batch = worker.batch;
+  if (batch.count == IO_BATCH) {
+    batchFlush(worker);
+  }
+  size_t i = batch.count++;
+  memcpy(batch.data[i], data, length);
+  batch.targets[i] = toSockaddr(to);
+  batch.vectors[i].iov_base = batch.data[i];
+  batch.vectors[i].iov_len = length;
+  memset(&batch.messages[i], 0, sizeof(batch.messages[i]));
+  batch.messages[i].msg_hdr.msg_name = &batch.targets[i];
+  batch.messages[i].msg_hdr.msg_namelen = sizeof(batch.targets[i]);
+  batch.messages[i].msg_hdr.msg_iov = &batch.vectors[i];
+  batch.messages[i].msg_hdr.msg_iovlen = 1;
+}
+
+template <typename Packet>
+void sendPacket(Worker &worker, const NetAddress &to, const Packet &packet) {
+  sendBytes(worker, to, reinterpret_cast<const uint8_t *>(&packet), sizeof(packet));
+}
+
+// The main thread must learn this; it drains the outbox continuously, so a
+// full one only means waiting a moment.
+void postDirectory(Worker &worker, const DirectoryMessage &message) {
+  while (!worker.outbox.push(message)) {
+    std::this_thread::yield();
+  }
+}
+
+void sendStart(Worker &worker, Shard &shard, uint32_t match) {
+  StartPacket start{static_cast<uint8_t>(PacketType::Start), shard.table.seeds[match],
+                    static_cast<uint8_t>(NetMode::Snapshot)};
+  for (size_t seat = 0; seat < SEATS; ++seat) {
+    Seat &player = seatAt(shard.table, match, seat);
+    if (player.connected) {
+      sendPacket(worker, player.address, start);
+    }
+  }
+}
+
+// The JoinAck carries the opponent's name, which is what the client shows.
+void sendJoinAck(Worker &worker, Shard &shard, uint32_t match, size_t seat, bool resumed) {
+  const Seat &player = seatAt(shard.table, match, seat);
+  const Seat &opponent = seatAt(shard.table, match, 1 - seat);
+  JoinAckPacket ack{};
+  ack.type = static_cast<uint8_t>(PacketType::JoinAck);
+  memcpy(ack.name, opponent.name, sizeof(ack.name));
+  ack.sessionToken = player.token;
+  ack.resumed = resumed ? 1 : 0;
+  sendPacket(worker, player.address, ack);
+}
+
+void sendState(Worker &worker, Shard &shard, uint32_t match, size_t seat, const SimState &view, uint32_t nowMs,
+               StateSendReason reason) {
+  Seat &player = seatAt(shard.table, match, seat);
+  bool paused = shard.table.phases[match] == MatchPhase::Playing && !seatsConnected(shard.table, match);
+  StateFrame frame;
+  frame.flags = (view.matchActive ? FLAG_MATCH_ACTIVE : 0) | (view.waitingForServe ? FLAG_WAITING_SERVE : 0) |
+                (view.gameOver ? FLAG_GAME_OVER : 0) | (paused ? FLAG_PAUSED : 0);
+  frame.hostScore = view.hostScore;
+  frame.clientScore = view.clientScore;
+  frame.frameId = ++player.frameCounter;
+  frame.hostTimeMs = nowMs;
+  frame.ackInputSeq = player.paddle.appliedSeq;
+  frame.ballX = quantizePosition(simToFloat(view.ballX));
+  frame.ballY = quantizePosition(simToFloat(view.ballY));
+  frame.ballVX = quantizeVelocity(simToFloat(view.ballVX));
+  frame.ballVY = quantizeVelocity(simToFloat(view.ballVY));
+  frame.hostPaddleY = quantizePosition(simToFloat(view.hostPaddleY));
+  frame.clientPaddleY = quantizePosition(simToFloat(view.clientPaddleY));
+
+  uint8_t packet[STATE_PACKET_MAX];
+  const StateFrame *baseline = player.ackFrameId != 0 ? stateHistoryFind(player.sent, player.ackFrameId) : nullptr;
+  size_t length = stateEncode(frame, baseline, packet, sizeof(packet));
+  stateHistoryPush(player.sent, frame);
+  sendBytes(worker, player.address, packet, length);
+  sendPolicySent(player.policy, view, nowMs, reason);
+}
+
+void startMatch(Worker &worker, Shard &shard, uint32_t match, uint32_t nowMs) {
+  MatchTable &table = shard.table;
+  table.seeds[match] = nextRandom(worker.rng) ^ match;
+  table.phases[match] = MatchPhase::Playing;
+  table.phaseSinceMs[match] = nowMs;
+  SimState &sim = table.sims[match];
+  simResetMatch(sim);
+  simSeed(sim, table.seeds[match]);
+  simPrepareServe(sim, 1);
+  for (size_t seat = 0; seat < SEATS; ++seat) {
+    Seat &player = seatAt(table, match, seat);
+    paddleReceiverReset(player.paddle);
+    sendPolicyReset(player.policy);
+  }
+  sendStart(worker, shard, match);
+  ++worker.stats.matchesStarted;
+}
+
+// The directory gave this seat to a new player. The second seat completes the
+// match: both get their JoinAck and the match starts.
+void fillSeat(Worker &worker, Shard &shard, const ShardMessage &message) {
+  MatchTable &table = shard.table;
+  uint32_t match = message.match;
+  if (message.seat == 0) {
+    table.phases[match] = MatchPhase::Waiting;
+    table.phaseSinceMs[match] = message.receiveMs;
+  } else if (table.phases[match] != MatchPhase::Waiting) {
+    return;  // the first player gave up meanwhile; the directory frees the row
+  }
+  Seat &player = seatAt(table, match, message.seat);
+  player = Seat();
+  player.address = message.address;
+  player.taken = true;
+  player.connected = true;
+  player.lastHeardMs = message.receiveMs;
+  memcpy(player.name, message.data, sizeof(player.name));
+  player.name[PLAYER_NAME_MAX_LEN - 1] = '\0';
+  if (message.seat == 0) {
+    return;
+  }
+  for (size_t seat = 0; seat < SEATS; ++seat) {
+    seatAt(table, match, seat).token = message.tokens[seat];
+    sendJoinAck(worker, shard, match, seat, false);
+  }
+  startMatch(worker, shard, match, message.receiveMs);
+}
+
+// A player came back with its token, maybe from a new address. It starts over
+// without a state baseline or a paddle history, like a resumed client.
+void resumeSeat(Worker &worker, Shard &shard, const ShardMessage &message) {
+  uint32_t match = message.match;
+  if (shard.table.phases[match] == MatchPhase::Free) {
+    return;
+  }
+  Seat &player = seatAt(shard.table, match, message.seat);
+  player.address = message.address;
+  player.connected = true;
+  player.lastHeardMs = message.receiveMs;
+  player.ackFrameId = 0;
+  paddleReceiverReset(player.paddle);
+  sendJoinAck(worker, shard, match, message.seat, true);
+  for (size_t seat = 0; seat < SEATS; ++seat) {
+    sendPolicyForce(seatAt(shard.table, match, seat).policy);  // the pause lifts for both
+  }
+  ++worker.stats.resumes;
+}
+
+void handlePacket(Worker &worker, Shard &shard, const ShardMessage &message) {
+  uint32_t match = message.match;
+  Seat &player = seatAt(shard.table, match, message.seat);
+  if (!player.connected || player.address != message.address) {
+    return;  // the seat changed hands while the datagram was queued
+  }
+  player.lastHeardMs = message.receiveMs;
+  PacketType type = static_cast<PacketType>(message.data[0]);
+  if (type == PacketType::Join) {
+    if (shard.table.phases[match] != MatchPhase::Waiting) {
+      // Still asking, so our JoinAck or Start was lost.
+      sendJoinAck(worker, shard, match, message.seat, false);
+      sendStart(worker, shard, match);
+    }
+  } else if (type == PacketType::Ping) {
+    PingPacket ping;
+    if (readPacket(message.data, message.length, ping)) {
+      PongPacket pong{};
+      pong.type = static_cast<uint8_t>(PacketType::Pong);
+      pong.originUs = ping.originUs;
+      pong.originMs = ping.originMs;
+      pong.receiveMs = message.receiveMs;
+      pong.holdUs = micros32() - message.receiveUs;  // includes the wait for the frame
+      sendPacket(worker, message.address, pong);
+    }
+  } else if (type == PacketType::Paddle && shard.table.phases[match] == MatchPhase::Playing) {
+    PaddleMessage paddle;
+    if (!paddleDecode(message.data, message.length, paddle)) {
+      return;
+    }
+    paddleReceiverApply(player.paddle, paddle, seatPaddle(shard.table.sims[match], message.seat));
+    if (paddle.ackFrameId != 0 && (player.ackFrameId == 0 || sequenceNewer(paddle.ackFrameId, player.ackFrameId))) {
+      player.ackFrameId = paddle.ackFrameId;
+    }
+  }
+}
+
+void drainInbox(Worker &worker, Shard &shard) {
+  ShardMessage message;
+  while (shard.inbox.pop(message)) {
+    switch (message.kind) {
+      case ShardMessageKind::Packet:
+        handlePacket(worker, shard, message);
+        break;
+      case ShardMessageKind::Seat:
+        fillSeat(worker, shard, message);
+        break;
+      case ShardMessageKind::Resume:
+        resumeSeat(worker, shard, message);
+        break;
+    }
+  }
+}
+
+// Seats silent for SEAT_DROP_MS leave their match paused; a match nobody
+// came back to within SESSION_RESUME_WINDOW_MS, or a lone waiting player
+// gone quiet, is freed.
+void expireSeats(Worker &worker, Shard &shard, uint32_t shardIndex, uint32_t match, uint32_t nowMs) {
+  MatchTable &table = shard.table;
+  bool anyConnected = false;
+  bool expired = false;
+  for (size_t seat = 0; seat < SEATS; ++seat) {
+    Seat &player = seatAt(table, match, seat);
+    // Signed: the main thread keeps queueing while a frame runs, so a seat
+    // can have been heard after the frame's nowMs.
+    if (player.connected && static_cast<int32_t>(nowMs - player.lastHeardMs) > static_cast<int32_t>(SEAT_DROP_MS)) {
+      player.connected = false;
+      player.leftMs = nowMs;
+      DirectoryMessage left;
+      left.kind = DirectoryMessageKind::SeatLeft;
+      left.shard = shardIndex;
+      left.match = match;
+      left.seat = static_cast<uint8_t>(seat);
+      left.address = player.address;
+      postDirectory(worker, left);
+    }
+    anyConnected = anyConnected || player.connected;
+    expired = expired || (player.taken && !player.connected && nowMs - player.leftMs > SESSION_RESUME_WINDOW_MS);
+  }
+  if (expired || !anyConnected) {
+    for (size_t seat = 0; seat < SEATS; ++seat) {
+      seatAt(table, match, seat) = Seat();
+    }
+    table.phases[match] = MatchPhase::Free;
+    DirectoryMessage freed;
+    freed.kind = DirectoryMessageKind::MatchFreed;
+    freed.shard = shardIndex;
+    freed.match = match;
+    postDirectory(worker, freed);
+  }
+}
+
+SimInput botInput(const SimState &sim) {
+  auto chase = [&](SimScalar paddleY) {
+    float delta = simToFloat(sim.ballY) - simToFloat(paddleY);
+    return static_cast<int8_t>(delta < -3.0f ? -1 : (delta > 3.0f ? 1 : 0));
+  };
+  SimInput input;
+  input.hostPaddleDir = chase(sim.hostPaddleY);
+  // A little slack on one side so points get scored and matches end.
+  input.clientPaddleDir = sim.tick % 3 == 0 ? 0 : chase(sim.clientPaddleY);
+  return input;
+}
+
+// Ticks one chunk of a shard and sends what is due. Inputs are already in
+// the sims; players move their paddles through packets.
+void runChunk(Server &server, Worker &worker, uint32_t shardIndex, uint32_t chunk, const FrameOrder &order) {
+  Shard &shard = *server.shards[shardIndex];
+  MatchTable &table = shard.table;
+  uint32_t first = chunk * CHUNK_MATCHES;
+  uint32_t last = std::min(first + CHUNK_MATCHES, static_cast<uint32_t>(table.phases.size()));
+  for (uint32_t match = first; match < last; ++match) {
+    MatchPhase phase = table.phases[match];
+    if (phase == MatchPhase::Free) {
+      continue;
+    }
+    if (!server.bots) {
+      expireSeats(worker, shard, shardIndex, match, order.nowMs);
+      phase = table.phases[match];
+      if (phase == MatchPhase::Free || phase == MatchPhase::Waiting) {
+        continue;
+      }
+    }
+    SimState &sim = table.sims[match];
+    if (phase == MatchPhase::GameOver) {
+      if (order.nowMs - table.phaseSinceMs[match] >= REMATCH_DELAY_MS && seatsConnected(table, match)) {
+        startMatch(worker, shard, match, order.nowMs);
+      }
+    } else if (seatsConnected(table, match)) {
+      uint8_t events = 0;
+      for (uint32_t i = 0; i < order.ticks; ++i) {
+        SimInput input = server.bots ? botInput(sim) : SimInput();
+        events |= simStep(sim, input);
+        if (events & SIM_EVENT_GAME_OVER) {
+          table.phases[match] = MatchPhase::GameOver;
+          table.phaseSinceMs[match] = order.nowMs;
+          ++worker.stats.matchesFinished;
+          break;
+        }
+      }
+      for (size_t seat = 0; seat < SEATS; ++seat) {
+        sendPolicyNoteEvents(seatAt(table, match, seat).policy, events);
+      }
+    }
+
+    SimState mirrored;
+    mirrorSim(sim, mirrored);
+    for (size_t seat = 0; seat < SEATS; ++seat) {
+      Seat &player = seatAt(table, match, seat);
+      if (!player.connected) {
+        continue;
+      }
+      const SimState &view = seat == 0 ? sim : mirrored;
+      StateSendReason reason = sendPolicyCheck(player.policy, view, order.nowMs);
+      if (reason != StateSendReason::None) {
+        sendState(worker, shard, match, seat, view, order.nowMs, reason);
+      }
+    }
+  }
+}
+
+uint32_t chunkCount(const Shard &shard) {
+  return static_cast<uint32_t>((shard.table.phases.size() + CHUNK_MATCHES - 1) / CHUNK_MATCHES);
+}
+
+// One frame on one worker: its own queue, then every chunk it can get, its
+// own shard first.
+void runWorkerFrame(Server &server, Worker &worker, const FrameOrder &order) {
+  uint32_t count = static_cast<uint32_t>(server.shards.size());
+  Shard &own = *server.shards[worker.index];
+  drainInbox(worker, own);
+  own.chunks.reset(chunkCount(own));
+  // Nobody may tick a shard whose owner is still applying packets to it.
+  server.drained.fetch_add(1, std::memory_order_acq_rel);
+  while (server.drained.load(std::memory_order_acquire) < count) {
+    std::this_thread::yield();
+  }
+
+  uint32_t chunk;
+  while (own.chunks.takeFront(chunk)) {
+    runChunk(server, worker, worker.index, chunk, order);
+    ++worker.stats.chunks;
+  }
+  for (uint32_t offset = 1; offset < count; ++offset) {
+    uint32_t victim = (worker.index + offset) % count;
+    while (server.shards[victim]->chunks.takeBack(chunk)) {
+      runChunk(server, worker, victim, chunk, order);
+      ++worker.stats.chunks;
+      ++worker.stats.steals;
+    }
+  }
+  batchFlush(worker);
+  worker.frameDoneUs = monotonicUs();
+  server.finished.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void workerLoop(Server &server, Worker &worker) {
+  uint64_t seen = 0;
+  for (;;) {
+    FrameOrder order;
+    {
+      std::unique_lock<std::mutex> lock(server.frameMutex);
+      server.frameStart.wait(lock, [&] { return server.order.sequence != seen || server.order.stop; });
+      if (server.order.stop) {
+        return;
+      }
+      order = server.order;
+    }
+    seen = order.sequence;
+    runWorkerFrame(server, worker, order);
+  }
+}
+
+void startServer(Server &server, uint32_t threads, uint32_t matchesPerShard, int sendSocket, uint32_t seed) {
+  for (uint32_t i = 0; i < threads; ++i) {
+    std::unique_ptr<Shard> shard(new Shard());
+    matchTableInit(shard->table, matchesPerShard);
+    server.shards.push_back(std::move(shard));
+    std::unique_ptr<Worker> worker(new Worker());
+    worker->index = i;
+    worker->rng = (seed + i * 2654435761u) | 1u;
+    worker->batch.socket = sendSocket;
+    server.workers.push_back(std::move(worker));
+  }
+  for (auto &worker : server.workers) {
+    Worker *each = worker.get();
+    each->thread = std::thread([&server, each] { workerLoop(server, *each); });
+  }
+}
+
+bool frameIdle(const Server &server) {
+  return server.finished.load(std::memory_order_acquire) == server.workers.size();
+}
+
+// When the last worker finished the frame; only once frameIdle().
+uint64_t frameDoneUs(const Server &server) {
+  uint64_t doneUs = 0;
+  for (const auto &worker : server.workers) {
+    doneUs = std::max(doneUs, worker->frameDoneUs);
+  }
+  return doneUs;
+}
+
+void beginFrame(Server &server, uint32_t ticks, uint32_t nowMs) {
+  server.drained.store(0, std::memory_order_relaxed);
+  server.finished.store(0, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(server.frameMutex);
+    ++server.order.sequence;
+    server.order.ticks = ticks;
+    server.order.nowMs = nowMs;
+  }
+  server.frameStart.notify_all();
+}
+
+void stopServer(Server &server) {
+  {
+    std::lock_guard<std::mutex> lock(server.frameMutex);
+    server.order.stop = true;
+  }
+  server.frameStart.notify_all();
+  for (auto &worker : server.workers) {
+    worker->thread.join();
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Directory (main thread) ----------------------------------------------------
+
+// Where every seat is: which shard and row, whose address, which token, and
+// which rows are free. Only the main thread touches it.
+struct Directory {
+  std::unordered_map<uint64_t, uint64_t> seatsByAddress;  // addressKey -> seatRef
+  std::unordered_map<uint32_t, uint64_t> seatsByToken;
+  std::vector<std::vector<uint32_t>> freeRows;      // per shard, a stack
+  std::vector<std::vector<NetAddress>> addresses;   // per shard, by match * SEATS + seat
+  std::vector<std::vector<uint32_t>> tokens;        // likewise
+  std::vector<uint32_t> loads;                      // rows in use per shard
+  uint64_t waiting = UINT64_MAX;                    // seatRef of a lone first player
+  uint32_t rng = 1;
+  int socket = -1;       // lobby probes are answered straight from the main thread
+  uint32_t lobbyId = 0;
+  uint8_t beaconSeq = 0;
+};
+
+struct DirectoryStats {
+  uint32_t packetsIn = 0;
+  uint64_t bytesIn = 0;
+  uint32_t receiveCalls = 0;
+  uint32_t joins = 0;
+  uint32_t refused = 0;      // joins turned away with every shard full
+  uint32_t queueDrops = 0;   // a shard's inbox was full
+  uint32_t probes = 0;       // lobby round-trip probes answered
+  uint32_t frames = 0;
+  uint64_t frameUsTotal = 0;
+  uint32_t frameUsMax = 0;
+  uint32_t lateFrames = 0;   // the previous frame was still running at the deadline
+};
+
+uint64_t addressKey(const NetAddress &address) {
+  return (static_cast<uint64_t>(address.ip) << 16) | address.port;
+}
+
+uint64_t seatRef(uint32_t shard, uint32_t match, size_t seat) {
+  return (static_cast<uint64_t>(shard) << 32) | (static_cast<uint64_t>(match) * SEATS + seat);
+}
+
+uint32_t refShard(uint64_t ref) {
+  return static_cast<uint32_t>(ref >> 32);
+}
+
+uint32_t refRow(uint64_t ref) {
+  return static_cast<uint32_t>(ref);
+}
+
+void directoryInit(Directory &directory, uint32_t shards, uint32_t matchesPerShard, uint32_t seed) {
+  directory.freeRows.assign(shards, std::vector<uint32_t>());
+  directory.addresses.assign(shards, std::vector<NetAddress>(static_cast<size_t>(matchesPerShard) * SEATS));
+  directory.tokens.assign(shards, std::vector<uint32_t>(static_cast<size_t>(matchesPerShard) * SEATS, 0));
+  directory.loads.assign(shards, 0);
+  for (auto &rows : directory.freeRows) {
+    for (uint32_t i = matchesPerShard; i > 0; --i) {
+      rows.push_back(i - 1);
+    }
+  }
+  directory.rng = seed | 1u;
+}
+
+bool forward(Server &server, DirectoryStats &stats, uint32_t shard, const ShardMessage &message) {
+  if (!server.shards[shard]->inbox.push(message)) {
+    ++stats.queueDrops;
+    return false;
+  }
+  return true;
+}
+
+uint32_t newSessionToken(Directory &directory) {
+  for (;;) {
+    uint32_t token = nextRandom(directory.rng);
+    if (token != 0 && directory.seatsByToken.find(token) == directory.seatsByToken.end()) {
+      return token;
+    }
+  }
+}
+
+// A new player takes the waiting seat, or the first seat of a new match on
+// the least loaded shard.
+void seatNewPlayer(Server &server, Directory &directory, DirectoryStats &stats, const JoinPacket &join,
+                   const NetAddress &from, uint32_t nowMs) {
+  ShardMessage message;
+  message.kind = ShardMessageKind::Seat;
+  message.address = from;
+  message.receiveMs = nowMs;
+  memcpy(message.data, join.name, sizeof(join.name));
+  uint64_t ref;
+  if (directory.waiting != UINT64_MAX) {
+    ref = directory.waiting + 1;
+    directory.waiting = UINT64_MAX;
+    uint64_t firstRef = ref - 1;
+    for (size_t seat = 0; seat < SEATS; ++seat) {
+      uint32_t token = newSessionToken(directory);
+      message.tokens[seat] = token;
+      directory.tokens[refShard(ref)][refRow(firstRef) + seat] = token;
+      directory.seatsByToken[token] = firstRef + seat;
+    }
+  } else {
+    uint32_t best = UINT32_MAX;
+    for (uint32_t shard = 0; shard < directory.loads.size(); ++shard) {
+      if (!directory.freeRows[shard].empty() && (best == UINT32_MAX || directory.loads[shard] < directory.loads[best])) {
+        best = shard;
+      }
+    }
+    if (best == UINT32_MAX) {
+      ++stats.refused;
+      return;
+    }
+    uint32_t match = directory.freeRows[best].back();
+    directory.freeRows[best].pop_back();
+    ++directory.loads[best];
+    ref = seatRef(best, match, 0);
+    directory.waiting = ref;
+  }
+  message.match = refRow(ref) / SEATS;
+  message.seat = static_cast<uint8_t>(refRow(ref) % SEATS);
+  directory.addresses[refShard(ref)][refRow(ref)] = from;
+  directory.seatsByAddress[addressKey(from)] = ref;
+  ++stats.joins;
+  forward(server, stats, refShard(ref), message);
+}
+
+void answerProbe(Directory &directory, DirectoryStats &stats, const LobbyProbePacket &probe, const NetAddress &to) {
+  LobbyProbeAckPacket ack{static_cast<uint8_t>(PacketType::LobbyProbeAck), probe.originUs, directory.lobbyId};
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(to.ip);
+  address.sin_port = htons(to.port);
+  if (sendto(directory.socket, &ack, sizeof(ack), 0, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) >
+      0) {
+    ++stats.probes;
+  }
+}
+
+// The server is a lobby that is open while a player could still be seated.
+void sendBeacon(Directory &directory, UdpSocketTransport &socket, const NetAddress &to) {
+  bool open = directory.waiting != UINT64_MAX;
+  for (const auto &rows : directory.freeRows) {
+    open = open || !rows.empty();
+  }
+  LobbyBeacon beacon;
+  beacon.lobbyId = directory.lobbyId;
+  beacon.seq = ++directory.beaconSeq;
+  beacon.state = open ? LobbyState::Open : LobbyState::Playing;
+  strncpy(beacon.name, "pong_server", LOBBY_NAME_MAX);
+  uint8_t packet[LOBBY_BEACON_MAX];
+  size_t length = lobbyBeaconEncode(beacon, packet, sizeof(packet));
+  if (to.ip != 0) {
+    socket.sendTo(to, packet, length);
+  } else {
+    socket.broadcast(UDP_PORT, packet, length);
+  }
+}
+
+void routeDatagram(Server &server, Directory &directory, DirectoryStats &stats, const uint8_t *data, int length,
+                   const NetAddress &from, uint32_t receiveUs, uint32_t receiveMs) {
+  ++stats.packetsIn;
+  stats.bytesIn += static_cast<uint64_t>(length);
+  PacketType type = static_cast<PacketType>(data[0]);
+  if (type == PacketType::LobbyProbe) {
+    LobbyProbePacket probe;
+    if (readPacket(data, length, probe)) {
+      answerProbe(directory, stats, probe, from);
+    }
+    return;
+  }
+  if (type == PacketType::Join) {
+    JoinPacket join;
+    if (!readPacket(data, length, join)) {
+      return;
+    }
+    join.name[PLAYER_NAME_MAX_LEN - 1] = '\0';
+    auto resumed = join.sessionToken != 0 ? directory.seatsByToken.find(join.sessionToken) : directory.seatsByToken.end();
+    if (resumed != directory.seatsByToken.end()) {
+      uint64_t ref = resumed->second;
+      NetAddress &previous = directory.addresses[refShard(ref)][refRow(ref)];
+      auto stale = directory.seatsByAddress.find(addressKey(previous));
+      if (stale != directory.seatsByAddress.end() && stale->second == ref) {
+        directory.seatsByAddress.erase(stale);
+      }
+      previous = from;
+      directory.seatsByAddress[addressKey(from)] = ref;
+      ShardMessage message;
+      message.kind = ShardMessageKind::Resume;
+      message.match = refRow(ref) / SEATS;
+      message.seat = static_cast<uint8_t>(refRow(ref) % SEATS);
+      message.address = from;
+      message.receiveMs = receiveMs;
+      forward(server, stats, refShard(ref), message);
+      return;
+    }
+    if (directory.seatsByAddress.find(addressKey(from)) == directory.seatsByAddress.end()) {
+      seatNewPlayer(server, directory, stats, join, from, receiveMs);
+      return;
+    }
+  }
+  auto seated = directory.seatsByAddress.find(addressKey(from));
+  if (seated == directory.seatsByAddress.end()) {
+    return;
+  }
+  ShardMessage message;
+  message.kind = ShardMessageKind::Packet;
+  message.match = refRow(seated->second) / SEATS;
+  message.seat = static_cast<uint8_t>(refRow(seated->second) % SEATS);
+  message.address = from;
+  message.receiveUs = receiveUs;
+  message.receiveMs = receiveMs;
+  message.length = static_cast<uint8_t>(length);
+  memcpy(message.data, data, static_cast<size_t>(length));
+  forward(server, stats, refShard(seated->second), message);
+}
+
+void forgetSeat(Directory &directory, uint32_t shard, uint32_t row) {
+  uint64_t ref = seatRef(shard, 0, 0) | row;
+  auto found = directory.seatsByAddress.find(addressKey(directory.addresses[shard][row]));
+  if (found != directory.seatsByAddress.end() && found->second == ref) {
+    directory.seatsByAddress.erase(found);
+  }
+  directory.addresses[shard][row] = NetAddress();
+}
+
+void drainOutboxes(Server &server, Directory &directory) {
+  for (auto &worker : server.workers) {
+    DirectoryMessage message;
+    while (worker->outbox.pop(message)) {
+      uint32_t row = message.match * SEATS + message.seat;
+      if (message.kind == DirectoryMessageKind::SeatLeft) {
+        if (directory.addresses[message.shard][row] == message.address) {
+          forgetSeat(directory, message.shard, row);
+        }
+        continue;
+      }
+      for (size_t seat = 0; seat < SEATS; ++seat) {
+        uint32_t each = message.match * SEATS + static_cast<uint32_t>(seat);
+        forgetSeat(directory, message.shard, each);
+        uint32_t &token = directory.tokens[message.shard][each];
+        if (token != 0) {
+          directory.seatsByToken.erase(token);
+          token = 0;
+        }
+      }
+      if (directory.waiting == seatRef(message.shard, message.match, 0)) {
+        directory.waiting = UINT64_MAX;
+      }
+      directory.freeRows[message.shard].push_back(message.match);
+      --directory.loads[message.shard];
+    }
+  }
+}
+
+WorkerStats sumWorkerStats(const Server &server) {
+  WorkerStats total;
+  for (const auto &worker : server.workers) {
+    const WorkerStats &stats = worker->stats;
+    total.packetsOut += stats.packetsOut;
+    total.bytesOut += stats.bytesOut;
+    total.sendCalls += stats.sendCalls;
+    total.resumes += stats.resumes;
+    total.matchesStarted += stats.matchesStarted;
+    total.matchesFinished += stats.matchesFinished;
+    total.chunks += stats.chunks;
+    total.steals += stats.steals;
+  }
+  return total;
+}
+
+// Only between frames: the workers' tables are not being written then.
+void printReport(const Server &server, const Directory &directory, const DirectoryStats &stats) {
+  uint32_t playing = 0;
+  uint32_t waiting = 0;
+  uint32_t over = 0;
+  for (const auto &shard : server.shards) {
+    for (MatchPhase phase : shard->table.phases) {
+      playing += phase == MatchPhase::Playing ? 1 : 0;
+      waiting += phase == MatchPhase::Waiting ? 1 : 0;
+      over += phase == MatchPhase::GameOver ? 1 : 0;
+    }
+  }
+  WorkerStats workers = sumWorkerStats(server);
+  printf("server: matches %u playing %u over %u waiting %u shards", playing + over, playing, over, waiting);
+  for (size_t i = 0; i < directory.loads.size(); ++i) {
+    printf("%c%u", i == 0 ? ' ' : '/', directory.loads[i]);
+  }
+  printf(" | joins %u resumed %u refused %u started %u finished %u probes %u | in %u/%lluB %u calls out %u/%lluB %u calls"
+         " | qdrop %u steals %u/%u | frame avg %lluus max %uus late %u\n",
+         stats.joins, workers.resumes, stats.refused, workers.matchesStarted, workers.matchesFinished, stats.probes,
+         stats.packetsIn,
+         static_cast<unsigned long long>(stats.bytesIn), stats.receiveCalls, workers.packetsOut,
+         static_cast<unsigned long long>(workers.bytesOut), workers.sendCalls, stats.queueDrops, workers.steals,
+         workers.chunks, static_cast<unsigned long long>(stats.frames != 0 ? stats.frameUsTotal / stats.frames : 0),
+         stats.frameUsMax, stats.lateFrames);
+  fflush(stdout);
+}
+
+// -----------------------------------------------------------------------------
+// Serve ----------------------------------------------------------------------
+
+// Reads everything waiting, IO_BATCH datagrams per system call.
+void receiveAll(Server &server, Directory &directory, DirectoryStats &stats, int socket) {
+  static uint8_t buffers[IO_BATCH][MAX_DATAGRAM_SIZE];
+  static sockaddr_in sources[IO_BATCH];
+  static iovec vectors[IO_BATCH];
+  static mmsghdr messages[IO_BATCH];
+  for (;;) {
+    for (size_t i = 0; i < IO_BATCH; ++i) {
+      vectors[i].iov_base = buffers[i];
+      vectors[i].iov_len = sizeof(buffers[i]);
+      memset(&messages[i], 0, sizeof(messages[i]));
+      messages[i].msg_hdr.msg_name = &sources[i];
+      messages[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+      messages[i].msg_hdr.msg_iov = &vectors[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    int count = recvmmsg(socket, messages, IO_BATCH, MSG_DONTWAIT, nullptr);
+    ++stats.receiveCalls;
+    if (count <= 0) {
+      return;
+    }
+    uint32_t receiveUs = micros32();
+    uint32_t receiveMs = millis32();
+    for (int i = 0; i < count; ++i) {
+      unsigned length = messages[i].msg_len;
+      if (length == 0 || length >= MAX_DATAGRAM_SIZE || (messages[i].msg_hdr.msg_flags & MSG_TRUNC) != 0) {
+        continue;  // oversized, as in UdpSocketTransport
+      }
+      NetAddress from;
+      from.ip = ntohl(sources[i].sin_addr.s_addr);
+      from.port = ntohs(sources[i].sin_port);
+      routeDatagram(server, directory, stats, buffers[i], static_cast<int>(length), from, receiveUs, receiveMs);
+    }
+    if (static_cast<size_t>(count) < IO_BATCH) {
+      return;
+    }
+  }
+}
+
+int runServe(const Options &options) {
+  UdpSocketTransport socket;
+  if (!socket.bind(options.port)) {
+    fprintf(stderr, "pong_server: cannot bind UDP port %u\n", options.port);
+    return 1;
+  }
+  int poller = epoll_create1(0);
+  epoll_event watch{};
+  watch.events = EPOLLIN;
+  if (poller < 0 || epoll_ctl(poller, EPOLL_CTL_ADD, socket.descriptor(), &watch) != 0) {
+    fprintf(stderr, "pong_server: cannot set up epoll\n");
+    return 1;
+  }
+
+  uint32_t seed = static_cast<uint32_t>(monotonicUs());
+  Server server;
+  startServer(server, options.threads, options.matches, socket.descriptor(), seed);
+  server.finished.store(options.threads);
+  Directory directory;
+  directoryInit(directory, options.threads, options.matches, seed ^ 0x5bd1e995u);
+  directory.socket = socket.descriptor();
+  directory.lobbyId = std::random_device()();
+  DirectoryStats stats;
+  printf("server: %u threads x %u matches on port %u\n", options.threads, options.matches, options.port);
+
+  SimClock clock;
+  uint64_t startUs = monotonicUs();
+  uint64_t nextFrameUs = startUs;
+  uint64_t lastFrameUs = startUs;
+  uint64_t frameStartedUs = 0;
+  bool frameRunning = false;
+  uint32_t lastReportMs = millis32();
+  uint32_t lastBeaconMs = lastReportMs - LOBBY_BEACON_INTERVAL_MS;  // due straight away
+  while (options.seconds == 0 || monotonicUs() - startUs < options.seconds * 1000000ull) {
+    uint64_t nowUs = monotonicUs();
+    int waitMs = nextFrameUs > nowUs ? static_cast<int>((nextFrameUs - nowUs + 999) / 1000) : (frameRunning ? 1 : 0);
+    epoll_event ready;
+    if (epoll_wait(poller, &ready, 1, waitMs) > 0) {
+      receiveAll(server, directory, stats, socket.descriptor());
+    }
+    drainOutboxes(server, directory);
+    if (millis32() - lastBeaconMs >= LOBBY_BEACON_INTERVAL_MS) {
+      lastBeaconMs = millis32();
+      sendBeacon(directory, socket, options.beaconTo);
+    }
+
+    nowUs = monotonicUs();
+    if (frameRunning && frameIdle(server)) {
+      frameRunning = false;
+      uint32_t costUs = static_cast<uint32_t>(frameDoneUs(server) - frameStartedUs);
+      ++stats.frames;
+      stats.frameUsTotal += costUs;
+      stats.frameUsMax = std::max(stats.frameUsMax, costUs);
+      uint32_t nowMs = millis32();
+      if (nowMs - lastReportMs >= REPORT_INTERVAL_MS) {
+        lastReportMs = nowMs;
+        printReport(server, directory, stats);
+        stats.frameUsMax = 0;
+      }
+    }
+    if (nowUs < nextFrameUs) {
+      continue;
+    }
+    if (frameRunning) {
+      ++stats.lateFrames;
+      nextFrameUs = nowUs + FRAME_US / 4;  // look again shortly
+      continue;
+    }
+    if (nowUs - nextFrameUs >= FRAME_US) {
+      nextFrameUs = nowUs;  // do not try to catch up a stall frame by frame
+    }
+    nextFrameUs += FRAME_US;
+    uint32_t ticks = simClockAdvance(clock, static_cast<uint32_t>(nowUs - lastFrameUs));
+    lastFrameUs = nowUs;
+    frameStartedUs = nowUs;
+    frameRunning = true;
+    beginFrame(server, ticks, static_cast<uint32_t>(nowUs / 1000));
+  }
+  while (!frameIdle(server)) {
+    std::this_thread::yield();
+  }
+  stopServer(server);
+  return 0;
+}
+
+// -----------------------------------------------------------------------------
+// Bench ----------------------------------------------------------------------
+
+struct BenchResult {
+  double matchFramesPerSecond = 0.0;
+  uint32_t p99Us = 0;
+  uint32_t steals = 0;
+  uint32_t chunks = 0;
+  uint64_t bytesOut = 0;
+};
+
+// Runs `seconds` of 60 Hz frames back to back over `matches` bot matches on
+// `threads` workers, spread evenly or all on shard 0, sending to sink.
+BenchResult benchRun(uint32_t matches, uint32_t threads, bool skewed, uint32_t seconds, int sendSocket,
+                     const NetAddress &sink) {
+  Server server;
+  server.bots = true;
+  uint32_t perShard = skewed ? matches : (matches + threads - 1) / threads;
+  startServer(server, threads, perShard, sendSocket, 12345);
+  for (uint32_t i = 1; skewed && i < threads; ++i) {
+    matchTableInit(server.shards[i]->table, 0);  // nothing of their own; their workers only steal
+  }
+  for (uint32_t i = 0; i < matches; ++i) {
+    Shard &shard = *server.shards[skewed ? 0 : i % threads];
+    uint32_t match = skewed ? i : i / threads;
+    ShardMessage message;
+    message.kind = ShardMessageKind::Seat;
+    message.match = match;
+    message.address = sink;
+    memcpy(message.data, "bot", 4);
+    for (uint8_t seat = 0; seat < SEATS; ++seat) {
+      message.seat = seat;
+      fillSeat(*server.workers[0], shard, message);
+    }
+  }
+  server.workers[0]->batch.count = 0;  // the handshakes are not part of the measurement
+  server.workers[0]->stats = WorkerStats();
+
+  uint32_t frames = seconds * 60;
+  uint32_t ticksPerFrame = SIM_TICK_HZ / 60;
+  std::vector<uint32_t> latencies;
+  latencies.reserve(frames);
+  uint64_t wallStartUs = monotonicUs();
+  for (uint32_t frame = 1; frame <= frames; ++frame) {
+    uint64_t startUs = monotonicUs();
+    beginFrame(server, ticksPerFrame, frame * FRAME_US / 1000);
+    while (!frameIdle(server)) {
+      std::this_thread::yield();
+    }
+    latencies.push_back(static_cast<uint32_t>(frameDoneUs(server) - startUs));
+  }
+  uint64_t wallUs = monotonicUs() - wallStartUs;
+  stopServer(server);
+
+  std::sort(latencies.begin(), latencies.end());
+  WorkerStats totals = sumWorkerStats(server);
+  BenchResult result;
+  result.matchFramesPerSecond = static_cast<double>(matches) * frames * 1e6 / static_cast<double>(wallUs);
+  result.p99Us = latencies[latencies.size() * 99 / 100];
+  result.steals = totals.steals;
+  result.chunks = totals.chunks;
+  result.bytesOut = totals.bytesOut;
+  return result;
+}
+
+int runBench(const Options &options) {
+  // Everything goes to one local port nobody reads; the kernel drops what
+  // overflows its buffer, which keeps the send cost real.
+  UdpSocketTransport sender;
+  UdpSocketTransport sinkSocket;
+  if (!sender.bind(0) || !sinkSocket.bind(0)) {
+    fprintf(stderr, "pong_server: cannot open bench sockets\n");
+    return 1;
+  }
+  NetAddress sink = netAddress(127, 0, 0, 1, sinkSocket.localPort());
+  std::vector<uint32_t> threadCounts;
+  for (uint32_t threads = 1; threads < options.threads; threads *= 2) {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(options.threads);
+
+  printf("server bench: %u s of 60 Hz frames, %u sim ticks each, bots on both paddles, %u hardware threads\n",
+         options.seconds, SIM_TICK_HZ / 60, std::thread::hardware_concurrency());
+  for (uint32_t matches : options.benchMatches) {
+    double single = 0.0;
+    for (uint32_t threads : threadCounts) {
+      BenchResult even = benchRun(matches, threads, false, options.seconds, sender.descriptor(), sink);
+      BenchResult skewed = benchRun(matches, threads, true, options.seconds, sender.descriptor(), sink);
+      if (single == 0.0) {
+        single = even.matchFramesPerSecond;
+      }
+      printf("%6u matches %2u threads: %9.0f match-frames/s = %6.0f at 60 Hz (x%.2f) p99 %6uus %5.0f B/s per match"
+             " | all on one shard: %6.0f at 60 Hz p99 %6uus stole %u/%u chunks\n",
+             matches, threads, even.matchFramesPerSecond, even.matchFramesPerSecond / 60.0,
+             even.matchFramesPerSecond / single, even.p99Us,
+             static_cast<double>(even.bytesOut) / options.seconds / matches, skewed.matchFramesPerSecond / 60.0,
+             skewed.p99Us, skewed.steals, skewed.chunks);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage();
+    return 2;
+  }
+  return options.mode == Mode::Serve ? runServe(options) : runBench(options);
+}
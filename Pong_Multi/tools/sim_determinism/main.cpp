@@ -0,0 +1,176 @@
+// Plays a fixed seed and a scripted input stream through the simulation and
+// compares simStateHash() frame by frame, so two builds of the same number
+// type (different compilers or optimisation levels, x86-64 and AArch64) can
+// be checked against each other. Float and Q16.16 runs never match.
+//
+//   sim_determinism [--seed N] [--ticks N] [--record PATH | --check PATH]
+//
+// --record writes one "tick hash" line per tick; --check replays and stops at
+// the first tick whose hash differs from the file, exiting 1. With the default
+// seed and length the run is also checked against the checkpoints recorded
+// below, so a plain run fails on its own when the sequence drifts.
+
+#include <pong_sim.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+constexpr uint32_t DEFAULT_SEED = 20240611;
+constexpr uint32_t DEFAULT_TICKS = 10 * 60 * SIM_TICK_HZ;  // ten minutes of play
+constexpr uint32_t CHECKPOINT_TICKS = 60 * SIM_TICK_HZ;
+constexpr size_t CHECKPOINT_COUNT = DEFAULT_TICKS / CHECKPOINT_TICKS;
+
+// simStateHash() at every minute of the default run. The float sequence holds
+// for IEEE single precision without fused multiply-add contraction (the env
+// builds with -ffp-contract=off); the Q16.16 one holds everywhere.
+#if PONG_SIM_FIXED_POINT
+const uint32_t GOLDEN[CHECKPOINT_COUNT] = {
+    0x165cb42cu, 0x384f9660u, 0x7ea8dd27u, 0xb77bace5u, 0x8bf48bf1u,
+    0x3a6203fbu, 0x7be8fc9cu, 0xd6a2490bu, 0xcb41430du, 0xd86b8282u,
+};
+#else
+const uint32_t GOLDEN[CHECKPOINT_COUNT] = {
+    0x42d68747u, 0x1e62cfc9u, 0x62d768f7u, 0x96172200u, 0xc2202381u,
+    0x5598d4c0u, 0x5a78627au, 0x4257a9aeu, 0xdacb63a8u, 0xab30aaf5u,
+};
+#endif
+
+// Both players' key presses: each holds a direction for a random stretch of
+// ticks. Drawn from its own xorshift so it never depends on the simulation.
+struct InputScript {
+  uint32_t rng;
+  SimInput input;
+  uint32_t hostTicksLeft = 0;
+  uint32_t clientTicksLeft = 0;
+
+  uint32_t next() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+  }
+
+  SimInput step() {
+    if (hostTicksLeft == 0) {
+      input.hostPaddleDir = static_cast<int8_t>(static_cast<int>(next() % 3) - 1);
+      hostTicksLeft = 1 + next() % 48;
+    }
+    if (clientTicksLeft == 0) {
+      input.clientPaddleDir = static_cast<int8_t>(static_cast<int>(next() % 3) - 1);
+      clientTicksLeft = 1 + next() % 48;
+    }
+    --hostTicksLeft;
+    --clientTicksLeft;
+    return input;
+  }
+};
+
+struct Match {
+  SimState sim;
+  InputScript script;
+  uint32_t matches = 1;
+  uint32_t paddleHits = 0;
+};
+
+void startMatch(Match &match, uint32_t seed) {
+  simResetMatch(match.sim);
+  simSeed(match.sim, seed);
+  simPrepareServe(match.sim, 1);
+  match.script.rng = seed ^ 0xA5A5A5A5u;
+}
+
+// One tick of play; a finished match is followed by a rematch, like the host
+// pressing Space, so the run never idles.
+uint32_t stepMatch(Match &match) {
+  uint8_t events = simStep(match.sim, match.script.step());
+  if (events & SIM_EVENT_PADDLE_HIT) {
+    ++match.paddleHits;
+  }
+  uint32_t hash = simStateHash(match.sim);
+  if (events & SIM_EVENT_GAME_OVER) {
+    int direction = match.sim.hostScore > match.sim.clientScore ? -1 : 1;
+    simResetMatch(match.sim);
+    simPrepareServe(match.sim, direction);
+    ++match.matches;
+  }
+  return hash;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  uint32_t seed = DEFAULT_SEED;
+  uint32_t ticks = DEFAULT_TICKS;
+  const char *recordPath = nullptr;
+  const char *checkPath = nullptr;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--seed") == 0) {
+      seed = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+    } else if (strcmp(argv[i], "--ticks") == 0) {
+      ticks = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+    } else if (strcmp(argv[i], "--record") == 0) {
+      recordPath = argv[i + 1];
+    } else if (strcmp(argv[i], "--check") == 0) {
+      checkPath = argv[i + 1];
+    } else {
+      fprintf(stderr, "usage: sim_determinism [--seed N] [--ticks N] [--record PATH | --check PATH]\n");
+      return 2;
+    }
+  }
+  if (recordPath != nullptr && checkPath != nullptr) {
+    fprintf(stderr, "sim_determinism: --record and --check are exclusive\n");
+    return 2;
+  }
+
+  FILE *file = nullptr;
+  if (recordPath != nullptr || checkPath != nullptr) {
+    file = fopen(recordPath != nullptr ? recordPath : checkPath, recordPath != nullptr ? "w" : "r");
+    if (file == nullptr) {
+      perror(recordPath != nullptr ? recordPath : checkPath);
+      return 2;
+    }
+  }
+
+  printf("%s sim, seed %u, %u ticks\n", PONG_SIM_FIXED_POINT ? "Q16.16" : "float", seed, ticks);
+  bool useGolden = seed == DEFAULT_SEED && ticks == DEFAULT_TICKS;
+  Match match;
+  startMatch(match, seed);
+  int failures = 0;
+  for (uint32_t tick = 1; tick <= ticks; ++tick) {
+    uint32_t hash = stepMatch(match);
+    if (recordPath != nullptr) {
+      fprintf(file, "%u %08" PRIx32 "\n", tick, hash);
+    } else if (checkPath != nullptr) {
+      unsigned fileTick = 0;
+      uint32_t fileHash = 0;
+      if (fscanf(file, "%u %" SCNx32, &fileTick, &fileHash) != 2 || fileTick != tick) {
+        printf("%s ends before tick %u\n", checkPath, tick);
+        ++failures;
+        break;
+      }
+      if (fileHash != hash) {
+        printf("tick %u: hash %08" PRIx32 ", %s has %08" PRIx32 "\n", tick, hash, checkPath, fileHash);
+        ++failures;
+        break;
+      }
+    }
+    if (tick % CHECKPOINT_TICKS == 0) {
+      size_t index = tick / CHECKPOINT_TICKS - 1;
+      bool mismatch = useGolden && GOLDEN[index] != hash;
+      printf("tick %6u  hash %08" PRIx32 "%s\n", tick, hash, mismatch ? "  differs from the recorded run" : "");
+      if (mismatch) {
+        ++failures;
+      }
+    }
+  }
+  if (file != nullptr) {
+    fclose(file);
+  }
+  printf("%u matches, %u paddle hits, %s\n", match.matches, match.paddleHits,
+         failures == 0 ? "deterministic" : "DIVERGED");
+  return failures == 0 ? 0 : 1;
+}
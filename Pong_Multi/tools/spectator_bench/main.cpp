@@ -0,0 +1,338 @@
+// What spectators cost the host: plays a self-play match through the real
+// state path (send policy, delta codec, sockets) and hands every state packet
+// to S spectators two ways: once to a multicast group they all joined, as the
+// firmware does, or once per spectator, as a unicast relay would. For each S
+// it prints the packets and bytes the host sends, the host CPU spent encoding
+// and sending them, the estimated 802.11 airtime, and how many of the states
+// every spectator decoded.
+//
+//   spectator_bench [--spectators 0,1,5,10,20,50] [--seconds S] [--seed N]
+//
+// Everything runs on loopback, so the kernel delivers to the spectators
+// inside the host's send call: the CPU figures include that work for both
+// modes. The match runs in simulated time, as fast as the machine allows.
+
+#include <pong_sim.h>
+#include <protocol.h>
+#include <sequence_tracker.h>
+#include <state_codec.h>
+#include <state_send_policy.h>
+#include <udp_socket_transport.h>
+
+#include <time.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// -----------------------------------------------------------------------------
+// Airtime model --------------------------------------------------------------
+// 802.11g/n OFDM in the 2.4 GHz band, both devices on one access point, so
+// every packet takes two hops: up to the AP and down to the receiver. Unicast
+// goes at a typical data rate and is acknowledged; the AP sends multicast
+// downstream once, unacknowledged, at a basic rate, 6 Mbps or, on APs that
+// keep 802.11b rates, 1 Mbps DSSS.
+
+constexpr double UNICAST_MBPS = 24.0;
+constexpr double MULTICAST_MBPS = 6.0;
+constexpr double SLOT_US = 9.0;
+constexpr double SIFS_US = 10.0;
+constexpr double DIFS_US = SIFS_US + 2 * SLOT_US;
+constexpr double BACKOFF_US = 7.5 * SLOT_US;  // mean of CWmin 15
+constexpr double OFDM_PREAMBLE_US = 20.0;
+constexpr double DSSS_PREAMBLE_US = 192.0;   // long preamble, 1 Mbps
+constexpr double DSSS_ACCESS_US = 50.0 + 15.5 * 20.0;  // DIFS and mean backoff with 20 us slots
+constexpr size_t FRAME_OVERHEAD_BYTES = 24 + 8 + 20 + 8 + 4;  // MAC header, LLC/SNAP, IPv4, UDP, FCS
+constexpr size_t ACK_BYTES = 14;
+
+double ofdmUs(size_t bytes, double mbps) {
+  double bitsPerSymbol = 4.0 * mbps;
+  return OFDM_PREAMBLE_US + 4.0 * std::ceil((16.0 + 6.0 + 8.0 * static_cast<double>(bytes)) / bitsPerSymbol);
+}
+
+double unicastHopUs(size_t payload) {
+  return DIFS_US + BACKOFF_US + ofdmUs(payload + FRAME_OVERHEAD_BYTES, UNICAST_MBPS) + SIFS_US +
+         ofdmUs(ACK_BYTES, UNICAST_MBPS);
+}
+
+double multicastHopUs(size_t payload, bool dsss) {
+  if (dsss) {
+    return DSSS_ACCESS_US + DSSS_PREAMBLE_US + 8.0 * static_cast<double>(payload + FRAME_OVERHEAD_BYTES);
+  }
+  return DIFS_US + BACKOFF_US + ofdmUs(payload + FRAME_OVERHEAD_BYTES, MULTICAST_MBPS);
+}
+
+// -----------------------------------------------------------------------------
+// Bench ----------------------------------------------------------------------
+
+constexpr uint32_t LOOPBACK = 0x7F000001u;
+
+enum class FanOut : uint8_t {
+  Multicast,
+  Unicast,
+};
+
+struct Options {
+  std::vector<uint32_t> spectators{0, 1, 5, 10, 20, 50};
+  uint32_t seconds = 60;
+  uint32_t seed = 12345;
+};
+
+struct Spectator {
+  UdpSocketTransport socket;
+  StateHistory received;
+  SequenceTracker sequence;
+  uint32_t decoded = 0;
+};
+
+struct RunResult {
+  uint32_t stateSends = 0;  // states the match produced
+  uint32_t hostPackets = 0;
+  uint64_t hostBytes = 0;
+  uint64_t cpuNs = 0;
+  double airUs = 0.0;      // unicast, or multicast at MULTICAST_MBPS
+  double airDsssUs = 0.0;  // multicast at 1 Mbps
+  uint64_t decoded = 0;
+  uint64_t expected = 0;
+};
+
+uint64_t threadCpuNs() {
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+}
+
+bool parseList(const char *text, std::vector<uint32_t> &out) {
+  out.clear();
+  while (*text != '\0') {
+    char *end = nullptr;
+    unsigned long value = strtoul(text, &end, 10);
+    if (end == text) {
+      return false;
+    }
+    out.push_back(static_cast<uint32_t>(value));
+    text = *end == ',' ? end + 1 : end;
+  }
+  return !out.empty();
+}
+
+int directionTo(SimScalar paddleY, SimScalar targetY) {
+  float delta = simToFloat(targetY) - simToFloat(paddleY);
+  return delta < -3.0f ? -1 : (delta > 3.0f ? 1 : 0);
+}
+
+void fillFrame(const SimState &sim, uint32_t frameId, uint32_t nowMs, StateFrame &frame) {
+  frame.flags = (sim.matchActive ? FLAG_MATCH_ACTIVE : 0) | (sim.waitingForServe ? FLAG_WAITING_SERVE : 0);
+  frame.hostScore = sim.hostScore;
+  frame.clientScore = sim.clientScore;
+  frame.frameId = frameId;
+  frame.hostTimeMs = nowMs;
+  frame.ballX = quantizePosition(simToFloat(sim.ballX));
+  frame.ballY = quantizePosition(simToFloat(sim.ballY));
+  frame.ballVX = quantizeVelocity(simToFloat(sim.ballVX));
+  frame.ballVY = quantizeVelocity(simToFloat(sim.ballVY));
+  frame.hostPaddleY = quantizePosition(simToFloat(sim.hostPaddleY));
+  frame.clientPaddleY = quantizePosition(simToFloat(sim.clientPaddleY));
+}
+
+// Reads everything waiting for one spectator and decodes it like the device.
+void drainSpectator(Spectator &spectator) {
+  uint8_t buffer[MAX_DATAGRAM_SIZE];
+  NetAddress from;
+  int length;
+  while ((length = spectator.socket.receive(buffer, sizeof(buffer), from)) > 0) {
+    StateFrame frame;
+    if (stateDecode(buffer, static_cast<size_t>(length), spectator.received, spectator.sequence.newest, frame) !=
+        StateDecodeResult::Ok) {
+      continue;
+    }
+    if (sequenceTrack(spectator.sequence, frame.frameId) == SequenceVerdict::Newer) {
+      stateHistoryPush(spectator.received, frame);
+      ++spectator.decoded;
+    }
+  }
+}
+
+void drainSink(UdpSocketTransport &socket) {
+  uint8_t buffer[MAX_DATAGRAM_SIZE];
+  NetAddress from;
+  while (socket.receive(buffer, sizeof(buffer), from) > 0) {
+  }
+}
+
+bool runMatch(const Options &options, uint32_t spectatorCount, FanOut fanOut, RunResult &result) {
+  UdpSocketTransport host;
+  UdpSocketTransport client;  // the player: acknowledges every state at once
+  host.setMulticastInterface(LOOPBACK);
+  if (!host.bind(0) || !client.bind(0)) {
+    return false;
+  }
+  NetAddress clientAddress = netAddress(127, 0, 0, 1, client.localPort());
+  NetAddress group;
+  group.ip = spectateGroupIp(options.seed);
+  group.port = SPECTATE_PORT;
+
+  std::vector<std::unique_ptr<Spectator>> spectators;
+  std::vector<NetAddress> spectatorAddresses;
+  for (uint32_t i = 0; i < spectatorCount; ++i) {
+    spectators.emplace_back(new Spectator());
+    Spectator &spectator = *spectators.back();
+    spectator.socket.setMulticastInterface(LOOPBACK);
+    if (!spectator.socket.bind(0)) {
+      return false;
+    }
+    if (fanOut == FanOut::Multicast && !spectator.socket.joinGroup(group)) {
+      return false;
+    }
+    spectatorAddresses.push_back(netAddress(127, 0, 0, 1, spectator.socket.localPort()));
+  }
+
+  SimState sim;
+  simResetMatch(sim);
+  simSeed(sim, options.seed);
+  simPrepareServe(sim, 1);
+  StateSendPolicy policy;
+  sendPolicyReset(policy);
+  StateHistory sent;
+  uint32_t frameCounter = 0;
+  uint32_t ackFrameId = 0;
+
+  result = RunResult();
+  uint32_t totalTicks = options.seconds * SIM_TICK_HZ;
+  for (uint32_t tick = 1; tick <= totalTicks; ++tick) {
+    SimInput input;
+    input.hostPaddleDir = static_cast<int8_t>(directionTo(sim.hostPaddleY, sim.ballY));
+    input.clientPaddleDir = static_cast<int8_t>(tick % 3 == 0 ? 0 : directionTo(sim.clientPaddleY, sim.ballY));
+    uint8_t events = simStep(sim, input);
+    sendPolicyNoteEvents(policy, events);
+    if (events & SIM_EVENT_GAME_OVER) {
+      simResetMatch(sim);
+      simPrepareServe(sim, 1);
+    }
+    uint32_t nowMs = static_cast<uint32_t>(static_cast<uint64_t>(tick) * 1000 / SIM_TICK_HZ);
+    StateSendReason reason = sendPolicyCheck(policy, sim, nowMs);
+    if (reason == StateSendReason::None) {
+      continue;
+    }
+    StateFrame frame;
+    fillFrame(sim, ++frameCounter, nowMs, frame);
+
+    uint64_t startNs = threadCpuNs();
+    uint8_t packet[STATE_PACKET_MAX];
+    const StateFrame *baseline = ackFrameId != 0 ? stateHistoryFind(sent, ackFrameId) : nullptr;
+    size_t length = stateEncode(frame, baseline, packet, sizeof(packet));
+    stateHistoryPush(sent, frame);
+    host.sendTo(clientAddress, packet, length);
+    uint32_t packets = 1;
+    if (spectatorCount != 0 && fanOut == FanOut::Multicast) {
+      host.sendTo(group, packet, length);
+      ++packets;
+    } else {
+      for (const NetAddress &address : spectatorAddresses) {
+        host.sendTo(address, packet, length);
+        ++packets;
+      }
+    }
+    result.cpuNs += threadCpuNs() - startNs;
+    sendPolicySent(policy, sim, nowMs, reason);
+    ackFrameId = frame.frameId;
+
+    ++result.stateSends;
+    result.hostPackets += packets;
+    result.hostBytes += packets * length;
+    // The player's stream and any unicast copies: up to the AP and down again.
+    uint32_t unicastCopies = fanOut == FanOut::Unicast ? spectatorCount : 0;
+    double airUs = 2.0 * (1 + unicastCopies) * unicastHopUs(length);
+    double airDsssUs = airUs;
+    if (fanOut == FanOut::Multicast && spectatorCount != 0) {
+      airUs += unicastHopUs(length) + multicastHopUs(length, false);
+      airDsssUs += unicastHopUs(length) + multicastHopUs(length, true);
+    }
+    result.airUs += airUs;
+    result.airDsssUs += airDsssUs;
+
+    drainSink(client);
+    for (auto &spectator : spectators) {
+      drainSpectator(*spectator);
+    }
+  }
+  for (auto &spectator : spectators) {
+    drainSpectator(*spectator);
+    result.decoded += spectator->decoded;
+  }
+  result.expected = static_cast<uint64_t>(result.stateSends) * spectatorCount;
+  return true;
+}
+
+void printRow(uint32_t spectators, const char *mode, const RunResult &result, uint32_t seconds, bool dsss) {
+  double perSecond = 1.0 / static_cast<double>(seconds);
+  char air[32];
+  if (dsss) {
+    snprintf(air, sizeof(air), "%.1f (%.1f)", result.airUs * perSecond / 1000.0,
+             result.airDsssUs * perSecond / 1000.0);
+  } else {
+    snprintf(air, sizeof(air), "%.1f", result.airUs * perSecond / 1000.0);
+  }
+  char delivered[16];
+  if (result.expected != 0) {
+    snprintf(delivered, sizeof(delivered), "%.1f%%",
+             100.0 * static_cast<double>(result.decoded) / static_cast<double>(result.expected));
+  } else {
+    snprintf(delivered, sizeof(delivered), "-");
+  }
+  printf("%10u %-10s %9.1f %9.0f %10.0f %9.2f %16s %10s\n", spectators, mode, result.hostPackets * perSecond,
+         static_cast<double>(result.hostBytes) * perSecond, static_cast<double>(result.cpuNs) / 1000.0 * perSecond,
+         static_cast<double>(result.cpuNs) / 1000.0 / result.stateSends, air, delivered);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--spectators") == 0) {
+      if (!parseList(argv[i + 1], options.spectators)) {
+        fprintf(stderr, "spectator_bench: bad --spectators list\n");
+        return 2;
+      }
+    } else if (strcmp(argv[i], "--seconds") == 0) {
+      options.seconds = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+    } else if (strcmp(argv[i], "--seed") == 0) {
+      options.seed = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+    } else {
+      fprintf(stderr, "usage: spectator_bench [--spectators 0,1,5,10,20,50] [--seconds S] [--seed N]\n");
+      return 2;
+    }
+  }
+  if (options.seconds == 0) {
+    options.seconds = 1;
+  }
+
+  printf("%u s of self-play per row; airtime: unicast %.0f Mbps with ACK, multicast %.0f Mbps (1 Mbps DSSS)\n",
+         options.seconds, UNICAST_MBPS, MULTICAST_MBPS);
+  printf("%10s %-10s %9s %9s %10s %9s %16s %10s\n", "spectators", "fan-out", "pkts/s", "B/s", "host us/s", "us/state",
+         "air ms/s", "delivered");
+  int failures = 0;
+  for (uint32_t count : options.spectators) {
+    RunResult multicast;
+    RunResult unicast;
+    if (!runMatch(options, count, FanOut::Multicast, multicast) || !runMatch(options, count, FanOut::Unicast, unicast)) {
+      fprintf(stderr, "spectator_bench: socket setup failed for %u spectators\n", count);
+      ++failures;
+      continue;
+    }
+    if (count == 0) {
+      printRow(count, "none", unicast, options.seconds, false);
+      continue;
+    }
+    printRow(count, "multicast", multicast, options.seconds, true);
+    printRow(count, "unicast", unicast, options.seconds, false);
+    failures += multicast.decoded != multicast.expected ? 1 : 0;
+  }
+  return failures == 0 ? 0 : 1;
+}
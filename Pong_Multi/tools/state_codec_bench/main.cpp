@@ -0,0 +1,219 @@
+// Measures the state packet codec on a recorded self-play match: bytes per
+// second against the old fixed 38-byte StatePacket, and encode/decode time per
+// packet. Every decoded frame is checked against the one that was encoded.
+//
+//   state_codec_bench [--seconds S] [--seed N]
+
+#include <pong_sim.h>
+#include <state_codec.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t TICKS_PER_PACKET = 8;  // 240 Hz sim, ~30 packets/s like the firmware
+constexpr size_t LEGACY_PACKET_SIZE = 38;  // packed float StatePacket before delta encoding
+constexpr int TIMING_ROUNDS = 50;
+
+struct Scenario {
+  const char *name;
+  uint32_t ackLagFrames;  // frames between the client receiving a state and the host seeing its ack
+  uint32_t lossPercent;
+  bool keyframesOnly;
+};
+
+const Scenario SCENARIOS[] = {
+    {"keyframes only", 0, 0, true},
+    {"delta, ack lag 1", 1, 0, false},
+    {"delta, ack lag 3", 3, 0, false},
+    {"delta, ack lag 3, 10% loss", 3, 10, false},
+    {"delta, ack lag 8, 30% loss", 8, 30, false},
+};
+
+int directionTo(SimScalar paddleY, SimScalar targetY) {
+  float delta = simToFloat(targetY) - simToFloat(paddleY);
+  return delta < -3.0f ? -1 : (delta > 3.0f ? 1 : 0);
+}
+
+// Self-play with both paddles chasing the ball, sampled every packet interval.
+std::vector<StateFrame> recordMatch(uint32_t seconds, uint32_t seed) {
+  std::vector<StateFrame> frames;
+  SimState sim;
+  simResetMatch(sim);
+  simSeed(sim, seed);
+  simPrepareServe(sim, 1);
+  uint32_t totalTicks = seconds * SIM_TICK_HZ;
+  for (uint32_t tick = 1; tick <= totalTicks; ++tick) {
+    SimInput input;
+    // A little lag on the client side so points actually get scored.
+    input.hostPaddleDir = static_cast<int8_t>(directionTo(sim.hostPaddleY, sim.ballY));
+    input.clientPaddleDir = static_cast<int8_t>(tick % 3 == 0 ? 0 : directionTo(sim.clientPaddleY, sim.ballY));
+    uint8_t events = simStep(sim, input);
+    if (events & SIM_EVENT_GAME_OVER) {
+      simResetMatch(sim);
+      simPrepareServe(sim, 1);
+    }
+    if (tick % TICKS_PER_PACKET != 0) {
+      continue;
+    }
+    StateFrame frame;
+    frame.frameId = static_cast<uint32_t>(frames.size() + 1);
+    frame.hostTimeMs = tick * 1000 / SIM_TICK_HZ;
+    frame.ackInputSeq = static_cast<uint16_t>(tick / TICKS_PER_PACKET / 2);
+    frame.flags = sim.matchActive ? 0x01 : 0;
+    frame.hostScore = sim.hostScore;
+    frame.clientScore = sim.clientScore;
+    frame.ballX = quantizePosition(simToFloat(sim.ballX));
+    frame.ballY = quantizePosition(simToFloat(sim.ballY));
+    frame.ballVX = quantizeVelocity(simToFloat(sim.ballVX));
+    frame.ballVY = quantizeVelocity(simToFloat(sim.ballVY));
+    frame.hostPaddleY = quantizePosition(simToFloat(sim.hostPaddleY));
+    frame.clientPaddleY = quantizePosition(simToFloat(sim.clientPaddleY));
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+bool sameFrame(const StateFrame &a, const StateFrame &b) {
+  return a.frameId == b.frameId && a.hostTimeMs == b.hostTimeMs && a.ackInputSeq == b.ackInputSeq &&
+         a.flags == b.flags && a.hostScore == b.hostScore && a.clientScore == b.clientScore && a.ballX == b.ballX &&
+         a.ballY == b.ballY && a.ballVX == b.ballVX && a.ballVY == b.ballVY && a.hostPaddleY == b.hostPaddleY &&
+         a.clientPaddleY == b.clientPaddleY;
+}
+
+struct Encoded {
+  uint8_t data[STATE_PACKET_MAX];
+  size_t length;
+  bool delivered;
+};
+
+// Plays the link once: host encodes against the newest ack it has seen, the
+// client decodes what survives the loss and acks it ackLagFrames later.
+bool runLink(const Scenario &scenario, const std::vector<StateFrame> &frames, std::vector<Encoded> &packets,
+             uint32_t &mismatches) {
+  StateHistory sent;
+  StateHistory received;
+  std::vector<uint32_t> ackAtFrame(frames.size() + scenario.ackLagFrames + 1, 0);
+  uint32_t hostAck = 0;
+  uint32_t clientNewest = 0;
+  uint32_t rng = 0x2545F491u;
+  packets.assign(frames.size(), Encoded());
+  mismatches = 0;
+
+  for (size_t i = 0; i < frames.size(); ++i) {
+    if (ackAtFrame[i] != 0) {
+      hostAck = ackAtFrame[i];
+    }
+    const StateFrame *baseline =
+        scenario.keyframesOnly || hostAck == 0 ? nullptr : stateHistoryFind(sent, hostAck);
+    Encoded &packet = packets[i];
+    packet.length = stateEncode(frames[i], baseline, packet.data, sizeof(packet.data));
+    if (packet.length == 0) {
+      return false;
+    }
+    stateHistoryPush(sent, frames[i]);
+
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    packet.delivered = rng % 100 >= scenario.lossPercent;
+    if (!packet.delivered) {
+      continue;
+    }
+    StateFrame decoded;
+    if (stateDecode(packet.data, packet.length, received, clientNewest, decoded) != StateDecodeResult::Ok ||
+        !sameFrame(decoded, frames[i])) {
+      ++mismatches;
+      continue;
+    }
+    stateHistoryPush(received, decoded);
+    clientNewest = decoded.frameId;
+    ackAtFrame[i + scenario.ackLagFrames] = clientNewest;
+  }
+  return true;
+}
+
+double nanosecondsSince(std::chrono::steady_clock::time_point start, size_t operations) {
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+  return static_cast<double>(elapsed.count()) / static_cast<double>(operations);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  uint32_t seconds = 120;
+  uint32_t seed = 12345;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--seconds") == 0) {
+      seconds = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+    } else if (strcmp(argv[i], "--seed") == 0) {
+      seed = static_cast<uint32_t>(strtoul(argv[i + 1], nullptr, 10));
+    } else {
+      fprintf(stderr, "usage: state_codec_bench [--seconds S] [--seed N]\n");
+      return 2;
+    }
+  }
+
+  std::vector<StateFrame> frames = recordMatch(seconds, seed);
+  double packetsPerSecond = static_cast<double>(SIM_TICK_HZ) / TICKS_PER_PACKET;
+  printf("%zu frames, %.1f packets/s\n", frames.size(), packetsPerSecond);
+  printf("%-28s %7s %9s %9s %11s %11s\n", "scenario", "avg B", "B/s", "vs 38 B", "encode ns", "decode ns");
+  printf("%-28s %7zu %9.0f %8.0f%% %11s %11s\n", "legacy StatePacket", LEGACY_PACKET_SIZE,
+         LEGACY_PACKET_SIZE * packetsPerSecond, 100.0, "-", "-");
+
+  int failures = 0;
+  std::vector<Encoded> packets;
+  for (const Scenario &scenario : SCENARIOS) {
+    uint32_t mismatches = 0;
+    if (!runLink(scenario, frames, packets, mismatches)) {
+      printf("%-28s encode overflow\n", scenario.name);
+      ++failures;
+      continue;
+    }
+    size_t totalBytes = 0;
+    for (const Encoded &packet : packets) {
+      totalBytes += packet.length;
+    }
+    double averageBytes = static_cast<double>(totalBytes) / static_cast<double>(packets.size());
+
+    // Timing reruns the same work without the bookkeeping around it.
+    StateHistory history;
+    for (const StateFrame &frame : frames) {
+      stateHistoryPush(history, frame);
+    }
+    const StateFrame &baseline = frames[frames.size() - 2];
+    const StateFrame &target = frames.back();
+    const StateFrame *encodeBase = scenario.keyframesOnly ? nullptr : &baseline;
+    uint8_t scratch[STATE_PACKET_MAX];
+    size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < TIMING_ROUNDS; ++round) {
+      for (size_t i = 0; i < frames.size(); ++i) {
+        sink += stateEncode(target, encodeBase, scratch, sizeof(scratch));
+      }
+    }
+    double encodeNs = nanosecondsSince(start, frames.size() * TIMING_ROUNDS);
+
+    size_t length = stateEncode(target, encodeBase, scratch, sizeof(scratch));
+    StateFrame decoded;
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < TIMING_ROUNDS; ++round) {
+      for (size_t i = 0; i < frames.size(); ++i) {
+        sink += stateDecode(scratch, length, history, target.frameId, decoded) == StateDecodeResult::Ok;
+      }
+    }
+    double decodeNs = nanosecondsSince(start, frames.size() * TIMING_ROUNDS);
+
+    printf("%-28s %7.1f %9.0f %8.0f%% %11.1f %11.1f%s\n", scenario.name, averageBytes,
+           averageBytes * packetsPerSecond, 100.0 * averageBytes / LEGACY_PACKET_SIZE, encodeNs, decodeNs,
+           mismatches != 0 ? "  DECODE MISMATCH" : "");
+    if (mismatches != 0 || sink == 0) {
+      ++failures;
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+// Fires randomized serves at the paddles and checks that the swept ball never
+// tunnels. Each serve puts the ball near a paddle with a random velocity up to
+// BALL_SPEED_MAX on both axes, random paddle positions and random paddle
+// inputs, and plays a few ticks. Every tick is replayed independently in
+// double precision by walking the straight path in small steps (folded at the
+// walls); if that walk digs into a paddle the simulation must have reported a
+// paddle hit, and it must never leave the ball sunk into one or pinned
+// against one. Exits 1 on any failure, so it runs as a check in both the
+// float and the -DPONG_SIM_FIXED_POINT=1 build.
+//
+// A paddle that closes on a ball lying against the wall wedges it with no way
+// out; those ticks are counted but not checked.
+//
+//   sweep_stress [--serves N] [--seed N]
+
+#include <pong_sim.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+constexpr int TICKS_PER_SERVE = 6;
+constexpr double WALK_STEP_PX = 0.05;  // reference path resolution
+constexpr double DEPTH_MARGIN_PX = 0.25;  // deeper than this is a real contact, not rounding
+constexpr double STALL_PX = 0.001;       // a moving ball that gets no further than this stalled
+constexpr double FIELD_NEAR_PX = 48.0;  // serves start this close to a paddle's face
+constexpr int MAX_REPORTED = 10;
+
+struct Random {
+  uint64_t state;
+  uint64_t next() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+  double uniform(double lo, double hi) {
+    return lo + (hi - lo) * static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0);
+  }
+  int direction() {
+    return static_cast<int>(next() % 3) - 1;
+  }
+};
+
+struct Box {
+  double minX;
+  double minY;
+  double maxX;
+  double maxY;
+};
+
+Box paddleBox(double paddleX, double paddleY) {
+  return Box{paddleX, paddleY - PADDLE_HALF_HEIGHT, paddleX + PADDLE_WIDTH, paddleY + PADDLE_HALF_HEIGHT};
+}
+
+// How far a ball centred at (x, y) sinks into the box: <= 0 is clear.
+double depthInto(const Box &box, double x, double y) {
+  double cx = x < box.minX ? box.minX : (x > box.maxX ? box.maxX : x);
+  double cy = y < box.minY ? box.minY : (y > box.maxY ? box.maxY : y);
+  double dx = x - cx;
+  double dy = y - cy;
+  if (dx != 0.0 || dy != 0.0) {
+    return BALL_RADIUS - std::sqrt(dx * dx + dy * dy);
+  }
+  double inside = std::fmin(std::fmin(x - box.minX, box.maxX - x), std::fmin(y - box.minY, box.maxY - y));
+  return BALL_RADIUS + inside;
+}
+
+// Mirrors y into the band the ball's centre can reach, as the walls do.
+double foldIntoField(double y) {
+  double span = SCREEN_HEIGHT - 2.0 * BALL_RADIUS;
+  double u = std::fmod(y - BALL_RADIUS, 2.0 * span);
+  if (u < 0.0) {
+    u += 2.0 * span;
+  }
+  if (u > span) {
+    u = 2.0 * span - u;
+  }
+  return BALL_RADIUS + u;
+}
+
+// Deepest the unobstructed straight path of one tick gets into the box, past
+// where it started.
+double deepestAlongPath(const Box &box, double x, double y, double vx, double vy) {
+  double dx = vx * SIM_DT;
+  double dy = vy * SIM_DT;
+  // Cheap reject: the swept bounds never come near the box.
+  if (std::fmax(x, x + dx) + BALL_RADIUS < box.minX || std::fmin(x, x + dx) - BALL_RADIUS > box.maxX) {
+    return -1.0;
+  }
+  double start = depthInto(box, x, y);
+  int steps = static_cast<int>(std::ceil(std::sqrt(dx * dx + dy * dy) / WALK_STEP_PX));
+  double deepest = -1.0;
+  for (int i = 1; i <= steps; ++i) {
+    double t = static_cast<double>(i) / steps;
+    double depth = depthInto(box, x + dx * t, foldIntoField(y + dy * t));
+    if (depth - (start > 0.0 ? start : 0.0) > deepest) {
+      deepest = depth - (start > 0.0 ? start : 0.0);
+    }
+  }
+  return deepest;
+}
+
+struct Stats {
+  uint64_t ticks = 0;
+  uint64_t contactsExpected = 0;  // ticks whose reference path dug into a paddle
+  uint64_t paddleHits = 0;
+  uint64_t tunnels = 0;   // reference dug in, simulation reported no hit
+  uint64_t embedded = 0;  // simulation ended the tick sunk into a paddle
+  uint64_t stalled = 0;   // a paddle hit left the ball where it started, still moving
+  uint64_t wedged = 0;    // paddle moved into a ball lying against the wall
+};
+
+void report(const char *what, uint64_t serve, int tick, double x, double y, double vx, double vy, double hostY,
+            double clientY, double depth) {
+  printf("  %s: serve %llu tick %d ball (%.4f, %.4f) v (%.2f, %.2f) paddles %.4f / %.4f, %.3f px deep\n", what,
+         static_cast<unsigned long long>(serve), tick, x, y, vx, vy, hostY, clientY, depth);
+}
+
+void serveOnce(Random &random, uint64_t serve, Stats &stats) {
+  SimState state;
+  simResetMatch(state);
+  state.matchActive = true;
+  state.hostPaddleY = simClampPaddleY(static_cast<float>(random.uniform(0.0, SCREEN_HEIGHT)));
+  state.clientPaddleY = simClampPaddleY(static_cast<float>(random.uniform(0.0, SCREEN_HEIGHT)));
+
+  // Start in front of (or occasionally behind) one paddle, clear of both.
+  bool towardsClient = (random.next() & 1) != 0;
+  double x;
+  double y;
+  do {
+    double face = towardsClient ? CLIENT_PADDLE_X - BALL_RADIUS : HOST_PADDLE_X + PADDLE_WIDTH + BALL_RADIUS;
+    double offset = random.uniform(-PADDLE_WIDTH - 2.0 * BALL_RADIUS - 8.0, FIELD_NEAR_PX);
+    x = towardsClient ? face - offset : face + offset;
+    y = random.uniform(BALL_RADIUS, SCREEN_HEIGHT - BALL_RADIUS);
+  } while (depthInto(paddleBox(HOST_PADDLE_X, simToFloat(state.hostPaddleY)), x, y) > -DEPTH_MARGIN_PX ||
+           depthInto(paddleBox(CLIENT_PADDLE_X, simToFloat(state.clientPaddleY)), x, y) > -DEPTH_MARGIN_PX);
+
+  // A quarter of the serves at playable speeds, the rest anywhere up to the cap.
+  double limit = (random.next() & 3) == 0 ? 600.0 : BALL_SPEED_MAX;
+  double speedX = random.uniform(BALL_SPEED_INITIAL, limit);
+  state.ballX = static_cast<float>(x);
+  state.ballY = static_cast<float>(y);
+  state.ballVX = static_cast<float>(towardsClient ? speedX : -speedX);
+  state.ballVY = static_cast<float>(random.uniform(-limit, limit));
+
+  for (int tick = 0; tick < TICKS_PER_SERVE; ++tick) {
+    SimInput input;
+    input.hostPaddleDir = static_cast<int8_t>(random.direction());
+    input.clientPaddleDir = static_cast<int8_t>(random.direction());
+    double bx = simToFloat(state.ballX);
+    double by = simToFloat(state.ballY);
+    double vx = simToFloat(state.ballVX);
+    double vy = simToFloat(state.ballVY);
+
+    uint8_t events = simStep(state, input);
+    ++stats.ticks;
+    if (events & SIM_EVENT_PADDLE_HIT) {
+      ++stats.paddleHits;
+    }
+    // Paddles move before the ball, so the post-tick paddles are the ones it met.
+    double hostY = simToFloat(state.hostPaddleY);
+    double clientY = simToFloat(state.clientPaddleY);
+    Box host = paddleBox(HOST_PADDLE_X, hostY);
+    Box client = paddleBox(CLIENT_PADDLE_X, clientY);
+    double before = std::fmax(depthInto(host, bx, by), depthInto(client, bx, by));
+    bool onWall = by <= BALL_RADIUS + DEPTH_MARGIN_PX || by >= SCREEN_HEIGHT - BALL_RADIUS - DEPTH_MARGIN_PX;
+    if (before > 0.0 && onWall) {
+      ++stats.wedged;
+      if (events & (SIM_EVENT_HOST_SCORED | SIM_EVENT_CLIENT_SCORED)) {
+        return;
+      }
+      continue;
+    }
+    double deepest = std::fmax(deepestAlongPath(host, bx, by, vx, vy), deepestAlongPath(client, bx, by, vx, vy));
+    if (deepest > DEPTH_MARGIN_PX) {
+      ++stats.contactsExpected;
+      if (!(events & SIM_EVENT_PADDLE_HIT)) {
+        if (++stats.tunnels <= MAX_REPORTED) {
+          report("tunnel", serve, tick, bx, by, vx, vy, hostY, clientY, deepest);
+        }
+      }
+    }
+    if (events & (SIM_EVENT_HOST_SCORED | SIM_EVENT_CLIENT_SCORED)) {
+      return;
+    }
+
+    double endX = simToFloat(state.ballX);
+    double endY = simToFloat(state.ballY);
+    double after = std::fmax(depthInto(host, endX, endY), depthInto(client, endX, endY));
+    if (after > DEPTH_MARGIN_PX && after > before + DEPTH_MARGIN_PX) {
+      if (++stats.embedded <= MAX_REPORTED) {
+        report("embedded", serve, tick, bx, by, vx, vy, hostY, clientY, after);
+      }
+    }
+    // Bouncing back and forth on one contact inside a tick ends the tick
+    // where it began, however fast the ball is going.
+    double moved = std::hypot(endX - bx, endY - by);
+    if ((events & SIM_EVENT_PADDLE_HIT) && moved < STALL_PX && std::hypot(vx, vy) * SIM_DT > 100.0 * STALL_PX) {
+      if (++stats.stalled <= MAX_REPORTED) {
+        report("stalled", serve, tick, bx, by, vx, vy, hostY, clientY, after);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  uint64_t serves = 2000000;
+  uint64_t seed = 12345;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--serves") == 0) {
+      serves = strtoull(argv[i + 1], nullptr, 10);
+    } else if (strcmp(argv[i], "--seed") == 0) {
+      seed = strtoull(argv[i + 1], nullptr, 10);
+    } else {
+      fprintf(stderr, "usage: sweep_stress [--serves N] [--seed N]\n");
+      return 2;
+    }
+  }
+
+  printf("%s sim, %llu serves, seed %llu\n", PONG_SIM_FIXED_POINT ? "Q16.16" : "float",
+         static_cast<unsigned long long>(serves), static_cast<unsigned long long>(seed));
+  Random random{seed * 0x9E3779B97F4A7C15ull + 1};
+  Stats stats;
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t serve = 0; serve < serves; ++serve) {
+    serveOnce(random, serve, stats);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%llu ticks in %.1f s, %llu paddle contacts expected, %llu paddle hits\n",
+         static_cast<unsigned long long>(stats.ticks), seconds, static_cast<unsigned long long>(stats.contactsExpected),
+         static_cast<unsigned long long>(stats.paddleHits));
+  printf("tunnels %llu, embedded %llu, stalled %llu (%llu wedged ticks skipped)\n",
+         static_cast<unsigned long long>(stats.tunnels), static_cast<unsigned long long>(stats.embedded),
+         static_cast<unsigned long long>(stats.stalled), static_cast<unsigned long long>(stats.wedged));
+  return stats.tunnels == 0 && stats.embedded == 0 && stats.stalled == 0 ? 0 : 1;
+}